@@ -0,0 +1,116 @@
+#include "bench.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <numeric>
+#include <ostream>
+
+namespace mareweb::bench {
+
+auto bench_registry::run(const bench_options &options) const -> std::vector<bench_result> {
+  std::vector<bench_result> results;
+  for (const auto &benchmark : m_benchmarks) {
+    if (!options.filter.empty() && benchmark.name.find(options.filter) == std::string::npos) {
+      continue;
+    }
+    std::cerr << "running " << benchmark.name << "..." << std::endl;
+    bench_result result = benchmark.function(options);
+    result.name = benchmark.name;
+    results.push_back(std::move(result));
+  }
+  return results;
+}
+
+namespace {
+
+auto percentile(const std::vector<double> &sorted, double p) -> double {
+  if (sorted.empty()) {
+    return 0.0;
+  }
+  // linear interpolation between closest ranks
+  double rank = p * static_cast<double>(sorted.size() - 1);
+  auto lower = static_cast<size_t>(std::floor(rank));
+  auto upper = static_cast<size_t>(std::ceil(rank));
+  double fraction = rank - static_cast<double>(lower);
+  return sorted[lower] + ((sorted[upper] - sorted[lower]) * fraction);
+}
+
+auto escape_json(const std::string &str) -> std::string {
+  std::string escaped;
+  escaped.reserve(str.size());
+  for (char c : str) {
+    switch (c) {
+    case '"':
+      escaped += "\\\"";
+      break;
+    case '\\':
+      escaped += "\\\\";
+      break;
+    case '\n':
+      escaped += "\\n";
+      break;
+    default:
+      escaped += c;
+      break;
+    }
+  }
+  return escaped;
+}
+
+} // namespace
+
+auto summarize(std::vector<double> samples) -> bench_summary {
+  bench_summary summary;
+  if (samples.empty()) {
+    return summary;
+  }
+  std::sort(samples.begin(), samples.end());
+
+  const auto count = static_cast<double>(samples.size());
+  summary.min_ns = samples.front();
+  summary.max_ns = samples.back();
+  summary.mean_ns = std::accumulate(samples.begin(), samples.end(), 0.0) / count;
+  double variance = 0.0;
+  for (double sample : samples) {
+    variance += (sample - summary.mean_ns) * (sample - summary.mean_ns);
+  }
+  summary.stddev_ns = std::sqrt(variance / count);
+  summary.p50_ns = percentile(samples, 0.50);
+  summary.p90_ns = percentile(samples, 0.90);
+  summary.p95_ns = percentile(samples, 0.95);
+  summary.p99_ns = percentile(samples, 0.99);
+  return summary;
+}
+
+void write_json(std::ostream &out, const bench_options &options, const std::vector<bench_result> &results) {
+  out << "{\n";
+  out << "  \"options\": {\"iterations\": " << options.iterations << ", \"frames\": " << options.frames
+      << ", \"scale\": " << options.scale << "},\n";
+  out << "  \"benchmarks\": [\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const auto &result = results[i];
+    auto summary = summarize(result.samples_ns);
+    double per_item_ns = summary.mean_ns / static_cast<double>(std::max<uint64_t>(result.items_per_sample, 1));
+    out << "    {\"name\": \"" << escape_json(result.name) << "\", \"group\": \"" << escape_json(result.group)
+        << "\", \"samples\": " << result.samples_ns.size() << ", \"items_per_sample\": " << result.items_per_sample
+        << ", \"min_ns\": " << summary.min_ns << ", \"max_ns\": " << summary.max_ns
+        << ", \"mean_ns\": " << summary.mean_ns << ", \"stddev_ns\": " << summary.stddev_ns
+        << ", \"p50_ns\": " << summary.p50_ns << ", \"p90_ns\": " << summary.p90_ns
+        << ", \"p95_ns\": " << summary.p95_ns << ", \"p99_ns\": " << summary.p99_ns
+        << ", \"mean_ns_per_item\": " << per_item_ns << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  out << "  ]\n";
+  out << "}\n";
+}
+
+void wait_for_gpu(wgpu::Instance &instance, wgpu::Device &device) {
+  bool done = false;
+  device.GetQueue().OnSubmittedWorkDone(
+      wgpu::CallbackMode::AllowProcessEvents,
+      [](wgpu::QueueWorkDoneStatus /*status*/, bool *finished) { *finished = true; }, &done);
+  while (!done) {
+    instance.ProcessEvents();
+  }
+}
+
+} // namespace mareweb::bench
@@ -0,0 +1,103 @@
+#ifndef MAREWEB_BENCH_HPP
+#define MAREWEB_BENCH_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include <webgpu/webgpu_cpp.h>
+
+namespace mareweb::bench {
+
+struct bench_options {
+  std::string filter;              // only run benchmarks whose name contains this string
+  std::string output;              // JSON output path, stdout when empty
+  uint32_t iterations = 200;       // timed samples per microbenchmark
+  uint32_t warmup_iterations = 20; // untimed samples before measuring
+  uint32_t frames = 300;           // timed frames per scene preset
+  uint32_t warmup_frames = 30;     // untimed frames per scene preset
+  uint32_t scale = 1;              // multiplier applied to scene preset object counts
+};
+
+struct bench_result {
+  std::string name;
+  std::string group;              // "micro" or "scene"
+  uint64_t items_per_sample = 1;  // work items timed by each sample, used for per-item throughput
+  std::vector<double> samples_ns; // one entry per timed iteration or frame
+};
+
+struct bench_summary {
+  double min_ns = 0.0;
+  double max_ns = 0.0;
+  double mean_ns = 0.0;
+  double stddev_ns = 0.0;
+  double p50_ns = 0.0;
+  double p90_ns = 0.0;
+  double p95_ns = 0.0;
+  double p99_ns = 0.0;
+};
+
+using bench_function = std::function<bench_result(const bench_options &)>;
+
+class bench_registry {
+public:
+  void add(const std::string &name, bench_function function) { m_benchmarks.push_back({name, std::move(function)}); }
+
+  auto run(const bench_options &options) const -> std::vector<bench_result>;
+
+private:
+  struct entry {
+    std::string name;
+    bench_function function;
+  };
+  std::vector<entry> m_benchmarks;
+};
+
+// Times `fn` once per sample after the configured warmup. Each sample covers `batch` calls so very cheap operations
+// are not dominated by clock overhead; the recorded value is the average per call.
+template <typename F>
+auto measure(const bench_options &options, uint32_t batch, F &&fn) -> std::vector<double> {
+  using clock = std::chrono::steady_clock;
+  for (uint32_t i = 0; i < options.warmup_iterations; ++i) {
+    for (uint32_t j = 0; j < batch; ++j) {
+      fn();
+    }
+  }
+
+  std::vector<double> samples;
+  samples.reserve(options.iterations);
+  for (uint32_t i = 0; i < options.iterations; ++i) {
+    auto start = clock::now();
+    for (uint32_t j = 0; j < batch; ++j) {
+      fn();
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+    samples.push_back(elapsed / static_cast<double>(batch));
+  }
+  return samples;
+}
+
+auto summarize(std::vector<double> samples) -> bench_summary;
+void write_json(std::ostream &out, const bench_options &options, const std::vector<bench_result> &results);
+
+// Blocks until all work submitted to the device queue has finished executing.
+void wait_for_gpu(wgpu::Instance &instance, wgpu::Device &device);
+
+// Keeps the optimizer from discarding results computed only for timing.
+template <typename T> void do_not_optimize(const T &value) {
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : "r,m"(value) : "memory");
+#else
+  static volatile const void *sink;
+  sink = &value;
+#endif
+}
+
+void register_micro_benchmarks(bench_registry &registry);
+void register_scene_benchmarks(bench_registry &registry);
+
+} // namespace mareweb::bench
+
+#endif // MAREWEB_BENCH_HPP
@@ -0,0 +1,84 @@
+#include "bench.hpp"
+#include "mareweb/application.hpp"
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+void print_usage() {
+  std::cerr << "usage: mareweb_bench [options]\n"
+            << "  --filter <substring>   only run benchmarks whose name contains <substring>\n"
+            << "  --output <file>        write JSON results to <file> instead of stdout\n"
+            << "  --iterations <n>       timed samples per microbenchmark (default 200)\n"
+            << "  --frames <n>           timed frames per scene preset (default 300)\n"
+            << "  --warmup-frames <n>    untimed frames per scene preset (default 30)\n"
+            << "  --scale <n>            multiply scene preset object counts by <n> (default 1)\n";
+}
+
+auto parse_options(int argc, char **argv, mareweb::bench::bench_options &options) -> bool {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--help" || arg == "-h") {
+      return false;
+    }
+    if (i + 1 >= argc) {
+      std::cerr << "missing value for " << arg << std::endl;
+      return false;
+    }
+    std::string value = argv[++i];
+    if (arg == "--filter") {
+      options.filter = value;
+    } else if (arg == "--output") {
+      options.output = value;
+    } else if (arg == "--iterations") {
+      options.iterations = static_cast<uint32_t>(std::stoul(value));
+    } else if (arg == "--frames") {
+      options.frames = static_cast<uint32_t>(std::stoul(value));
+    } else if (arg == "--warmup-frames") {
+      options.warmup_frames = static_cast<uint32_t>(std::stoul(value));
+    } else if (arg == "--scale") {
+      options.scale = static_cast<uint32_t>(std::stoul(value));
+    } else {
+      std::cerr << "unknown option " << arg << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  mareweb::bench::bench_options options;
+  if (!parse_options(argc, argv, options)) {
+    print_usage();
+    return 1;
+  }
+
+  try {
+    mareweb::application &app = mareweb::application::get_instance();
+    app.initialize({.headless = true});
+
+    mareweb::bench::bench_registry registry;
+    mareweb::bench::register_micro_benchmarks(registry);
+    mareweb::bench::register_scene_benchmarks(registry);
+    auto results = registry.run(options);
+
+    if (options.output.empty()) {
+      mareweb::bench::write_json(std::cout, options, results);
+    } else {
+      std::ofstream out(options.output);
+      if (!out) {
+        throw std::runtime_error("Failed to open output file: " + options.output);
+      }
+      mareweb::bench::write_json(out, options, results);
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,176 @@
+#include "bench.hpp"
+#include "mareweb/application.hpp"
+#include "mareweb/buffer.hpp"
+#include "mareweb/components/transform.hpp"
+#include "mareweb/entities/text.hpp"
+#include "mareweb/meshes/array_mesh.hpp"
+#include "mareweb/meshes/cube_mesh.hpp"
+#include "mareweb/meshes/cylinder_mesh.hpp"
+#include "mareweb/meshes/sphere_mesh.hpp"
+#include "mareweb/meshes/torus_mesh.hpp"
+#include "mareweb/meshes/tube_mesh.hpp"
+#include "mareweb/scene.hpp"
+#include <cmath>
+#include <memory>
+#include <vector>
+
+namespace mareweb::bench {
+using namespace squint;
+
+namespace {
+
+constexpr uint32_t TRANSFORM_BATCH = 1000;
+constexpr size_t INSTANCE_COUNT = 10000;
+constexpr size_t ARRAY_MESH_VERTEX_COUNT = 100000;
+
+auto get_device() -> wgpu::Device & { return application::get_instance().get_wgpu_device(); }
+
+template <typename MeshType, typename... Args> auto mesh_generator(Args... args) -> bench_function {
+  return [args...](const bench_options &options) {
+    bench_result result;
+    result.group = "micro";
+    result.samples_ns = measure(options, 1, [&]() {
+      MeshType mesh_instance(get_device(), args...);
+      do_not_optimize(mesh_instance.get_vertex_count());
+    });
+    return result;
+  };
+}
+
+auto make_transforms(size_t count) -> std::vector<transform> {
+  std::vector<transform> transforms(count);
+  for (size_t i = 0; i < count; ++i) {
+    auto f = static_cast<float>(i);
+    transforms[i].set_position(vec3_t<length>{length(f), length(f * 0.5F), length(-f)});
+    transforms[i].set_rotation(vec3{0.0F, 1.0F, 0.0F}, f * 0.01F);
+    transforms[i].set_scale(vec3{1.0F, 2.0F, 1.0F});
+  }
+  return transforms;
+}
+
+auto bench_arena_upload(const bench_options &options) -> bench_result {
+  std::vector<vertex> vertices(ARRAY_MESH_VERTEX_COUNT);
+  for (size_t i = 0; i < vertices.size(); ++i) {
+    vertices[i].position[0] = static_cast<float>(i);
+  }
+  std::vector<uint32_t> indices(ARRAY_MESH_VERTEX_COUNT);
+  for (uint32_t i = 0; i < indices.size(); ++i) {
+    indices[i] = i;
+  }
+  auto layout = vertex_layouts::pos3_norm3_tex2();
+
+  bench_result result;
+  result.group = "micro";
+  result.items_per_sample = ARRAY_MESH_VERTEX_COUNT;
+  result.samples_ns = measure(options, 1, [&]() {
+    array_mesh mesh_instance(get_device(), vertices, layout, indices);
+    do_not_optimize(mesh_instance.get_vertex_count());
+  });
+  return result;
+}
+
+auto bench_transform_matrix(const bench_options &options) -> bench_result {
+  auto transforms = make_transforms(TRANSFORM_BATCH);
+  size_t index = 0;
+
+  bench_result result;
+  result.group = "micro";
+  result.samples_ns = measure(options, TRANSFORM_BATCH, [&]() {
+    auto matrix = transforms[index++ % transforms.size()].get_transformation_matrix();
+    do_not_optimize(matrix);
+  });
+  return result;
+}
+
+auto bench_normal_matrix(const bench_options &options) -> bench_result {
+  auto transforms = make_transforms(TRANSFORM_BATCH);
+  size_t index = 0;
+
+  bench_result result;
+  result.group = "micro";
+  result.samples_ns = measure(options, TRANSFORM_BATCH, [&]() {
+    auto matrix = transforms[index++ % transforms.size()].get_normal_matrix();
+    do_not_optimize(matrix);
+  });
+  return result;
+}
+
+auto bench_view_matrix(const bench_options &options) -> bench_result {
+  auto transforms = make_transforms(TRANSFORM_BATCH);
+  size_t index = 0;
+
+  bench_result result;
+  result.group = "micro";
+  result.samples_ns = measure(options, TRANSFORM_BATCH, [&]() {
+    auto matrix = transforms[index++ % transforms.size()].get_view_matrix();
+    do_not_optimize(matrix);
+  });
+  return result;
+}
+
+auto bench_transform_rotate(const bench_options &options) -> bench_result {
+  transform t;
+
+  bench_result result;
+  result.group = "micro";
+  result.samples_ns = measure(options, TRANSFORM_BATCH, [&]() {
+    t.rotate(vec3{0.0F, 0.0F, 1.0F}, 0.001F);
+    do_not_optimize(t.get_rotation_matrix());
+  });
+  return result;
+}
+
+auto bench_update_transforms(const bench_options &options) -> bench_result {
+  auto transforms = make_transforms(INSTANCE_COUNT);
+  instance_buffer instances(get_device(), transforms);
+
+  bench_result result;
+  result.group = "micro";
+  result.items_per_sample = INSTANCE_COUNT;
+  result.samples_ns = measure(options, 1, [&]() { instances.update_transforms(transforms); });
+  return result;
+}
+
+auto bench_update_text(const bench_options &options) -> bench_result {
+  auto &app = application::get_instance();
+  renderer_properties props{.width = 64, .height = 64, .title = "text bench", .headless = true};
+  auto *bench_scene = app.create_renderer<scene>(props);
+
+  const std::string first = "THE QUICK BROWN FOX\nJUMPS OVER THE LAZY DOG 0123456789";
+  const std::string second = "the quick brown fox\njumps over the lazy dog !@#$%^&*()";
+  auto *label = bench_scene->create_object<text>(bench_scene, first, 0.05F, 0.1F, nullptr, nullptr, 1000);
+  bool flip = false;
+
+  bench_result result;
+  result.group = "micro";
+  result.items_per_sample = first.size();
+  result.samples_ns = measure(options, 1, [&]() {
+    label->set_text(flip ? first : second);
+    flip = !flip;
+  });
+
+  app.remove_renderers();
+  return result;
+}
+
+} // namespace
+
+void register_micro_benchmarks(bench_registry &registry) {
+  registry.add("micro/mesh/cube", mesh_generator<cube_mesh>(length(1.0F)));
+  registry.add("micro/mesh/sphere_latlong_64", mesh_generator<sphere_mesh>(length(1.0F), size_t{64}, size_t{64}));
+  registry.add("micro/mesh/sphere_icosphere_4", mesh_generator<sphere_mesh>(length(1.0F), 4U));
+  registry.add("micro/mesh/torus_64", mesh_generator<torus_mesh>(length(1.0F), length(0.25F), size_t{64}, size_t{64}));
+  registry.add("micro/mesh/cylinder_64",
+               mesh_generator<cylinder_mesh>(length(0.5F), length(1.0F), 0.0F, units::degrees(360.0F), size_t{64}));
+  registry.add("micro/mesh/tube_64",
+               mesh_generator<tube_mesh>(length(0.5F), length(0.1F), 0.0F, units::degrees(360.0F), size_t{64}));
+  registry.add("micro/mesh/arena_upload_100k", bench_arena_upload);
+  registry.add("micro/transform/get_transformation_matrix", bench_transform_matrix);
+  registry.add("micro/transform/get_normal_matrix", bench_normal_matrix);
+  registry.add("micro/transform/get_view_matrix", bench_view_matrix);
+  registry.add("micro/transform/rotate", bench_transform_rotate);
+  registry.add("micro/instance_buffer/update_transforms_10k", bench_update_transforms);
+  registry.add("micro/text/update_text", bench_update_text);
+}
+
+} // namespace mareweb::bench
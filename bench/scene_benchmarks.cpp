@@ -0,0 +1,209 @@
+#include "bench.hpp"
+#include "mareweb/application.hpp"
+#include "mareweb/entities/renderable.hpp"
+#include "mareweb/entities/text.hpp"
+#include "mareweb/materials/flat_color_material.hpp"
+#include "mareweb/materials/instanced_flat_color_material.hpp"
+#include "mareweb/meshes/cube_mesh.hpp"
+#include "mareweb/scene.hpp"
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mareweb::bench {
+using namespace squint;
+
+namespace {
+
+constexpr uint32_t BENCH_WIDTH = 1280;
+constexpr uint32_t BENCH_HEIGHT = 720;
+
+enum class preset_kind {
+  cubes,
+  occluded_cubes,
+  instanced_cubes,
+  instanced_cubes_vertex,
+  instanced_cubes_transparent,
+  text_labels
+};
+
+struct scene_preset {
+  const char *name;
+  preset_kind kind;
+  size_t object_count;
+  bool depth_prepass = false;
+  bool occlusion_culling = false;
+  size_t point_lights = 0;
+  float resolution_scale = 1.0F; // below 1, dynamic resolution pinned at this scale
+};
+
+// Lays objects out on a square grid in the XY plane centered on the origin.
+auto grid_position(size_t index, size_t count, float spacing) -> vec3_t<length> {
+  auto side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<float>(count))));
+  float half = 0.5F * spacing * static_cast<float>(side);
+  float x = (static_cast<float>(index % side) * spacing) - half;
+  float y = (static_cast<float>(index / side) * spacing) - half;
+  return vec3_t<length>{length(x), length(y), length(0.0F)};
+}
+
+class preset_scene : public scene {
+public:
+  preset_scene(wgpu::Device &device, wgpu::Surface surface, SDL_Window *window, const renderer_properties &properties,
+               const scene_preset &preset, size_t object_count)
+      : scene(device, surface, window, properties) {
+    set_aspect_ratio(static_cast<float>(properties.width) / static_cast<float>(properties.height));
+    auto side = static_cast<float>(std::ceil(std::sqrt(static_cast<float>(object_count))));
+    set_position(vec3_t<length>{length(0.0F), length(0.0F), length(1.5F * side)});
+    set_perspective_far(length(4.0F * side));
+
+    switch (preset.kind) {
+    case preset_kind::cubes:
+      build_cubes(object_count);
+      break;
+    case preset_kind::occluded_cubes:
+      build_cubes(object_count);
+      build_occluder(side);
+      break;
+    case preset_kind::instanced_cubes:
+      build_instanced_cubes(object_count, instance_input::storage_buffer);
+      break;
+    case preset_kind::instanced_cubes_vertex:
+      build_instanced_cubes(object_count, instance_input::vertex_buffer);
+      break;
+    case preset_kind::instanced_cubes_transparent:
+      build_instanced_cubes(object_count, instance_input::vertex_buffer, alpha_mode::weighted_blended);
+      break;
+    case preset_kind::text_labels:
+      build_text_labels(object_count);
+      break;
+    }
+    if (preset.point_lights > 0) {
+      build_point_lights(preset.point_lights, side);
+    }
+  }
+
+  void update(const squint::duration &dt) override {
+    scene::update(dt);
+    // keep some per-frame CPU work in the loop so transform updates are measured too
+    for (auto *obj : m_renderables) {
+      obj->rotate(vec3{0.0F, 1.0F, 0.0F}, 0.01F);
+    }
+  }
+
+private:
+  std::unique_ptr<mesh> m_mesh;
+  std::unique_ptr<material> m_material;
+  std::vector<renderable *> m_renderables;
+  std::unique_ptr<mesh> m_occluder_mesh;
+  std::unique_ptr<material> m_occluder_material;
+
+  void build_cubes(size_t count) {
+    m_mesh = create_mesh<cube_mesh>(length(0.5F));
+    m_material = create_material<flat_color_material>(vec4{0.8F, 0.3F, 0.2F, 1.0F});
+    m_renderables.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+      auto *obj = create_object<renderable>(this, m_mesh.get(), m_material.get());
+      obj->set_position(grid_position(i, count, 1.0F));
+      m_renderables.push_back(obj);
+    }
+  }
+
+  // A wall between the camera and the whole grid, so nearly every cube is hidden
+  void build_occluder(float side) {
+    m_occluder_mesh = create_mesh<cube_mesh>(length(side));
+    m_occluder_material = create_material<flat_color_material>(vec4{0.3F, 0.3F, 0.35F, 1.0F});
+    auto *wall = create_object<renderable>(this, m_occluder_mesh.get(), m_occluder_material.get());
+    wall->set_position(vec3_t<length>{length(0.0F), length(0.0F), length(0.75F * side)});
+  }
+
+  void build_instanced_cubes(size_t count, instance_input input, alpha_mode mode = alpha_mode::opaque) {
+    m_mesh = create_mesh<cube_mesh>(length(0.5F));
+    const float alpha = mode == alpha_mode::opaque ? 1.0F : 0.3F;
+    m_material = create_material<instanced_flat_color_material>(vec4{0.2F, 0.6F, 0.9F, alpha}, input, mode);
+    auto *instances = create_object<instanced_renderable>(this, m_mesh.get(), m_material.get(), count);
+    std::vector<transform> transforms(count);
+    for (size_t i = 0; i < count; ++i) {
+      transforms[i].set_position(grid_position(i, count, 1.0F));
+    }
+    instances->set_instances(transforms);
+  }
+
+  // Lights spread over the grid just in front of it, each reaching a few cubes
+  void build_point_lights(size_t count, float side) {
+    std::vector<point_light> lights(count);
+    for (size_t i = 0; i < count; ++i) {
+      auto position = grid_position(i, count, side / std::ceil(std::sqrt(static_cast<float>(count))));
+      lights[i].position_range = vec4{position[0].value(), position[1].value(), 1.0F, 4.0F};
+      lights[i].color_intensity = vec4{static_cast<float>(i % 3 == 0), static_cast<float>(i % 3 == 1),
+                                       static_cast<float>(i % 3 == 2), 4.0F};
+    }
+    set_point_lights(std::move(lights));
+  }
+
+  void build_text_labels(size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+      auto *label = create_object<text>(this, "LABEL " + std::to_string(i), 0.05F, 0.0F);
+      auto position = grid_position(i, count, 2.0F);
+      label->set_center(vec2{position[0].value(), position[1].value()});
+    }
+  }
+};
+
+auto scene_benchmark(scene_preset preset) -> bench_function {
+  return [preset](const bench_options &options) {
+    auto &app = application::get_instance();
+    size_t object_count = preset.object_count * options.scale;
+    renderer_properties props{
+        .width = BENCH_WIDTH, .height = BENCH_HEIGHT, .title = preset.name, .sample_count = 4, .headless = true,
+        .depth_prepass = preset.depth_prepass, .occlusion_culling = preset.occlusion_culling,
+        .dynamic_resolution = preset.resolution_scale < 1.0F,
+        .resolution_scale = {.min_scale = preset.resolution_scale, .max_scale = preset.resolution_scale}};
+    app.create_renderer<preset_scene>(props, preset, object_count);
+
+    app.run_frames(options.warmup_frames);
+    wait_for_gpu(app.get_wgpu_instance(), app.get_wgpu_device());
+
+    bench_result result;
+    result.group = "scene";
+    result.items_per_sample = object_count;
+    result.samples_ns.reserve(options.frames);
+    for (uint32_t frame = 0; frame < options.frames; ++frame) {
+      auto start = std::chrono::steady_clock::now();
+      app.run_frames(1);
+      // frame time includes GPU execution so GPU-side regressions show up as well
+      wait_for_gpu(app.get_wgpu_instance(), app.get_wgpu_device());
+      result.samples_ns.push_back(
+          std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    app.remove_renderers();
+    return result;
+  };
+}
+
+} // namespace
+
+void register_scene_benchmarks(bench_registry &registry) {
+  const scene_preset presets[] = {
+      {"scene/cubes_1k", preset_kind::cubes, 1000},
+      {"scene/cubes_5k", preset_kind::cubes, 5000},
+      {"scene/cubes_5k_depth_prepass", preset_kind::cubes, 5000, true},
+      {"scene/cubes_5k_point_lights_256", preset_kind::cubes, 5000, false, false, 256},
+      {"scene/cubes_5k_half_resolution", preset_kind::cubes, 5000, false, false, 0, 0.5F},
+      {"scene/occluded_cubes_5k", preset_kind::occluded_cubes, 5000},
+      {"scene/occluded_cubes_5k_culled", preset_kind::occluded_cubes, 5000, false, true},
+      {"scene/instanced_cubes_10k", preset_kind::instanced_cubes, 10000},
+      {"scene/instanced_cubes_100k", preset_kind::instanced_cubes, 100000},
+      {"scene/instanced_cubes_vertex_100k", preset_kind::instanced_cubes_vertex, 100000},
+      {"scene/instanced_cubes_transparent_100k", preset_kind::instanced_cubes_transparent, 100000},
+      {"scene/text_labels_1k", preset_kind::text_labels, 1000},
+  };
+  for (const auto &preset : presets) {
+    registry.add(preset.name, scene_benchmark(preset));
+  }
+}
+
+} // namespace mareweb::bench
@@ -55,12 +55,12 @@ public:
     // mesh = scene->create_mesh<mareweb::line_mesh>(0.2F);
     // mesh = scene->create_mesh<mareweb::char_mesh>("Hello, World!", 0.02F);
 
-    // Create a textured material (provide path to your texture)
-    material = scene->create_material<mareweb::textured_material>("assets/2k_earth_daymap.jpg");
+    // Create a textured material; the texture decodes in the background and replaces a placeholder when ready
+    material = scene->create_material<mareweb::textured_material>(scene->load_texture("assets/2k_earth_daymap.jpg"));
 
     // Set initial light direction
     vec3 light_direction{-1.f, -2.f, -1.f};
-    material->update_light_direction(light_direction);
+    scene->set_light(light_direction);
 
     obj = create_object<mareweb::renderable>(scene, mesh.get(), material.get());
   }
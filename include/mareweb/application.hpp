@@ -3,6 +3,7 @@
 
 #include "mareweb/renderer.hpp"
 #include <SDL2/SDL.h>
+#include <chrono>
 #include <memory>
 #include <stdexcept>
 #include <vector>
@@ -12,6 +13,12 @@ namespace mareweb {
 
 class renderer;
 
+struct application_properties {
+  bool headless = false;      // skip the SDL video subsystem, all renderers draw to offscreen targets
+  bool gpu_profiling = false; // request timestamp queries so renderers can time their passes on the GPU
+  bool cpu_profiling = false; // start recording profiler zones immediately, see profiler::set_enabled
+};
+
 class application {
 public:
   static auto get_instance() -> application &;
@@ -21,20 +28,25 @@ public:
   application(application &&) = delete;
   auto operator=(application &&) -> application & = delete;
 
-  void initialize();
+  void initialize(const application_properties &properties = {});
   void run();
+  void run_frames(uint32_t frame_count);
   void quit();
+  void remove_renderers();
 
   auto get_wgpu_instance() -> wgpu::Instance & { return m_instance; }
   auto get_wgpu_device() -> wgpu::Device & { return m_device; }
 
-  template <typename T, typename... Args> void create_renderer(const renderer_properties &properties, Args &&...args);
+  [[nodiscard]] auto get_properties() const -> const application_properties & { return m_properties; }
+
+  template <typename T, typename... Args>
+  auto create_renderer(const renderer_properties &properties, Args &&...args) -> T *;
 
 private:
   application() = default;
   ~application();
 
-  static void init_sdl();
+  void init_sdl();
   void init_webgpu();
   void handle_events();
   void handle_window_close(const SDL_Event &event);
@@ -44,28 +56,41 @@ private:
   void handle_mouse_motion_event(const SDL_Event &event);
   void handle_mouse_wheel_event(const SDL_Event &event);
   void setup_webgpu_callbacks(wgpu::DeviceDescriptor &device_desc);
+  auto select_features(const wgpu::Adapter &adapter) const -> std::vector<wgpu::FeatureName>;
   void on_frame();
 
   static auto create_window(const renderer_properties &properties) -> SDL_Window *;
   auto create_surface(SDL_Window *window) -> wgpu::Surface;
 
+  application_properties m_properties;
   bool m_initialized = false;
   bool m_quit = false;
+  std::chrono::steady_clock::time_point m_last_frame_time;
   wgpu::Instance m_instance;
   wgpu::Device m_device;
   std::vector<std::unique_ptr<renderer>> m_renderers;
 };
 
 template <typename T, typename... Args>
-void application::create_renderer(const renderer_properties &properties, Args &&...args) {
+auto application::create_renderer(const renderer_properties &properties, Args &&...args) -> T * {
   if (!m_initialized) {
     throw std::runtime_error("Application not initialized");
   }
 
-  SDL_Window *window = create_window(properties);
-  wgpu::Surface surface = create_surface(window);
+  renderer_properties renderer_props = properties;
+  renderer_props.headless = renderer_props.headless || m_properties.headless;
+
+  SDL_Window *window = nullptr;
+  wgpu::Surface surface = nullptr;
+  if (!renderer_props.headless) {
+    window = create_window(renderer_props);
+    surface = create_surface(window);
+  }
 
-  m_renderers.push_back(std::make_unique<T>(m_device, surface, window, properties, std::forward<Args>(args)...));
+  auto rend = std::make_unique<T>(m_device, surface, window, renderer_props, std::forward<Args>(args)...);
+  T *rend_ptr = rend.get();
+  m_renderers.push_back(std::move(rend));
+  return rend_ptr;
 }
 
 } // namespace mareweb
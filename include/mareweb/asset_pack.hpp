@@ -0,0 +1,74 @@
+#ifndef MAREWEB_ASSET_PACK_HPP
+#define MAREWEB_ASSET_PACK_HPP
+
+#include "mareweb/mapped_file.hpp"
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mareweb {
+
+enum class asset_compression : uint8_t {
+  none = 0,
+  lz4 = 1, // LZ4 frame format
+  zstd = 2,
+};
+
+struct asset_pack_entry {
+  std::string name;
+  uint64_t offset = 0;      // of the stored bytes, 64-byte aligned
+  uint64_t stored_size = 0; // in the pack, compressed or not
+  uint64_t size = 0;        // once decompressed
+  asset_compression compression = asset_compression::none;
+};
+
+// Read-only archive of many assets in one file (.mwp), produced from assets/ by tools/pack_assets.py at build time.
+// The table of contents sits at the front, so opening a pack costs a single read of it. Natively the pack is memory
+// mapped and uncompressed entries can be viewed in place. Emscripten builds fetch the header and table of contents,
+// then each entry with an HTTP range request, so assets no longer have to be preloaded into the virtual filesystem.
+//
+// Reading is thread safe, so entries can be decompressed and decoded on worker threads.
+class asset_pack {
+public:
+  // A file path natively, a URL relative to the page on Emscripten
+  explicit asset_pack(const std::string &path);
+
+  asset_pack(const asset_pack &) = delete;
+  auto operator=(const asset_pack &) -> asset_pack & = delete;
+  asset_pack(asset_pack &&) = default;
+  auto operator=(asset_pack &&) -> asset_pack & = default;
+
+  [[nodiscard]] auto get_path() const -> const std::string & { return m_path; }
+  [[nodiscard]] auto get_entries() const -> const std::vector<asset_pack_entry> & { return m_entries; }
+  // Null if the pack has no such entry. Names are paths relative to the packed directory's parent ("assets/wall.jpg")
+  [[nodiscard]] auto find(std::string_view name) const -> const asset_pack_entry *;
+  [[nodiscard]] auto contains(std::string_view name) const -> bool { return find(name) != nullptr; }
+
+  // The entry's bytes, decompressed if needed. Throws std::runtime_error for unknown entries or failed reads.
+  [[nodiscard]] auto read(std::string_view name) const -> std::vector<uint8_t>;
+  // The entry's bytes in place, without a copy. Empty for compressed entries and on Emscripten, use read() then.
+  [[nodiscard]] auto view(std::string_view name) const -> std::span<const uint8_t>;
+
+  // Whether this build can decompress entries stored with the given codec
+  [[nodiscard]] static auto supports(asset_compression compression) -> bool;
+
+  static constexpr uint32_t VERSION = 1;
+  static constexpr uint64_t ALIGNMENT = 64;
+
+private:
+  std::string m_path;
+  std::vector<asset_pack_entry> m_entries; // sorted by name
+#ifndef __EMSCRIPTEN__
+  mapped_file m_file;
+#endif
+
+  [[nodiscard]] auto read_range(uint64_t offset, uint64_t size) const -> std::vector<uint8_t>;
+  [[nodiscard]] static auto decompress(const asset_pack_entry &entry, std::span<const uint8_t> stored)
+      -> std::vector<uint8_t>;
+};
+
+} // namespace mareweb
+
+#endif // MAREWEB_ASSET_PACK_HPP
@@ -0,0 +1,68 @@
+#ifndef MAREWEB_BIND_GROUP_CACHE_HPP
+#define MAREWEB_BIND_GROUP_CACHE_HPP
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <webgpu/webgpu_cpp.h>
+
+namespace mareweb {
+
+struct bind_group_cache_stats {
+  uint64_t layout_count = 0;
+  uint64_t bind_group_count = 0;
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+};
+
+// Deduplicates bind group layouts by their entries and bind groups by the exact resources they bind, so materials
+// with identical layouts share one layout (and every pipeline built from it accepts the same bind groups), and
+// switching back to a previously bound set of resources reuses its bind group instead of creating a new one.
+//
+// Cached bind groups keep their resources alive, so entries not requested for MAX_IDLE_FRAMES frames are dropped in
+// end_frame(). Every renderer on the device calls it, and the cache ages once all of them have had a turn, so the
+// idle limit counts application frames however many windows share the device. Main thread only.
+class bind_group_cache {
+public:
+  explicit bind_group_cache(wgpu::Device &device) : m_device(device) {}
+
+  bind_group_cache(const bind_group_cache &) = delete;
+  auto operator=(const bind_group_cache &) -> bind_group_cache & = delete;
+  bind_group_cache(bind_group_cache &&) = delete;
+  auto operator=(bind_group_cache &&) -> bind_group_cache & = delete;
+
+  // Returns the cache for this device, creating it on first use.
+  static auto get(wgpu::Device &device) -> bind_group_cache &;
+
+  [[nodiscard]] auto get_layout(const std::vector<wgpu::BindGroupLayoutEntry> &entries) -> wgpu::BindGroupLayout;
+  [[nodiscard]] auto get_bind_group(const wgpu::BindGroupLayout &layout,
+                                    const std::vector<wgpu::BindGroupEntry> &entries) -> wgpu::BindGroup;
+
+  // Called by each renderer at the end of its frame. Once a renderer comes round again, the frame every renderer has
+  // had a turn in is over: the cached bind groups age by one frame and the idle ones are evicted.
+  void end_frame(const void *renderer);
+  void clear();
+
+  [[nodiscard]] auto get_stats() const -> bind_group_cache_stats;
+
+  static constexpr uint64_t MAX_IDLE_FRAMES = 120;
+
+private:
+  struct cached_bind_group {
+    wgpu::BindGroup bind_group;
+    uint64_t last_used = 0;
+  };
+
+  wgpu::Device m_device;
+  std::unordered_map<std::string, wgpu::BindGroupLayout> m_layouts;
+  std::unordered_map<std::string, cached_bind_group> m_bind_groups;
+  uint64_t m_frame = 0;
+  std::vector<const void *> m_frame_renderers; // renderers that ended a frame since m_frame last advanced
+  uint64_t m_hits = 0;
+  uint64_t m_misses = 0;
+};
+
+} // namespace mareweb
+
+#endif // MAREWEB_BIND_GROUP_CACHE_HPP
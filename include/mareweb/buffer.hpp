@@ -2,7 +2,9 @@
 #define MAREWEB_BUFFER_HPP
 
 #include "mareweb/components/transform.hpp"
+#include "mareweb/resource_registry.hpp"
 #include "mareweb/vertex_attributes.hpp"
+#include <cstdint>
 #include <utility>
 #include <vector>
 #include <webgpu/webgpu_cpp.h>
@@ -21,7 +23,7 @@ public:
   // Move constructor
   buffer(buffer &&other) noexcept
       : m_device(std::move(other.m_device)), m_buffer(std::exchange(other.m_buffer, nullptr)),
-        m_size(std::exchange(other.m_size, 0)) {}
+        m_size(std::exchange(other.m_size, 0)), m_resource(std::move(other.m_resource)) {}
 
   // Move assignment operator
   auto operator=(buffer &&other) noexcept -> buffer & {
@@ -33,6 +35,7 @@ public:
       m_device = std::move(other.m_device);
       m_buffer = std::exchange(other.m_buffer, nullptr);
       m_size = std::exchange(other.m_size, 0);
+      m_resource = std::move(other.m_resource);
     }
     return *this;
   }
@@ -40,14 +43,25 @@ public:
   virtual void update(const void *data, size_t size);
   virtual void update(const void *data, size_t size, size_t offset);
   virtual void update_regions(const std::vector<std::tuple<const void *, size_t, size_t>> &regions);
+  // Streams through the upload_manager's staging ring instead of WriteBuffer. The copy is submitted by the manager's
+  // next flush, which the renderer runs just before it submits the frame.
+  void stage(const void *data, size_t size, size_t offset = 0);
 
   [[nodiscard]] virtual auto get_buffer() const -> wgpu::Buffer { return m_buffer; }
   [[nodiscard]] virtual auto get_size() const -> size_t { return m_size; }
 
+  // Names the buffer in GPU debuggers and in the resource registry
+  void set_label(const std::string &label);
+
 protected:
   wgpu::Device m_device;
   wgpu::Buffer m_buffer;
   size_t m_size;
+  resource_handle m_resource;
+
+private:
+  // WriteBuffer, or behind the staged copies into this buffer while any are queued, so the newest data lands last
+  void write(size_t offset, const void *data, size_t size);
 };
 
 class vertex_buffer : public buffer {
@@ -78,7 +92,57 @@ private:
 
 class storage_buffer : public buffer {
 public:
-  storage_buffer(wgpu::Device &device, const void *data, size_t size);
+  // extra_usage adds to Storage, for buffers that are also bound another way
+  storage_buffer(wgpu::Device &device, const void *data, size_t size,
+                 wgpu::BufferUsage extra_usage = wgpu::BufferUsage::None);
+};
+
+// Per-instance payload stored next to each instance's matrix. Materials decide what it means: a color, a scalar to
+// map through a palette, an ID, flags.
+struct instance_attributes {
+  squint::vec4 color{1.0F, 1.0F, 1.0F, 1.0F};
+  squint::vec4 data{0.0F, 0.0F, 0.0F, 0.0F};
+};
+
+// One instance as stored in an instance_buffer, matches the Instance struct in INSTANCE_DATA_WGSL
+struct instance_record {
+  squint::mat4 transform;
+  instance_attributes attributes;
+};
+
+static_assert(sizeof(instance_record) == 96, "must match INSTANCE_DATA_WGSL");
+
+constexpr const char *INSTANCE_DATA_WGSL = R"(
+struct Instance {
+    model: mat4x4<f32>,
+    color: vec4<f32>,
+    data: vec4<f32>,
+};
+)";
+
+// Vertex inputs of an instance_buffer bound at vertex_buffer_slots::INSTANCE, laid out by
+// vertex_layouts::instance_record_layout. Add an InstanceInput parameter to the vertex entry point and convert it with
+// load_instance.
+constexpr const char *INSTANCE_VERTEX_INPUT_WGSL = R"(
+struct InstanceInput {
+    @location(8) model_0: vec4<f32>,
+    @location(9) model_1: vec4<f32>,
+    @location(10) model_2: vec4<f32>,
+    @location(11) model_3: vec4<f32>,
+    @location(12) color: vec4<f32>,
+    @location(13) data: vec4<f32>,
+};
+
+fn load_instance(in: InstanceInput) -> Instance {
+    return Instance(mat4x4<f32>(in.model_0, in.model_1, in.model_2, in.model_3), in.color, in.data);
+}
+)";
+
+// Where an instanced material reads its instance_records. Vertex buffers work without storage buffers in the vertex
+// stage, which some WebGPU implementations limit, and let the vertex fetch hardware prefetch instance data.
+enum class instance_input : uint8_t {
+  storage_buffer, // read-only storage array indexed by instance_index, bound in the material's group
+  vertex_buffer,  // per-instance vertex attributes, see INSTANCE_VERTEX_INPUT_WGSL
 };
 
 class instance_buffer : public storage_buffer {
@@ -86,18 +150,29 @@ public:
   instance_buffer(wgpu::Device &device, const std::vector<transform> &instances);
 
   void update_transforms(const std::vector<transform> &instances);
+  // Replaces the instances along with their attributes, which must be as many as the transforms
+  void update_transforms(const std::vector<transform> &instances, const std::vector<instance_attributes> &attributes);
   void update_transform(size_t index, const transform &t);
   void update_transforms(const std::vector<std::pair<size_t, transform>> &updates);
-  
+  // Writes only the attributes, the matrix stays as it is
+  void update_attributes(size_t index, const instance_attributes &attributes);
+  // Binds the active instances as the per-instance vertex buffer
+  void bind_vertex_buffer(wgpu::RenderPassEncoder &pass_encoder, uint32_t slot = vertex_buffer_slots::INSTANCE) const;
+
   [[nodiscard]] auto get_capacity() const -> uint32_t;
   [[nodiscard]] auto get_active_count() const -> uint32_t;
   [[nodiscard]] auto get_transforms() const -> const std::vector<transform> &;
   [[nodiscard]] auto get_transform(size_t index) const -> const transform &;
+  [[nodiscard]] auto get_attributes(size_t index) const -> const instance_attributes &;
   void clear_instances();
 
 private:
   std::vector<transform> m_transforms;
+  std::vector<instance_attributes> m_attributes;
   size_t m_active_count = 0;
+
+  // Uploads records [first, first + count)
+  void write_records(size_t first, size_t count);
 };
 
 } // namespace mareweb
@@ -0,0 +1,43 @@
+#ifndef MAREWEB_DEPTH_PREPASS_HPP
+#define MAREWEB_DEPTH_PREPASS_HPP
+
+#include "mareweb/frame_bindings.hpp"
+#include "mareweb/mesh.hpp"
+#include "mareweb/shader.hpp"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <webgpu/webgpu_cpp.h>
+
+namespace mareweb {
+
+// Depth-only pipelines for the depth pre-pass. They read just the position of each vertex and have no fragment stage,
+// so the pass costs vertex work and depth writes only. The color pass then shades each pixel once, testing Equal.
+// Pipelines depend only on the primitive state and vertex stride of the mesh and are shared by every material.
+class depth_prepass {
+public:
+  depth_prepass(wgpu::Device &device, uint32_t sample_count);
+
+  // Binds an empty group 1, which the pipeline layout keeps so groups 0 and 2 match every other pipeline
+  void begin(wgpu::RenderPassEncoder &pass_encoder);
+  // Sets the depth-only pipeline for the mesh unless it is already bound in the pass
+  void bind(wgpu::RenderPassEncoder &pass_encoder, pass_bindings &bindings, const mesh &geometry);
+
+private:
+  using pipeline_key =
+      std::tuple<wgpu::PrimitiveTopology, wgpu::IndexFormat, wgpu::FrontFace, wgpu::CullMode, uint64_t>;
+
+  wgpu::Device m_device;
+  uint32_t m_sample_count;
+  std::unique_ptr<shader> m_shader;
+  wgpu::PipelineLayout m_pipeline_layout;
+  wgpu::BindGroup m_empty_bind_group;
+  std::map<pipeline_key, wgpu::RenderPipeline> m_pipelines;
+
+  auto get_pipeline(const wgpu::PrimitiveState &primitive_state, uint64_t stride) -> wgpu::RenderPipeline;
+};
+
+} // namespace mareweb
+
+#endif // MAREWEB_DEPTH_PREPASS_HPP
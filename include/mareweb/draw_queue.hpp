@@ -0,0 +1,80 @@
+#ifndef MAREWEB_DRAW_QUEUE_HPP
+#define MAREWEB_DRAW_QUEUE_HPP
+
+#include "mareweb/buffer.hpp"
+#include "mareweb/depth_prepass.hpp"
+#include "mareweb/frame_bindings.hpp"
+#include "mareweb/material.hpp"
+#include "mareweb/mesh.hpp"
+#include "mareweb/occlusion_culler.hpp"
+#include <cstdint>
+#include <vector>
+#include <webgpu/webgpu_cpp.h>
+
+namespace mareweb {
+
+// A draw recorded during traversal and issued once the whole frame is known
+struct draw_item {
+  const mesh *geometry = nullptr;
+  material *surface = nullptr;
+  draw_uniforms uniforms;
+  const instance_buffer *instances = nullptr; // null for a single, non-instanced draw
+  uint32_t instance_count = 1;
+  float distance = 0.0F; // squared distance from the camera to the model origin, filled in by sort
+  uint64_t draw_slot = 0; // frame_bindings slot written by the depth pre-pass
+  bool prepassed = false; // depth already written by the pre-pass
+};
+
+struct draw_queue_stats {
+  uint64_t opaque_count = 0; // opaque and masked draws of the last frame
+  uint64_t blended_count = 0;
+  uint64_t weighted_blended_count = 0; // draws accumulated into the order-independent transparency targets
+  uint64_t prepass_count = 0; // draws whose depth came from the depth pre-pass
+  uint64_t frustum_culled_count = 0;
+  uint64_t occlusion_culled_count = 0;
+};
+
+// Collects the frame's draws so they can be ordered by alpha mode. Opaque draws go first, front to back so early depth
+// testing rejects as much as possible, then masked ones, then blended ones back to front so they composite correctly.
+// Ties keep consecutive draws of one material together. Weighted blended draws are order independent, so they are
+// only grouped by material, and record_weighted_blended issues them in the renderer's OIT pass after the color pass.
+// Everything submitted has to stay alive until clear.
+//
+// With a depth pre-pass, record_depth_prepass draws the non-instanced opaque draws of materials that support it into a
+// depth-only pass first. record then draws those with depth_mode::equal, so each covered pixel is shaded once.
+//
+// cull drops non-instanced draws whose mesh bounds are outside the frustum or hidden in the occlusion culler's depth.
+// Instanced draws are always kept, their mesh bounds say nothing about where the instances are.
+class draw_queue {
+public:
+  void submit(const draw_item &item);
+  void cull(const occlusion_culler &culler, const squint::mat4 &view_projection);
+  void sort(const squint::vec4 &camera_position);
+  void record_depth_prepass(wgpu::RenderPassEncoder &pass_encoder, frame_bindings &frame, geometry_bindings &geometry,
+                            depth_prepass &prepass);
+  // Records the opaque, masked and blended draws into the color pass, in sorted order
+  void record(wgpu::RenderPassEncoder &pass_encoder, frame_bindings &frame, geometry_bindings &geometry);
+  void record_weighted_blended(wgpu::RenderPassEncoder &pass_encoder, frame_bindings &frame,
+                               geometry_bindings &geometry);
+  [[nodiscard]] auto has_weighted_blended() const -> bool { return !m_weighted_blended.empty(); }
+  void clear();
+
+  [[nodiscard]] auto get_stats() const -> draw_queue_stats { return m_stats; }
+
+private:
+  std::vector<draw_item> m_opaque;
+  std::vector<draw_item> m_masked;
+  std::vector<draw_item> m_blended;
+  std::vector<draw_item> m_weighted_blended;
+  draw_queue_stats m_stats;
+  uint64_t m_frustum_culled = 0;
+  uint64_t m_occlusion_culled = 0;
+
+  static void record_item(const draw_item &item, wgpu::RenderPassEncoder &pass_encoder, frame_bindings &frame,
+                          geometry_bindings &geometry);
+  [[nodiscard]] static auto can_prepass(const draw_item &item) -> bool;
+};
+
+} // namespace mareweb
+
+#endif // MAREWEB_DRAW_QUEUE_HPP
@@ -22,10 +22,10 @@ public:
     vec3_t<length> v1{head_width * 0.5f, body_length, length(0.0f)};
     vec3_t<length> v2{length(0.0f), body_length + head_length, length(0.0f)};
     vec3_t<length> v3{-head_width * 0.5f, body_length, length(0.0f)};
-    m_head_mesh = scene->create_mesh<triangle_mesh>(v1, v2, v3);
+    m_head_mesh = scene->acquire_mesh<triangle_mesh>(v1, v2, v3);
 
     // Create body (scaled and positioned square)
-    m_body_mesh = scene->create_mesh<square_mesh>(body_width);
+    m_body_mesh = scene->acquire_mesh<square_mesh>(body_width);
 
     // Create materials (either use provided ones or create new ones)
     if (head_material) {
@@ -85,8 +85,8 @@ public:
   [[nodiscard]] auto get_body() const -> renderable * { return m_body; }
 
 private:
-  std::unique_ptr<mesh> m_head_mesh;
-  std::unique_ptr<mesh> m_body_mesh;
+  std::shared_ptr<mesh> m_head_mesh;
+  std::shared_ptr<mesh> m_body_mesh;
   std::unique_ptr<material> m_head_material; // Owns head material if not provided
   std::unique_ptr<material> m_body_material; // Owns body material if not provided
   renderable *m_head = nullptr;
@@ -0,0 +1,112 @@
+#ifndef MAREWEB_GLTF_MODEL_HPP
+#define MAREWEB_GLTF_MODEL_HPP
+
+#include "mareweb/entities/renderable.hpp"
+#include "mareweb/gltf_loader.hpp"
+#include "mareweb/materials/flat_color_material.hpp"
+#include "mareweb/materials/textured_material.hpp"
+#include "mareweb/scene.hpp"
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace mareweb {
+
+// A glTF scene streamed into the object tree. Every glTF node becomes a composite_renderable carrying the node's local
+// transform, and every primitive a renderable under the nodes that use its mesh. Nodes appear as soon as the hierarchy
+// is parsed and primitives pop in as the gltf_loader uploads them.
+class gltf_model : public composite_renderable {
+public:
+  gltf_model(scene *scene, const std::string &path)
+      : composite_renderable(scene), m_scene(scene), m_stream(scene->get_gltf_loader().load(path)) {
+    m_stream->set_listener([this](const gltf_stream &stream) { build_nodes(stream); },
+                           [this](const gltf_primitive &primitive) { add_primitive(primitive); });
+  }
+
+  ~gltf_model() override { m_stream->clear_listener(); }
+
+  gltf_model(const gltf_model &) = delete;
+  auto operator=(const gltf_model &) -> gltf_model & = delete;
+  gltf_model(gltf_model &&) = delete;
+  auto operator=(gltf_model &&) -> gltf_model & = delete;
+
+  [[nodiscard]] auto is_loaded() const -> bool { return m_stream->is_loaded(); }
+  [[nodiscard]] auto has_failed() const -> bool { return m_stream->has_failed(); }
+  [[nodiscard]] auto get_stream() const -> const gltf_stream & { return *m_stream; }
+  // Null until the hierarchy has arrived
+  [[nodiscard]] auto get_node(size_t index) const -> composite_renderable * {
+    return index < m_nodes.size() ? m_nodes[index] : nullptr;
+  }
+
+private:
+  scene *m_scene = nullptr;
+  std::shared_ptr<gltf_stream> m_stream;
+  std::vector<composite_renderable *> m_nodes; // by glTF node index
+  std::vector<std::shared_ptr<mesh>> m_meshes;
+  // Keyed by glTF material index (-1 for the default material) and whether the primitive can be textured
+  std::map<std::pair<int32_t, bool>, std::unique_ptr<material>> m_materials;
+
+  void build_nodes(const gltf_stream &stream) {
+    m_nodes.assign(stream.get_nodes().size(), nullptr);
+    for (uint32_t root : stream.get_root_nodes()) {
+      build_node(stream, root, *this);
+    }
+  }
+
+  void build_node(const gltf_stream &stream, uint32_t index, composite_renderable &parent) {
+    // A node may only have one parent, skip malformed files that reference it twice
+    if (index >= m_nodes.size() || m_nodes[index] != nullptr) {
+      return;
+    }
+    const gltf_node &desc = stream.get_nodes()[index];
+    auto *node = parent.create_object<composite_renderable>(m_scene);
+    static_cast<transform &>(*node) = transform(desc.local_transform);
+    parent.add_child(node);
+    m_nodes[index] = node;
+    for (uint32_t child : desc.children) {
+      build_node(stream, child, *node);
+    }
+  }
+
+  void add_primitive(const gltf_primitive &primitive) {
+    m_meshes.push_back(primitive.geometry);
+    const auto &nodes = m_stream->get_nodes();
+    for (size_t i = 0; i < nodes.size(); ++i) {
+      if (i >= m_nodes.size() || m_nodes[i] == nullptr || nodes[i].mesh != static_cast<int32_t>(primitive.mesh)) {
+        continue;
+      }
+      auto *part = m_nodes[i]->create_object<renderable>(m_scene, primitive.geometry.get(), create_material(primitive));
+      m_nodes[i]->add_child(part);
+    }
+  }
+
+  // Renderables using the same glTF material share one material, as per-draw matrices live in the draw bind group
+  auto create_material(const gltf_primitive &primitive) -> material * {
+    const gltf_material *desc =
+        primitive.material >= 0 ? &m_stream->get_materials()[static_cast<size_t>(primitive.material)] : nullptr;
+    const int32_t texture = desc != nullptr ? desc->base_color_texture : -1;
+    const bool textured = texture >= 0 && m_stream->get_textures()[static_cast<size_t>(texture)] != nullptr &&
+                          primitive.geometry->get_vertex_layout().has_texcoords();
+    auto &cached = m_materials[{primitive.material, textured}];
+    if (!cached) {
+      const alpha_mode mode = desc != nullptr ? desc->alpha : alpha_mode::opaque;
+      if (textured) {
+        cached = m_scene->create_material<textured_material>(m_stream->get_textures()[static_cast<size_t>(texture)],
+                                                             mode);
+      } else {
+        const vec4 color = desc != nullptr ? desc->base_color : vec4{1.0F, 1.0F, 1.0F, 1.0F};
+        cached = m_scene->create_material<flat_color_material>(color, mode);
+      }
+      if (mode == alpha_mode::masked) {
+        cached->set_alpha_cutoff(desc->alpha_cutoff);
+      }
+    }
+    return cached.get();
+  }
+};
+
+} // namespace mareweb
+
+#endif // MAREWEB_GLTF_MODEL_HPP
@@ -3,6 +3,8 @@
 
 #include "mareweb/components/transform.hpp"
 #include "mareweb/entity.hpp"
+#include "mareweb/frame_bindings.hpp"
+#include "mareweb/frame_stats.hpp"
 #include "mareweb/material.hpp"
 #include "mareweb/mesh.hpp"
 #include "mareweb/scene.hpp"
@@ -13,6 +15,19 @@
 
 namespace mareweb {
 
+// Model and normal matrices of a draw, combined with the parent's transform if there is one
+inline auto make_draw_uniforms(const transform &local, const transform *parent_transform) -> draw_uniforms {
+  draw_uniforms uniforms;
+  if (parent_transform != nullptr) {
+    uniforms.model = parent_transform->get_transformation_matrix() * local.get_transformation_matrix();
+    uniforms.normal_matrix.subview<3, 3>(0, 0) = mat3{inv(uniforms.model).transpose().subview<3, 3>(0, 0)};
+  } else {
+    uniforms.model = local.get_transformation_matrix();
+    uniforms.normal_matrix.subview<3, 3>(0, 0) = local.get_normal_matrix();
+  }
+  return uniforms;
+}
+
 // Base class for all renderables to establish common interface
 class renderable_base {
 public:
@@ -40,33 +55,12 @@ public:
       return;
     }
 
-    auto pass_encoder = m_scene->get_render_pass();
-    m_mesh->bind_material(*m_material, pass_encoder); // Bind the material
-
-    // Calculate combined transform if parent exists
-    mat4 combined_transform = parent_transform
-                                  ? parent_transform->get_transformation_matrix() * get_transformation_matrix()
-                                  : get_transformation_matrix();
-
-    // Set MVP and Normal matrices with combined transform
-    mat4 mvp = m_scene->get_view_projection_matrix() * combined_transform;
-    mat4x3 padded_normal_matrix;
-    padded_normal_matrix.subview<3, 3>(0, 0) = get_normal_matrix();
-
-    // Update uniforms with new matrices
-    m_material->update_uniform(uniform_locations::MVP_MATRIX, &mvp);
-    m_material->update_uniform(uniform_locations::NORMAL_MATRIX, &padded_normal_matrix);
-
-    // Draw the mesh
-    const uint32_t vertex_count = m_mesh->get_vertex_count();
-    pass_encoder.SetVertexBuffer(0, m_mesh->get_vertex_buffer());
-
-    if (m_mesh->get_vertex_state().is_indexed) {
-      pass_encoder.SetIndexBuffer(m_mesh->get_index_buffer(), wgpu::IndexFormat::Uint32);
-      pass_encoder.DrawIndexed(m_mesh->get_index_count());
-    } else {
-      pass_encoder.Draw(vertex_count);
-    }
+    // Recorded by the renderer once every draw of the frame is known, in an order that depends on the alpha mode
+    draw_item item;
+    item.geometry = m_mesh;
+    item.surface = m_material;
+    item.uniforms = make_draw_uniforms(*this, parent_transform);
+    m_scene->get_draw_queue().submit(item);
   }
 
   // Setters for mesh and material
@@ -109,6 +103,28 @@ public:
     }
   }
 
+  // Set instances together with their per-instance attributes (one per transform)
+  void set_instances(const std::vector<transform> &instances, const std::vector<instance_attributes> &attributes) {
+    if (!m_instance_buffer) {
+      throw std::runtime_error("Instance buffer not initialized");
+    }
+    if (instances.size() > m_instance_buffer->get_capacity()) {
+      throw std::runtime_error("Too many instances for buffer capacity");
+    }
+    m_instance_buffer->update_transforms(instances, attributes);
+    if (m_material) {
+      m_material->update_instance_buffer(m_instance_buffer->get_buffer(), m_instance_buffer->get_size());
+    }
+  }
+
+  // Update the attributes (color, custom data) of a single instance
+  void update_instance_attributes(size_t index, const instance_attributes &attributes) {
+    if (!m_instance_buffer) {
+      throw std::runtime_error("Instance buffer not initialized");
+    }
+    m_instance_buffer->update_attributes(index, attributes);
+  }
+
   // Update a single instance transform
   void update_instance(size_t index, const transform &t) {
     if (!m_instance_buffer) {
@@ -156,6 +172,13 @@ public:
     return m_instance_buffer->get_transform(index);
   }
 
+  [[nodiscard]] auto get_instance_attributes(size_t index) const -> const instance_attributes & {
+    if (!m_instance_buffer) {
+      throw std::runtime_error("Instance buffer not initialized");
+    }
+    return m_instance_buffer->get_attributes(index);
+  }
+
   // Get all instance transforms
   [[nodiscard]] auto get_instances() const -> const std::vector<transform> & {
     if (!m_instance_buffer) {
@@ -175,34 +198,13 @@ public:
       return;
     }
 
-    auto pass_encoder = m_scene->get_render_pass();
-
-    // Calculate combined transform if parent exists
-    mat4 combined_transform = parent_transform
-                                  ? parent_transform->get_transformation_matrix() * get_transformation_matrix()
-                                  : get_transformation_matrix();
-
-    // Set MVP and Normal matrices with combined transform
-    mat4 mvp = m_scene->get_view_projection_matrix() * combined_transform;
-    mat4x3 padded_normal_matrix;
-    padded_normal_matrix.subview<3, 3>(0, 0) = get_normal_matrix();
-
-    m_material->update_uniform(uniform_locations::MVP_MATRIX, &mvp);
-    m_material->update_uniform(uniform_locations::NORMAL_MATRIX, &padded_normal_matrix);
-
-    // Bind mesh and material (this will handle instance buffer binding)
-    m_mesh->bind_material(*m_material, pass_encoder);
-
-    // Draw with instancing
-    const uint32_t vertex_count = m_mesh->get_vertex_count();
-    pass_encoder.SetVertexBuffer(0, m_mesh->get_vertex_buffer());
-
-    if (m_mesh->get_vertex_state().is_indexed) {
-      pass_encoder.SetIndexBuffer(m_mesh->get_index_buffer(), wgpu::IndexFormat::Uint32);
-      pass_encoder.DrawIndexed(m_mesh->get_index_count(), m_instance_buffer->get_active_count());
-    } else {
-      pass_encoder.Draw(vertex_count, m_instance_buffer->get_active_count());
-    }
+    draw_item item;
+    item.geometry = m_mesh;
+    item.surface = m_material;
+    item.uniforms = make_draw_uniforms(*this, parent_transform);
+    item.instances = m_instance_buffer.get();
+    item.instance_count = m_instance_buffer->get_active_count();
+    m_scene->get_draw_queue().submit(item);
   }
 
   // Setters for mesh and material
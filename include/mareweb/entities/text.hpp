@@ -24,7 +24,7 @@ public:
         if (extrusion == 0.0f) {
             if (thickness == 0.0f) {
                 // 2D text with single-pixel lines
-                m_link_mesh = scene->create_mesh<line_mesh>();
+                m_link_mesh = scene->acquire_mesh<line_mesh>();
                 if (link_material) {
                     m_link_material = nullptr;
                 } else {
@@ -39,8 +39,8 @@ public:
                 );
             } else {
                 // 2D text with circle nodes and square links
-                m_node_mesh = scene->create_mesh<circle_mesh>(length(0.5f), 16);
-                m_link_mesh = scene->create_mesh<square_mesh>(length(1.F));
+                m_node_mesh = scene->acquire_mesh<circle_mesh>(length(0.5f), 16);
+                m_link_mesh = scene->acquire_mesh<square_mesh>(length(1.F));
 
                 // Create or use provided materials
                 if (node_material) {
@@ -72,9 +72,9 @@ public:
             }
         } else {
             // 3D extruded text with cylinders and cubes
-            m_node_mesh = scene->create_mesh<cylinder_mesh>(length(0.5f), length(1.F), 
-                                                          0, units::degrees(360.0f), 16);
-            m_link_mesh = scene->create_mesh<cube_mesh>(length(1.0f));
+            m_node_mesh = scene->acquire_mesh<cylinder_mesh>(length(0.5f), length(1.F),
+                                                           0, units::degrees(360.0f), 16);
+            m_link_mesh = scene->acquire_mesh<cube_mesh>(length(1.0f));
 
             if (node_material) {
                 m_node_material = nullptr;
@@ -272,8 +272,8 @@ private:
     unsigned int m_max_width = 0;
     unsigned int m_stroke_count = 0;
     
-    std::unique_ptr<mesh> m_node_mesh;
-    std::unique_ptr<mesh> m_link_mesh;
+    std::shared_ptr<mesh> m_node_mesh;
+    std::shared_ptr<mesh> m_link_mesh;
     std::unique_ptr<material> m_node_material;
     std::unique_ptr<material> m_link_material;
     instanced_renderable* m_node_instances = nullptr;
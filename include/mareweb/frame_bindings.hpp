@@ -0,0 +1,147 @@
+#ifndef MAREWEB_FRAME_BINDINGS_HPP
+#define MAREWEB_FRAME_BINDINGS_HPP
+
+#include "mareweb/buffer.hpp"
+#include "mareweb/light_clusters.hpp"
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <squint/tensor.hpp>
+#include <vector>
+#include <webgpu/webgpu_cpp.h>
+
+namespace mareweb {
+
+// Bind group indices shared by every pipeline, ordered by how often their contents change
+namespace bind_group_index {
+constexpr uint32_t FRAME = 0;    // camera, time, lights and light clusters, bound once per pass
+constexpr uint32_t MATERIAL = 1; // the material's own bindings, rebound when the material changes
+constexpr uint32_t DRAW = 2;     // model matrices, rebound with a dynamic offset per draw
+} // namespace bind_group_index
+
+// Matches the Frame struct in FRAME_BINDINGS_WGSL
+struct frame_uniforms {
+  squint::mat4 view = squint::mat4::eye();
+  squint::mat4 projection = squint::mat4::eye();
+  squint::mat4 view_projection = squint::mat4::eye();
+  squint::vec4 camera_position{0.0F, 0.0F, 0.0F, 1.0F};
+  squint::vec4 light_direction{1.0F, 1.0F, 1.0F, 0.0F}; // towards the light, w unused
+  squint::vec4 light_color{1.0F, 1.0F, 1.0F, 0.2F};     // a holds the ambient factor
+  float time = 0.0F;                                     // seconds since the renderer was created
+  float delta_time = 0.0F;
+  std::array<float, 2> padding{};
+};
+
+// Matches the Draw struct in DRAW_BINDINGS_WGSL
+struct draw_uniforms {
+  squint::mat4 model = squint::mat4::eye();
+  squint::mat4x3 normal_matrix; // mat3x3 in WGSL, columns padded to vec4
+};
+
+static_assert(sizeof(frame_uniforms) == 256, "must match FRAME_BINDINGS_WGSL");
+static_assert(sizeof(draw_uniforms) == 112, "must match DRAW_BINDINGS_WGSL");
+
+// Declarations of group 0 and group 2, prepended to the shaders that use them
+constexpr const char *FRAME_BINDINGS_WGSL = R"(
+struct Frame {
+    view: mat4x4<f32>,
+    projection: mat4x4<f32>,
+    view_projection: mat4x4<f32>,
+    camera_position: vec4<f32>,
+    light_direction: vec4<f32>,
+    light_color: vec4<f32>,
+    time: f32,
+    delta_time: f32,
+};
+@group(0) @binding(0) var<uniform> frame: Frame;
+)";
+
+constexpr const char *DRAW_BINDINGS_WGSL = R"(
+struct Draw {
+    model: mat4x4<f32>,
+    normal_matrix: mat3x3<f32>,
+};
+@group(2) @binding(0) var<uniform> draw_data: Draw;
+)";
+
+// Clip position of an object-space vertex, prepended after both declarations above. Shaders that output it through an
+// @invariant position get bit-identical depth in every pipeline, which the depth pre-pass relies on.
+constexpr const char *CLIP_POSITION_WGSL = R"(
+fn clip_position(position: vec3<f32>) -> vec4<f32> {
+    return frame.view_projection * (draw_data.model * vec4<f32>(position, 1.0));
+}
+)";
+
+// What is bound in the current pass, so consecutive draws sharing a pipeline or material skip redundant calls.
+// Reset at the start of every pass.
+struct pass_bindings {
+  WGPURenderPipeline pipeline = nullptr;
+  WGPUBindGroup material = nullptr;
+
+  void reset() {
+    pipeline = nullptr;
+    material = nullptr;
+  }
+};
+
+struct frame_bindings_stats {
+  uint64_t draw_count = 0; // draws recorded in the last frame
+  uint64_t block_count = 0;
+};
+
+// Owns the per-frame and per-draw bind groups. Frame data, including the light_clusters' buffers at bindings 1 to 4, is
+// written and bound once per pass. Per-draw data is packed
+// into a CPU copy of a ring of uniform blocks, each draw binding its block at a dynamic offset, and uploaded with one
+// WriteBuffer per block before the frame is submitted.
+class frame_bindings {
+public:
+  frame_bindings(wgpu::Device &device, const light_clusters &lights);
+
+  frame_bindings(const frame_bindings &) = delete;
+  auto operator=(const frame_bindings &) -> frame_bindings & = delete;
+  frame_bindings(frame_bindings &&) = delete;
+  auto operator=(frame_bindings &&) -> frame_bindings & = delete;
+
+  // Shared through the bind_group_cache, so every pipeline gets the same objects
+  [[nodiscard]] static auto get_frame_layout(wgpu::Device &device) -> wgpu::BindGroupLayout;
+  [[nodiscard]] static auto get_draw_layout(wgpu::Device &device) -> wgpu::BindGroupLayout;
+
+  // Writes the frame uniforms, binds group 0 and forgets what the previous pass had bound
+  void begin_pass(wgpu::RenderPassEncoder &pass_encoder, const frame_uniforms &uniforms);
+  // Same for a later pass of the frame, reusing the uniforms already written
+  void begin_pass(wgpu::RenderPassEncoder &pass_encoder);
+  // Appends the draw's uniforms to the ring and binds group 2 at their offset. Returns the slot for bind_draw_slot.
+  auto bind_draw(wgpu::RenderPassEncoder &pass_encoder, const draw_uniforms &uniforms) -> uint64_t;
+  // Binds a slot appended earlier in the frame, so a draw recorded in several passes uploads its uniforms once
+  void bind_draw_slot(wgpu::RenderPassEncoder &pass_encoder, uint64_t slot);
+  // Uploads the draw uniforms recorded since begin_pass. Call once the pass has ended, before submitting.
+  void flush();
+
+  [[nodiscard]] auto get_pass_bindings() -> pass_bindings & { return m_pass_bindings; }
+  [[nodiscard]] auto get_stats() const -> frame_bindings_stats;
+
+  // minUniformBufferOffsetAlignment is at most 256 on every WebGPU implementation
+  static constexpr uint64_t DRAW_STRIDE = 256;
+  static constexpr uint64_t DRAWS_PER_BLOCK = 1024;
+
+private:
+  struct draw_block {
+    std::unique_ptr<uniform_buffer> buffer;
+    wgpu::BindGroup bind_group;
+  };
+
+  wgpu::Device m_device;
+  std::unique_ptr<uniform_buffer> m_frame_buffer;
+  wgpu::BindGroup m_frame_bind_group;
+  std::vector<draw_block> m_draw_blocks;
+  std::vector<uint8_t> m_draw_data; // block i at i * DRAWS_PER_BLOCK * DRAW_STRIDE
+  uint64_t m_draw_count = 0;
+  uint64_t m_last_draw_count = 0;
+  pass_bindings m_pass_bindings;
+
+  void add_draw_block();
+};
+
+} // namespace mareweb
+
+#endif // MAREWEB_FRAME_BINDINGS_HPP
@@ -0,0 +1,143 @@
+#ifndef MAREWEB_FRAME_STATS_HPP
+#define MAREWEB_FRAME_STATS_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <utility>
+
+namespace mareweb {
+
+// What one frame cost in API calls and bytes moved to the GPU.
+struct frame_stats {
+  uint64_t frame_index = 0;
+  uint64_t draw_calls = 0;
+  uint64_t instances_drawn = 0;
+  uint64_t pipeline_binds = 0;
+  uint64_t bind_group_binds = 0;
+  uint64_t buffer_upload_bytes = 0;
+  uint64_t texture_upload_bytes = 0;
+  uint64_t pipelines_created = 0;
+  uint64_t bind_groups_created = 0;
+  double frame_time_ms = 0.0; // time since the previous end_frame
+};
+
+// frame_stats averaged over the recent history.
+struct frame_stats_average {
+  double draw_calls = 0.0;
+  double instances_drawn = 0.0;
+  double pipeline_binds = 0.0;
+  double bind_group_binds = 0.0;
+  double buffer_upload_bytes = 0.0;
+  double texture_upload_bytes = 0.0;
+  double pipelines_created = 0.0;
+  double bind_groups_created = 0.0;
+  double frame_time_ms = 0.0;
+};
+
+// Counters bumped at the call sites that talk to WebGPU. Each renderer owns one and makes it current on the calling
+// thread for its update traversal and from begin_frame to end_frame, so every renderer counts only its own work. Work
+// outside any renderer's scope (e.g. setup before the first frame, or loader threads) lands in a process-wide pool that
+// the next renderer to end a frame takes with its own counts.
+class frame_counters {
+public:
+  // Makes counters the target of the add_* calls on this thread until the scope ends
+  class scope {
+  public:
+    explicit scope(frame_counters &counters) : m_previous(install(&counters)) {}
+    ~scope() {
+      if (m_active) {
+        install(m_previous);
+      }
+    }
+    scope(const scope &) = delete;
+    auto operator=(const scope &) -> scope & = delete;
+
+    // Leaves the counters installed past the scope, returns what to install() again once they are done
+    auto release() -> frame_counters * {
+      m_active = false;
+      return m_previous;
+    }
+
+  private:
+    frame_counters *m_previous;
+    bool m_active = true;
+  };
+
+  // Makes counters (null for the process-wide pool) the target on this thread, returns the previous target
+  static auto install(frame_counters *counters) -> frame_counters * { return std::exchange(current(), counters); }
+
+  static void add_draw(uint64_t instances) {
+    get().draw_calls.fetch_add(1, std::memory_order_relaxed);
+    get().instances_drawn.fetch_add(instances, std::memory_order_relaxed);
+  }
+  static void add_pipeline_bind() { get().pipeline_binds.fetch_add(1, std::memory_order_relaxed); }
+  static void add_bind_group_bind() { get().bind_group_binds.fetch_add(1, std::memory_order_relaxed); }
+  static void add_buffer_upload(uint64_t bytes) {
+    get().buffer_upload_bytes.fetch_add(bytes, std::memory_order_relaxed);
+  }
+  static void add_texture_upload(uint64_t bytes) {
+    get().texture_upload_bytes.fetch_add(bytes, std::memory_order_relaxed);
+  }
+  static void add_pipeline_created() { get().pipelines_created.fetch_add(1, std::memory_order_relaxed); }
+  static void add_bind_group_created() { get().bind_groups_created.fetch_add(1, std::memory_order_relaxed); }
+
+  // Returns the counts accumulated since the last call, plus the unscoped ones, and resets them.
+  auto take() -> frame_stats;
+
+private:
+  struct counters {
+    std::atomic<uint64_t> draw_calls = 0;
+    std::atomic<uint64_t> instances_drawn = 0;
+    std::atomic<uint64_t> pipeline_binds = 0;
+    std::atomic<uint64_t> bind_group_binds = 0;
+    std::atomic<uint64_t> buffer_upload_bytes = 0;
+    std::atomic<uint64_t> texture_upload_bytes = 0;
+    std::atomic<uint64_t> pipelines_created = 0;
+    std::atomic<uint64_t> bind_groups_created = 0;
+  };
+
+  counters m_counts;
+
+  static auto current() -> frame_counters *& {
+    thread_local frame_counters *instance = nullptr;
+    return instance;
+  }
+  static auto unscoped() -> counters & {
+    static counters instance;
+    return instance;
+  }
+  static auto get() -> counters & {
+    frame_counters *counters = current();
+    return counters != nullptr ? counters->m_counts : unscoped();
+  }
+};
+
+// Keeps the last HISTORY_LENGTH frames for rolling averages and optionally appends the averages to a CSV file.
+class frame_stats_history {
+public:
+  static constexpr size_t HISTORY_LENGTH = 120;
+
+  void push(const frame_stats &stats);
+  [[nodiscard]] auto get_last() const -> const frame_stats & { return m_last; }
+  [[nodiscard]] auto get_average() const -> frame_stats_average;
+
+  // Writes the rolling averages every interval_frames frames. An empty path disables dumping.
+  void set_dump_file(const std::string &path, uint32_t interval_frames);
+
+private:
+  std::array<frame_stats, HISTORY_LENGTH> m_history{};
+  size_t m_next = 0;
+  size_t m_count = 0;
+  frame_stats m_last;
+  std::ofstream m_dump_file;
+  uint32_t m_dump_interval = 0;
+
+  void dump();
+};
+
+} // namespace mareweb
+
+#endif // MAREWEB_FRAME_STATS_HPP
@@ -0,0 +1,150 @@
+#ifndef MAREWEB_GEOMETRY_ARENA_HPP
+#define MAREWEB_GEOMETRY_ARENA_HPP
+
+#include "mareweb/resource_registry.hpp"
+#include "mareweb/upload_manager.hpp"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <webgpu/webgpu_cpp.h>
+
+namespace mareweb {
+
+class geometry_arena;
+
+// A range of elements (vertices of one stride, or uint32 indices) inside one of the arena's pages. The arena owns the
+// block and may move it during defragment(), so read the buffer and offset at draw time instead of caching them.
+struct geometry_block {
+  uint32_t pool = 0;
+  uint32_t page = 0;
+  uint64_t offset = 0; // in elements, usable directly as baseVertex / firstVertex / firstIndex
+  uint64_t count = 0;
+};
+
+// Frees its block when destroyed.
+class geometry_allocation {
+public:
+  geometry_allocation() = default;
+  geometry_allocation(geometry_arena *arena, geometry_block *block) : m_arena(arena), m_block(block) {}
+  ~geometry_allocation() { reset(); }
+
+  geometry_allocation(const geometry_allocation &) = delete;
+  auto operator=(const geometry_allocation &) -> geometry_allocation & = delete;
+  geometry_allocation(geometry_allocation &&other) noexcept
+      : m_arena(std::exchange(other.m_arena, nullptr)), m_block(std::exchange(other.m_block, nullptr)) {}
+  auto operator=(geometry_allocation &&other) noexcept -> geometry_allocation & {
+    if (this != &other) {
+      reset();
+      m_arena = std::exchange(other.m_arena, nullptr);
+      m_block = std::exchange(other.m_block, nullptr);
+    }
+    return *this;
+  }
+
+  void reset();
+
+  [[nodiscard]] auto is_valid() const -> bool { return m_block != nullptr; }
+  [[nodiscard]] auto get_buffer() const -> wgpu::Buffer;
+  [[nodiscard]] auto get_offset() const -> uint32_t { return static_cast<uint32_t>(m_block->offset); }
+  [[nodiscard]] auto get_count() const -> uint32_t { return static_cast<uint32_t>(m_block->count); }
+
+private:
+  geometry_arena *m_arena = nullptr;
+  geometry_block *m_block = nullptr;
+};
+
+// Buffers bound in the current render pass, so consecutive draws from the same page skip redundant Set*Buffer calls.
+// Reset at the start of every pass.
+struct geometry_bindings {
+  WGPUBuffer vertex_buffer = nullptr;
+  WGPUBuffer index_buffer = nullptr;
+
+  void reset() {
+    vertex_buffer = nullptr;
+    index_buffer = nullptr;
+  }
+};
+
+struct geometry_arena_stats {
+  uint64_t page_count = 0;
+  uint64_t capacity_bytes = 0;
+  uint64_t used_bytes = 0;
+  uint64_t block_count = 0;
+  uint64_t free_range_count = 0; // fragmentation, 1 per page when fully compacted
+};
+
+// Suballocates mesh geometry out of a few large buffers. Vertices are pooled by stride, so meshes with the same stride
+// share pages regardless of their attribute layout, and indices share one uint32 pool. Each page hands out ranges
+// first-fit from an offset-ordered free list that coalesces neighbours on release.
+class geometry_arena {
+public:
+  explicit geometry_arena(wgpu::Device &device, uint64_t page_bytes = DEFAULT_PAGE_BYTES);
+
+  geometry_arena(const geometry_arena &) = delete;
+  auto operator=(const geometry_arena &) -> geometry_arena & = delete;
+  geometry_arena(geometry_arena &&) = delete;
+  auto operator=(geometry_arena &&) -> geometry_arena & = delete;
+
+  // Returns the arena for this device, creating it on first use.
+  static auto get(wgpu::Device &device) -> geometry_arena &;
+
+  // The data is copied into upload_manager staging, the copy into the page is submitted by its next flush()
+  [[nodiscard]] auto allocate_vertices(const void *data, uint32_t vertex_count, uint32_t stride) -> geometry_allocation;
+  [[nodiscard]] auto allocate_indices(const uint32_t *indices, uint32_t index_count) -> geometry_allocation;
+  // Commits staging reserved without a destination, e.g. filled by a decoder on a worker thread, to the new range
+  [[nodiscard]] auto allocate_vertices(upload_span staged, uint32_t vertex_count, uint32_t stride)
+      -> geometry_allocation;
+  [[nodiscard]] auto allocate_indices(upload_span staged, uint32_t index_count) -> geometry_allocation;
+
+  // Packs every pool's live blocks into as few pages as possible. The copies are recorded into encoder, which must be
+  // submitted before the next draw that uses the moved geometry. Pools with staged copies still queued are left as they
+  // are, so flush the upload_manager first.
+  void defragment(wgpu::CommandEncoder &encoder);
+
+  [[nodiscard]] auto get_stats() const -> geometry_arena_stats;
+
+  static constexpr uint64_t DEFAULT_PAGE_BYTES = 16ULL * 1024 * 1024;
+
+private:
+  friend class geometry_allocation;
+
+  struct page {
+    wgpu::Buffer buffer;
+    uint64_t capacity = 0;                   // in elements
+    std::map<uint64_t, uint64_t> free_ranges; // offset -> count
+    uint32_t live_blocks = 0;
+    resource_handle resource;
+  };
+
+  struct pool {
+    uint32_t stride = 0;
+    bool is_index = false;
+    std::vector<page> pages;
+  };
+
+  wgpu::Device m_device;
+  uint64_t m_page_bytes;
+  std::vector<pool> m_pools;
+  std::unordered_map<uint32_t, uint32_t> m_vertex_pools; // stride -> pool
+  uint32_t m_index_pool = 0;
+  std::vector<std::unique_ptr<geometry_block>> m_blocks;
+  std::vector<geometry_block *> m_free_blocks;
+
+  auto get_vertex_pool(uint32_t stride) -> uint32_t;
+  auto allocate(uint32_t pool_index, upload_span &staged, uint64_t count) -> geometry_allocation;
+  void release(geometry_block *block);
+  auto create_page(pool &target, uint64_t min_elements) -> uint32_t;
+  auto get_block_buffer(const geometry_block &block) const -> wgpu::Buffer {
+    return m_pools[block.pool].pages[block.page].buffer;
+  }
+  static auto take_range(page &target, uint64_t count) -> std::optional<uint64_t>;
+  static void return_range(page &target, uint64_t offset, uint64_t count);
+};
+
+} // namespace mareweb
+
+#endif // MAREWEB_GEOMETRY_ARENA_HPP
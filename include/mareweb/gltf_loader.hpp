@@ -0,0 +1,173 @@
+#ifndef MAREWEB_GLTF_LOADER_HPP
+#define MAREWEB_GLTF_LOADER_HPP
+
+#include "mareweb/mesh.hpp"
+#include "mareweb/pipeline.hpp"
+#include "mareweb/texture_loader.hpp"
+#include "mareweb/thread_pool.hpp"
+#include "mareweb/upload_manager.hpp"
+#include "mareweb/vertex_attributes.hpp"
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <squint/tensor.hpp>
+#include <string>
+#include <vector>
+#include <webgpu/webgpu_cpp.h>
+
+struct cgltf_data;
+
+namespace mareweb {
+
+struct gltf_node {
+  std::string name;
+  squint::mat4 local_transform = squint::mat4::eye();
+  int32_t mesh = -1;
+  std::vector<uint32_t> children;
+};
+
+struct gltf_material {
+  squint::vec4 base_color{1.0F, 1.0F, 1.0F, 1.0F};
+  int32_t base_color_texture = -1; // index into gltf_stream::get_textures()
+  bool double_sided = false;
+  alpha_mode alpha = alpha_mode::opaque; // glTF OPAQUE, MASK and BLEND
+  float alpha_cutoff = 0.5F;
+};
+
+// One primitive of a glTF mesh, uploaded and ready to draw
+struct gltf_primitive {
+  uint32_t mesh = 0;
+  uint32_t primitive = 0;
+  int32_t material = -1; // index into gltf_stream::get_materials(), -1 for the glTF default material
+  std::shared_ptr<mareweb::mesh> geometry;
+};
+
+// A glTF file being streamed in. The node hierarchy arrives first, then primitives one by one as they are decoded and
+// uploaded, so a consumer can show the first nodes long before the whole file is processed. Only touched on the main
+// thread.
+class gltf_stream {
+public:
+  using structure_callback = std::function<void(const gltf_stream &)>;
+  using primitive_callback = std::function<void(const gltf_primitive &)>;
+
+  explicit gltf_stream(std::string path) : m_path(std::move(path)) {}
+
+  [[nodiscard]] auto get_path() const -> const std::string & { return m_path; }
+  [[nodiscard]] auto has_structure() const -> bool { return m_has_structure; }
+  // Every primitive has been delivered (or skipped)
+  [[nodiscard]] auto is_loaded() const -> bool { return m_has_structure && m_delivered == m_primitive_count; }
+  [[nodiscard]] auto has_failed() const -> bool { return m_error.has_value(); }
+  [[nodiscard]] auto get_error() const -> const std::optional<std::string> & { return m_error; }
+
+  [[nodiscard]] auto get_nodes() const -> const std::vector<gltf_node> & { return m_nodes; }
+  [[nodiscard]] auto get_root_nodes() const -> const std::vector<uint32_t> & { return m_root_nodes; }
+  [[nodiscard]] auto get_materials() const -> const std::vector<gltf_material> & { return m_materials; }
+  [[nodiscard]] auto get_textures() const -> const std::vector<std::shared_ptr<texture_handle>> & {
+    return m_textures;
+  }
+
+  // The structure callback runs once when the hierarchy is known, the primitive callback once per uploaded primitive.
+  // Both run inside renderer::begin_frame, before the frame's pass starts.
+  void set_listener(structure_callback on_structure, primitive_callback on_primitive);
+  void clear_listener();
+
+private:
+  friend class gltf_loader;
+
+  std::string m_path;
+  bool m_has_structure = false;
+  size_t m_primitive_count = 0;
+  size_t m_delivered = 0;
+  std::optional<std::string> m_error;
+  std::vector<gltf_node> m_nodes;
+  std::vector<uint32_t> m_root_nodes;
+  std::vector<gltf_material> m_materials;
+  std::vector<std::shared_ptr<texture_handle>> m_textures;
+  structure_callback m_on_structure;
+  primitive_callback m_on_primitive;
+
+  void fail(std::string error);
+};
+
+// Loads glTF 2.0 (.gltf and .glb) files. Parsing and buffer loading run on a worker pool (by default the process-wide
+// shared one), which then decodes each primitive straight from its accessors into upload_manager staging, already in
+// the interleaved layout the mesh draws with. poll() hands a bounded number of primitives per frame to the geometry
+// arena on the main thread. Images go through the texture_loader.
+class gltf_loader {
+public:
+  explicit gltf_loader(wgpu::Device &device, texture_loader &textures,
+                       std::shared_ptr<thread_pool> pool = thread_pool::shared());
+
+  gltf_loader(const gltf_loader &) = delete;
+  auto operator=(const gltf_loader &) -> gltf_loader & = delete;
+  gltf_loader(gltf_loader &&) = delete;
+  auto operator=(gltf_loader &&) -> gltf_loader & = delete;
+
+  [[nodiscard]] auto load(const std::string &path) -> std::shared_ptr<gltf_stream>;
+  // Delivers decoded hierarchies and uploads up to max_uploads primitives. Returns how many primitives were uploaded.
+  auto poll(size_t max_uploads = DEFAULT_UPLOADS_PER_POLL) -> size_t;
+
+  static constexpr size_t DEFAULT_UPLOADS_PER_POLL = 8;
+
+private:
+  struct embedded_image {
+    std::string uri; // resolved path of an external image, empty if bytes holds the encoded image
+    std::vector<uint8_t> bytes;
+  };
+
+  struct decoded_texture {
+    int32_t image = -1;
+    wgpu::AddressMode address_mode = wgpu::AddressMode::Repeat;
+  };
+
+  struct decoded_structure {
+    std::vector<gltf_node> nodes;
+    std::vector<uint32_t> root_nodes;
+    std::vector<gltf_material> materials;
+    std::vector<embedded_image> images;
+    std::vector<decoded_texture> textures;
+    size_t primitive_count = 0;
+  };
+
+  struct decoded_primitive {
+    uint32_t mesh = 0;
+    uint32_t primitive = 0;
+    int32_t material = -1;
+    wgpu::PrimitiveState primitive_state;
+    vertex_layout layout;
+    upload_span vertices; // packed with layout's stride
+    uint32_t vertex_count = 0;
+    upload_span indices; // uint32
+    uint32_t index_count = 0;
+    mesh_bounds bounds{};
+  };
+
+  struct decoded_item {
+    std::weak_ptr<gltf_stream> stream;
+    std::optional<decoded_structure> structure;
+    std::optional<decoded_primitive> primitive;
+    std::string error; // the whole file failed. An item with nothing set is a primitive that was skipped
+  };
+
+  wgpu::Device m_device;
+  texture_loader &m_textures;
+  upload_manager &m_uploads;
+  std::mutex m_mutex;
+  std::deque<decoded_item> m_decoded;
+  // Declared last so running decodes finish before the queue they write into is destroyed
+  task_group m_tasks;
+
+  void push(decoded_item item);
+  static auto decode_structure(const cgltf_data &data, const std::string &path) -> decoded_structure;
+  static auto decode_primitive(const cgltf_data &data, uint32_t mesh, uint32_t primitive, upload_manager &uploads)
+      -> decoded_primitive;
+  void deliver_structure(gltf_stream &stream, decoded_structure &structure);
+  void deliver_primitive(gltf_stream &stream, decoded_primitive &primitive);
+};
+
+} // namespace mareweb
+
+#endif // MAREWEB_GLTF_LOADER_HPP
@@ -0,0 +1,104 @@
+#ifndef MAREWEB_GPU_PROFILER_HPP
+#define MAREWEB_GPU_PROFILER_HPP
+
+#include "mareweb/resource_registry.hpp"
+#include <array>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include <webgpu/webgpu_cpp.h>
+
+namespace mareweb {
+
+// Rolling statistics for one named GPU scope, in milliseconds.
+struct gpu_scope_stats {
+  double last_ms = 0.0;
+  double average_ms = 0.0;
+  double min_ms = 0.0;
+  double max_ms = 0.0;
+  uint64_t sample_count = 0;
+};
+
+// Measures GPU execution time of render and compute passes with timestamp queries.
+//
+// Each pass asks for a scope with render_pass_timestamps/compute_pass_timestamps and plugs the result into its pass
+// descriptor. At the end of the frame resolve() copies the timestamps into one of a small ring of readback buffers
+// which is mapped asynchronously after submission, so results arrive a few frames late without stalling the CPU.
+// Requires the device to have been created with wgpu::FeatureName::TimestampQuery.
+class gpu_profiler {
+public:
+  static constexpr uint32_t MAX_SCOPES_PER_FRAME = 32;
+  static constexpr uint32_t READBACK_FRAMES = 4;
+  static constexpr size_t HISTORY_LENGTH = 120;
+
+  explicit gpu_profiler(wgpu::Device &device);
+
+  gpu_profiler(const gpu_profiler &) = delete;
+  auto operator=(const gpu_profiler &) -> gpu_profiler & = delete;
+  gpu_profiler(gpu_profiler &&) = delete;
+  auto operator=(gpu_profiler &&) -> gpu_profiler & = delete;
+  ~gpu_profiler() = default;
+
+  [[nodiscard]] static auto is_supported(const wgpu::Device &device) -> bool;
+
+  void begin_frame();
+  [[nodiscard]] auto render_pass_timestamps(const std::string &scope) -> std::optional<wgpu::RenderPassTimestampWrites>;
+  [[nodiscard]] auto compute_pass_timestamps(const std::string &scope)
+      -> std::optional<wgpu::ComputePassTimestampWrites>;
+  void resolve(wgpu::CommandEncoder &encoder);
+  void after_submit();
+
+  // Statistics per scope name, updated whenever a readback completes.
+  [[nodiscard]] auto get_scope_stats() const -> const std::map<std::string, gpu_scope_stats> &;
+  // Span from the first timestamp to the last one of the most recently read back frame.
+  [[nodiscard]] auto get_frame_stats() const -> const gpu_scope_stats &;
+
+private:
+  enum class slot_state { free, pending_map, mapping };
+
+  struct readback_slot {
+    wgpu::Buffer buffer;
+    std::vector<std::string> scopes;
+    slot_state state = slot_state::free;
+  };
+
+  struct scope_history {
+    std::array<double, HISTORY_LENGTH> samples{};
+    size_t next = 0;
+    size_t count = 0;
+  };
+
+  // Shared with in-flight map callbacks so they stay valid if the profiler is destroyed first.
+  struct shared_state {
+    std::array<readback_slot, READBACK_FRAMES> slots;
+    std::map<std::string, gpu_scope_stats> stats;
+    std::map<std::string, scope_history> history;
+    gpu_scope_stats frame_stats;
+    scope_history frame_history;
+  };
+
+  struct map_request {
+    std::shared_ptr<shared_state> state;
+    size_t slot;
+  };
+
+  wgpu::Device m_device;
+  wgpu::QuerySet m_query_set;
+  wgpu::Buffer m_resolve_buffer;
+  std::shared_ptr<shared_state> m_state;
+  std::vector<resource_handle> m_resources;
+  std::vector<std::string> m_frame_scopes;
+  std::optional<size_t> m_frame_slot;
+  size_t m_next_slot = 0;
+
+  auto allocate_scope(const std::string &scope) -> std::optional<uint32_t>;
+  static void on_mapped(map_request &request, bool success);
+  static void record_sample(gpu_scope_stats &stats, scope_history &history, double milliseconds);
+};
+
+} // namespace mareweb
+
+#endif // MAREWEB_GPU_PROFILER_HPP
@@ -0,0 +1,31 @@
+#ifndef MAREWEB_KTX2_LOADER_HPP
+#define MAREWEB_KTX2_LOADER_HPP
+
+#include "mareweb/texture.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <webgpu/webgpu_cpp.h>
+
+namespace mareweb {
+
+// Reads KTX2 containers through libktx. Basis Universal payloads (ETC1S and UASTC) are transcoded on the CPU to BC7,
+// ASTC 4x4 or ETC2 depending on what the device supports, and to RGBA8 when it supports none of them. Textures that
+// are already block-compressed are uploaded as stored. Mip levels in the file are kept.
+class ktx2_loader {
+public:
+  // Checks the 12-byte KTX2 file identifier rather than the extension
+  [[nodiscard]] static auto is_ktx2_file(const char *file_path) -> bool;
+  [[nodiscard]] static auto is_ktx2_data(const uint8_t *data, size_t size) -> bool;
+  [[nodiscard]] static auto load(const char *file_path, const texture_compression_support &compression)
+      -> image_data;
+  // Same for a container already in memory, e.g. a pack entry or an image embedded in a glTF binary. label names it in
+  // errors.
+  [[nodiscard]] static auto load(const uint8_t *data, size_t size, const std::string &label,
+                                 const texture_compression_support &compression) -> image_data;
+  [[nodiscard]] static auto is_available() -> bool;
+};
+
+} // namespace mareweb
+
+#endif // MAREWEB_KTX2_LOADER_HPP
@@ -0,0 +1,135 @@
+#ifndef MAREWEB_LIGHT_CLUSTERS_HPP
+#define MAREWEB_LIGHT_CLUSTERS_HPP
+
+#include "mareweb/buffer.hpp"
+#include "mareweb/gpu_profiler.hpp"
+#include "mareweb/shader.hpp"
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <squint/tensor.hpp>
+#include <vector>
+#include <webgpu/webgpu_cpp.h>
+
+namespace mareweb {
+
+// Matches PointLight in CLUSTERED_LIGHTS_WGSL
+struct point_light {
+  squint::vec4 position_range{0.0F, 0.0F, 0.0F, 1.0F}; // world position, w the distance at which it fades to zero
+  squint::vec4 color_intensity{1.0F, 1.0F, 1.0F, 1.0F};
+};
+
+// Matches Clusters in CLUSTERED_LIGHTS_WGSL
+struct cluster_uniforms {
+  squint::mat4 view = squint::mat4::eye();
+  squint::mat4 inverse_projection = squint::mat4::eye();
+  std::array<uint32_t, 4> grid{}; // clusters along x, y and z, then the light count
+  std::array<float, 4> viewport{}; // target width and height, near and far view depth
+};
+
+static_assert(sizeof(point_light) == 32, "must match CLUSTERED_LIGHTS_WGSL");
+static_assert(sizeof(cluster_uniforms) == 160, "must match CLUSTERED_LIGHTS_WGSL");
+
+// Bindings 1 to 4 of group 0 and the lighting function, prepended after FRAME_BINDINGS_WGSL by fragment shaders.
+// surface_lighting returns the light reaching a surface: the directional light and ambient of the frame uniforms plus
+// the point lights assigned to the fragment's cluster.
+constexpr const char *CLUSTERED_LIGHTS_WGSL = R"(
+struct PointLight {
+    position: vec4<f32>,
+    color: vec4<f32>,
+};
+struct Clusters {
+    view: mat4x4<f32>,
+    inverse_projection: mat4x4<f32>,
+    grid: vec4<u32>,
+    viewport: vec4<f32>,
+};
+@group(0) @binding(1) var<uniform> clusters: Clusters;
+@group(0) @binding(2) var<storage, read> point_lights: array<PointLight>;
+@group(0) @binding(3) var<storage, read> cluster_light_counts: array<u32>;
+@group(0) @binding(4) var<storage, read> cluster_light_indices: array<u32>;
+
+const MAX_LIGHTS_PER_CLUSTER: u32 = 128u;
+
+// Screen tiles, then slices spaced logarithmically in view depth between the near and far planes
+fn cluster_index(frag_position: vec4<f32>, view_depth: f32) -> u32 {
+    let grid = clusters.grid.xyz;
+    let tile = min(vec2<u32>(frag_position.xy / clusters.viewport.xy * vec2<f32>(grid.xy)), grid.xy - 1u);
+    let near = clusters.viewport.z;
+    let far = clusters.viewport.w;
+    let slice = log(max(view_depth, near) / near) / log(far / near) * f32(grid.z);
+    return tile.x + tile.y * grid.x + min(u32(slice), grid.z - 1u) * grid.x * grid.y;
+}
+
+fn surface_lighting(world_position: vec3<f32>, world_normal: vec3<f32>, frag_position: vec4<f32>) -> vec3<f32> {
+    let n = normalize(world_normal);
+    let n_dot_l = max(dot(n, normalize(frame.light_direction.xyz)), 0.0);
+    let ambient = frame.light_color.a;
+    var lighting = frame.light_color.rgb * (ambient + n_dot_l * (1.0 - ambient));
+
+    let view_depth = -(frame.view * vec4<f32>(world_position, 1.0)).z;
+    let cluster = cluster_index(frag_position, view_depth);
+    let count = min(cluster_light_counts[cluster], MAX_LIGHTS_PER_CLUSTER);
+    for (var i = 0u; i < count; i++) {
+        let light = point_lights[cluster_light_indices[cluster * MAX_LIGHTS_PER_CLUSTER + i]];
+        let to_light = light.position.xyz - world_position;
+        let distance = max(length(to_light), 1e-4);
+        // Inverse square falloff, windowed so it reaches zero at the light's range
+        let window = clamp(1.0 - pow(distance / light.position.w, 4.0), 0.0, 1.0);
+        let attenuation = window * window / (distance * distance + 1.0);
+        let n_dot_point = max(dot(n, to_light / distance), 0.0);
+        lighting += light.color.rgb * light.color.a * attenuation * n_dot_point;
+    }
+    return lighting;
+}
+)";
+
+// Clustered forward lighting. The view frustum is split into a grid of GRID_X x GRID_Y screen tiles and GRID_Z depth
+// slices. Each frame a compute pass tests every light's sphere against every cluster's view-space box and writes the
+// indices of the lights touching it, so fragment shaders loop over their own cluster's lights only. The light list and
+// the cluster grid are part of the frame bind group.
+class light_clusters {
+public:
+  static constexpr uint32_t GRID_X = 16;
+  static constexpr uint32_t GRID_Y = 9;
+  static constexpr uint32_t GRID_Z = 24;
+  static constexpr uint32_t CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+  static constexpr uint32_t MAX_LIGHTS = 1024;
+  static constexpr uint32_t MAX_LIGHTS_PER_CLUSTER = 128; // matches CLUSTERED_LIGHTS_WGSL
+
+  explicit light_clusters(wgpu::Device &device);
+
+  light_clusters(const light_clusters &) = delete;
+  auto operator=(const light_clusters &) -> light_clusters & = delete;
+  light_clusters(light_clusters &&) = delete;
+  auto operator=(light_clusters &&) -> light_clusters & = delete;
+  ~light_clusters() = default;
+
+  // Layout and bind group entries of bindings 1 to 4 of the frame bind group
+  [[nodiscard]] static auto get_layout_entries() -> std::vector<wgpu::BindGroupLayoutEntry>;
+  [[nodiscard]] auto get_bind_group_entries() const -> std::vector<wgpu::BindGroupEntry>;
+
+  // Replaces the light list. Throws when there are more than MAX_LIGHTS.
+  void set_lights(std::vector<point_light> lights);
+  [[nodiscard]] auto get_lights() const -> const std::vector<point_light> & { return m_lights; }
+  // Uploads the lights and records the assignment pass, ahead of the render passes that read the clusters
+  void assign(wgpu::CommandEncoder &encoder, const squint::mat4 &view, const squint::mat4 &projection, uint32_t width,
+              uint32_t height, gpu_profiler *profiler);
+
+private:
+  wgpu::Device m_device;
+  std::vector<point_light> m_lights;
+  bool m_lights_dirty = false;
+  uint32_t m_assigned_count = 0; // lights in the grid as of the last pass
+  std::unique_ptr<uniform_buffer> m_uniforms;
+  std::unique_ptr<storage_buffer> m_light_buffer;
+  std::unique_ptr<storage_buffer> m_count_buffer;
+  std::unique_ptr<storage_buffer> m_index_buffer;
+  std::unique_ptr<shader> m_shader;
+  wgpu::ComputePipeline m_pipeline;
+  wgpu::BindGroup m_bind_group;
+};
+
+} // namespace mareweb
+
+#endif // MAREWEB_LIGHT_CLUSTERS_HPP
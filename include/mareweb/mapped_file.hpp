@@ -0,0 +1,48 @@
+#ifndef MAREWEB_MAPPED_FILE_HPP
+#define MAREWEB_MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+namespace mareweb {
+
+// Read-only memory mapping of a whole file. The pages are faulted in on first touch, so mapping large files is cheap
+// and data can go from the page cache straight to the upload path. Emscripten maps files out of its in-memory FS.
+class mapped_file {
+public:
+  mapped_file() = default;
+  explicit mapped_file(const std::string &path);
+  ~mapped_file();
+
+  mapped_file(const mapped_file &) = delete;
+  auto operator=(const mapped_file &) -> mapped_file & = delete;
+  mapped_file(mapped_file &&other) noexcept
+      : m_data(std::exchange(other.m_data, nullptr)), m_size(std::exchange(other.m_size, 0))
+#ifdef _WIN32
+        ,
+        m_file(std::exchange(other.m_file, nullptr)), m_mapping(std::exchange(other.m_mapping, nullptr))
+#endif
+  {
+  }
+  auto operator=(mapped_file &&other) noexcept -> mapped_file &;
+
+  [[nodiscard]] auto data() const -> const uint8_t * { return m_data; }
+  [[nodiscard]] auto size() const -> size_t { return m_size; }
+  [[nodiscard]] auto is_open() const -> bool { return m_data != nullptr; }
+
+private:
+  const uint8_t *m_data = nullptr;
+  size_t m_size = 0;
+#ifdef _WIN32
+  void *m_file = nullptr;
+  void *m_mapping = nullptr;
+#endif
+
+  void close();
+};
+
+} // namespace mareweb
+
+#endif // MAREWEB_MAPPED_FILE_HPP
@@ -2,8 +2,10 @@
 #define MAREWEB_MATERIAL_HPP
 
 #include "mareweb/buffer.hpp"
+#include "mareweb/frame_bindings.hpp"
 #include "mareweb/pipeline.hpp"
 #include "mareweb/shader.hpp"
+#include "mareweb/uniform_block.hpp"
 #include <memory>
 #include <string>
 #include <variant>
@@ -18,8 +20,9 @@ struct binding_info {
 };
 
 // Specific binding types
-struct uniform_binding : binding_info {
-  size_t size;
+// All of a material's uniform parameters, packed into one buffer. A material has at most one.
+struct uniform_block_binding : binding_info {
+  uniform_block_layout layout;
 };
 
 struct texture_binding : binding_info {
@@ -40,17 +43,25 @@ struct storage_binding : binding_info {
 };
 
 // Use variant to store different binding types
-using binding_resource = std::variant<uniform_binding, texture_binding, sampler_binding, storage_binding>;
+using binding_resource = std::variant<uniform_block_binding, texture_binding, sampler_binding, storage_binding>;
 
 struct pipeline_key {
   wgpu::PrimitiveTopology topology;
   wgpu::IndexFormat strip_index_format;
   wgpu::FrontFace front_face;
   wgpu::CullMode cull_mode;
+  // Vertex buffer layout, which differs between meshes sharing the material
+  bool has_normals;
+  bool has_texcoords;
+  bool has_colors;
+  bool has_instance_data;
+  depth_mode depth;
 
   bool operator==(const pipeline_key &other) const {
     return topology == other.topology && strip_index_format == other.strip_index_format &&
-           front_face == other.front_face && cull_mode == other.cull_mode;
+           front_face == other.front_face && cull_mode == other.cull_mode && has_normals == other.has_normals &&
+           has_texcoords == other.has_texcoords && has_colors == other.has_colors &&
+           has_instance_data == other.has_instance_data && depth == other.depth;
   }
 };
 
@@ -60,7 +71,11 @@ struct pipeline_key_hash {
     std::size_t h2 = std::hash<int>()(static_cast<int>(k.strip_index_format));
     std::size_t h3 = std::hash<int>()(static_cast<int>(k.front_face));
     std::size_t h4 = std::hash<int>()(static_cast<int>(k.cull_mode));
-    return h1 ^ (h2 << 1) ^ (h3 << 2) ^ (h4 << 3);
+    std::size_t h5 = (static_cast<std::size_t>(k.has_normals) << 0) | (static_cast<std::size_t>(k.has_texcoords) << 1) |
+                     (static_cast<std::size_t>(k.has_colors) << 2) |
+                     (static_cast<std::size_t>(k.has_instance_data) << 3) |
+                     (static_cast<std::size_t>(k.depth) << 4);
+    return h1 ^ (h2 << 1) ^ (h3 << 2) ^ (h4 << 3) ^ (h5 << 4);
   }
 };
 
@@ -69,6 +84,8 @@ struct vertex_requirements {
   bool needs_normal = false;
   bool needs_texcoord = false;
   bool needs_color = false;
+  // Reads instance_records from a vertex buffer stepped per instance rather than from storage
+  bool needs_instance_data = false;
 
   // Check if a vertex state satisfies these requirements
   bool is_satisfied_by(const vertex_state &state) const {
@@ -87,30 +104,39 @@ struct vertex_requirements {
   static vertex_requirements with_normals_and_texcoords() { return vertex_requirements{true, true, true, false}; }
 };
 
-namespace uniform_locations {
-constexpr uint32_t MVP_MATRIX = 0;
-constexpr uint32_t NORMAL_MATRIX = 1;
-// Add more uniform locations as needed
-} // namespace uniform_locations
-
+// A shader pair plus the resources in its bind group 1. Group 0 (frame) and group 2 (draw) are owned by the renderer's
+// frame_bindings, so one material can be shared by any number of renderables.
 class material {
 public:
   material(wgpu::Device &device, const std::string &vertex_shader_source, const std::string &fragment_shader_source,
            wgpu::TextureFormat surface_format, uint32_t sample_count, const std::vector<binding_resource> &bindings,
-           const vertex_requirements &requirements);
+           const vertex_requirements &requirements, alpha_mode mode = alpha_mode::opaque);
 
-  void bind(wgpu::RenderPassEncoder &pass_encoder, const wgpu::PrimitiveState &primitive_state,
-            const vertex_state &mesh_vertex_state);
-  void update_uniform(uint32_t binding, const void *data);
+  // Sets the pipeline and group 1, skipping whichever of them is already bound in the pass
+  void bind(wgpu::RenderPassEncoder &pass_encoder, pass_bindings &bindings, const wgpu::PrimitiveState &primitive_state,
+            const vertex_state &mesh_vertex_state, depth_mode depth = depth_mode::test_and_write);
+  // Field indices follow the order of the uniform_block_layout. Written to the GPU once per frame.
+  template <typename T> void set_uniform(uint32_t field, const T &value) { get_uniforms().set(field, value); }
   void update_texture(uint32_t binding, wgpu::TextureView texture_view);
   void update_sampler(uint32_t binding, wgpu::Sampler sampler);
   void update_instance_buffer(wgpu::Buffer buffer, size_t size);
   [[nodiscard]] const vertex_requirements &get_requirements() const { return m_requirements; }
+  // Fixed at construction, as the fragment shader is built for it
+  [[nodiscard]] auto get_alpha_mode() const -> alpha_mode { return m_alpha_mode; }
+  // Masked materials only. The cutoff is a pipeline constant, so changing it recreates the pipelines.
+  void set_alpha_cutoff(float cutoff);
+  [[nodiscard]] auto get_alpha_cutoff() const -> float { return m_alpha_cutoff; }
+  // True when the vertex shader outputs clip_position() through an @invariant position, so the depth pre-pass
+  // reproduces its depth exactly. Only such opaque materials are drawn in the pre-pass.
+  [[nodiscard]] auto supports_depth_prepass() const -> bool { return m_supports_depth_prepass; }
+  // Throws std::runtime_error if the material has no uniform block
+  [[nodiscard]] auto get_uniforms() -> uniform_block &;
 
 protected:
   wgpu::Device &get_device() { return m_device; }
-  auto get_or_create_pipeline(const wgpu::PrimitiveState &primitive_state,
-                              const vertex_state &mesh_vertex_state) -> pipeline &;
+  void set_supports_depth_prepass(bool supported) { m_supports_depth_prepass = supported; }
+  auto get_or_create_pipeline(const wgpu::PrimitiveState &primitive_state, const vertex_state &mesh_vertex_state,
+                              depth_mode depth = depth_mode::test_and_write) -> pipeline &;
 
 private:
   wgpu::Device m_device;
@@ -120,17 +146,24 @@ private:
   uint32_t m_sample_count;
   std::vector<binding_resource> m_bindings;
   vertex_requirements m_requirements;
+  alpha_mode m_alpha_mode;
+  float m_alpha_cutoff = 0.5F;
+  bool m_supports_depth_prepass = false;
 
   std::unique_ptr<shader> m_vertex_shader;
   std::unique_ptr<shader> m_fragment_shader;
   std::unordered_map<pipeline_key, std::unique_ptr<pipeline>, pipeline_key_hash> m_pipelines;
-  std::unordered_map<uint32_t, std::unique_ptr<uniform_buffer>> m_uniform_buffers;
-  std::unordered_map<uint32_t, size_t> m_uniform_sizes;
+  std::unique_ptr<uniform_block> m_uniforms;
+  // Shared through the bind_group_cache, so every pipeline of every material with the same bindings uses one layout
+  wgpu::BindGroupLayout m_bind_group_layout;
+  wgpu::BindGroup m_bind_group;
+  bool m_bind_group_dirty = true;
 
   void create_shaders();
   void create_buffers();
   auto create_bind_group_layout_entries() const -> std::vector<wgpu::BindGroupLayoutEntry>;
   auto create_bind_group_entries() const -> std::vector<wgpu::BindGroupEntry>;
+  void invalidate_bind_group() { m_bind_group_dirty = true; }
 };
 
 } // namespace mareweb
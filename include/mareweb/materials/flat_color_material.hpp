@@ -12,105 +12,76 @@ using namespace squint;
 
 class flat_color_material : public material {
 public:
+  // Pass alpha_mode::blended or weighted_blended for translucent colors, the other modes write the color's alpha
+  // without blending
   flat_color_material(wgpu::Device &device, wgpu::TextureFormat surface_format, uint32_t sample_count,
-                      const vec4 &color)
-      : material(device, get_vertex_shader(), get_fragment_shader(), surface_format, sample_count, get_bindings(),
-                 vertex_requirements::with_normals()) {
+                      const vec4 &color, alpha_mode mode = alpha_mode::opaque)
+      : material(device, get_vertex_shader(), get_fragment_shader(mode), surface_format, sample_count, get_bindings(),
+                 vertex_requirements::with_normals(), mode) {
     // Initialize color
     update_color(color);
-
-    // Initialize light direction
-    vec3 light_dir{1.0f, 1.0f, 1.0f};
-    light_dir = normalize(light_dir);
-    update_light_direction(light_dir);
+    set_supports_depth_prepass(true);
   }
 
-  void update_color(const vec4 &color) { update_uniform(2, &color); }
+  // Fields of the uniform block, in layout order
+  static constexpr uint32_t COLOR = 0;
 
-  void update_light_direction(const vec3 &light_dir) {
-    // In WGSL (column-major), vec3 needs to be stored as vec4 (16 bytes)
-    vec4 light_dir_padded{light_dir[0], light_dir[1], light_dir[2], 0.0f};
-    update_uniform(3, &light_dir_padded);
-  }
+  void update_color(const vec4 &color) { set_uniform(COLOR, color); }
 
 private:
   static std::string get_vertex_shader() {
-    return R"(
-            @group(0) @binding(0) var<uniform> mvp: mat4x4<f32>;
-            @group(0) @binding(1) var<uniform> normal_matrix: mat3x3<f32>;
-
+    return std::string(FRAME_BINDINGS_WGSL) + DRAW_BINDINGS_WGSL + CLIP_POSITION_WGSL + R"(
             struct VertexInput {
                 @location(0) position: vec3<f32>,
                 @location(1) normal: vec3<f32>,
             };
 
             struct VertexOutput {
-                @builtin(position) position: vec4<f32>,
+                @builtin(position) @invariant position: vec4<f32>,
                 @location(0) world_normal: vec3<f32>,
+                @location(1) world_position: vec3<f32>,
             };
 
             @vertex
             fn main(in: VertexInput) -> VertexOutput {
                 var out: VertexOutput;
-                out.position = mvp * vec4<f32>(in.position, 1.0);
-                out.world_normal = normalize(normal_matrix * in.normal);
+                out.position = clip_position(in.position);
+                out.world_normal = normalize(draw_data.normal_matrix * in.normal);
+                out.world_position = (draw_data.model * vec4<f32>(in.position, 1.0)).xyz;
                 return out;
             }
         )";
   }
 
-  static std::string get_fragment_shader() {
-    return R"(
-            @group(0) @binding(2) var<uniform> color: vec4<f32>;
-            @group(0) @binding(3) var<uniform> light_direction: vec3<f32>;
+  static std::string get_fragment_shader(alpha_mode mode) {
+    return std::string(FRAME_BINDINGS_WGSL) + CLUSTERED_LIGHTS_WGSL + get_uniform_layout().to_wgsl("Material") +
+           alpha_test_wgsl(mode) + fragment_output_wgsl(mode) + R"(
+            @group(1) @binding(0) var<uniform> material: Material;
 
             @fragment
-            fn main(@location(0) world_normal: vec3<f32>) -> @location(0) vec4<f32> {
-                // Calculate lighting
-                let n_dot_l = max(dot(normalize(world_normal), normalize(light_direction)), 0.0);
-                let ambient = 0.2;
-                let diffuse = n_dot_l;
-                let lighting = ambient + diffuse * 0.8;
-                
+            fn main(@builtin(position) position: vec4<f32>, @location(0) world_normal: vec3<f32>,
+                    @location(1) world_position: vec3<f32>) -> FragmentOutput {
+                let lighting = surface_lighting(world_position, world_normal, position);
+
                 // Combine lighting with base color
-                return vec4<f32>(color.rgb * lighting, color.a);
+                alpha_test(material.color.a);
+                return fragment_output(vec4<f32>(material.color.rgb * lighting, material.color.a), position);
             }
         )";
   }
 
+  static auto get_uniform_layout() -> uniform_block_layout {
+    return uniform_block_layout().add("color", uniform_type::vec4);
+  }
+
   static auto get_bindings() -> std::vector<binding_resource> {
-    // MVP matrix binding
-    uniform_binding mvp_binding;
-    mvp_binding.binding = 0;
-    mvp_binding.visibility = wgpu::ShaderStage::Vertex;
-    mvp_binding.size = sizeof(mat4);
-
-    // Normal matrix binding
-    uniform_binding normal_matrix_binding;
-    normal_matrix_binding.binding = 1;
-    normal_matrix_binding.visibility = wgpu::ShaderStage::Vertex;
-    // In WGSL (column-major), mat3x3 needs to be stored as 3 columns of vec4 (3 * 16 = 48 bytes)
-    normal_matrix_binding.size = sizeof(mat4x3);
-
-    // Color binding
-    uniform_binding color_binding;
-    color_binding.binding = 2;
-    color_binding.visibility = wgpu::ShaderStage::Fragment;
-    color_binding.size = sizeof(vec4);
-
-    // Light direction binding
-    uniform_binding light_binding;
-    light_binding.binding = 3;
-    light_binding.visibility = wgpu::ShaderStage::Fragment;
-    // In WGSL (column-major), vec3 needs to be stored as vec4 (16 bytes)
-    light_binding.size = sizeof(vec4);
-
-    return {
-        std::move(mvp_binding),
-        std::move(normal_matrix_binding),
-        std::move(color_binding),
-        std::move(light_binding),
-    };
+    // Uniform block binding
+    uniform_block_binding uniforms;
+    uniforms.binding = 0;
+    uniforms.visibility = wgpu::ShaderStage::Fragment;
+    uniforms.layout = get_uniform_layout();
+
+    return {std::move(uniforms)};
   }
 };
 
@@ -10,120 +10,125 @@
 namespace mareweb {
 using namespace squint;
 
+// Flat shading for instanced_renderable. Each instance's instance_attributes::color tints the material color, so a
+// single draw can show any number of colors. With instance_input::vertex_buffer the instances arrive as vertex
+// attributes and the material binds no instance buffer of its own, so it can be shared between instanced_renderables.
+// Translucent instances want alpha_mode::weighted_blended, which needs no sorting of the instances.
 class instanced_flat_color_material : public material {
 public:
   instanced_flat_color_material(wgpu::Device &device, wgpu::TextureFormat surface_format, uint32_t sample_count,
-                                const vec4 &color)
-      : material(device, get_vertex_shader(), get_fragment_shader(), surface_format, sample_count, get_bindings(),
-                 vertex_requirements::with_normals()) {
+                                const vec4 &color, instance_input input = instance_input::storage_buffer,
+                                alpha_mode mode = alpha_mode::opaque)
+      : material(device, get_vertex_shader(input), get_fragment_shader(mode), surface_format, sample_count,
+                 get_bindings(input), get_vertex_requirements(input), mode) {
     // Initialize color
     update_color(color);
-
-    // Initialize light direction
-    vec3 light_dir{1.0f, 1.0f, 1.0f};
-    light_dir = normalize(light_dir);
-    update_light_direction(light_dir);
   }
 
-  void update_color(const vec4 &color) { update_uniform(2, &color); }
+  // Fields of the uniform block, in layout order
+  static constexpr uint32_t COLOR = 0;
 
-  void update_light_direction(const vec3 &light_dir) {
-    vec4 light_dir_padded{light_dir[0], light_dir[1], light_dir[2], 0.0f};
-    update_uniform(3, &light_dir_padded);
-  }
+  void update_color(const vec4 &color) { set_uniform(COLOR, color); }
 
 private:
-  static std::string get_vertex_shader() {
-    return R"(
-            @group(0) @binding(0) var<uniform> mvp: mat4x4<f32>;
-            @group(0) @binding(1) var<uniform> normal_matrix: mat3x3<f32>;
-            @group(0) @binding(4) var<storage, read> instances: array<mat4x4<f32>>;
-
+  static std::string get_vertex_shader(instance_input input) {
+    // Only where the instance comes from differs, the entry point body is shared
+    std::string instance_source;
+    std::string instance_parameter;
+    std::string instance_expression;
+    if (input == instance_input::vertex_buffer) {
+      instance_source = INSTANCE_VERTEX_INPUT_WGSL;
+      instance_parameter = ", instance_in: InstanceInput";
+      instance_expression = "load_instance(instance_in)";
+    } else {
+      instance_source = "@group(1) @binding(1) var<storage, read> instances: array<Instance>;\n";
+      instance_parameter = ", @builtin(instance_index) instance_idx: u32";
+      instance_expression = "instances[instance_idx]";
+    }
+
+    return std::string(FRAME_BINDINGS_WGSL) + DRAW_BINDINGS_WGSL + INSTANCE_DATA_WGSL + instance_source + R"(
             struct VertexInput {
                 @location(0) position: vec3<f32>,
                 @location(1) normal: vec3<f32>,
-                @builtin(instance_index) instance_idx: u32,
             };
 
             struct VertexOutput {
                 @builtin(position) position: vec4<f32>,
                 @location(0) world_normal: vec3<f32>,
+                @location(1) color: vec4<f32>,
+                @location(2) world_position: vec3<f32>,
             };
 
             @vertex
-            fn main(in: VertexInput) -> VertexOutput {
+            fn main(in: VertexInput)" + instance_parameter + R"() -> VertexOutput {
                 var out: VertexOutput;
-                let instance_transform = instances[in.instance_idx];
-                
-                // Apply instance transform first, then MVP
-                out.position = mvp * instance_transform * vec4<f32>(in.position, 1.0);
-                
-                // Transform normal by both instance and global normal matrices
-                out.world_normal = normalize(normal_matrix * in.normal);
+                let instance = )" + instance_expression + R"(;
+
+                // Apply instance transform first, then the renderable's model and the camera
+                let world_position = draw_data.model * instance.model * vec4<f32>(in.position, 1.0);
+                out.position = frame.view_projection * world_position;
+
+                // Rotate the normal by the instance, then by the renderable's normal matrix
+                let instance_normal = (instance.model * vec4<f32>(in.normal, 0.0)).xyz;
+                out.world_normal = normalize(draw_data.normal_matrix * instance_normal);
+                out.color = instance.color;
+                out.world_position = world_position.xyz;
                 return out;
             }
         )";
   }
 
-  static std::string get_fragment_shader() {
-    return R"(
-            @group(0) @binding(2) var<uniform> color: vec4<f32>;
-            @group(0) @binding(3) var<uniform> light_direction: vec3<f32>;
+  static std::string get_fragment_shader(alpha_mode mode) {
+    return std::string(FRAME_BINDINGS_WGSL) + CLUSTERED_LIGHTS_WGSL + get_uniform_layout().to_wgsl("Material") +
+           alpha_test_wgsl(mode) + fragment_output_wgsl(mode) + R"(
+            @group(1) @binding(0) var<uniform> material: Material;
 
             @fragment
-            fn main(@location(0) world_normal: vec3<f32>) -> @location(0) vec4<f32> {
-                // Calculate lighting
-                let n_dot_l = max(dot(normalize(world_normal), normalize(light_direction)), 0.0);
-                let ambient = 0.2;
-                let diffuse = n_dot_l;
-                let lighting = ambient + diffuse * 0.8;
-                
-                // Combine lighting with base color
-                return vec4<f32>(color.rgb * lighting, color.a);
+            fn main(@builtin(position) position: vec4<f32>, @location(0) world_normal: vec3<f32>,
+                    @location(1) instance_color: vec4<f32>, @location(2) world_position: vec3<f32>)
+                -> FragmentOutput {
+                let lighting = surface_lighting(world_position, world_normal, position);
+
+                // Tint the material color by the instance's own color
+                let color = material.color * instance_color;
+                alpha_test(color.a);
+                return fragment_output(vec4<f32>(color.rgb * lighting, color.a), position);
             }
         )";
   }
 
-  static auto get_bindings() -> std::vector<binding_resource> {
-    // MVP matrix binding
-    uniform_binding mvp_binding;
-    mvp_binding.binding = 0;
-    mvp_binding.visibility = wgpu::ShaderStage::Vertex;
-    mvp_binding.size = sizeof(mat4);
-
-    // Normal matrix binding
-    uniform_binding normal_matrix_binding;
-    normal_matrix_binding.binding = 1;
-    normal_matrix_binding.visibility = wgpu::ShaderStage::Vertex;
-    normal_matrix_binding.size = sizeof(mat4x3);
-
-    // Color binding
-    uniform_binding color_binding;
-    color_binding.binding = 2;
-    color_binding.visibility = wgpu::ShaderStage::Fragment;
-    color_binding.size = sizeof(vec4);
-
-    // Light direction binding
-    uniform_binding light_binding;
-    light_binding.binding = 3;
-    light_binding.visibility = wgpu::ShaderStage::Fragment;
-    light_binding.size = sizeof(vec4);
+  static auto get_uniform_layout() -> uniform_block_layout {
+    return uniform_block_layout().add("color", uniform_type::vec4);
+  }
+
+  static auto get_vertex_requirements(instance_input input) -> vertex_requirements {
+    vertex_requirements requirements = vertex_requirements::with_normals();
+    requirements.needs_instance_data = input == instance_input::vertex_buffer;
+    return requirements;
+  }
+
+  static auto get_bindings(instance_input input) -> std::vector<binding_resource> {
+    // Uniform block binding
+    uniform_block_binding uniforms;
+    uniforms.binding = 0;
+    uniforms.visibility = wgpu::ShaderStage::Fragment;
+    uniforms.layout = get_uniform_layout();
+    if (input == instance_input::vertex_buffer) {
+      return {std::move(uniforms)};
+    }
 
     // Instance buffer binding
     storage_binding instance_binding;
-    instance_binding.binding = 4;
+    instance_binding.binding = 1;
     instance_binding.visibility = wgpu::ShaderStage::Vertex;
     instance_binding.type = wgpu::BufferBindingType::ReadOnlyStorage;
     instance_binding.buffer = nullptr;
     instance_binding.size = 0;
 
-    return {
-        std::move(mvp_binding),   std::move(normal_matrix_binding), std::move(color_binding),
-        std::move(light_binding), std::move(instance_binding),
-    };
+    return {std::move(uniforms), std::move(instance_binding)};
   }
 };
 
 } // namespace mareweb
 
-#endif // MAREWEB_INSTANCED_FLAT_COLOR_MATERIAL_HPP
\ No newline at end of file
+#endif // MAREWEB_INSTANCED_FLAT_COLOR_MATERIAL_HPP
@@ -2,64 +2,95 @@
 #define MAREWEB_MESH_HPP
 
 #include "mareweb/buffer.hpp"
+#include "mareweb/geometry_arena.hpp"
 #include "mareweb/material.hpp"
 #include "mareweb/pipeline.hpp"
 #include "mareweb/vertex_attributes.hpp"
 #include "webgpu/webgpu_cpp.h"
+#include <array>
+#include <cstdint>
 #include <memory>
 #include <vector>
 
 namespace mareweb {
 
+// Object-space axis-aligned bounding box of a mesh's positions
+struct mesh_bounds {
+  std::array<float, 3> min;
+  std::array<float, 3> max;
+
+  [[nodiscard]] static auto compute(const void *vertex_data, uint32_t vertex_count, const vertex_layout &layout)
+      -> mesh_bounds;
+};
+
 class mesh {
 public:
   // Constructor for fully specified vertex data
   mesh(wgpu::Device &device, const wgpu::PrimitiveState &primitive_state, const std::vector<vertex> &vertices,
        const vertex_layout &layout, const std::vector<uint32_t> &indices = {});
+  // Constructor for vertex data already interleaved with the layout's stride, uploaded without conversion
+  mesh(wgpu::Device &device, const wgpu::PrimitiveState &primitive_state, const void *vertex_data,
+       uint32_t vertex_count, const vertex_layout &layout, const uint32_t *indices = nullptr, uint32_t index_count = 0,
+       const mesh_bounds *bounds = nullptr);
+  // Constructor for geometry a decoder already wrote into staging from upload_manager::reserve(size), committed
+  // straight into the arena. An empty index span draws unindexed.
+  mesh(wgpu::Device &device, const wgpu::PrimitiveState &primitive_state, upload_span vertices, uint32_t vertex_count,
+       const vertex_layout &layout, upload_span indices, uint32_t index_count, const mesh_bounds &bounds);
 
   mesh(const mesh &other) = delete;
   auto operator=(const mesh &other) -> mesh & = delete;
   mesh(mesh &&other) noexcept
-      : m_vertex_buffer(std::move(other.m_vertex_buffer)), m_index_buffer(std::move(other.m_index_buffer)),
-        m_vertex_layout(std::move(other.m_vertex_layout)), m_primitive_state(other.m_primitive_state) {}
+      : m_vertices(std::move(other.m_vertices)), m_indices(std::move(other.m_indices)),
+        m_vertex_layout(std::move(other.m_vertex_layout)), m_primitive_state(other.m_primitive_state),
+        m_bounds(other.m_bounds) {}
   auto operator=(mesh &&other) noexcept -> mesh & {
     if (this != &other) {
-      m_vertex_buffer = std::move(other.m_vertex_buffer);
-      m_index_buffer = std::move(other.m_index_buffer);
+      m_vertices = std::move(other.m_vertices);
+      m_indices = std::move(other.m_indices);
       m_vertex_layout = std::move(other.m_vertex_layout);
       m_primitive_state = other.m_primitive_state;
+      m_bounds = other.m_bounds;
     }
     return *this;
   }
   virtual ~mesh() = default;
 
-  [[nodiscard]] auto get_vertex_buffer() const -> const vertex_buffer & { return *m_vertex_buffer; }
-  [[nodiscard]] auto get_index_buffer() const -> const index_buffer * { return m_index_buffer.get(); }
   [[nodiscard]] auto get_vertex_layout() const -> const vertex_layout & { return m_vertex_layout; }
   [[nodiscard]] auto get_vertex_count() const -> uint32_t;
   [[nodiscard]] auto get_index_count() const -> uint32_t;
   [[nodiscard]] auto get_primitive_state() const -> const wgpu::PrimitiveState & { return m_primitive_state; }
+  [[nodiscard]] auto get_bounds() const -> const mesh_bounds & { return m_bounds; }
   [[nodiscard]] auto get_vertex_state() const -> vertex_state {
     vertex_state state;
     state.has_normals = m_vertex_layout.has_normals();
     state.has_texcoords = m_vertex_layout.has_texcoords();
     state.has_colors = m_vertex_layout.has_colors();
-    state.is_indexed = m_index_buffer != nullptr;
+    state.is_indexed = m_indices.is_valid();
     return state;
   }
 
-  void bind_material(material &material, wgpu::RenderPassEncoder &pass_encoder) const;
+  void bind_material(material &material, wgpu::RenderPassEncoder &pass_encoder, pass_bindings &bindings,
+                     depth_mode depth = depth_mode::test_and_write) const;
+  // Interleaves the attributes the layout contains, in the layout's stride
+  [[nodiscard]] static auto pack_vertices(const std::vector<vertex> &vertices, const vertex_layout &layout)
+      -> std::vector<uint8_t>;
+  // Binds the arena pages holding this mesh (unless already bound) and draws it from its offsets
+  void draw(wgpu::RenderPassEncoder &pass_encoder, geometry_bindings &bindings, uint32_t instance_count = 1) const;
 
-  auto get_vertex_buffer() -> wgpu::Buffer { return m_vertex_buffer->get_buffer(); }
-  auto get_index_buffer() -> wgpu::Buffer { return m_index_buffer->get_buffer(); }
+  // Geometry lives in shared geometry_arena pages, so draws must start at the base vertex / first index
+  [[nodiscard]] auto get_vertex_buffer() const -> wgpu::Buffer { return m_vertices.get_buffer(); }
+  [[nodiscard]] auto get_index_buffer() const -> wgpu::Buffer {
+    return m_indices.is_valid() ? m_indices.get_buffer() : nullptr;
+  }
+  [[nodiscard]] auto get_base_vertex() const -> uint32_t { return m_vertices.get_offset(); }
+  [[nodiscard]] auto get_first_index() const -> uint32_t { return m_indices.is_valid() ? m_indices.get_offset() : 0; }
 
 private:
-  std::unique_ptr<vertex_buffer> m_vertex_buffer;
-  std::unique_ptr<index_buffer> m_index_buffer;
+  geometry_allocation m_vertices;
+  geometry_allocation m_indices;
   vertex_layout m_vertex_layout;
   wgpu::PrimitiveState m_primitive_state;
-
-  void create_vertex_buffer(wgpu::Device &device, const std::vector<vertex> &vertices, const vertex_layout &layout);
+  mesh_bounds m_bounds{};
 };
 
 } // namespace mareweb
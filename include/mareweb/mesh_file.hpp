@@ -0,0 +1,66 @@
+#ifndef MAREWEB_MESH_FILE_HPP
+#define MAREWEB_MESH_FILE_HPP
+
+#include "mareweb/mapped_file.hpp"
+#include "mareweb/mesh.hpp"
+#include "mareweb/vertex_attributes.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <webgpu/webgpu_cpp.h>
+
+namespace mareweb {
+
+// Binary mesh format (.mwm) laid out exactly as the GPU consumes it, so loading is a mmap plus one upload with no
+// parsing or per-vertex conversion. Little-endian:
+//
+//   header                  magic "MWM1", version, primitive state, counts, blob offsets, bounds
+//   attribute table         attribute_count entries of {location, format, offset, reserved}, in the order the
+//                           stock pipelines expect: POSITION Float32x3, then any of NORMAL Float32x3,
+//                           TEXCOORD Float32x2 and COLOR Float32x4
+//   vertex blob             vertex_count * stride bytes, interleaved, 64-byte aligned
+//   index blob              index_count uint32 indices, 64-byte aligned
+//
+// Enums are stored as the format's own codes rather than WebGPU values, which are not stable across API revisions.
+class mesh_file {
+public:
+  // Maps and validates the file, throwing std::runtime_error if it is not a well formed .mwm
+  explicit mesh_file(const std::string &path);
+
+  [[nodiscard]] auto get_primitive_state() const -> wgpu::PrimitiveState;
+  [[nodiscard]] auto get_layout() const -> const vertex_layout & { return m_layout; }
+  [[nodiscard]] auto get_vertex_data() const -> const void * { return m_vertex_data; }
+  [[nodiscard]] auto get_vertex_count() const -> uint32_t { return m_vertex_count; }
+  [[nodiscard]] auto get_indices() const -> const uint32_t * { return m_indices; }
+  [[nodiscard]] auto get_index_count() const -> uint32_t { return m_index_count; }
+  [[nodiscard]] auto get_bounds() const -> const mesh_bounds & { return m_bounds; }
+
+  // Offline conversion: writes interleaved vertex data (packed in the layout's stride) and indices to path
+  static void write(const std::string &path, const wgpu::PrimitiveState &primitive_state, const void *vertex_data,
+                    uint32_t vertex_count, const vertex_layout &layout, const uint32_t *indices = nullptr,
+                    uint32_t index_count = 0);
+  // Same, from the vertex structs the procedural and array meshes are built from
+  static void write(const std::string &path, const wgpu::PrimitiveState &primitive_state,
+                    const std::vector<vertex> &vertices, const vertex_layout &layout,
+                    const std::vector<uint32_t> &indices = {});
+
+  static constexpr uint32_t VERSION = 1;
+  static constexpr uint64_t BLOB_ALIGNMENT = 64;
+
+private:
+  mapped_file m_file;
+  uint32_t m_topology = 0;
+  uint32_t m_strip_index_format = 0;
+  uint32_t m_front_face = 0;
+  uint32_t m_cull_mode = 0;
+  vertex_layout m_layout;
+  const void *m_vertex_data = nullptr;
+  uint32_t m_vertex_count = 0;
+  const uint32_t *m_indices = nullptr;
+  uint32_t m_index_count = 0;
+  mesh_bounds m_bounds{};
+};
+
+} // namespace mareweb
+
+#endif // MAREWEB_MESH_FILE_HPP
@@ -0,0 +1,25 @@
+#ifndef MAREWEB_FILE_MESH_HPP
+#define MAREWEB_FILE_MESH_HPP
+
+#include "mareweb/mesh.hpp"
+#include "mareweb/mesh_file.hpp"
+#include <string>
+
+namespace mareweb {
+
+class file_mesh : public mesh {
+public:
+  /**
+   * Loads a binary .mwm mesh. The vertex and index blobs are uploaded straight from the mapped file and the mapping
+   * is released once the mesh is constructed.
+   */
+  file_mesh(wgpu::Device &device, const std::string &path) : file_mesh(device, mesh_file(path)) {}
+
+  file_mesh(wgpu::Device &device, const mesh_file &file)
+      : mesh(device, file.get_primitive_state(), file.get_vertex_data(), file.get_vertex_count(), file.get_layout(),
+             file.get_indices(), file.get_index_count(), &file.get_bounds()) {}
+};
+
+} // namespace mareweb
+
+#endif // MAREWEB_FILE_MESH_HPP
@@ -0,0 +1,60 @@
+#ifndef MAREWEB_MIPMAP_GENERATOR_HPP
+#define MAREWEB_MIPMAP_GENERATOR_HPP
+
+#include "mareweb/shader.hpp"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+#include <webgpu/webgpu_cpp.h>
+
+namespace mareweb {
+
+enum class mipmap_filter {
+  none,       // a single level
+  gpu,        // bilinear downsample blits on the device
+  cpu_box,    // 2x2 box filter on the CPU
+  cpu_kaiser, // Kaiser-windowed sinc on the CPU, sharper than the box filter at some CPU cost
+};
+
+// One tightly packed RGBA8 mip level.
+struct mip_level {
+  uint32_t width;
+  uint32_t height;
+  std::vector<uint8_t> pixels;
+};
+
+// Builds mip chains for RGBA8 textures.
+//
+// The GPU path renders each level from the previous one with a fullscreen triangle. Color textures are downsampled
+// through an sRGB view so filtering happens in linear space; the texture itself keeps its linear format, which means
+// it has to list the sRGB format in viewFormats and be created with RenderAttachment usage.
+class mipmap_generator {
+public:
+  explicit mipmap_generator(wgpu::Device &device);
+
+  // Returns the generator for this device, creating it on first use.
+  static auto get(wgpu::Device &device) -> mipmap_generator &;
+
+  [[nodiscard]] static auto get_mip_level_count(uint32_t width, uint32_t height) -> uint32_t;
+  // Fills levels 1..mip_level_count-1 of a texture whose level 0 has already been uploaded.
+  void generate(const wgpu::Texture &texture, wgpu::TextureFormat view_format, uint32_t mip_level_count);
+  // Returns levels 1..n of a tightly or loosely packed RGBA8 image. Color channels are filtered in linear space when
+  // srgb is set; alpha is always filtered linearly.
+  [[nodiscard]] static auto generate_cpu(const uint8_t *pixels, uint32_t width, uint32_t height, size_t row_pitch,
+                                         bool srgb, mipmap_filter filter) -> std::vector<mip_level>;
+
+private:
+  wgpu::Device m_device;
+  std::unique_ptr<shader> m_shader;
+  wgpu::BindGroupLayout m_bind_group_layout;
+  wgpu::PipelineLayout m_pipeline_layout;
+  wgpu::Sampler m_sampler;
+  std::map<wgpu::TextureFormat, wgpu::RenderPipeline> m_pipelines;
+
+  auto get_pipeline(wgpu::TextureFormat format) -> wgpu::RenderPipeline;
+};
+
+} // namespace mareweb
+
+#endif // MAREWEB_MIPMAP_GENERATOR_HPP
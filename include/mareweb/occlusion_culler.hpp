@@ -0,0 +1,120 @@
+#ifndef MAREWEB_OCCLUSION_CULLER_HPP
+#define MAREWEB_OCCLUSION_CULLER_HPP
+
+#include "mareweb/gpu_profiler.hpp"
+#include "mareweb/mesh.hpp"
+#include "mareweb/resource_registry.hpp"
+#include "mareweb/shader.hpp"
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <squint/tensor.hpp>
+#include <vector>
+#include <webgpu/webgpu_cpp.h>
+
+namespace mareweb {
+
+enum class cull_result : uint8_t { visible, outside_frustum, occluded };
+
+// Culls draws against the view frustum and a hierarchical-Z pyramid of depth from earlier frames.
+//
+// build() records a compute pass that max-reduces the depth texture into a chain of R32Float levels, each texel holding
+// the farthest depth under its footprint, and copies the first level at most MAX_READBACK_WIDTH wide into a ring of
+// readback buffers. They are mapped asynchronously like the gpu_profiler's, so test() compares against depth that is
+// a few frames old, projected with the view-projection it was rendered with. A box whose nearest point lies behind
+// every texel it covers is occluded. Objects that come out from behind an occluder can appear that many frames late.
+class occlusion_culler {
+public:
+  static constexpr uint32_t READBACK_FRAMES = 3;
+  static constexpr uint32_t MAX_READBACK_WIDTH = 128;
+
+  explicit occlusion_culler(wgpu::Device &device);
+
+  occlusion_culler(const occlusion_culler &) = delete;
+  auto operator=(const occlusion_culler &) -> occlusion_culler & = delete;
+  occlusion_culler(occlusion_culler &&) = delete;
+  auto operator=(occlusion_culler &&) -> occlusion_culler & = delete;
+  ~occlusion_culler() = default;
+
+  // Tests the object-space bounds under model against the frustum of view_projection, then against the pyramid
+  [[nodiscard]] auto test(const mesh_bounds &bounds, const squint::mat4 &model,
+                          const squint::mat4 &view_projection) const -> cull_result;
+  // Records the pyramid build and readback of a finished depth texture, rendered with view_projection
+  void build(wgpu::CommandEncoder &encoder, const wgpu::Texture &depth_texture, const squint::mat4 &view_projection,
+             gpu_profiler *profiler);
+  void after_submit();
+  // Whether a pyramid has been read back yet; until then test() only culls against the frustum
+  [[nodiscard]] auto has_depth() const -> bool { return m_state->depth.valid; }
+
+private:
+  enum class slot_state { free, pending_map, mapping };
+
+  struct readback_slot {
+    wgpu::Buffer buffer;
+    resource_handle resource;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t bytes_per_row = 0;
+    squint::mat4 view_projection;
+    slot_state state = slot_state::free;
+  };
+
+  // The most recent pyramid level read back, row major without padding
+  struct depth_level {
+    std::vector<float> texels;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    squint::mat4 view_projection;
+    bool valid = false;
+  };
+
+  // Shared with in-flight map callbacks so they stay valid if the culler is destroyed first
+  struct shared_state {
+    std::array<readback_slot, READBACK_FRAMES> slots;
+    depth_level depth;
+  };
+
+  // Levels are separate textures so their sizes can round up, which keeps odd edges covered
+  struct pyramid_level {
+    wgpu::Texture texture;
+    wgpu::TextureView view;
+    wgpu::BindGroup bind_group; // reads the level above, writes this one
+    resource_handle resource;
+    uint32_t width;
+    uint32_t height;
+  };
+
+  struct map_request {
+    std::shared_ptr<shared_state> state;
+    size_t slot;
+  };
+
+  wgpu::Device m_device;
+  std::unique_ptr<shader> m_depth_shader;
+  std::unique_ptr<shader> m_multisampled_depth_shader;
+  std::unique_ptr<shader> m_reduce_shader;
+  wgpu::BindGroupLayout m_depth_layout;
+  wgpu::BindGroupLayout m_multisampled_depth_layout;
+  wgpu::BindGroupLayout m_reduce_layout;
+  wgpu::ComputePipeline m_depth_pipeline;
+  wgpu::ComputePipeline m_multisampled_depth_pipeline;
+  wgpu::ComputePipeline m_reduce_pipeline;
+
+  // Rebuilt whenever the depth texture changes
+  wgpu::Texture m_source;
+  std::vector<pyramid_level> m_levels;
+
+  std::shared_ptr<shared_state> m_state;
+  std::optional<size_t> m_frame_slot;
+  size_t m_next_slot = 0;
+
+  auto create_pipeline(const shader &compute_shader, const wgpu::BindGroupLayout &layout) -> wgpu::ComputePipeline;
+  void create_pyramid(const wgpu::Texture &depth_texture);
+  [[nodiscard]] auto is_occluded(const std::array<std::array<float, 3>, 8> &corners) const -> bool;
+  static void on_mapped(map_request &request, bool success);
+};
+
+} // namespace mareweb
+
+#endif // MAREWEB_OCCLUSION_CULLER_HPP
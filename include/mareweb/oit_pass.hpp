@@ -0,0 +1,59 @@
+#ifndef MAREWEB_OIT_PASS_HPP
+#define MAREWEB_OIT_PASS_HPP
+
+#include "mareweb/gpu_profiler.hpp"
+#include "mareweb/pipeline.hpp"
+#include "mareweb/resource_registry.hpp"
+#include "mareweb/shader.hpp"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <webgpu/webgpu_cpp.h>
+
+namespace mareweb {
+
+// Weighted blended order-independent transparency (McGuire and Bavoil). begin() opens a pass over the frame's depth,
+// read only, in which alpha_mode::weighted_blended draws sum their weighted colors into OIT_ACCUM_FORMAT and multiply
+// their revealage into OIT_REVEAL_FORMAT, so their order does not matter. composite() then blends the weighted average
+// color over the color target with a fullscreen triangle. With MSAA the targets are multisampled like the depth and
+// resolved for the composite.
+class oit_pass {
+public:
+  oit_pass(wgpu::Device &device, uint32_t sample_count);
+
+  // Clears both targets, recreating them if the size changed, and returns the open pass
+  [[nodiscard]] auto begin(wgpu::CommandEncoder &encoder, const wgpu::TextureView &depth_view, uint32_t width,
+                           uint32_t height, gpu_profiler *profiler) -> wgpu::RenderPassEncoder;
+  // Blends the accumulated transparency over target, whose contents are loaded
+  void composite(wgpu::CommandEncoder &encoder, const wgpu::TextureView &target, wgpu::TextureFormat target_format,
+                 gpu_profiler *profiler);
+
+private:
+  struct oit_target {
+    wgpu::Texture texture;
+    wgpu::TextureView view;
+    resource_handle resource;
+  };
+
+  wgpu::Device m_device;
+  uint32_t m_sample_count;
+  uint32_t m_width = 0;
+  uint32_t m_height = 0;
+  oit_target m_accum;
+  oit_target m_reveal;
+  oit_target m_msaa_accum; // only with MSAA, resolved into m_accum
+  oit_target m_msaa_reveal;
+  std::unique_ptr<shader> m_shader;
+  wgpu::BindGroupLayout m_bind_group_layout;
+  wgpu::PipelineLayout m_pipeline_layout;
+  wgpu::BindGroup m_bind_group;
+  std::map<wgpu::TextureFormat, wgpu::RenderPipeline> m_pipelines;
+
+  void create_targets(uint32_t width, uint32_t height);
+  auto create_target(wgpu::TextureFormat format, uint32_t sample_count, const char *label) -> oit_target;
+  auto get_pipeline(wgpu::TextureFormat format) -> wgpu::RenderPipeline;
+};
+
+} // namespace mareweb
+
+#endif // MAREWEB_OIT_PASS_HPP
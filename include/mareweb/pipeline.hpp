@@ -4,6 +4,7 @@
 #include "mareweb/buffer.hpp"
 #include "mareweb/shader.hpp"
 #include <cstdint>
+#include <string>
 #include <vector>
 #include <webgpu/webgpu_cpp.h>
 
@@ -14,27 +15,61 @@ struct vertex_state {
   bool has_texcoords = false;
   bool has_colors = false;
   bool is_indexed = false;
+  // Adds an instance_record buffer stepped per instance at vertex_buffer_slots::INSTANCE
+  bool has_instance_data = false;
 };
 
+// How a material's fragments combine with the color target, which also decides when the renderer draws it
+enum class alpha_mode : uint8_t {
+  opaque,  // no blending, depth written; drawn first, front to back
+  masked,  // as opaque, but fragments under the alpha_cutoff override constant are discarded; drawn after opaques
+  blended, // alpha blended, depth tested but not written; drawn last, back to front
+  // Accumulated unsorted into the order-independent transparency targets, then composited over the frame
+  weighted_blended,
+};
+
+// Targets of weighted blended order-independent transparency: premultiplied color and weight sums, and revealage
+constexpr wgpu::TextureFormat OIT_ACCUM_FORMAT = wgpu::TextureFormat::RGBA16Float;
+constexpr wgpu::TextureFormat OIT_REVEAL_FORMAT = wgpu::TextureFormat::R8Unorm;
+
+// Depth testing of a color pipeline
+enum class depth_mode : uint8_t {
+  test_and_write, // Less, writing depth unless blended
+  equal,          // Equal, read only, for draws whose depth the depth pre-pass already wrote
+};
+
+// Fragment shaders call alpha_test(alpha) on their final alpha. Only the masked version declares alpha_cutoff and
+// discards, so opaque pipelines keep early depth testing.
+[[nodiscard]] auto alpha_test_wgsl(alpha_mode mode) -> std::string;
+// Fragment shaders return FragmentOutput from fragment_output(color, position), passing their straight alpha color and
+// @builtin(position). The weighted_blended version writes the two OIT targets, weighted by depth and alpha.
+[[nodiscard]] auto fragment_output_wgsl(alpha_mode mode) -> std::string;
+
 class pipeline {
 public:
   pipeline(wgpu::Device &device, const shader &vertex_shader, const shader &fragment_shader,
            wgpu::TextureFormat surface_format, uint32_t sample_count,
-           const std::vector<wgpu::BindGroupLayoutEntry> &bind_group_layout_entries,
-           const wgpu::PrimitiveState &primitive_state, const vertex_state &vert_state = {});
+           std::vector<wgpu::BindGroupLayout> bind_group_layouts, const wgpu::PrimitiveState &primitive_state,
+           const vertex_state &vert_state = {}, alpha_mode mode = alpha_mode::opaque, float alpha_cutoff = 0.5F,
+           depth_mode depth = depth_mode::test_and_write);
 
   [[nodiscard]] auto get_pipeline() const -> wgpu::RenderPipeline { return m_pipeline; }
-  [[nodiscard]] auto get_bind_group_layout() const -> wgpu::BindGroupLayout { return m_bind_group_layout; }
-  [[nodiscard]] auto get_bind_group() const -> wgpu::BindGroup { return m_bind_group; }
-  void set_bind_group(wgpu::BindGroup bind_group) { m_bind_group = bind_group; }
+  // Indexed by group, see bind_group_index
+  [[nodiscard]] auto get_bind_group_layouts() const -> const std::vector<wgpu::BindGroupLayout> & {
+    return m_bind_group_layouts;
+  }
 
 private:
+  // Buffer layouts indexed by slot, with the attribute arrays they point into
+  struct vertex_buffer_layouts {
+    std::vector<std::vector<wgpu::VertexAttribute>> attributes;
+    std::vector<wgpu::VertexBufferLayout> buffers;
+  };
+
   wgpu::RenderPipeline m_pipeline;
-  wgpu::BindGroupLayout m_bind_group_layout;
-  wgpu::BindGroup m_bind_group;
+  std::vector<wgpu::BindGroupLayout> m_bind_group_layouts;
 
-  static auto create_vertex_buffer_layout(const vertex_state &vert_state)
-      -> std::pair<std::vector<wgpu::VertexAttribute>, wgpu::VertexBufferLayout>;
+  static auto create_vertex_buffer_layout(const vertex_state &vert_state) -> vertex_buffer_layouts;
 };
 
 } // namespace mareweb
@@ -0,0 +1,142 @@
+#ifndef MAREWEB_PROFILER_HPP
+#define MAREWEB_PROFILER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace mareweb {
+
+// A completed zone. Names must be string literals or otherwise outlive the profiler.
+struct profile_event {
+  const char *name;
+  uint64_t start_ns;
+  uint64_t end_ns;
+  uint32_t depth;
+};
+
+// Aggregated timings of every recorded instance of a zone name.
+struct zone_stats {
+  std::string name;
+  uint64_t count = 0;
+  double total_ms = 0.0;
+  double average_ms = 0.0;
+  double min_ms = 0.0;
+  double max_ms = 0.0;
+};
+
+// A frame that took longer than the hitch threshold. Pass start_ns/end_ns to export_chrome_trace to capture it.
+struct hitch_info {
+  uint64_t frame_index;
+  uint64_t start_ns;
+  uint64_t end_ns;
+  double duration_ms;
+};
+
+// CPU profiler built from scoped zones.
+//
+// Every thread records into its own fixed-size ring buffer, so the oldest events are overwritten during long sessions
+// and recording never allocates. Zones cost one relaxed atomic load while profiling is disabled at runtime and compile
+// away entirely without MAREWEB_ENABLE_PROFILING.
+class profiler {
+public:
+  static constexpr size_t EVENTS_PER_THREAD = 1U << 16U;
+
+  static auto get_instance() -> profiler &;
+
+  profiler(const profiler &) = delete;
+  auto operator=(const profiler &) -> profiler & = delete;
+  profiler(profiler &&) = delete;
+  auto operator=(profiler &&) -> profiler & = delete;
+
+  void set_enabled(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+  [[nodiscard]] auto is_enabled() const -> bool { return m_enabled.load(std::memory_order_relaxed); }
+
+  [[nodiscard]] static auto now_ns() -> uint64_t;
+  void record(const profile_event &event);
+  auto enter_zone() -> uint32_t;
+  void leave_zone();
+
+  // Called once per frame by the application with the frame's bounds.
+  void end_frame(uint64_t start_ns, uint64_t end_ns);
+  void set_hitch_handler(double threshold_ms, std::function<void(const hitch_info &)> handler);
+
+  // Writes the buffered events overlapping [start_ns, end_ns] in Chrome trace event format (chrome://tracing, Perfetto).
+  void export_chrome_trace(std::ostream &out, uint64_t start_ns = 0, uint64_t end_ns = UINT64_MAX) const;
+  void export_chrome_trace(const std::string &path, uint64_t start_ns = 0, uint64_t end_ns = UINT64_MAX) const;
+  // Aggregates the buffered events by zone name, sorted by total time.
+  [[nodiscard]] auto get_zone_stats() const -> std::vector<zone_stats>;
+  void clear();
+
+private:
+  struct thread_buffer {
+    std::vector<profile_event> events;
+    size_t next = 0;
+    size_t count = 0;
+    uint32_t thread_id = 0;
+    uint32_t depth = 0;
+    std::mutex mutex;
+  };
+
+  profiler() = default;
+
+  auto get_thread_buffer() -> thread_buffer &;
+  template <typename F> void for_each_event(F &&fn) const;
+
+  std::atomic<bool> m_enabled = false;
+  mutable std::mutex m_mutex;
+  std::vector<std::shared_ptr<thread_buffer>> m_buffers;
+  uint32_t m_next_thread_id = 0;
+  uint64_t m_frame_index = 0;
+  double m_hitch_threshold_ms = 0.0;
+  std::function<void(const hitch_info &)> m_hitch_handler;
+};
+
+class profile_zone {
+public:
+  explicit profile_zone(const char *name) : m_name(name) {
+    auto &prof = profiler::get_instance();
+    if (prof.is_enabled()) {
+      m_depth = prof.enter_zone();
+      m_start_ns = profiler::now_ns();
+      m_active = true;
+    }
+  }
+
+  ~profile_zone() {
+    if (m_active) {
+      auto &prof = profiler::get_instance();
+      prof.record({m_name, m_start_ns, profiler::now_ns(), m_depth});
+      prof.leave_zone();
+    }
+  }
+
+  profile_zone(const profile_zone &) = delete;
+  auto operator=(const profile_zone &) -> profile_zone & = delete;
+  profile_zone(profile_zone &&) = delete;
+  auto operator=(profile_zone &&) -> profile_zone & = delete;
+
+private:
+  const char *m_name;
+  uint64_t m_start_ns = 0;
+  uint32_t m_depth = 0;
+  bool m_active = false;
+};
+
+} // namespace mareweb
+
+#define MAREWEB_PROFILE_CONCAT_IMPL(a, b) a##b
+#define MAREWEB_PROFILE_CONCAT(a, b) MAREWEB_PROFILE_CONCAT_IMPL(a, b)
+
+#ifdef MAREWEB_ENABLE_PROFILING
+#define MAREWEB_PROFILE_ZONE(name) ::mareweb::profile_zone MAREWEB_PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#else
+#define MAREWEB_PROFILE_ZONE(name)
+#endif
+
+#endif // MAREWEB_PROFILER_HPP
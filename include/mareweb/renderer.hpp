@@ -2,14 +2,31 @@
 #define MAREWEB_RENDERER_HPP
 
 #include <SDL2/SDL.h>
+#include <chrono>
 #include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
 #include <webgpu/webgpu_cpp.h>
 
+#include "mareweb/asset_pack.hpp"
 #include "mareweb/components/camera.hpp"
 #include "mareweb/components/transform.hpp"
+#include "mareweb/draw_queue.hpp"
 #include "mareweb/entity.hpp"
+#include "mareweb/frame_bindings.hpp"
+#include "mareweb/frame_stats.hpp"
+#include "mareweb/gltf_loader.hpp"
+#include "mareweb/gpu_profiler.hpp"
 #include "mareweb/material.hpp"
 #include "mareweb/mesh.hpp"
+#include "mareweb/occlusion_culler.hpp"
+#include "mareweb/oit_pass.hpp"
+#include "mareweb/profiler.hpp"
+#include "mareweb/resource_cache.hpp"
+#include "mareweb/resolution_scaler.hpp"
+#include "mareweb/resource_registry.hpp"
+#include "mareweb/texture_loader.hpp"
 #include "squint/quantity.hpp"
 
 namespace mareweb {
@@ -27,6 +44,15 @@ struct renderer_properties {
   uint32_t sample_count = 1;                                // MSAA sample count
   wgpu::Color clear_color = {0.0F, 0.0F, 0.0F, 1.0F};
   squint::duration fixed_time_step = DEFAULT_FIXED_TIME_STEP;
+  bool headless = false; // render into an offscreen texture instead of a window surface
+  // Draws opaque geometry into a depth-only pass first, so the color pass shades each pixel once
+  bool depth_prepass = false;
+  // Skips draws outside the frustum or hidden behind the depth of earlier frames
+  bool occlusion_culling = false;
+  // Renders the scene at a scale of the surface size that follows the GPU frame time, then upscales it. Needs the
+  // timestamp-query feature to measure; without it the scale stays at resolution_scale.max_scale, with a warning.
+  bool dynamic_resolution = false;
+  resolution_scale_settings resolution_scale;
 };
 
 template <typename T> class renderer_render_system : public render_system<T> {
@@ -36,8 +62,11 @@ public:
       return;
     }
     rend.begin_frame();
-    for (const auto &child : rend.get_children()) {
-      child->render(dt);
+    {
+      MAREWEB_PROFILE_ZONE("render_traversal");
+      for (const auto &child : rend.get_children()) {
+        child->render(dt);
+      }
     }
     rend.end_frame();
   }
@@ -49,6 +78,8 @@ public:
     if (rend.is_disabled()) {
       return;
     }
+    MAREWEB_PROFILE_ZONE("update_traversal");
+    frame_counters::scope counting(rend.get_frame_counters());
     for (const auto &child : rend.get_children()) {
       child->update(dt);
     }
@@ -141,13 +172,50 @@ public:
     return std::make_unique<MaterialType>(m_device, m_surface_format, m_properties.sample_count,
                                           std::forward<Args>(args)...);
   }
+  // Shared mesh built from the same arguments, freed when the last user releases it. Meshes are immutable once built,
+  // so this is the preferred way to get the stock shapes.
+  template <typename MeshType, typename... Args> auto acquire_mesh(const Args &...args) -> std::shared_ptr<MeshType> {
+    return m_resource_cache->acquire<MeshType>([&]() { return std::make_shared<MeshType>(m_device, args...); },
+                                               args...);
+  }
+  // Shared material built from the same arguments, freed when the last user releases it. Everyone holding it draws with
+  // the same uniforms and bindings, so it must not be updated; materials that can change, such as the default materials
+  // an entity exposes to its users, come from create_material instead.
+  template <typename MaterialType, typename... Args>
+  auto acquire_material(const Args &...args) -> std::shared_ptr<MaterialType> {
+    return m_resource_cache->acquire<MaterialType>(
+        [&]() {
+          return std::make_shared<MaterialType>(m_device, m_surface_format, m_properties.sample_count, args...);
+        },
+        m_surface_format, m_properties.sample_count, args...);
+  }
+  // Decodes on the loader's worker pool; the returned handle serves a placeholder until begin_frame uploads it.
+  // Handles are shared per file (path and modification time) and options.
+  auto load_texture(const std::string &path, const texture_options &options = {}) -> std::shared_ptr<texture_handle>;
+  // Serves later load_texture calls for paths the pack contains from the pack instead of individual files
+  void mount_asset_pack(const std::string &path);
+  [[nodiscard]] auto get_asset_pack() const -> const std::shared_ptr<const asset_pack> & { return m_asset_pack; }
   void set_fullscreen(bool fullscreen);
   void set_present_mode(wgpu::PresentMode present_mode);
   void set_clear_color(const wgpu::Color &clear_color) { m_clear_color = clear_color; }
+  // Takes effect from the next begin_frame
+  void set_depth_prepass(bool enabled) { m_properties.depth_prepass = enabled; }
+  void set_occlusion_culling(bool enabled) { m_properties.occlusion_culling = enabled; }
+  void set_dynamic_resolution(bool enabled) { m_properties.dynamic_resolution = enabled; }
+  // Throws when the bounds are not 0 < min_scale <= max_scale
+  void set_resolution_scale(const resolution_scale_settings &settings);
+  // Fraction of the surface size the scene renders at, 1 without dynamic resolution
+  [[nodiscard]] auto get_resolution_scale() const -> float;
   [[nodiscard]] auto get_clear_color() const -> wgpu::Color { return m_clear_color; }
   void begin_frame();
   void end_frame();
-  void update_model_view_projection(const transform &model_transform, const camera &cam);
+  // Directional light shared by every material through the frame uniforms. The direction points towards the light.
+  void set_light(const vec3 &direction, const vec3 &color = vec3{1.0F, 1.0F, 1.0F}, float ambient = 0.2F);
+  // Point lights on top of the directional light, assigned to clusters of the view frustum every frame
+  void set_point_lights(std::vector<point_light> lights) { m_light_clusters->set_lights(std::move(lights)); }
+  [[nodiscard]] auto get_point_lights() const -> const std::vector<point_light> & {
+    return m_light_clusters->get_lights();
+  }
 
   [[nodiscard]] auto get_window() const -> SDL_Window * { return m_window; }
   [[nodiscard]] auto get_title() const -> const std::string & { return m_properties.title; }
@@ -156,12 +224,47 @@ public:
   [[nodiscard]] auto get_surface() const -> wgpu::Surface { return m_surface; }
   [[nodiscard]] auto get_surface_format() const -> wgpu::TextureFormat { return m_surface_format; }
   [[nodiscard]] auto get_command_encoder() const -> wgpu::CommandEncoder { return m_command_encoder; }
+  // The color pass. With a depth pre-pass it only begins in end_frame, so it is null during traversal.
   [[nodiscard]] auto get_render_pass() const -> wgpu::RenderPassEncoder { return m_render_pass; }
+  // The surface texture of the frame
   [[nodiscard]] auto get_current_texture_view() const -> wgpu::TextureView { return m_current_texture_view; }
+  // What the color pass renders into: the surface texture, or the scaled target that is upscaled onto it
+  [[nodiscard]] auto get_scene_texture_view() const -> wgpu::TextureView { return m_scene_texture_view; }
+  // Size of the scene, depth and MSAA targets
+  [[nodiscard]] auto get_render_width() const -> uint32_t { return m_render_width; }
+  [[nodiscard]] auto get_render_height() const -> uint32_t { return m_render_height; }
   [[nodiscard]] auto get_msaa_texture() const -> wgpu::Texture { return m_msaa_texture; }
   [[nodiscard]] auto get_msaa_texture_view() const -> wgpu::TextureView { return m_msaa_texture_view; }
   [[nodiscard]] auto get_depth_texture() const -> wgpu::Texture { return m_depth_texture; }
   [[nodiscard]] auto get_depth_texture_view() const -> wgpu::TextureView { return m_depth_texture_view; }
+  [[nodiscard]] auto is_headless() const -> bool { return m_properties.headless; }
+  // Null unless the device was created with the timestamp-query feature
+  [[nodiscard]] auto get_gpu_profiler() const -> gpu_profiler * { return m_gpu_profiler.get(); }
+  [[nodiscard]] auto get_texture_loader() const -> texture_loader & { return *m_texture_loader; }
+  // Streams glTF files; gltf_model builds renderables from its streams as they arrive. Created on first use.
+  [[nodiscard]] auto get_gltf_loader() -> gltf_loader &;
+  [[nodiscard]] auto get_resource_cache() const -> resource_cache & { return *m_resource_cache; }
+  // Vertex/index buffers bound in the current pass, reset by begin_frame
+  [[nodiscard]] auto get_geometry_bindings() -> geometry_bindings & { return m_geometry_bindings; }
+  // Frame (group 0) and per-draw (group 2) bind groups of the current pass
+  [[nodiscard]] auto get_frame_bindings() -> frame_bindings & { return *m_frame_bindings; }
+  [[nodiscard]] auto get_frame_uniforms() const -> const frame_uniforms & { return m_frame_uniforms; }
+  // Renderables submit here during traversal, end_frame sorts the draws by alpha mode and distance and records them
+  [[nodiscard]] auto get_draw_queue() -> draw_queue & { return m_draw_queue; }
+  // Compacts the geometry arena's pages with a separate submit, e.g. after a level unload
+  void defragment_geometry();
+  // Counts this renderer's WebGPU work, current during the update traversal and from begin_frame to end_frame
+  [[nodiscard]] auto get_frame_counters() -> frame_counters & { return *m_frame_counters; }
+  // Counters of the most recently ended frame, and their rolling averages
+  [[nodiscard]] auto get_frame_stats() const -> const frame_stats & { return m_frame_stats.get_last(); }
+  [[nodiscard]] auto get_average_frame_stats() const -> frame_stats_average { return m_frame_stats.get_average(); }
+  void set_frame_stats_dump(const std::string &path, uint32_t interval_frames) {
+    m_frame_stats.set_dump_file(path, interval_frames);
+  }
+
+protected:
+  // Fills the camera part of the frame uniforms before they are uploaded in begin_frame
+  virtual void update_frame_uniforms(frame_uniforms & /*uniforms*/) {}
 
 private:
   renderer_properties m_properties;
@@ -172,15 +275,51 @@ private:
   wgpu::CommandEncoder m_command_encoder;
   wgpu::RenderPassEncoder m_render_pass;
   wgpu::TextureView m_current_texture_view;
+  wgpu::TextureView m_scene_texture_view;
+  uint32_t m_render_width;
+  uint32_t m_render_height;
   wgpu::Color m_clear_color;
   wgpu::Texture m_msaa_texture;
   wgpu::TextureView m_msaa_texture_view;
   wgpu::Texture m_depth_texture;
   wgpu::TextureView m_depth_texture_view;
+  wgpu::Texture m_headless_texture;
+  wgpu::TextureView m_headless_texture_view;
+  resource_handle m_msaa_resource;
+  resource_handle m_depth_resource;
+  resource_handle m_headless_resource;
+  std::unique_ptr<gpu_profiler> m_gpu_profiler;
+  std::unique_ptr<texture_loader> m_texture_loader;
+  std::unique_ptr<gltf_loader> m_gltf_loader;
+  std::shared_ptr<const asset_pack> m_asset_pack;
+  std::unique_ptr<resource_cache> m_resource_cache = std::make_unique<resource_cache>();
+  geometry_bindings m_geometry_bindings;
+  std::unique_ptr<light_clusters> m_light_clusters;
+  std::unique_ptr<frame_bindings> m_frame_bindings;
+  frame_uniforms m_frame_uniforms;
+  draw_queue m_draw_queue;
+  std::unique_ptr<depth_prepass> m_depth_prepass;
+  bool m_frame_depth_prepass = false; // depth_prepass as of begin_frame
+  bool m_frame_upscale = false;       // the scene renders below the surface size this frame
+  std::unique_ptr<occlusion_culler> m_occlusion_culler;
+  std::unique_ptr<oit_pass> m_oit_pass; // created by the first frame with weighted blended draws
+  std::unique_ptr<resolution_scaler> m_resolution_scaler; // created by the first frame with dynamic resolution
+  std::chrono::steady_clock::time_point m_start_time = std::chrono::steady_clock::now();
+  std::unique_ptr<frame_counters> m_frame_counters = std::make_unique<frame_counters>();
+  frame_counters *m_previous_counters = nullptr; // installed again by end_frame
+  frame_stats_history m_frame_stats;
+  uint64_t m_frame_index = 0;
+  std::chrono::steady_clock::time_point m_last_frame_end = std::chrono::steady_clock::now();
 
   void configure_surface();
+  void create_headless_texture();
   void create_msaa_texture();
   void create_depth_texture();
+  [[nodiscard]] auto get_scaled_size() const -> std::pair<uint32_t, uint32_t>;
+  void create_render_targets();
+  void begin_main_pass(wgpu::LoadOp depth_load);
+  void record_depth_prepass();
+  void record_weighted_blended();
 };
 
 } // namespace mareweb
@@ -0,0 +1,83 @@
+#ifndef MAREWEB_RESOLUTION_SCALER_HPP
+#define MAREWEB_RESOLUTION_SCALER_HPP
+
+#include "mareweb/gpu_profiler.hpp"
+#include "mareweb/resource_registry.hpp"
+#include "mareweb/shader.hpp"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <utility>
+#include <webgpu/webgpu_cpp.h>
+
+namespace mareweb {
+
+enum class upscale_filter : uint8_t {
+  bilinear,   // one filtered tap per pixel
+  edge_aware, // bilinear plus contrast-adaptive sharpening, which restores the edges the lower resolution softened
+};
+
+struct resolution_scale_settings {
+  float min_scale = 0.5F; // per axis, so 0.5 shades a quarter of the pixels
+  float max_scale = 1.0F;
+  double target_gpu_ms = 14.0; // leaves headroom under the 16.7 ms of a 60 Hz frame
+  upscale_filter filter = upscale_filter::bilinear;
+};
+
+// Dynamic resolution. The scene renders into a target scaled down from the surface size, and upscale() stretches it
+// over the surface. update() reads the GPU frame time from the profiler and moves the scale between the settings'
+// bounds: down as soon as a frame runs over the target, up only once frames have some headroom. Scales are quantized
+// to SCALE_STEP and held for a few frames after each change, so the targets are not recreated every frame and the
+// late timestamp readbacks get to reflect the new size.
+class resolution_scaler {
+public:
+  static constexpr float SCALE_STEP = 1.0F / 16.0F;
+  static constexpr double HEADROOM = 0.85;      // fraction of the target a frame must stay under to scale up
+  static constexpr float MAX_INCREASE = 0.125F; // scaling up is gradual, a misjudged step costs a dropped frame
+  static constexpr uint32_t SETTLE_FRAMES = gpu_profiler::READBACK_FRAMES + 1;
+
+  // Throws validate's error for bad settings
+  resolution_scaler(wgpu::Device &device, wgpu::TextureFormat format, const resolution_scale_settings &settings);
+
+  // Throws when the bounds are not 0 < min_scale <= max_scale
+  static void validate(const resolution_scale_settings &settings);
+
+  void set_settings(const resolution_scale_settings &settings);
+  [[nodiscard]] auto get_settings() const -> const resolution_scale_settings & { return m_settings; }
+  [[nodiscard]] auto get_scale() const -> float { return m_scale; }
+  // Scene size for a surface of the given size, at least one pixel each way
+  [[nodiscard]] auto scaled_size(uint32_t width, uint32_t height) const -> std::pair<uint32_t, uint32_t>;
+
+  // Feeds the most recent GPU frame time, returns true when the scale changed
+  auto update(const gpu_profiler &profiler) -> bool;
+  // Scene color target of the given size, recreated when the size changes
+  [[nodiscard]] auto get_target(uint32_t width, uint32_t height) -> wgpu::TextureView;
+  // Stretches the scene target over target, which must have the format given at construction
+  void upscale(wgpu::CommandEncoder &encoder, const wgpu::TextureView &target, gpu_profiler *profiler);
+
+private:
+  wgpu::Device m_device;
+  wgpu::TextureFormat m_format;
+  resolution_scale_settings m_settings;
+  float m_scale;
+  uint64_t m_last_sample_count = 0;
+  uint32_t m_settle_frames = 0;
+  uint32_t m_width = 0;
+  uint32_t m_height = 0;
+  wgpu::Texture m_texture;
+  wgpu::TextureView m_view;
+  resource_handle m_resource;
+  std::unique_ptr<shader> m_shader;
+  wgpu::BindGroupLayout m_bind_group_layout;
+  wgpu::PipelineLayout m_pipeline_layout;
+  wgpu::Sampler m_sampler;
+  wgpu::BindGroup m_bind_group;
+  std::map<upscale_filter, wgpu::RenderPipeline> m_pipelines;
+
+  void create_target(uint32_t width, uint32_t height);
+  auto get_pipeline(upscale_filter filter) -> wgpu::RenderPipeline;
+};
+
+} // namespace mareweb
+
+#endif // MAREWEB_RESOLUTION_SCALER_HPP
@@ -0,0 +1,146 @@
+#ifndef MAREWEB_RESOURCE_CACHE_HPP
+#define MAREWEB_RESOURCE_CACHE_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
+
+namespace mareweb {
+
+namespace cache_key_detail {
+
+inline void append_bytes(std::string &key, const void *data, size_t size) {
+  key.append(static_cast<const char *>(data), size);
+}
+
+template <typename T> void append(std::string &key, const T &value) {
+  if constexpr (requires { value.append_cache_key(key); }) {
+    // Structs with padding or floating-point members append their fields one by one
+    value.append_cache_key(key);
+  } else if constexpr (std::is_convertible_v<const T &, std::string_view>) {
+    std::string_view str = value;
+    size_t size = str.size();
+    append_bytes(key, &size, sizeof(size));
+    key.append(str);
+  } else if constexpr (requires { value.value(); }) {
+    // squint quantities, keyed by their magnitude
+    append(key, value.value());
+  } else if constexpr (requires { value.data(); value.size(); }) {
+    // Contiguous containers and squint tensors, keyed element by element
+    size_t size = value.size();
+    append_bytes(key, &size, sizeof(size));
+    for (size_t i = 0; i < size; ++i) {
+      append(key, value.data()[i]);
+    }
+  } else if constexpr (requires { value.get(); value.use_count(); }) {
+    // Shared resources such as texture handles, keyed by identity. The resource built from them keeps them alive, so
+    // the address cannot be reused while the entry lives.
+    const void *address = value.get();
+    append_bytes(key, &address, sizeof(address));
+  } else if constexpr (std::is_same_v<T, float> || std::is_same_v<T, double>) {
+    // Keyed by value rather than bytes: -0.0 matches 0.0, and every NaN matches every other
+    T canonical = value == T{0} ? T{0} : value;
+    if (std::isnan(value)) {
+      canonical = std::numeric_limits<T>::quiet_NaN();
+    }
+    append_bytes(key, &canonical, sizeof(T));
+  } else if constexpr (std::has_unique_object_representations_v<T>) {
+    // Integers, enums and pointers, where equal values have equal bytes
+    append_bytes(key, &value, sizeof(T));
+  } else if constexpr (std::ranges::sized_range<T>) {
+    size_t size = std::ranges::size(value);
+    append_bytes(key, &size, sizeof(size));
+    for (const auto &element : value) {
+      append(key, element);
+    }
+  } else {
+    static_assert(std::has_unique_object_representations_v<T>,
+                  "resource_cache cannot key this argument type by its bytes, give it an append_cache_key member");
+  }
+}
+
+} // namespace cache_key_detail
+
+// Shares GPU resources that are built from identical parameters. Entries are held weakly, so a resource is freed as
+// soon as its last user releases it and the next request builds a fresh one.
+class resource_cache {
+public:
+  resource_cache() = default;
+
+  resource_cache(const resource_cache &) = delete;
+  auto operator=(const resource_cache &) -> resource_cache & = delete;
+  resource_cache(resource_cache &&) = delete;
+  auto operator=(resource_cache &&) -> resource_cache & = delete;
+
+  // Returns the live T built from the same key arguments, or stores and returns factory(). The factory runs without
+  // the lock held, so it may acquire other resources.
+  template <typename T, typename Factory, typename... KeyArgs>
+  auto acquire(Factory &&factory, const KeyArgs &...key_args) -> std::shared_ptr<T> {
+    std::string key = make_key<T>(key_args...);
+    {
+      std::lock_guard lock(m_mutex);
+      if (auto existing = find(key)) {
+        ++m_hits;
+        return std::static_pointer_cast<T>(existing);
+      }
+      ++m_misses;
+    }
+
+    std::shared_ptr<T> created = std::forward<Factory>(factory)();
+
+    std::lock_guard lock(m_mutex);
+    // Another thread may have built the same resource meanwhile, keep the first one so both callers share it
+    if (auto existing = find(key)) {
+      return std::static_pointer_cast<T>(existing);
+    }
+    m_entries[std::move(key)] = created;
+    prune_if_needed();
+    return created;
+  }
+
+  template <typename T, typename... KeyArgs>
+  [[nodiscard]] static auto make_key(const KeyArgs &...key_args) -> std::string {
+    std::string key = typeid(T).name();
+    ((key += typeid(KeyArgs).name()), ...);
+    key += '\0';
+    (cache_key_detail::append(key, key_args), ...);
+    return key;
+  }
+
+  // Path plus last write time, so a file edited on disk misses the cache and loads fresh
+  [[nodiscard]] static auto file_key(const std::string &path) -> std::string;
+
+  // Drops entries whose resource has already been released
+  void prune();
+  void clear();
+
+  [[nodiscard]] auto get_entry_count() const -> size_t;
+  [[nodiscard]] auto get_hit_count() const -> uint64_t;
+  [[nodiscard]] auto get_miss_count() const -> uint64_t;
+
+private:
+  static constexpr size_t MIN_PRUNE_THRESHOLD = 64;
+
+  mutable std::mutex m_mutex;
+  std::unordered_map<std::string, std::weak_ptr<void>> m_entries;
+  size_t m_prune_threshold = MIN_PRUNE_THRESHOLD;
+  uint64_t m_hits = 0;
+  uint64_t m_misses = 0;
+
+  auto find(const std::string &key) -> std::shared_ptr<void>;
+  void prune_if_needed();
+  void prune_locked();
+};
+
+} // namespace mareweb
+
+#endif // MAREWEB_RESOURCE_CACHE_HPP
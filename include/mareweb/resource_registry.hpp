@@ -0,0 +1,133 @@
+#ifndef MAREWEB_RESOURCE_REGISTRY_HPP
+#define MAREWEB_RESOURCE_REGISTRY_HPP
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <webgpu/webgpu_cpp.h>
+
+namespace mareweb {
+
+enum class resource_category : uint8_t {
+  vertex_buffer,
+  index_buffer,
+  uniform_buffer,
+  storage_buffer,
+  staging_buffer,
+  other_buffer,
+  texture,
+  render_target,
+  depth_target,
+  count
+};
+
+using resource_id = uint64_t;
+
+// Footprint of one block of texels; 1x1 for uncompressed formats
+struct texel_block {
+  uint32_t width;
+  uint32_t height;
+  uint32_t bytes;
+};
+
+struct resource_record {
+  resource_id id = 0;
+  resource_category category = resource_category::other_buffer;
+  uint64_t size = 0;
+  uint64_t usage = 0; // wgpu::BufferUsage or wgpu::TextureUsage bits depending on the category
+  std::string label;
+};
+
+// Releases its registry entry when destroyed, so owners only need to keep it next to the GPU object.
+class resource_handle {
+public:
+  resource_handle() = default;
+  explicit resource_handle(resource_id id) : m_id(id) {}
+  ~resource_handle() { reset(); }
+
+  resource_handle(const resource_handle &) = delete;
+  auto operator=(const resource_handle &) -> resource_handle & = delete;
+  resource_handle(resource_handle &&other) noexcept : m_id(std::exchange(other.m_id, 0)) {}
+  auto operator=(resource_handle &&other) noexcept -> resource_handle & {
+    if (this != &other) {
+      reset();
+      m_id = std::exchange(other.m_id, 0);
+    }
+    return *this;
+  }
+
+  void reset();
+  [[nodiscard]] auto get_id() const -> resource_id { return m_id; }
+
+private:
+  resource_id m_id = 0;
+};
+
+// Tracks the estimated GPU memory of every buffer and texture created through mareweb.
+//
+// An optional budget is enforced after each registration: while the total exceeds it, budget handlers are called in
+// registration order with the number of bytes that should be freed. Handlers free memory by destroying resources
+// (evicting textures, dropping LODs, ...); the allocation that crossed the budget is never refused.
+class resource_registry {
+public:
+  using budget_handler = std::function<void(uint64_t bytes_over_budget)>;
+  using handler_id = uint64_t;
+
+  static auto get_instance() -> resource_registry &;
+
+  resource_registry(const resource_registry &) = delete;
+  auto operator=(const resource_registry &) -> resource_registry & = delete;
+  resource_registry(resource_registry &&) = delete;
+  auto operator=(resource_registry &&) -> resource_registry & = delete;
+
+  [[nodiscard]] auto register_buffer(uint64_t size, wgpu::BufferUsage usage, const std::string &label = "")
+      -> resource_handle;
+  [[nodiscard]] auto register_texture(const wgpu::TextureDescriptor &desc, resource_category category,
+                                      const std::string &label = "") -> resource_handle;
+  void release(resource_id id);
+  void set_label(resource_id id, const std::string &label);
+
+  [[nodiscard]] auto get_total_bytes() const -> uint64_t;
+  [[nodiscard]] auto get_peak_bytes() const -> uint64_t;
+  [[nodiscard]] auto get_category_bytes(resource_category category) const -> uint64_t;
+  [[nodiscard]] auto get_records() const -> std::vector<resource_record>;
+  // Prints totals per category followed by the largest resources.
+  void report(std::ostream &out, size_t largest_count = 10) const;
+
+  // A budget of zero disables enforcement.
+  void set_budget(uint64_t bytes);
+  [[nodiscard]] auto get_budget() const -> uint64_t;
+  auto add_budget_handler(budget_handler handler) -> handler_id;
+  void remove_budget_handler(handler_id id);
+
+  [[nodiscard]] static auto estimate_texture_size(const wgpu::TextureDescriptor &desc) -> uint64_t;
+  [[nodiscard]] static auto get_texel_block(wgpu::TextureFormat format) -> texel_block;
+  [[nodiscard]] static auto category_name(resource_category category) -> const char *;
+
+private:
+  resource_registry() = default;
+
+  auto add(resource_record record) -> resource_handle;
+  void enforce_budget();
+
+  mutable std::mutex m_mutex;
+  std::unordered_map<resource_id, resource_record> m_records;
+  std::array<uint64_t, static_cast<size_t>(resource_category::count)> m_category_bytes{};
+  uint64_t m_total_bytes = 0;
+  uint64_t m_peak_bytes = 0;
+  uint64_t m_budget_bytes = 0;
+  resource_id m_next_id = 1;
+  std::vector<std::pair<handler_id, budget_handler>> m_budget_handlers;
+  handler_id m_next_handler_id = 1;
+  bool m_enforcing = false;
+};
+
+} // namespace mareweb
+
+#endif // MAREWEB_RESOURCE_REGISTRY_HPP
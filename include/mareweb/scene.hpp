@@ -12,6 +12,9 @@ class scene : public renderer, public camera {
 public:
   scene(wgpu::Device &device, wgpu::Surface surface, SDL_Window *window, const renderer_properties &properties,
         projection_type type = projection_type::perspective);
+
+protected:
+  void update_frame_uniforms(frame_uniforms &uniforms) override;
 };
 
 } // namespace mareweb
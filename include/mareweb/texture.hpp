@@ -2,16 +2,48 @@
 #ifndef MAREWEB_TEXTURE_HPP
 #define MAREWEB_TEXTURE_HPP
 
+#include "mareweb/mipmap_generator.hpp"
+#include "mareweb/resource_registry.hpp"
 #include <SDL2/SDL_surface.h>
+#include <cstdint>
 #include <string>
+#include <vector>
 #include <webgpu/webgpu_cpp.h>
 
 namespace mareweb {
 
+struct texture_options {
+  mipmap_filter mipmaps = mipmap_filter::gpu;
+  bool srgb = true; // color data, mips are filtered in linear space. Disable for normal maps and other linear data
+  wgpu::AddressMode address_mode = wgpu::AddressMode::Repeat;
+};
+
+// Block-compressed formats the device was created with, picked as transcode targets for KTX2/Basis files
+struct texture_compression_support {
+  bool bc = false;
+  bool etc2 = false;
+  bool astc = false;
+
+  [[nodiscard]] static auto query(const wgpu::Device &device) -> texture_compression_support;
+};
+
+// Decoded, tightly packed pixels. Produced without touching the GPU, so it can be built on worker threads.
+// Image files decode to RGBA8; KTX2 files keep their (possibly block-compressed) format and mip chain.
+struct image_data {
+  uint32_t width = 0;
+  uint32_t height = 0;
+  wgpu::TextureFormat format = wgpu::TextureFormat::RGBA8Unorm;
+  std::vector<uint8_t> pixels;
+  std::vector<mip_level> mips; // levels 1..n, from CPU mipmap filters or the file itself
+  bool prebuilt_mips = false;  // the mips came from the file and are uploaded as-is
+};
+
 class texture {
 public:
-  texture(wgpu::Device &device, const char *file_path);
-  texture(wgpu::Device &device, SDL_Surface *surface);
+  texture(wgpu::Device &device, const char *file_path, const texture_options &options = {});
+  texture(wgpu::Device &device, SDL_Surface *surface, const texture_options &options = {});
+  texture(wgpu::Device &device, const image_data &image, const texture_options &options = {},
+          const std::string &label = "");
   ~texture();
 
   // Delete copy operations
@@ -27,6 +59,16 @@ public:
   [[nodiscard]] auto get_width() const -> int { return m_width; }
   [[nodiscard]] auto get_height() const -> int { return m_height; }
   [[nodiscard]] auto get_format() const -> wgpu::TextureFormat { return m_format; }
+  [[nodiscard]] auto get_mip_level_count() const -> uint32_t { return m_mip_level_count; }
+
+  // Loads and converts an image file, plus CPU mips if the options ask for them. Safe to call from any thread.
+  // KTX2 files are recognized by their identifier and transcoded to the best format in compression.
+  [[nodiscard]] static auto decode_image(const char *file_path, const texture_options &options = {},
+                                         const texture_compression_support &compression = {}) -> image_data;
+  // Same for an encoded image already in memory, e.g. one embedded in a glTF binary or stored in an asset pack
+  [[nodiscard]] static auto decode_image(const uint8_t *encoded, size_t size, const texture_options &options = {},
+                                         const texture_compression_support &compression = {},
+                                         const std::string &label = "encoded image") -> image_data;
 
 private:
   wgpu::Device m_device;
@@ -38,10 +80,19 @@ private:
   int m_width = 0;
   int m_height = 0;
   wgpu::TextureFormat m_format;
+  texture_options m_options;
+  uint32_t m_mip_level_count = 1;
+  std::string m_label;
+  resource_handle m_resource;
 
   void create_texture_from_surface();
+  void create_texture_from_image(const image_data &image);
+  void create_texture_from_levels(const image_data &image);
+  void create_texture(const uint8_t *pixels, size_t row_pitch, const std::vector<mip_level> *cpu_mips);
+  void upload_mips(const std::vector<mip_level> &levels);
   void create_sampler(wgpu::AddressMode address_mode = wgpu::AddressMode::Repeat);
   void cleanup();
+  static auto decode_surface(SDL_Surface *surface, const texture_options &options) -> image_data;
 };
 
 } // namespace mareweb
@@ -0,0 +1,107 @@
+#ifndef MAREWEB_TEXTURE_LOADER_HPP
+#define MAREWEB_TEXTURE_LOADER_HPP
+
+#include "mareweb/texture.hpp"
+#include "mareweb/thread_pool.hpp"
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+#include <webgpu/webgpu_cpp.h>
+
+namespace mareweb {
+
+class asset_pack;
+
+// A texture that may still be loading. Until it is ready the handle serves a shared 1x1 placeholder, so it can be
+// bound immediately. Handles are only touched on the main thread.
+class texture_handle {
+public:
+  using ready_callback = std::function<void(const texture &)>;
+
+  texture_handle(std::shared_ptr<texture> placeholder, std::string path);
+  explicit texture_handle(std::unique_ptr<texture> loaded, std::string path = "");
+
+  [[nodiscard]] auto is_ready() const -> bool { return m_texture != nullptr; }
+  [[nodiscard]] auto has_failed() const -> bool { return m_error.has_value(); }
+  [[nodiscard]] auto get_error() const -> const std::optional<std::string> & { return m_error; }
+  [[nodiscard]] auto get_path() const -> const std::string & { return m_path; }
+  // The loaded texture once ready, the placeholder before that (and forever if loading failed)
+  [[nodiscard]] auto get_texture() const -> const texture & { return m_texture ? *m_texture : *m_placeholder; }
+  [[nodiscard]] auto get_texture_view() const -> wgpu::TextureView { return get_texture().get_texture_view(); }
+  [[nodiscard]] auto get_sampler() const -> wgpu::Sampler { return get_texture().get_sampler(); }
+
+  // Called once when the real texture is swapped in. Runs immediately if the handle is already ready.
+  auto on_ready(ready_callback callback) -> uint64_t;
+  void remove_callback(uint64_t id);
+
+private:
+  friend class texture_loader;
+
+  std::shared_ptr<texture> m_placeholder;
+  std::unique_ptr<texture> m_texture;
+  std::string m_path;
+  std::optional<std::string> m_error;
+  std::vector<std::pair<uint64_t, ready_callback>> m_callbacks;
+  uint64_t m_next_callback_id = 1;
+
+  void complete(std::unique_ptr<texture> loaded);
+  void fail(std::string error);
+};
+
+// Decodes image files on a worker pool (by default the process-wide shared one) and creates the GPU textures on the
+// main thread in poll(), a bounded number per frame so a burst of loads does not stall a single frame.
+class texture_loader {
+public:
+  explicit texture_loader(wgpu::Device &device, std::shared_ptr<thread_pool> pool = thread_pool::shared());
+
+  texture_loader(const texture_loader &) = delete;
+  auto operator=(const texture_loader &) -> texture_loader & = delete;
+  texture_loader(texture_loader &&) = delete;
+  auto operator=(texture_loader &&) -> texture_loader & = delete;
+
+  [[nodiscard]] auto load(const std::string &path, const texture_options &options = {})
+      -> std::shared_ptr<texture_handle>;
+  // Decodes an image file that is already in memory (PNG/JPEG or KTX2 bytes), label names it in errors and GPU captures
+  [[nodiscard]] auto load_encoded(std::vector<uint8_t> encoded, const std::string &label,
+                                  const texture_options &options = {}) -> std::shared_ptr<texture_handle>;
+  // Reads (and decompresses) a pack entry on the worker pool, then decodes it like load_encoded
+  [[nodiscard]] auto load_packed(std::shared_ptr<const asset_pack> pack, const std::string &name,
+                                 const texture_options &options = {}) -> std::shared_ptr<texture_handle>;
+  // Uploads up to max_uploads decoded images and fires their ready callbacks. Returns how many were uploaded.
+  auto poll(size_t max_uploads = DEFAULT_UPLOADS_PER_POLL) -> size_t;
+
+  [[nodiscard]] auto get_pending_count() const -> size_t { return m_pending; }
+  [[nodiscard]] auto get_placeholder() const -> const std::shared_ptr<texture> & { return m_placeholder; }
+
+  static constexpr size_t DEFAULT_UPLOADS_PER_POLL = 4;
+
+private:
+  struct decoded_image {
+    std::weak_ptr<texture_handle> handle;
+    texture_options options;
+    std::optional<image_data> image;
+    std::string error;
+  };
+
+  wgpu::Device m_device;
+  texture_compression_support m_compression;
+  std::shared_ptr<texture> m_placeholder;
+  std::mutex m_mutex;
+  std::deque<decoded_image> m_decoded;
+  size_t m_pending = 0;
+  // Declared last so running decodes finish before the queue they write into is destroyed
+  task_group m_tasks;
+
+  auto enqueue(const std::string &label, const texture_options &options, std::function<image_data()> decode)
+      -> std::shared_ptr<texture_handle>;
+};
+
+} // namespace mareweb
+
+#endif // MAREWEB_TEXTURE_LOADER_HPP
@@ -0,0 +1,82 @@
+#ifndef MAREWEB_THREAD_POOL_HPP
+#define MAREWEB_THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mareweb {
+
+// Fixed-size pool of worker threads draining a FIFO task queue.
+//
+// With zero workers (the default on Emscripten builds, which are compiled without pthreads) tasks stay queued until
+// run_pending() is called, so callers can spread them across frames on the main thread.
+class thread_pool {
+public:
+  explicit thread_pool(size_t worker_count = default_worker_count());
+  ~thread_pool();
+
+  thread_pool(const thread_pool &) = delete;
+  auto operator=(const thread_pool &) -> thread_pool & = delete;
+  thread_pool(thread_pool &&) = delete;
+  auto operator=(thread_pool &&) -> thread_pool & = delete;
+
+  void submit(std::function<void()> task);
+  // Runs up to max_tasks queued tasks on the calling thread and returns how many ran.
+  auto run_pending(size_t max_tasks) -> size_t;
+
+  [[nodiscard]] auto get_worker_count() const -> size_t { return m_workers.size(); }
+  [[nodiscard]] static auto default_worker_count() -> size_t;
+  // The process-wide pool the loaders share, so several renderers do not each start a core's worth of threads.
+  // Created on first use with the default worker count and destroyed with its last user.
+  [[nodiscard]] static auto shared() -> std::shared_ptr<thread_pool>;
+
+private:
+  std::vector<std::thread> m_workers;
+  std::deque<std::function<void()>> m_tasks;
+  std::mutex m_mutex;
+  std::condition_variable m_condition;
+  bool m_stopping = false;
+
+  void worker_loop();
+};
+
+// The tasks one owner submits to a (shared) pool. Destroying the group skips its tasks that have not started yet and
+// waits for the running ones, so tasks may use the owner's members like they would with a pool of its own.
+class task_group {
+public:
+  explicit task_group(std::shared_ptr<thread_pool> pool);
+  ~task_group();
+
+  task_group(const task_group &) = delete;
+  auto operator=(const task_group &) -> task_group & = delete;
+  task_group(task_group &&) = delete;
+  auto operator=(task_group &&) -> task_group & = delete;
+
+  void submit(std::function<void()> task);
+  // Runs queued tasks of every group on the pool, for pools without workers
+  auto run_pending(size_t max_tasks) -> size_t { return m_pool->run_pending(max_tasks); }
+
+  [[nodiscard]] auto get_worker_count() const -> size_t { return m_pool->get_worker_count(); }
+
+private:
+  // Outlives the group, skipped tasks still check it after the owner is gone
+  struct state {
+    std::mutex mutex;
+    std::condition_variable idle;
+    size_t running = 0;
+    bool cancelled = false;
+  };
+
+  std::shared_ptr<thread_pool> m_pool;
+  std::shared_ptr<state> m_state = std::make_shared<state>();
+};
+
+} // namespace mareweb
+
+#endif // MAREWEB_THREAD_POOL_HPP
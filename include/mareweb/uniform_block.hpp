@@ -0,0 +1,92 @@
+#ifndef MAREWEB_UNIFORM_BLOCK_HPP
+#define MAREWEB_UNIFORM_BLOCK_HPP
+
+#include "mareweb/buffer.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <webgpu/webgpu_cpp.h>
+
+namespace mareweb {
+
+enum class uniform_type : uint8_t {
+  f32,
+  i32,
+  u32,
+  vec2,
+  vec3,
+  vec4,
+  mat3, // columns padded to vec4, set from a squint mat3 or mat4x3
+  mat4,
+};
+
+struct uniform_field {
+  std::string name;
+  uniform_type type;
+  uint32_t offset;
+};
+
+// Fields of a WGSL uniform struct, laid out with the std140-compatible rules WGSL applies to the uniform address
+// space. The same description produces the WGSL struct declaration, so shader and CPU offsets cannot drift apart.
+class uniform_block_layout {
+public:
+  // Fields are indexed in the order they are added
+  auto add(std::string name, uniform_type type) -> uniform_block_layout &;
+
+  // Throws std::runtime_error for unknown names. Resolve indices once, not per update.
+  [[nodiscard]] auto find(std::string_view name) const -> uint32_t;
+  [[nodiscard]] auto get_fields() const -> const std::vector<uniform_field> & { return m_fields; }
+  // Rounded up to the struct alignment of 16
+  [[nodiscard]] auto get_size() const -> uint32_t;
+  [[nodiscard]] auto to_wgsl(std::string_view struct_name) const -> std::string;
+
+  [[nodiscard]] static auto get_alignment(uniform_type type) -> uint32_t;
+  [[nodiscard]] static auto get_size(uniform_type type) -> uint32_t;
+
+private:
+  std::vector<uniform_field> m_fields;
+  uint32_t m_end = 0;
+};
+
+// One uniform buffer holding every field of a layout. set() writes into a CPU shadow and widens the dirty range;
+// flush_all() uploads each dirty block with a single WriteBuffer, once per frame before the renderer submits.
+// Main thread only.
+class uniform_block {
+public:
+  uniform_block(wgpu::Device &device, uniform_block_layout layout, wgpu::ShaderStage visibility);
+  ~uniform_block();
+
+  // Registered in its device's dirty list by address, so it has to stay put
+  uniform_block(const uniform_block &) = delete;
+  auto operator=(const uniform_block &) -> uniform_block & = delete;
+  uniform_block(uniform_block &&) = delete;
+  auto operator=(uniform_block &&) -> uniform_block & = delete;
+
+  template <typename T> void set(uint32_t field, const T &value) { set(field, &value, sizeof(T)); }
+  // Size must match the field's type, or be 36 bytes for a tightly packed mat3
+  void set(uint32_t field, const void *data, size_t size);
+
+  // Uploads the dirty range now
+  void flush();
+  // Uploads every dirty block of the device
+  static void flush_all(wgpu::Device &device);
+
+  [[nodiscard]] auto get_layout() const -> const uniform_block_layout & { return m_layout; }
+  [[nodiscard]] auto get_buffer() const -> wgpu::Buffer { return m_buffer->get_buffer(); }
+  [[nodiscard]] auto get_size() const -> uint32_t { return static_cast<uint32_t>(m_shadow.size()); }
+
+private:
+  wgpu::Device m_device;
+  uniform_block_layout m_layout;
+  std::unique_ptr<uniform_buffer> m_buffer;
+  std::vector<uint8_t> m_shadow;
+  uint32_t m_dirty_begin = UINT32_MAX;
+  uint32_t m_dirty_end = 0;
+  bool m_queued = false;
+};
+
+} // namespace mareweb
+
+#endif // MAREWEB_UNIFORM_BLOCK_HPP
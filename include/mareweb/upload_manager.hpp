@@ -0,0 +1,171 @@
+#ifndef MAREWEB_UPLOAD_MANAGER_HPP
+#define MAREWEB_UPLOAD_MANAGER_HPP
+
+#include "mareweb/resource_registry.hpp"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <webgpu/webgpu_cpp.h>
+
+namespace mareweb {
+
+class upload_manager;
+
+// Writable staging memory for one copy. The copy is queued when the span is destroyed (or commit() is called), so fill
+// it first. Spans are move-only and may be filled on any thread.
+class upload_span {
+public:
+  upload_span() = default;
+  ~upload_span() { commit(); }
+
+  upload_span(const upload_span &) = delete;
+  auto operator=(const upload_span &) -> upload_span & = delete;
+  upload_span(upload_span &&other) noexcept
+      : m_manager(std::exchange(other.m_manager, nullptr)), m_data(std::exchange(other.m_data, nullptr)),
+        m_size(std::exchange(other.m_size, 0)), m_id(other.m_id) {}
+  auto operator=(upload_span &&other) noexcept -> upload_span & {
+    if (this != &other) {
+      commit();
+      m_manager = std::exchange(other.m_manager, nullptr);
+      m_data = std::exchange(other.m_data, nullptr);
+      m_size = std::exchange(other.m_size, 0);
+      m_id = other.m_id;
+    }
+    return *this;
+  }
+
+  [[nodiscard]] auto data() const -> uint8_t * { return m_data; }
+  [[nodiscard]] auto size() const -> uint64_t { return m_size; }
+  // Queues the copy to the destination given to reserve(). A span reserved without one is dropped.
+  void commit();
+  // Queues the copy to destination, after every copy and write queued so far. Main thread, offset 4-byte aligned.
+  void commit_to(wgpu::Buffer destination, uint64_t offset);
+
+private:
+  friend class upload_manager;
+
+  upload_manager *m_manager = nullptr;
+  uint8_t *m_data = nullptr;
+  uint64_t m_size = 0;
+  uint64_t m_id = 0;
+};
+
+struct upload_stats {
+  uint64_t chunk_count = 0;
+  uint64_t chunk_bytes = 0;
+  uint64_t staged_bytes = 0;   // copied from mapped chunks by the last flush
+  uint64_t fallback_bytes = 0; // written with WriteBuffer by the last flush
+};
+
+// Streams buffer updates through a ring of persistently mapped MapWrite|CopySrc staging chunks.
+//
+// Producers reserve() space and write straight into mapped memory. reserve(size) leaves the destination open, for
+// producers that fill data before it has a home, such as decoders on worker threads ahead of a geometry_arena
+// allocation; commit_to() gives it one later. flush() unmaps the filled chunks, submits their CopyBufferToBuffer
+// commands in its own command buffer and maps the chunks again, so they return to the ring once the GPU is done with
+// them. The renderer flushes right before it submits the frame, so everything committed during the frame is in place
+// for the frame's draws.
+//
+// Copies reach each destination in the order they were queued. Writes to a buffer with copies still queued must go
+// through write() too (buffer::update does this), otherwise Queue::WriteBuffer would land first.
+class upload_manager {
+public:
+  explicit upload_manager(wgpu::Device &device, uint64_t chunk_size = DEFAULT_CHUNK_SIZE);
+
+  upload_manager(const upload_manager &) = delete;
+  auto operator=(const upload_manager &) -> upload_manager & = delete;
+  upload_manager(upload_manager &&) = delete;
+  auto operator=(upload_manager &&) -> upload_manager & = delete;
+
+  // Returns the manager for this device, creating it on first use. Call it first from the main thread.
+  static auto get(wgpu::Device &device) -> upload_manager &;
+
+  // Offset and size must be multiples of 4, as for any buffer copy. Thread safe.
+  [[nodiscard]] auto reserve(wgpu::Buffer destination, uint64_t offset, uint64_t size) -> upload_span;
+  // Staging without a destination yet, committed with upload_span::commit_to. Thread safe.
+  [[nodiscard]] auto reserve(uint64_t size) -> upload_span;
+  void write(wgpu::Buffer destination, uint64_t offset, const void *data, uint64_t size);
+  // Copies into destination are queued but not submitted yet. Thread safe.
+  [[nodiscard]] auto has_pending(const wgpu::Buffer &destination) const -> bool;
+
+  // Main thread, outside of any pass. Submits the copies of spans committed so far, ahead of anything submitted after
+  // it. A copy waits for the next flush while its chunk has spans still being filled, and so does every later copy to
+  // the same buffer.
+  void flush();
+
+  [[nodiscard]] auto get_stats() const -> upload_stats;
+
+  static constexpr uint64_t DEFAULT_CHUNK_SIZE = 4ULL * 1024 * 1024;
+
+private:
+  friend class upload_span;
+
+  static constexpr uint32_t NO_CHUNK = UINT32_MAX;
+
+  enum class chunk_state : uint8_t {
+    mapped,  // writable, may hold reservations
+    mapping, // MapAsync in flight
+    retired, // oversized chunk released after use, slot can be reused
+  };
+
+  struct chunk {
+    wgpu::Buffer buffer;
+    uint8_t *mapped = nullptr;
+    uint64_t size = 0;
+    uint64_t used = 0;
+    uint32_t writers = 0; // spans reserved but not committed yet
+    chunk_state state = chunk_state::mapped;
+    bool oversized = false;
+    resource_handle resource;
+  };
+
+  // One span's upload. flush() sends them in sequence order, the order they got their destination.
+  struct pending_copy {
+    uint64_t sequence = 0;
+    uint32_t chunk = NO_CHUNK;
+    uint64_t source_offset = 0;
+    // Only used when no mapped chunk was available off the main thread, uploaded with WriteBuffer in order
+    std::vector<uint8_t> fallback;
+    wgpu::Buffer destination;
+    uint64_t destination_offset = 0;
+    uint64_t size = 0;
+    bool committed = false;
+  };
+
+  struct map_request {
+    upload_manager *manager;
+    uint32_t chunk;
+  };
+
+  wgpu::Device m_device;
+  uint64_t m_chunk_size;
+  std::thread::id m_main_thread;
+  mutable std::mutex m_mutex;
+  // Chunks are heap allocated so their mapped pointers and states stay put while the vector grows
+  std::vector<std::unique_ptr<chunk>> m_chunks;
+  // Worker spans get chunks of their own, so a slow decode never holds back the main thread's copies
+  uint32_t m_active = NO_CHUNK;
+  uint32_t m_worker_active = NO_CHUNK;
+  bool m_worker_fell_back = false; // flush() then maps a spare chunk for the workers
+  uint64_t m_next_id = 0; // span ids and copy sequence numbers
+  // By span id. Nodes stay put, so a fallback vector's storage stays valid while its span fills it.
+  std::unordered_map<uint64_t, pending_copy> m_copies;
+  std::unordered_map<WGPUBuffer, uint32_t> m_pending; // queued copies per destination
+  upload_stats m_last_flush;
+
+  auto reserve_span(wgpu::Buffer destination, uint64_t offset, uint64_t size) -> upload_span;
+  auto find_chunk(uint64_t size) -> uint32_t;
+  auto create_chunk(uint64_t size) -> uint32_t;
+  void commit(upload_span &span, wgpu::Buffer *destination, uint64_t offset);
+  void add_pending(const wgpu::Buffer &destination);
+  void remove_pending(const wgpu::Buffer &destination);
+  static void on_mapped(map_request &request, bool success);
+};
+
+} // namespace mareweb
+
+#endif // MAREWEB_UPLOAD_MANAGER_HPP
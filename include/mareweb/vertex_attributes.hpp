@@ -15,9 +15,20 @@ constexpr uint32_t POSITION = 0;
 constexpr uint32_t NORMAL = 1;
 constexpr uint32_t TEXCOORD = 2;
 constexpr uint32_t COLOR = 3;
+// Per-instance attributes read from an instance_buffer bound as a vertex buffer. The model matrix takes four
+// consecutive locations, one per column.
+constexpr uint32_t INSTANCE_MODEL = 8;
+constexpr uint32_t INSTANCE_COLOR = 12;
+constexpr uint32_t INSTANCE_DATA = 13;
 // Add more attribute locations as needed
 } // namespace attribute_locations
 
+// Vertex buffer slots set with SetVertexBuffer
+namespace vertex_buffer_slots {
+constexpr uint32_t MESH = 0;
+constexpr uint32_t INSTANCE = 1; // stepped per instance
+} // namespace vertex_buffer_slots
+
 // Represents a single vertex attribute description
 struct vertex_attribute {
   uint32_t location;
@@ -186,6 +197,17 @@ inline auto pos3_norm3_tex2_color4() -> vertex_layout {
   return with_colors(with_texcoords(with_normals(create_layout())));
 }
 
+// Layout of an instance_record: the model matrix columns, then the color and data of its instance_attributes
+inline auto instance_record_layout() -> vertex_layout {
+  vertex_layout layout;
+  for (uint32_t column = 0; column < 4; ++column) {
+    layout.add_attribute({attribute_locations::INSTANCE_MODEL + column, wgpu::VertexFormat::Float32x4, 0, "MODEL"});
+  }
+  layout.add_attribute({attribute_locations::INSTANCE_COLOR, wgpu::VertexFormat::Float32x4, 0, "INSTANCE_COLOR"});
+  layout.add_attribute({attribute_locations::INSTANCE_DATA, wgpu::VertexFormat::Float32x4, 0, "INSTANCE_DATA"});
+  return layout;
+}
+
 } // namespace vertex_layouts
 
 } // namespace mareweb
@@ -1,6 +1,7 @@
 #include "webgpu/webgpu_cpp.h"
 #define SDL_MAIN_HANDLED
 #include "mareweb/application.hpp"
+#include "mareweb/profiler.hpp"
 #include "mareweb/renderer.hpp"
 #include "squint/quantity.hpp"
 #include <SDL2/SDL.h>
@@ -32,14 +33,18 @@ auto application::get_instance() -> application & {
   return instance;
 }
 
-void application::initialize() {
+void application::initialize(const application_properties &properties) {
   if (m_initialized) {
     return;
   }
+  m_properties = properties;
+  profiler::get_instance().set_enabled(m_properties.cpu_profiling);
 
   init_sdl();
   init_webgpu();
 
+  m_last_frame_time = std::chrono::steady_clock::now();
+
   m_initialized = true;
 }
 
@@ -53,25 +58,42 @@ application::~application() {
 }
 
 void application::on_frame() {
-  static squint::duration dt_seconds{0.0F};
-  static auto last_time = std::chrono::high_resolution_clock::now();
-  auto current_time = std::chrono::high_resolution_clock::now();
-  dt_seconds = squint::duration(std::chrono::duration<float>(current_time - last_time).count());
-  last_time = current_time;
+  uint64_t frame_start_ns = profiler::now_ns();
+  auto current_time = std::chrono::steady_clock::now();
+  squint::duration dt_seconds(std::chrono::duration<float>(current_time - m_last_frame_time).count());
+  m_last_frame_time = current_time;
+
+  {
+    MAREWEB_PROFILE_ZONE("frame");
+    {
+      MAREWEB_PROFILE_ZONE("events");
+#ifndef __EMSCRIPTEN__
+      // headless renderers never present, so nothing else gives Dawn a chance to complete callbacks
+      m_instance.ProcessEvents();
+#endif
+      handle_events();
+    }
 
-  handle_events();
+    // Update all renderers and their object hierarchies
+    {
+      MAREWEB_PROFILE_ZONE("update");
+      for (auto &rend : m_renderers) {
+        // physics updates use a fixed time step
+        rend->update(rend->get_properties().fixed_time_step);
+      }
+    }
 
-  // Update all renderers and their object hierarchies
-  for (auto &rend : m_renderers) {
-    // physics updates use a fixed time step
-    rend->update(rend->get_properties().fixed_time_step);
+    // Render all renderers and their object hierarchies
+    {
+      MAREWEB_PROFILE_ZONE("render");
+      for (auto &rend : m_renderers) {
+        // render updates use the actual time step
+        rend->render(dt_seconds);
+      }
+    }
   }
 
-  // Render all renderers and their object hierarchies
-  for (auto &rend : m_renderers) {
-    // render updates use the actual time step
-    rend->render(dt_seconds);
-  }
+  profiler::get_instance().end_frame(frame_start_ns, profiler::now_ns());
 }
 
 void application::run() {
@@ -93,14 +115,31 @@ void application::run() {
 #endif
 }
 
+void application::run_frames(uint32_t frame_count) {
+  if (!m_initialized) {
+    throw std::runtime_error("Application not initialized");
+  }
+
+  for (uint32_t i = 0; i < frame_count && !m_quit; ++i) {
+    on_frame();
+  }
+}
+
 void application::quit() { m_quit = true; }
 
+void application::remove_renderers() {
+  m_renderers.clear();
+  m_quit = false;
+}
+
 void application::init_sdl() {
 #ifndef __EMSCRIPTEN__
   SDL_SetHint(SDL_HINT_VIDEODRIVER, "x11,wayland,windows");
 #endif
   SDL_SetMainReady();
-  if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+  // headless applications never open a window, so they must not require a display
+  Uint32 subsystems = m_properties.headless ? SDL_INIT_EVENTS : SDL_INIT_VIDEO;
+  if (SDL_Init(subsystems) != 0) {
     throw std::runtime_error(std::string("SDL initialization failed: ") + SDL_GetError());
   }
   // init sdl image for png and jpg support
@@ -198,6 +237,25 @@ void application::setup_webgpu_callbacks(wgpu::DeviceDescriptor &device_desc) {
 #endif
 }
 
+auto application::select_features(const wgpu::Adapter &adapter) const -> std::vector<wgpu::FeatureName> {
+  std::vector<wgpu::FeatureName> features;
+  if (m_properties.gpu_profiling) {
+    if (adapter.HasFeature(wgpu::FeatureName::TimestampQuery)) {
+      features.push_back(wgpu::FeatureName::TimestampQuery);
+    } else {
+      std::cerr << "GPU profiling requested but the adapter does not support timestamp queries" << std::endl;
+    }
+  }
+  // Compressed formats cost nothing to enable and let KTX2 textures stay compressed in VRAM
+  for (auto feature : {wgpu::FeatureName::TextureCompressionBC, wgpu::FeatureName::TextureCompressionETC2,
+                       wgpu::FeatureName::TextureCompressionASTC}) {
+    if (adapter.HasFeature(feature)) {
+      features.push_back(feature);
+    }
+  }
+  return features;
+}
+
 void application::init_webgpu() {
 #ifdef __EMSCRIPTEN__
   m_instance = wgpu::CreateInstance();
@@ -214,6 +272,9 @@ void application::init_webgpu() {
         // Create device descriptor with device lost callback info
         wgpu::DeviceDescriptor device_desc{};
         self->setup_webgpu_callbacks(device_desc);
+        auto features = self->select_features(adapter);
+        device_desc.requiredFeatureCount = features.size();
+        device_desc.requiredFeatures = features.data();
 
         adapter.RequestDevice(
             &device_desc,
@@ -244,6 +305,9 @@ void application::init_webgpu() {
         // Create device descriptor with device lost callback info
         wgpu::DeviceDescriptor device_desc{};
         app->setup_webgpu_callbacks(device_desc);
+        auto features = app->select_features(adapter);
+        device_desc.requiredFeatureCount = features.size();
+        device_desc.requiredFeatures = features.data();
 
         wgpu::Future device_future = adapter.RequestDevice(
             &device_desc, wgpu::CallbackMode::WaitAnyOnly,
@@ -0,0 +1,265 @@
+#include "mareweb/asset_pack.hpp"
+#include "mareweb/profiler.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten.h>
+#include <emscripten/fetch.h>
+#endif
+#ifdef MAREWEB_HAS_LZ4
+#include <lz4frame.h>
+#endif
+#ifdef MAREWEB_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+namespace mareweb {
+
+static_assert(std::endian::native == std::endian::little, "asset_pack reads little-endian data in place");
+
+namespace {
+
+struct pack_header {
+  std::array<char, 4> magic;
+  uint32_t version;
+  uint32_t entry_count;
+  uint32_t names_size;
+  uint64_t toc_offset;
+  uint64_t names_offset;
+};
+
+struct pack_record {
+  uint64_t offset;
+  uint64_t stored_size;
+  uint64_t size;
+  uint32_t name_offset;
+  uint16_t name_length;
+  uint8_t compression;
+  uint8_t reserved;
+};
+
+static_assert(sizeof(pack_header) == 32 && sizeof(pack_record) == 32, "must match tools/pack_assets.py");
+
+constexpr std::array<char, 4> MAGIC = {'M', 'W', 'P', '1'};
+
+#ifdef __EMSCRIPTEN__
+// Blocks (through Asyncify) until the bytes [offset, offset + size) of url have arrived
+auto fetch_range(const std::string &url, uint64_t offset, uint64_t size) -> std::vector<uint8_t> {
+  emscripten_fetch_attr_t attributes;
+  emscripten_fetch_attr_init(&attributes);
+  std::strcpy(attributes.requestMethod, "GET");
+  attributes.attributes = EMSCRIPTEN_FETCH_LOAD_TO_MEMORY;
+  const std::string range = "bytes=" + std::to_string(offset) + "-" + std::to_string(offset + size - 1);
+  const char *headers[] = {"Range", range.c_str(), nullptr};
+  attributes.requestHeaders = headers;
+
+  emscripten_fetch_t *fetch = emscripten_fetch(&attributes, url.c_str());
+  // readyState 4 is DONE, for success and failure alike
+  while (fetch->readyState != 4) {
+    emscripten_sleep(1);
+  }
+  const unsigned short status = fetch->status;
+  const auto *bytes = reinterpret_cast<const uint8_t *>(fetch->data);
+  std::vector<uint8_t> result;
+  if (status == 206 && fetch->numBytes >= size) {
+    result.assign(bytes, bytes + size);
+  } else if (status == 200 && fetch->numBytes >= offset + size) {
+    // The server ignored the range and sent the whole file
+    result.assign(bytes + offset, bytes + offset + size);
+  }
+  emscripten_fetch_close(fetch);
+  if (result.size() != size) {
+    throw std::runtime_error("Failed to fetch " + url + " (HTTP " + std::to_string(status) + ")");
+  }
+  return result;
+}
+#endif
+
+} // namespace
+
+asset_pack::asset_pack(const std::string &path) : m_path(path) {
+  MAREWEB_PROFILE_ZONE("asset_pack_open");
+#ifndef __EMSCRIPTEN__
+  m_file = mapped_file(path);
+#endif
+  const auto fail = [&path](const char *reason) {
+    return std::runtime_error("Invalid asset pack " + path + ": " + reason);
+  };
+
+  pack_header header{};
+  std::vector<uint8_t> header_bytes = read_range(0, sizeof(header));
+  std::memcpy(&header, header_bytes.data(), sizeof(header));
+  if (header.magic != MAGIC) {
+    throw fail("bad magic");
+  }
+  if (header.version != VERSION) {
+    throw fail("unsupported version");
+  }
+  // Range checks are written as differences, so corrupt offsets cannot wrap around
+  constexpr uint64_t MAX_OFFSET = std::numeric_limits<uint64_t>::max();
+  const uint64_t toc_size = uint64_t{header.entry_count} * sizeof(pack_record);
+  if (header.toc_offset > MAX_OFFSET - toc_size || header.names_offset != header.toc_offset + toc_size ||
+      header.names_size > MAX_OFFSET - header.names_offset) {
+    throw fail("bad table of contents");
+  }
+
+  // Table of contents and names are contiguous, one read covers both
+  const uint64_t index_size = header.names_offset + header.names_size - header.toc_offset;
+  std::vector<uint8_t> index = read_range(header.toc_offset, index_size);
+  const uint8_t *names = index.data() + (header.names_offset - header.toc_offset);
+
+  m_entries.reserve(header.entry_count);
+  for (uint32_t i = 0; i < header.entry_count; ++i) {
+    pack_record record{};
+    std::memcpy(&record, index.data() + (i * sizeof(pack_record)), sizeof(record));
+    if (uint64_t{record.name_offset} + record.name_length > header.names_size) {
+      throw fail("entry name out of range");
+    }
+    if (record.compression > static_cast<uint8_t>(asset_compression::zstd)) {
+      throw fail("unknown compression");
+    }
+    asset_pack_entry entry;
+    entry.name.assign(reinterpret_cast<const char *>(names + record.name_offset), record.name_length);
+    entry.offset = record.offset;
+    entry.stored_size = record.stored_size;
+    entry.size = record.size;
+    entry.compression = static_cast<asset_compression>(record.compression);
+#ifndef __EMSCRIPTEN__
+    if (entry.offset > m_file.size() || entry.stored_size > m_file.size() - entry.offset) {
+      throw fail("entry data out of range");
+    }
+#endif
+    m_entries.push_back(std::move(entry));
+  }
+  // The packer writes them sorted, but lookups must not depend on it
+  std::sort(m_entries.begin(), m_entries.end(), [](const auto &a, const auto &b) { return a.name < b.name; });
+}
+
+auto asset_pack::find(std::string_view name) const -> const asset_pack_entry * {
+  auto it = std::lower_bound(m_entries.begin(), m_entries.end(), name,
+                             [](const asset_pack_entry &entry, std::string_view key) { return entry.name < key; });
+  return it != m_entries.end() && it->name == name ? &*it : nullptr;
+}
+
+auto asset_pack::read(std::string_view name) const -> std::vector<uint8_t> {
+  const asset_pack_entry *entry = find(name);
+  if (entry == nullptr) {
+    throw std::runtime_error("Asset pack " + m_path + " has no entry " + std::string(name));
+  }
+  MAREWEB_PROFILE_ZONE("asset_pack_read");
+#ifndef __EMSCRIPTEN__
+  std::span<const uint8_t> stored(m_file.data() + entry->offset, entry->stored_size);
+  if (entry->compression == asset_compression::none) {
+    return {stored.begin(), stored.end()};
+  }
+  return decompress(*entry, stored);
+#else
+  std::vector<uint8_t> stored = read_range(entry->offset, entry->stored_size);
+  if (entry->compression == asset_compression::none) {
+    return stored;
+  }
+  return decompress(*entry, stored);
+#endif
+}
+
+auto asset_pack::view(std::string_view name) const -> std::span<const uint8_t> {
+#ifndef __EMSCRIPTEN__
+  const asset_pack_entry *entry = find(name);
+  if (entry != nullptr && entry->compression == asset_compression::none) {
+    return {m_file.data() + entry->offset, entry->stored_size};
+  }
+#else
+  (void)name;
+#endif
+  return {};
+}
+
+auto asset_pack::supports(asset_compression compression) -> bool {
+  switch (compression) {
+  case asset_compression::none:
+    return true;
+  case asset_compression::lz4:
+#ifdef MAREWEB_HAS_LZ4
+    return true;
+#else
+    return false;
+#endif
+  case asset_compression::zstd:
+#ifdef MAREWEB_HAS_ZSTD
+    return true;
+#else
+    return false;
+#endif
+  }
+  return false;
+}
+
+auto asset_pack::read_range(uint64_t offset, uint64_t size) const -> std::vector<uint8_t> {
+#ifndef __EMSCRIPTEN__
+  if (offset > m_file.size() || size > m_file.size() - offset) {
+    throw std::runtime_error("Asset pack " + m_path + " is truncated");
+  }
+  return {m_file.data() + offset, m_file.data() + offset + size};
+#else
+  return fetch_range(m_path, offset, size);
+#endif
+}
+
+auto asset_pack::decompress(const asset_pack_entry &entry, std::span<const uint8_t> stored) -> std::vector<uint8_t> {
+  std::vector<uint8_t> output(entry.size);
+  switch (entry.compression) {
+  case asset_compression::none:
+    std::memcpy(output.data(), stored.data(), stored.size());
+    return output;
+  case asset_compression::lz4: {
+#ifdef MAREWEB_HAS_LZ4
+    LZ4F_dctx *context = nullptr;
+    if (LZ4F_isError(LZ4F_createDecompressionContext(&context, LZ4F_VERSION))) {
+      throw std::runtime_error("Failed to create LZ4 context");
+    }
+    // Frames decode in blocks, keep feeding until the whole entry is out
+    size_t consumed = 0;
+    size_t produced = 0;
+    size_t hint = 1;
+    while (hint != 0 && consumed < stored.size() && produced < output.size()) {
+      size_t source_size = stored.size() - consumed;
+      size_t destination_size = output.size() - produced;
+      hint = LZ4F_decompress(context, output.data() + produced, &destination_size, stored.data() + consumed,
+                             &source_size, nullptr);
+      if (LZ4F_isError(hint)) {
+        LZ4F_freeDecompressionContext(context);
+        throw std::runtime_error("Corrupt LZ4 entry " + entry.name);
+      }
+      consumed += source_size;
+      produced += destination_size;
+    }
+    LZ4F_freeDecompressionContext(context);
+    if (produced != output.size()) {
+      throw std::runtime_error("Truncated LZ4 entry " + entry.name);
+    }
+    return output;
+#else
+    break;
+#endif
+  }
+  case asset_compression::zstd: {
+#ifdef MAREWEB_HAS_ZSTD
+    size_t result = ZSTD_decompress(output.data(), output.size(), stored.data(), stored.size());
+    if (ZSTD_isError(result) || result != output.size()) {
+      throw std::runtime_error("Corrupt zstd entry " + entry.name);
+    }
+    return output;
+#else
+    break;
+#endif
+  }
+  }
+  throw std::runtime_error("Asset pack entry " + entry.name + " uses a compression this build does not support");
+}
+
+} // namespace mareweb
@@ -0,0 +1,121 @@
+#include "mareweb/bind_group_cache.hpp"
+#include "mareweb/frame_stats.hpp"
+#include <algorithm>
+#include <map>
+#include <memory>
+
+namespace mareweb {
+
+namespace {
+
+template <typename T> void append(std::string &key, const T &value) {
+  key.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+} // namespace
+
+auto bind_group_cache::get(wgpu::Device &device) -> bind_group_cache & {
+  // Leaked on purpose, so cached bind groups are never released after their device at exit
+  static auto *caches = new std::map<WGPUDevice, std::unique_ptr<bind_group_cache>>();
+  auto &cache = (*caches)[device.Get()];
+  if (!cache) {
+    cache = std::make_unique<bind_group_cache>(device);
+  }
+  return *cache;
+}
+
+auto bind_group_cache::get_layout(const std::vector<wgpu::BindGroupLayoutEntry> &entries) -> wgpu::BindGroupLayout {
+  std::string key;
+  key.reserve(entries.size() * 48);
+  for (const auto &entry : entries) {
+    append(key, entry.binding);
+    append(key, entry.visibility);
+    append(key, entry.buffer.type);
+    append(key, entry.buffer.hasDynamicOffset);
+    append(key, entry.buffer.minBindingSize);
+    append(key, entry.sampler.type);
+    append(key, entry.texture.sampleType);
+    append(key, entry.texture.viewDimension);
+    append(key, entry.texture.multisampled);
+    append(key, entry.storageTexture.access);
+    append(key, entry.storageTexture.format);
+    append(key, entry.storageTexture.viewDimension);
+  }
+
+  auto it = m_layouts.find(key);
+  if (it != m_layouts.end()) {
+    return it->second;
+  }
+  wgpu::BindGroupLayoutDescriptor desc{};
+  desc.entryCount = static_cast<uint32_t>(entries.size());
+  desc.entries = entries.data();
+  wgpu::BindGroupLayout layout = m_device.CreateBindGroupLayout(&desc);
+  m_layouts.emplace(std::move(key), layout);
+  return layout;
+}
+
+auto bind_group_cache::get_bind_group(const wgpu::BindGroupLayout &layout,
+                                      const std::vector<wgpu::BindGroupEntry> &entries) -> wgpu::BindGroup {
+  // Keyed by handles: a cached bind group holds references to its resources, so their addresses cannot be reused
+  // while the entry exists
+  std::string key;
+  key.reserve(8 + (entries.size() * 48));
+  append(key, layout.Get());
+  for (const auto &entry : entries) {
+    append(key, entry.binding);
+    append(key, entry.buffer.Get());
+    append(key, entry.offset);
+    append(key, entry.size);
+    append(key, entry.sampler.Get());
+    append(key, entry.textureView.Get());
+  }
+
+  auto it = m_bind_groups.find(key);
+  if (it != m_bind_groups.end()) {
+    ++m_hits;
+    it->second.last_used = m_frame;
+    return it->second.bind_group;
+  }
+
+  ++m_misses;
+  wgpu::BindGroupDescriptor desc{};
+  desc.layout = layout;
+  desc.entryCount = static_cast<uint32_t>(entries.size());
+  desc.entries = entries.data();
+  wgpu::BindGroup bind_group = m_device.CreateBindGroup(&desc);
+  frame_counters::add_bind_group_created();
+  m_bind_groups.emplace(std::move(key), cached_bind_group{bind_group, m_frame});
+  return bind_group;
+}
+
+void bind_group_cache::end_frame(const void *renderer) {
+  bool seen = std::find(m_frame_renderers.begin(), m_frame_renderers.end(), renderer) != m_frame_renderers.end();
+  if (!seen) {
+    m_frame_renderers.push_back(renderer);
+    return;
+  }
+  m_frame_renderers.assign(1, renderer);
+  ++m_frame;
+  // Sweeping every frame is wasted work, idle entries only need to go eventually
+  if (m_frame % MAX_IDLE_FRAMES != 0) {
+    return;
+  }
+  std::erase_if(m_bind_groups,
+                [this](const auto &entry) { return m_frame - entry.second.last_used > MAX_IDLE_FRAMES; });
+}
+
+void bind_group_cache::clear() {
+  m_bind_groups.clear();
+  m_layouts.clear();
+}
+
+auto bind_group_cache::get_stats() const -> bind_group_cache_stats {
+  bind_group_cache_stats stats;
+  stats.layout_count = m_layouts.size();
+  stats.bind_group_count = m_bind_groups.size();
+  stats.hits = m_hits;
+  stats.misses = m_misses;
+  return stats;
+}
+
+} // namespace mareweb
@@ -1,4 +1,8 @@
 #include "mareweb/buffer.hpp"
+#include "mareweb/frame_stats.hpp"
+#include "mareweb/upload_manager.hpp"
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
 
 namespace mareweb {
@@ -8,11 +12,19 @@ buffer::buffer(wgpu::Device &device, const void *data, size_t size, wgpu::Buffer
   wgpu::BufferDescriptor desc{};
   desc.size = size;
   desc.usage = usage | wgpu::BufferUsage::CopyDst;
-  desc.mappedAtCreation = false;
+  // Initial contents are written straight into the new allocation, skipping WriteBuffer's staging copy. Mapping at
+  // creation needs a 4-byte multiple size.
+  desc.mappedAtCreation = data != nullptr && size % 4 == 0;
 
   m_buffer = device.CreateBuffer(&desc);
-  if (data != nullptr) {
+  m_resource = resource_registry::get_instance().register_buffer(desc.size, desc.usage);
+  if (desc.mappedAtCreation) {
+    std::memcpy(m_buffer.GetMappedRange(0, size), data, size);
+    m_buffer.Unmap();
+    frame_counters::add_buffer_upload(size);
+  } else if (data != nullptr) {
     device.GetQueue().WriteBuffer(m_buffer, 0, data, size);
+    frame_counters::add_buffer_upload(size);
   }
 }
 
@@ -20,14 +32,14 @@ void buffer::update(const void *data, size_t size) {
   if (size > m_size) {
     throw std::runtime_error("Update size exceeds buffer size");
   }
-  m_device.GetQueue().WriteBuffer(m_buffer, 0, data, size);
+  write(0, data, size);
 }
 
 void buffer::update(const void *data, size_t size, size_t offset) {
   if (offset + size > m_size) {
     throw std::runtime_error("Update range exceeds buffer size");
   }
-  m_device.GetQueue().WriteBuffer(m_buffer, offset, data, size);
+  write(offset, data, size);
 }
 
 void buffer::update_regions(const std::vector<std::tuple<const void *, size_t, size_t>> &regions) {
@@ -53,7 +65,7 @@ void buffer::update_regions(const std::vector<std::tuple<const void *, size_t, s
     } else if (offset == batch_offset + batch_size) {
       batch_size += size;
     } else {
-      m_device.GetQueue().WriteBuffer(m_buffer, batch_offset, batch_data, batch_size);
+      write(batch_offset, batch_data, batch_size);
       batch_data = data;
       batch_size = size;
       batch_offset = offset;
@@ -61,8 +73,30 @@ void buffer::update_regions(const std::vector<std::tuple<const void *, size_t, s
   }
 
   if (batch_active) {
-    m_device.GetQueue().WriteBuffer(m_buffer, batch_offset, batch_data, batch_size);
+    write(batch_offset, batch_data, batch_size);
+  }
+}
+
+void buffer::stage(const void *data, size_t size, size_t offset) {
+  if (offset + size > m_size) {
+    throw std::runtime_error("Update range exceeds buffer size");
+  }
+  upload_manager::get(m_device).write(m_buffer, offset, data, size);
+}
+
+void buffer::write(size_t offset, const void *data, size_t size) {
+  auto &uploads = upload_manager::get(m_device);
+  if (uploads.has_pending(m_buffer)) {
+    uploads.write(m_buffer, offset, data, size);
+    return;
   }
+  m_device.GetQueue().WriteBuffer(m_buffer, offset, data, size);
+  frame_counters::add_buffer_upload(size);
+}
+
+void buffer::set_label(const std::string &label) {
+  m_buffer.SetLabel(label.c_str());
+  resource_registry::get_instance().set_label(m_resource.get_id(), label);
 }
 
 buffer::~buffer() {
@@ -90,39 +124,39 @@ index_buffer::index_buffer(wgpu::Device &device, const std::vector<uint32_t> &in
 uniform_buffer::uniform_buffer(wgpu::Device &device, size_t size, wgpu::ShaderStage visibility)
     : buffer(device, nullptr, size, wgpu::BufferUsage::Uniform), m_visibility(visibility) {}
 
-storage_buffer::storage_buffer(wgpu::Device &device, const void *data, size_t size)
-    : buffer(device, data, size, wgpu::BufferUsage::Storage) {}
+storage_buffer::storage_buffer(wgpu::Device &device, const void *data, size_t size, wgpu::BufferUsage extra_usage)
+    : buffer(device, data, size, wgpu::BufferUsage::Storage | extra_usage) {}
 
 instance_buffer::instance_buffer(wgpu::Device &device, const std::vector<transform> &instances)
-    : storage_buffer(device, nullptr, instances.size() * sizeof(squint::mat4)), 
-      m_transforms(instances), 
-      m_active_count(0) {
+    : storage_buffer(device, nullptr, instances.size() * sizeof(instance_record), wgpu::BufferUsage::Vertex),
+      m_transforms(instances), m_attributes(instances.size()), m_active_count(0) {
   // Initialize buffer with transforms but set active count to 0
-  std::vector<squint::mat4> transforms;
-  transforms.reserve(instances.size());
-  for (const auto &t : instances) {
-    transforms.push_back(t.get_transformation_matrix());
-  }
-  buffer::update(transforms.data(), transforms.size() * sizeof(squint::mat4));
+  write_records(0, m_transforms.size());
 }
 
 void instance_buffer::update_transforms(const std::vector<transform> &instances) {
   if (instances.size() > m_transforms.size()) {
     throw std::runtime_error("Update size exceeds buffer capacity");
   }
-  
+
   // Update active instances
-  for (size_t i = 0; i < instances.size(); ++i) {
-    m_transforms[i] = instances[i];
-  }
+  std::copy(instances.begin(), instances.end(), m_transforms.begin());
   m_active_count = instances.size();
+  write_records(0, m_active_count);
+}
 
-  std::vector<squint::mat4> transforms;
-  transforms.reserve(m_transforms.size());
-  for (const auto &t : m_transforms) {
-    transforms.push_back(t.get_transformation_matrix());
+void instance_buffer::update_transforms(const std::vector<transform> &instances,
+                                        const std::vector<instance_attributes> &attributes) {
+  if (attributes.size() != instances.size()) {
+    throw std::runtime_error("Every instance needs its attributes");
   }
-  buffer::update(transforms.data(), transforms.size() * sizeof(squint::mat4));
+  if (instances.size() > m_transforms.size()) {
+    throw std::runtime_error("Update size exceeds buffer capacity");
+  }
+  std::copy(instances.begin(), instances.end(), m_transforms.begin());
+  std::copy(attributes.begin(), attributes.end(), m_attributes.begin());
+  m_active_count = instances.size();
+  write_records(0, m_active_count);
 }
 
 void instance_buffer::update_transform(size_t index, const transform &t) {
@@ -131,27 +165,30 @@ void instance_buffer::update_transform(size_t index, const transform &t) {
   }
   m_transforms[index] = t;
   auto t_matrix = t.get_transformation_matrix();
-  buffer::update(&t_matrix, sizeof(squint::mat4), index * sizeof(squint::mat4));
-  
+  buffer::update(&t_matrix, sizeof(squint::mat4), index * sizeof(instance_record));
+
   if (index >= m_active_count) {
     m_active_count = index + 1;
   }
 }
 
 void instance_buffer::update_transforms(const std::vector<std::pair<size_t, transform>> &updates) {
+  // Regions point into this, so it must not reallocate while they are collected
+  std::vector<squint::mat4> matrices;
+  matrices.reserve(updates.size());
   std::vector<std::tuple<const void *, size_t, size_t>> regions;
   regions.reserve(updates.size());
 
   size_t max_index = m_active_count;
-  
+
   for (const auto &[index, t] : updates) {
     if (index >= m_transforms.size()) {
       throw std::runtime_error("Instance index out of bounds");
     }
     m_transforms[index] = t;
-    auto t_matrix = t.get_transformation_matrix();
-    regions.emplace_back(&t_matrix, sizeof(squint::mat4), index * sizeof(squint::mat4));
-    
+    matrices.push_back(t.get_transformation_matrix());
+    regions.emplace_back(&matrices.back(), sizeof(squint::mat4), index * sizeof(instance_record));
+
     max_index = std::max(max_index, index + 1);
   }
 
@@ -159,21 +196,38 @@ void instance_buffer::update_transforms(const std::vector<std::pair<size_t, tran
   buffer::update_regions(regions);
 }
 
-void instance_buffer::clear_instances() {
-  m_active_count = 0;
+void instance_buffer::update_attributes(size_t index, const instance_attributes &attributes) {
+  if (index >= m_attributes.size()) {
+    throw std::runtime_error("Instance index out of bounds");
+  }
+  m_attributes[index] = attributes;
+  buffer::update(&attributes, sizeof(instance_attributes),
+                 (index * sizeof(instance_record)) + sizeof(squint::mat4));
 }
 
-auto instance_buffer::get_capacity() const -> uint32_t { 
-  return static_cast<uint32_t>(m_transforms.size()); 
+void instance_buffer::write_records(size_t first, size_t count) {
+  if (count == 0) {
+    return;
+  }
+  std::vector<instance_record> records(count);
+  for (size_t i = 0; i < count; ++i) {
+    records[i].transform = m_transforms[first + i].get_transformation_matrix();
+    records[i].attributes = m_attributes[first + i];
+  }
+  buffer::update(records.data(), count * sizeof(instance_record), first * sizeof(instance_record));
 }
 
-auto instance_buffer::get_active_count() const -> uint32_t { 
-  return static_cast<uint32_t>(m_active_count); 
+void instance_buffer::bind_vertex_buffer(wgpu::RenderPassEncoder &pass_encoder, uint32_t slot) const {
+  pass_encoder.SetVertexBuffer(slot, m_buffer, 0, m_active_count * sizeof(instance_record));
 }
 
-auto instance_buffer::get_transforms() const -> const std::vector<transform> & { 
-  return m_transforms; 
-}
+void instance_buffer::clear_instances() { m_active_count = 0; }
+
+auto instance_buffer::get_capacity() const -> uint32_t { return static_cast<uint32_t>(m_transforms.size()); }
+
+auto instance_buffer::get_active_count() const -> uint32_t { return static_cast<uint32_t>(m_active_count); }
+
+auto instance_buffer::get_transforms() const -> const std::vector<transform> & { return m_transforms; }
 
 auto instance_buffer::get_transform(size_t index) const -> const transform & {
   if (index >= m_transforms.size()) {
@@ -182,4 +236,11 @@ auto instance_buffer::get_transform(size_t index) const -> const transform & {
   return m_transforms[index];
 }
 
+auto instance_buffer::get_attributes(size_t index) const -> const instance_attributes & {
+  if (index >= m_attributes.size()) {
+    throw std::runtime_error("Instance index out of bounds");
+  }
+  return m_attributes[index];
+}
+
 } // namespace mareweb
\ No newline at end of file
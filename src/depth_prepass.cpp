@@ -0,0 +1,107 @@
+#include "mareweb/depth_prepass.hpp"
+#include "mareweb/bind_group_cache.hpp"
+#include "mareweb/frame_stats.hpp"
+#include <array>
+#include <stdexcept>
+#include <string>
+
+namespace mareweb {
+
+namespace {
+
+// Goes through clip_position with an invariant output, so its depth matches the color pass exactly
+const char *const DEPTH_PREPASS_SHADER = R"(
+@vertex
+fn main(@location(0) position: vec3<f32>) -> @builtin(position) @invariant vec4<f32> {
+    return clip_position(position);
+}
+)";
+
+constexpr uint32_t ALL_SAMPLES_MASK = 0xFFFFFFFF;
+
+} // namespace
+
+depth_prepass::depth_prepass(wgpu::Device &device, uint32_t sample_count)
+    : m_device(device), m_sample_count(sample_count) {
+  m_shader = std::make_unique<shader>(m_device,
+                                      std::string(FRAME_BINDINGS_WGSL) + DRAW_BINDINGS_WGSL + CLIP_POSITION_WGSL +
+                                          DEPTH_PREPASS_SHADER,
+                                      wgpu::ShaderStage::Vertex);
+
+  wgpu::BindGroupLayout empty_layout = bind_group_cache::get(m_device).get_layout({});
+  std::array<wgpu::BindGroupLayout, 3> layouts{frame_bindings::get_frame_layout(m_device), empty_layout,
+                                               frame_bindings::get_draw_layout(m_device)};
+  wgpu::PipelineLayoutDescriptor pipeline_layout_desc{};
+  pipeline_layout_desc.bindGroupLayoutCount = layouts.size();
+  pipeline_layout_desc.bindGroupLayouts = layouts.data();
+  m_pipeline_layout = m_device.CreatePipelineLayout(&pipeline_layout_desc);
+
+  wgpu::BindGroupDescriptor bind_group_desc{};
+  bind_group_desc.layout = empty_layout;
+  bind_group_desc.entryCount = 0;
+  m_empty_bind_group = m_device.CreateBindGroup(&bind_group_desc);
+}
+
+void depth_prepass::begin(wgpu::RenderPassEncoder &pass_encoder) {
+  pass_encoder.SetBindGroup(bind_group_index::MATERIAL, m_empty_bind_group);
+  frame_counters::add_bind_group_bind();
+}
+
+void depth_prepass::bind(wgpu::RenderPassEncoder &pass_encoder, pass_bindings &bindings, const mesh &geometry) {
+  wgpu::RenderPipeline pipeline =
+      get_pipeline(geometry.get_primitive_state(), geometry.get_vertex_layout().get_stride());
+  if (bindings.pipeline != pipeline.Get()) {
+    pass_encoder.SetPipeline(pipeline);
+    bindings.pipeline = pipeline.Get();
+    frame_counters::add_pipeline_bind();
+  }
+}
+
+auto depth_prepass::get_pipeline(const wgpu::PrimitiveState &primitive_state, uint64_t stride)
+    -> wgpu::RenderPipeline {
+  const pipeline_key key{primitive_state.topology, primitive_state.stripIndexFormat, primitive_state.frontFace,
+                         primitive_state.cullMode, stride};
+  auto it = m_pipelines.find(key);
+  if (it != m_pipelines.end()) {
+    return it->second;
+  }
+
+  // Position is always the first attribute, the rest of the vertex is skipped by the stride
+  wgpu::VertexAttribute position{};
+  position.format = wgpu::VertexFormat::Float32x3;
+  position.offset = 0;
+  position.shaderLocation = attribute_locations::POSITION;
+  wgpu::VertexBufferLayout buffer_layout{};
+  buffer_layout.arrayStride = stride;
+  buffer_layout.stepMode = wgpu::VertexStepMode::Vertex;
+  buffer_layout.attributeCount = 1;
+  buffer_layout.attributes = &position;
+
+  wgpu::DepthStencilState depth_stencil{};
+  depth_stencil.format = wgpu::TextureFormat::Depth24Plus;
+  depth_stencil.depthWriteEnabled = true;
+  depth_stencil.depthCompare = wgpu::CompareFunction::Less;
+
+  wgpu::RenderPipelineDescriptor pipeline_desc{};
+  pipeline_desc.label = "depth pre-pass";
+  pipeline_desc.layout = m_pipeline_layout;
+  pipeline_desc.vertex.module = m_shader->get_shader_module();
+  pipeline_desc.vertex.entryPoint = "main";
+  pipeline_desc.vertex.bufferCount = 1;
+  pipeline_desc.vertex.buffers = &buffer_layout;
+  pipeline_desc.primitive = primitive_state;
+  pipeline_desc.depthStencil = &depth_stencil;
+  pipeline_desc.fragment = nullptr;
+  pipeline_desc.multisample.count = m_sample_count;
+  pipeline_desc.multisample.mask = ALL_SAMPLES_MASK;
+
+  auto pipeline = m_device.CreateRenderPipeline(&pipeline_desc);
+  if (!pipeline) {
+    throw std::runtime_error("Failed to create depth pre-pass pipeline");
+  }
+  frame_counters::add_pipeline_created();
+  m_pipelines.emplace(key, pipeline);
+  return pipeline;
+}
+
+} // namespace mareweb
@@ -0,0 +1,150 @@
+#include "mareweb/draw_queue.hpp"
+#include "mareweb/frame_stats.hpp"
+#include "mareweb/profiler.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace mareweb {
+
+void draw_queue::submit(const draw_item &item) {
+  switch (item.surface->get_alpha_mode()) {
+  case alpha_mode::opaque:
+    m_opaque.push_back(item);
+    break;
+  case alpha_mode::masked:
+    m_masked.push_back(item);
+    break;
+  case alpha_mode::blended:
+    m_blended.push_back(item);
+    break;
+  case alpha_mode::weighted_blended:
+    m_weighted_blended.push_back(item);
+    break;
+  }
+}
+
+void draw_queue::cull(const occlusion_culler &culler, const squint::mat4 &view_projection) {
+  MAREWEB_PROFILE_ZONE("draw_queue_cull");
+  auto is_culled = [&](const draw_item &item) {
+    if (item.instances != nullptr) {
+      return false;
+    }
+    switch (culler.test(item.geometry->get_bounds(), item.uniforms.model, view_projection)) {
+    case cull_result::visible:
+      return false;
+    case cull_result::outside_frustum:
+      ++m_frustum_culled;
+      return true;
+    case cull_result::occluded:
+      ++m_occlusion_culled;
+      return true;
+    }
+    return false;
+  };
+  std::erase_if(m_opaque, is_culled);
+  std::erase_if(m_masked, is_culled);
+  std::erase_if(m_blended, is_culled);
+  std::erase_if(m_weighted_blended, is_culled);
+}
+
+void draw_queue::sort(const squint::vec4 &camera_position) {
+  MAREWEB_PROFILE_ZONE("draw_queue_sort");
+  auto set_distances = [&camera_position](std::vector<draw_item> &items) {
+    for (auto &item : items) {
+      // The model matrix is column major, its translation is the last column
+      const float *model = item.uniforms.model.data();
+      const float dx = model[12] - camera_position[0];
+      const float dy = model[13] - camera_position[1];
+      const float dz = model[14] - camera_position[2];
+      item.distance = (dx * dx) + (dy * dy) + (dz * dz);
+    }
+  };
+  auto front_to_back = [](const draw_item &a, const draw_item &b) {
+    return a.distance != b.distance ? a.distance < b.distance : a.surface < b.surface;
+  };
+  auto back_to_front = [](const draw_item &a, const draw_item &b) {
+    return a.distance != b.distance ? a.distance > b.distance : a.surface < b.surface;
+  };
+  auto by_material = [](const draw_item &a, const draw_item &b) { return a.surface < b.surface; };
+
+  set_distances(m_opaque);
+  set_distances(m_masked);
+  set_distances(m_blended);
+  std::sort(m_opaque.begin(), m_opaque.end(), front_to_back);
+  std::sort(m_masked.begin(), m_masked.end(), front_to_back);
+  std::sort(m_blended.begin(), m_blended.end(), back_to_front);
+  std::stable_sort(m_weighted_blended.begin(), m_weighted_blended.end(), by_material);
+}
+
+void draw_queue::record_depth_prepass(wgpu::RenderPassEncoder &pass_encoder, frame_bindings &frame,
+                                      geometry_bindings &geometry, depth_prepass &prepass) {
+  MAREWEB_PROFILE_ZONE("draw_queue_depth_prepass");
+  prepass.begin(pass_encoder);
+  for (auto &item : m_opaque) {
+    if (!can_prepass(item)) {
+      continue;
+    }
+    prepass.bind(pass_encoder, frame.get_pass_bindings(), *item.geometry);
+    item.draw_slot = frame.bind_draw(pass_encoder, item.uniforms);
+    item.prepassed = true;
+    item.geometry->draw(pass_encoder, geometry);
+    frame_counters::add_draw(1);
+  }
+}
+
+void draw_queue::record(wgpu::RenderPassEncoder &pass_encoder, frame_bindings &frame, geometry_bindings &geometry) {
+  MAREWEB_PROFILE_ZONE("draw_queue_record");
+  for (const auto *items : {&m_opaque, &m_masked, &m_blended}) {
+    for (const auto &item : *items) {
+      record_item(item, pass_encoder, frame, geometry);
+    }
+  }
+}
+
+void draw_queue::record_weighted_blended(wgpu::RenderPassEncoder &pass_encoder, frame_bindings &frame,
+                                         geometry_bindings &geometry) {
+  MAREWEB_PROFILE_ZONE("draw_queue_record_weighted_blended");
+  for (const auto &item : m_weighted_blended) {
+    record_item(item, pass_encoder, frame, geometry);
+  }
+}
+
+void draw_queue::clear() {
+  m_stats.opaque_count = m_opaque.size() + m_masked.size();
+  m_stats.blended_count = m_blended.size();
+  m_stats.weighted_blended_count = m_weighted_blended.size();
+  m_stats.prepass_count = std::count_if(m_opaque.begin(), m_opaque.end(), [](const auto &item) {
+    return item.prepassed;
+  });
+  m_stats.frustum_culled_count = std::exchange(m_frustum_culled, 0);
+  m_stats.occlusion_culled_count = std::exchange(m_occlusion_culled, 0);
+  m_opaque.clear();
+  m_masked.clear();
+  m_blended.clear();
+  m_weighted_blended.clear();
+}
+
+void draw_queue::record_item(const draw_item &item, wgpu::RenderPassEncoder &pass_encoder, frame_bindings &frame,
+                             geometry_bindings &geometry) {
+  if (item.prepassed) {
+    // Uniforms were appended by the pre-pass, only the pipeline differs
+    item.geometry->bind_material(*item.surface, pass_encoder, frame.get_pass_bindings(), depth_mode::equal);
+    frame.bind_draw_slot(pass_encoder, item.draw_slot);
+  } else {
+    item.geometry->bind_material(*item.surface, pass_encoder, frame.get_pass_bindings());
+    // The view-projection is applied on the GPU from the frame uniforms
+    frame.bind_draw(pass_encoder, item.uniforms);
+  }
+  // Storage-based instanced materials bind their instance buffer in their own group instead
+  if (item.instances != nullptr && item.surface->get_requirements().needs_instance_data) {
+    item.instances->bind_vertex_buffer(pass_encoder);
+  }
+  item.geometry->draw(pass_encoder, geometry, item.instance_count);
+  frame_counters::add_draw(item.instance_count);
+}
+
+auto draw_queue::can_prepass(const draw_item &item) -> bool {
+  return item.instances == nullptr && item.surface->supports_depth_prepass();
+}
+
+} // namespace mareweb
@@ -0,0 +1,126 @@
+#include "mareweb/frame_bindings.hpp"
+#include "mareweb/bind_group_cache.hpp"
+#include "mareweb/frame_stats.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace mareweb {
+
+namespace {
+
+auto uniform_layout_entry(wgpu::ShaderStage visibility, uint64_t size, bool dynamic_offset)
+    -> wgpu::BindGroupLayoutEntry {
+  wgpu::BindGroupLayoutEntry entry{};
+  entry.binding = 0;
+  entry.visibility = visibility;
+  entry.buffer.type = wgpu::BufferBindingType::Uniform;
+  entry.buffer.hasDynamicOffset = dynamic_offset;
+  entry.buffer.minBindingSize = size;
+  return entry;
+}
+
+} // namespace
+
+frame_bindings::frame_bindings(wgpu::Device &device, const light_clusters &lights) : m_device(device) {
+  m_frame_buffer = std::make_unique<uniform_buffer>(m_device, sizeof(frame_uniforms),
+                                                    wgpu::ShaderStage::Vertex | wgpu::ShaderStage::Fragment);
+  m_frame_buffer->set_label("frame_uniforms");
+
+  std::vector<wgpu::BindGroupEntry> entries(1);
+  entries[0].binding = 0;
+  entries[0].buffer = m_frame_buffer->get_buffer();
+  entries[0].size = sizeof(frame_uniforms);
+  for (const auto &entry : lights.get_bind_group_entries()) {
+    entries.push_back(entry);
+  }
+  wgpu::BindGroupDescriptor desc{};
+  desc.layout = get_frame_layout(m_device);
+  desc.entryCount = entries.size();
+  desc.entries = entries.data();
+  m_frame_bind_group = m_device.CreateBindGroup(&desc);
+
+  add_draw_block();
+}
+
+auto frame_bindings::get_frame_layout(wgpu::Device &device) -> wgpu::BindGroupLayout {
+  std::vector<wgpu::BindGroupLayoutEntry> entries{
+      uniform_layout_entry(wgpu::ShaderStage::Vertex | wgpu::ShaderStage::Fragment, sizeof(frame_uniforms), false)};
+  for (const auto &entry : light_clusters::get_layout_entries()) {
+    entries.push_back(entry);
+  }
+  return bind_group_cache::get(device).get_layout(entries);
+}
+
+auto frame_bindings::get_draw_layout(wgpu::Device &device) -> wgpu::BindGroupLayout {
+  return bind_group_cache::get(device).get_layout(
+      {uniform_layout_entry(wgpu::ShaderStage::Vertex, sizeof(draw_uniforms), true)});
+}
+
+void frame_bindings::begin_pass(wgpu::RenderPassEncoder &pass_encoder, const frame_uniforms &uniforms) {
+  m_frame_buffer->update(&uniforms, sizeof(uniforms));
+  begin_pass(pass_encoder);
+}
+
+void frame_bindings::begin_pass(wgpu::RenderPassEncoder &pass_encoder) {
+  m_pass_bindings.reset();
+  pass_encoder.SetBindGroup(bind_group_index::FRAME, m_frame_bind_group);
+  frame_counters::add_bind_group_bind();
+}
+
+auto frame_bindings::bind_draw(wgpu::RenderPassEncoder &pass_encoder, const draw_uniforms &uniforms) -> uint64_t {
+  if (m_draw_count / DRAWS_PER_BLOCK == m_draw_blocks.size()) {
+    add_draw_block();
+  }
+  const uint64_t slot = m_draw_count++;
+  std::memcpy(m_draw_data.data() + (slot * DRAW_STRIDE), &uniforms, sizeof(uniforms));
+  bind_draw_slot(pass_encoder, slot);
+  return slot;
+}
+
+void frame_bindings::bind_draw_slot(wgpu::RenderPassEncoder &pass_encoder, uint64_t slot) {
+  const uint64_t block = slot / DRAWS_PER_BLOCK;
+  const auto dynamic_offset = static_cast<uint32_t>((slot % DRAWS_PER_BLOCK) * DRAW_STRIDE);
+  pass_encoder.SetBindGroup(bind_group_index::DRAW, m_draw_blocks[block].bind_group, 1, &dynamic_offset);
+  frame_counters::add_bind_group_bind();
+}
+
+void frame_bindings::flush() {
+  constexpr uint64_t block_size = DRAWS_PER_BLOCK * DRAW_STRIDE;
+  for (uint64_t block = 0; block * DRAWS_PER_BLOCK < m_draw_count; ++block) {
+    const uint64_t draws = std::min(DRAWS_PER_BLOCK, m_draw_count - (block * DRAWS_PER_BLOCK));
+    // The last draw only needs its uniforms, not the padding up to the stride
+    const uint64_t size = ((draws - 1) * DRAW_STRIDE) + sizeof(draw_uniforms);
+    m_draw_blocks[block].buffer->update(m_draw_data.data() + (block * block_size), size);
+  }
+  m_last_draw_count = m_draw_count;
+  m_draw_count = 0;
+}
+
+auto frame_bindings::get_stats() const -> frame_bindings_stats {
+  frame_bindings_stats stats;
+  stats.draw_count = m_last_draw_count;
+  stats.block_count = m_draw_blocks.size();
+  return stats;
+}
+
+void frame_bindings::add_draw_block() {
+  constexpr uint64_t block_size = DRAWS_PER_BLOCK * DRAW_STRIDE;
+  draw_block block;
+  block.buffer = std::make_unique<uniform_buffer>(m_device, block_size, wgpu::ShaderStage::Vertex);
+  block.buffer->set_label("draw_uniforms");
+
+  wgpu::BindGroupEntry entry{};
+  entry.binding = 0;
+  entry.buffer = block.buffer->get_buffer();
+  entry.size = sizeof(draw_uniforms);
+  wgpu::BindGroupDescriptor desc{};
+  desc.layout = get_draw_layout(m_device);
+  desc.entryCount = 1;
+  desc.entries = &entry;
+  block.bind_group = m_device.CreateBindGroup(&desc);
+
+  m_draw_blocks.push_back(std::move(block));
+  m_draw_data.resize(m_draw_blocks.size() * block_size);
+}
+
+} // namespace mareweb
@@ -0,0 +1,90 @@
+#include "mareweb/frame_stats.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+namespace mareweb {
+
+auto frame_counters::take() -> frame_stats {
+  auto &own = m_counts;
+  auto &shared = unscoped();
+  auto drain = [](std::atomic<uint64_t> &a, std::atomic<uint64_t> &b) {
+    return a.exchange(0, std::memory_order_relaxed) + b.exchange(0, std::memory_order_relaxed);
+  };
+  frame_stats stats;
+  stats.draw_calls = drain(own.draw_calls, shared.draw_calls);
+  stats.instances_drawn = drain(own.instances_drawn, shared.instances_drawn);
+  stats.pipeline_binds = drain(own.pipeline_binds, shared.pipeline_binds);
+  stats.bind_group_binds = drain(own.bind_group_binds, shared.bind_group_binds);
+  stats.buffer_upload_bytes = drain(own.buffer_upload_bytes, shared.buffer_upload_bytes);
+  stats.texture_upload_bytes = drain(own.texture_upload_bytes, shared.texture_upload_bytes);
+  stats.pipelines_created = drain(own.pipelines_created, shared.pipelines_created);
+  stats.bind_groups_created = drain(own.bind_groups_created, shared.bind_groups_created);
+  return stats;
+}
+
+void frame_stats_history::push(const frame_stats &stats) {
+  m_last = stats;
+  m_history[m_next] = stats;
+  m_next = (m_next + 1) % HISTORY_LENGTH;
+  m_count = std::min(m_count + 1, HISTORY_LENGTH);
+
+  if (m_dump_interval > 0 && m_dump_file.is_open() && stats.frame_index % m_dump_interval == 0) {
+    dump();
+  }
+}
+
+auto frame_stats_history::get_average() const -> frame_stats_average {
+  frame_stats_average average;
+  if (m_count == 0) {
+    return average;
+  }
+  for (size_t i = 0; i < m_count; ++i) {
+    const auto &stats = m_history[i];
+    average.draw_calls += static_cast<double>(stats.draw_calls);
+    average.instances_drawn += static_cast<double>(stats.instances_drawn);
+    average.pipeline_binds += static_cast<double>(stats.pipeline_binds);
+    average.bind_group_binds += static_cast<double>(stats.bind_group_binds);
+    average.buffer_upload_bytes += static_cast<double>(stats.buffer_upload_bytes);
+    average.texture_upload_bytes += static_cast<double>(stats.texture_upload_bytes);
+    average.pipelines_created += static_cast<double>(stats.pipelines_created);
+    average.bind_groups_created += static_cast<double>(stats.bind_groups_created);
+    average.frame_time_ms += stats.frame_time_ms;
+  }
+  auto n = static_cast<double>(m_count);
+  average.draw_calls /= n;
+  average.instances_drawn /= n;
+  average.pipeline_binds /= n;
+  average.bind_group_binds /= n;
+  average.buffer_upload_bytes /= n;
+  average.texture_upload_bytes /= n;
+  average.pipelines_created /= n;
+  average.bind_groups_created /= n;
+  average.frame_time_ms /= n;
+  return average;
+}
+
+void frame_stats_history::set_dump_file(const std::string &path, uint32_t interval_frames) {
+  m_dump_file.close();
+  m_dump_interval = 0;
+  if (path.empty() || interval_frames == 0) {
+    return;
+  }
+  m_dump_file.open(path, std::ios::out | std::ios::trunc);
+  if (!m_dump_file) {
+    throw std::runtime_error("Failed to open frame stats file: " + path);
+  }
+  m_dump_interval = interval_frames;
+  m_dump_file << "frame,draw_calls,instances_drawn,pipeline_binds,bind_group_binds,buffer_upload_bytes,"
+                 "texture_upload_bytes,pipelines_created,bind_groups_created,frame_time_ms\n";
+}
+
+void frame_stats_history::dump() {
+  auto average = get_average();
+  m_dump_file << m_last.frame_index << ',' << average.draw_calls << ',' << average.instances_drawn << ','
+              << average.pipeline_binds << ',' << average.bind_group_binds << ',' << average.buffer_upload_bytes
+              << ',' << average.texture_upload_bytes << ',' << average.pipelines_created << ','
+              << average.bind_groups_created << ',' << average.frame_time_ms << '\n';
+  m_dump_file.flush();
+}
+
+} // namespace mareweb
@@ -0,0 +1,238 @@
+#include "mareweb/geometry_arena.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace mareweb {
+
+void geometry_allocation::reset() {
+  if (m_block != nullptr) {
+    m_arena->release(m_block);
+    m_block = nullptr;
+    m_arena = nullptr;
+  }
+}
+
+auto geometry_allocation::get_buffer() const -> wgpu::Buffer { return m_arena->get_block_buffer(*m_block); }
+
+geometry_arena::geometry_arena(wgpu::Device &device, uint64_t page_bytes) : m_device(device), m_page_bytes(page_bytes) {
+  pool indices;
+  indices.stride = sizeof(uint32_t);
+  indices.is_index = true;
+  m_pools.push_back(std::move(indices));
+  m_index_pool = 0;
+}
+
+auto geometry_arena::get(wgpu::Device &device) -> geometry_arena & {
+  // Leaked on purpose: meshes held by static objects may release their blocks during static destruction
+  static auto *arenas = new std::map<WGPUDevice, std::unique_ptr<geometry_arena>>();
+  auto &arena = (*arenas)[device.Get()];
+  if (!arena) {
+    arena = std::make_unique<geometry_arena>(device);
+  }
+  return *arena;
+}
+
+auto geometry_arena::allocate_vertices(const void *data, uint32_t vertex_count, uint32_t stride)
+    -> geometry_allocation {
+  uint32_t pool_index = get_vertex_pool(stride);
+  uint64_t byte_size = static_cast<uint64_t>(vertex_count) * stride;
+  auto staged = upload_manager::get(m_device).reserve(byte_size);
+  std::memcpy(staged.data(), data, byte_size);
+  return allocate(pool_index, staged, vertex_count);
+}
+
+auto geometry_arena::allocate_indices(const uint32_t *indices, uint32_t index_count) -> geometry_allocation {
+  uint64_t byte_size = static_cast<uint64_t>(index_count) * sizeof(uint32_t);
+  auto staged = upload_manager::get(m_device).reserve(byte_size);
+  std::memcpy(staged.data(), indices, byte_size);
+  return allocate(m_index_pool, staged, index_count);
+}
+
+auto geometry_arena::allocate_vertices(upload_span staged, uint32_t vertex_count, uint32_t stride)
+    -> geometry_allocation {
+  return allocate(get_vertex_pool(stride), staged, vertex_count);
+}
+
+auto geometry_arena::allocate_indices(upload_span staged, uint32_t index_count) -> geometry_allocation {
+  return allocate(m_index_pool, staged, index_count);
+}
+
+auto geometry_arena::get_vertex_pool(uint32_t stride) -> uint32_t {
+  if (stride == 0 || stride % 4 != 0) {
+    throw std::runtime_error("Vertex stride must be a non-zero multiple of 4 bytes: " + std::to_string(stride));
+  }
+  auto [it, inserted] = m_vertex_pools.try_emplace(stride, static_cast<uint32_t>(m_pools.size()));
+  if (inserted) {
+    pool vertices;
+    vertices.stride = stride;
+    m_pools.push_back(std::move(vertices));
+  }
+  return it->second;
+}
+
+auto geometry_arena::allocate(uint32_t pool_index, upload_span &staged, uint64_t count) -> geometry_allocation {
+  if (count == 0) {
+    throw std::runtime_error("Cannot allocate empty geometry");
+  }
+  auto &target = m_pools[pool_index];
+  if (staged.size() != count * target.stride) {
+    throw std::runtime_error("Staged geometry size does not match its element count");
+  }
+
+  std::optional<uint64_t> offset;
+  uint32_t page_index = 0;
+  for (; page_index < target.pages.size(); ++page_index) {
+    offset = take_range(target.pages[page_index], count);
+    if (offset) {
+      break;
+    }
+  }
+  if (!offset) {
+    page_index = create_page(target, count);
+    offset = take_range(target.pages[page_index], count);
+  }
+  auto &destination = target.pages[page_index];
+  ++destination.live_blocks;
+
+  staged.commit_to(destination.buffer, *offset * target.stride);
+
+  geometry_block *block = nullptr;
+  if (m_free_blocks.empty()) {
+    block = m_blocks.emplace_back(std::make_unique<geometry_block>()).get();
+  } else {
+    block = m_free_blocks.back();
+    m_free_blocks.pop_back();
+  }
+  *block = {pool_index, page_index, *offset, count};
+  return {this, block};
+}
+
+void geometry_arena::release(geometry_block *block) {
+  auto &source = m_pools[block->pool].pages[block->page];
+  return_range(source, block->offset, block->count);
+  --source.live_blocks;
+  block->count = 0;
+  m_free_blocks.push_back(block);
+}
+
+auto geometry_arena::create_page(pool &target, uint64_t min_elements) -> uint32_t {
+  page new_page;
+  new_page.capacity = std::max(m_page_bytes / target.stride, min_elements);
+  new_page.free_ranges.emplace(0, new_page.capacity);
+
+  std::string label =
+      target.is_index ? "geometry_arena/index" : "geometry_arena/stride_" + std::to_string(target.stride);
+  wgpu::BufferDescriptor desc{};
+  desc.size = new_page.capacity * target.stride;
+  desc.usage = (target.is_index ? wgpu::BufferUsage::Index : wgpu::BufferUsage::Vertex) | wgpu::BufferUsage::CopyDst |
+               wgpu::BufferUsage::CopySrc;
+  desc.label = label.c_str();
+  new_page.buffer = m_device.CreateBuffer(&desc);
+  new_page.resource = resource_registry::get_instance().register_buffer(desc.size, desc.usage, label);
+
+  target.pages.push_back(std::move(new_page));
+  return static_cast<uint32_t>(target.pages.size() - 1);
+}
+
+auto geometry_arena::take_range(page &target, uint64_t count) -> std::optional<uint64_t> {
+  for (auto it = target.free_ranges.begin(); it != target.free_ranges.end(); ++it) {
+    auto [offset, size] = *it;
+    if (size < count) {
+      continue;
+    }
+    target.free_ranges.erase(it);
+    if (size > count) {
+      target.free_ranges.emplace(offset + count, size - count);
+    }
+    return offset;
+  }
+  return std::nullopt;
+}
+
+void geometry_arena::return_range(page &target, uint64_t offset, uint64_t count) {
+  auto next = target.free_ranges.lower_bound(offset);
+  // Merge with the following range
+  if (next != target.free_ranges.end() && offset + count == next->first) {
+    count += next->second;
+    next = target.free_ranges.erase(next);
+  }
+  // Merge with the preceding range
+  if (next != target.free_ranges.begin()) {
+    auto previous = std::prev(next);
+    if (previous->first + previous->second == offset) {
+      previous->second += count;
+      return;
+    }
+  }
+  target.free_ranges.emplace(offset, count);
+}
+
+void geometry_arena::defragment(wgpu::CommandEncoder &encoder) {
+  auto &uploads = upload_manager::get(m_device);
+  for (uint32_t pool_index = 0; pool_index < m_pools.size(); ++pool_index) {
+    auto &target = m_pools[pool_index];
+    bool fragmented = target.pages.size() > 1 || std::any_of(target.pages.begin(), target.pages.end(),
+                                                              [](const page &p) { return p.free_ranges.size() > 1; });
+    // A queued copy would land in the old page after its block moved out
+    bool uploading = std::any_of(target.pages.begin(), target.pages.end(),
+                                 [&](const page &p) { return uploads.has_pending(p.buffer); });
+    if (!fragmented || uploading) {
+      continue;
+    }
+
+    std::vector<geometry_block *> live;
+    for (auto &block : m_blocks) {
+      if (block->count > 0 && block->pool == pool_index) {
+        live.push_back(block.get());
+      }
+    }
+    // Keep the existing order within a page so neighbouring meshes stay neighbours
+    std::sort(live.begin(), live.end(), [](const geometry_block *a, const geometry_block *b) {
+      return a->page != b->page ? a->page < b->page : a->offset < b->offset;
+    });
+
+    std::vector<page> old_pages = std::exchange(target.pages, {});
+    uint32_t page_index = 0;
+    uint64_t cursor = 0;
+    for (auto *block : live) {
+      if (target.pages.empty() || cursor + block->count > target.pages[page_index].capacity) {
+        page_index = create_page(target, block->count);
+        cursor = 0;
+      }
+      auto &destination = target.pages[page_index];
+      encoder.CopyBufferToBuffer(old_pages[block->page].buffer, block->offset * target.stride, destination.buffer,
+                                 cursor * target.stride, block->count * target.stride);
+      block->page = page_index;
+      block->offset = cursor;
+      cursor += block->count;
+      ++destination.live_blocks;
+      destination.free_ranges.clear();
+      if (cursor < destination.capacity) {
+        destination.free_ranges.emplace(cursor, destination.capacity - cursor);
+      }
+    }
+    // The old buffers stay alive until the encoder's commands have executed, dropping our references is enough
+  }
+}
+
+auto geometry_arena::get_stats() const -> geometry_arena_stats {
+  geometry_arena_stats stats;
+  for (const auto &target : m_pools) {
+    for (const auto &p : target.pages) {
+      ++stats.page_count;
+      stats.capacity_bytes += p.capacity * target.stride;
+      uint64_t free_elements = 0;
+      for (const auto &[offset, count] : p.free_ranges) {
+        free_elements += count;
+      }
+      stats.used_bytes += (p.capacity - free_elements) * target.stride;
+      stats.block_count += p.live_blocks;
+      stats.free_range_count += p.free_ranges.size();
+    }
+  }
+  return stats;
+}
+
+} // namespace mareweb
@@ -0,0 +1,562 @@
+#include "mareweb/gltf_loader.hpp"
+#include "mareweb/profiler.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+#define CGLTF_IMPLEMENTATION
+#include <cgltf.h>
+
+namespace mareweb {
+
+namespace {
+
+auto describe(cgltf_result result) -> const char * {
+  switch (result) {
+  case cgltf_result_data_too_short:
+    return "data too short";
+  case cgltf_result_unknown_format:
+    return "unknown format";
+  case cgltf_result_invalid_json:
+    return "invalid JSON";
+  case cgltf_result_invalid_gltf:
+    return "invalid glTF";
+  case cgltf_result_file_not_found:
+    return "file not found";
+  case cgltf_result_io_error:
+    return "I/O error";
+  case cgltf_result_out_of_memory:
+    return "out of memory";
+  case cgltf_result_legacy_gltf:
+    return "glTF 1.0 is not supported";
+  default:
+    return "error";
+  }
+}
+
+auto find_attribute(const cgltf_primitive &primitive, cgltf_attribute_type type) -> const cgltf_accessor * {
+  for (cgltf_size i = 0; i < primitive.attributes_count; ++i) {
+    const cgltf_attribute &attribute = primitive.attributes[i];
+    // Only the first set of texcoords and colors is used
+    if (attribute.type == type && attribute.index == 0) {
+      return attribute.data;
+    }
+  }
+  return nullptr;
+}
+
+// Copies an accessor into one attribute slot of an interleaved vertex buffer. Tightly typed float data is copied
+// as-is; normalized integers, vec3 colors and sparse accessors are converted element by element.
+void copy_attribute(const cgltf_accessor &accessor, uint32_t components, uint8_t *vertices, uint64_t stride,
+                    uint64_t offset) {
+  const uint8_t *source = accessor.buffer_view != nullptr ? cgltf_buffer_view_data(accessor.buffer_view) : nullptr;
+  if (source != nullptr && !accessor.is_sparse && accessor.component_type == cgltf_component_type_r_32f &&
+      cgltf_num_components(accessor.type) == components) {
+    source += accessor.offset;
+    for (cgltf_size i = 0; i < accessor.count; ++i) {
+      std::memcpy(vertices + (i * stride) + offset, source + (i * accessor.stride), components * sizeof(float));
+    }
+    return;
+  }
+
+  for (cgltf_size i = 0; i < accessor.count; ++i) {
+    // Alpha defaults to opaque when a color has only three components
+    std::array<float, 4> element = {0.0F, 0.0F, 0.0F, 1.0F};
+    cgltf_accessor_read_float(&accessor, i, element.data(), element.size());
+    std::memcpy(vertices + (i * stride) + offset, element.data(), components * sizeof(float));
+  }
+}
+
+auto read_position(const cgltf_accessor &positions, cgltf_size vertex) -> std::array<float, 3> {
+  std::array<float, 3> value{};
+  cgltf_accessor_read_float(&positions, vertex, value.data(), value.size());
+  return value;
+}
+
+// Bounds from the accessor's min/max when the file has them, otherwise from the positions themselves
+auto accessor_bounds(const cgltf_accessor &positions) -> mesh_bounds {
+  if (positions.has_min && positions.has_max) {
+    return {{positions.min[0], positions.min[1], positions.min[2]},
+            {positions.max[0], positions.max[1], positions.max[2]}};
+  }
+  mesh_bounds bounds{read_position(positions, 0), read_position(positions, 0)};
+  for (cgltf_size i = 1; i < positions.count; ++i) {
+    const auto position = read_position(positions, i);
+    for (size_t axis = 0; axis < 3; ++axis) {
+      bounds.min[axis] = std::min(bounds.min[axis], position[axis]);
+      bounds.max[axis] = std::max(bounds.max[axis], position[axis]);
+    }
+  }
+  return bounds;
+}
+
+// Area weighted vertex normals for triangle lists that do not provide their own. Other topologies keep +Y. Reads the
+// accessors rather than the vertices already written, which sit in write-combined staging memory.
+void generate_normals(const cgltf_accessor &positions, const cgltf_accessor *indices, uint8_t *vertices,
+                      const vertex_layout &layout, wgpu::PrimitiveTopology topology) {
+  const auto vertex_count = static_cast<uint32_t>(positions.count);
+  const uint64_t stride = layout.get_stride();
+  uint64_t normal_offset = 0;
+  for (const auto &attribute : layout.get_attributes()) {
+    if (attribute.location == attribute_locations::NORMAL) {
+      normal_offset = attribute.offset;
+    }
+  }
+
+  std::vector<std::array<float, 3>> accumulated(vertex_count, {0.0F, 0.0F, 0.0F});
+  if (topology == wgpu::PrimitiveTopology::TriangleList) {
+    const size_t corner_count = indices == nullptr ? vertex_count : indices->count;
+    for (size_t corner = 0; corner + 2 < corner_count; corner += 3) {
+      std::array<uint32_t, 3> triangle{};
+      for (size_t i = 0; i < 3; ++i) {
+        triangle[i] = indices == nullptr ? static_cast<uint32_t>(corner + i)
+                                         : static_cast<uint32_t>(cgltf_accessor_read_index(indices, corner + i));
+      }
+      if (triangle[0] >= vertex_count || triangle[1] >= vertex_count || triangle[2] >= vertex_count) {
+        continue;
+      }
+      const auto a = read_position(positions, triangle[0]);
+      const auto b = read_position(positions, triangle[1]);
+      const auto c = read_position(positions, triangle[2]);
+      const std::array<float, 3> ab = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+      const std::array<float, 3> ac = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+      // Unnormalized, so larger triangles weigh more
+      const std::array<float, 3> face = {(ab[1] * ac[2]) - (ab[2] * ac[1]), (ab[2] * ac[0]) - (ab[0] * ac[2]),
+                                         (ab[0] * ac[1]) - (ab[1] * ac[0])};
+      for (uint32_t vertex : triangle) {
+        for (size_t axis = 0; axis < 3; ++axis) {
+          accumulated[vertex][axis] += face[axis];
+        }
+      }
+    }
+  }
+
+  for (uint32_t vertex = 0; vertex < vertex_count; ++vertex) {
+    std::array<float, 3> normal = accumulated[vertex];
+    const float length = std::sqrt((normal[0] * normal[0]) + (normal[1] * normal[1]) + (normal[2] * normal[2]));
+    normal = length > 0.0F ? std::array<float, 3>{normal[0] / length, normal[1] / length, normal[2] / length}
+                           : std::array<float, 3>{0.0F, 1.0F, 0.0F};
+    std::memcpy(vertices + (vertex * stride) + normal_offset, normal.data(), sizeof(normal));
+  }
+}
+
+} // namespace
+
+void gltf_stream::set_listener(structure_callback on_structure, primitive_callback on_primitive) {
+  m_on_structure = std::move(on_structure);
+  m_on_primitive = std::move(on_primitive);
+  if (m_has_structure && m_on_structure) {
+    m_on_structure(*this);
+  }
+}
+
+void gltf_stream::clear_listener() {
+  m_on_structure = nullptr;
+  m_on_primitive = nullptr;
+}
+
+void gltf_stream::fail(std::string error) {
+  std::cerr << "Failed to load glTF " << m_path << ": " << error << std::endl;
+  m_error = std::move(error);
+}
+
+gltf_loader::gltf_loader(wgpu::Device &device, texture_loader &textures, std::shared_ptr<thread_pool> pool)
+    : m_device(device), m_textures(textures), m_uploads(upload_manager::get(m_device)), m_tasks(std::move(pool)) {}
+
+auto gltf_loader::load(const std::string &path) -> std::shared_ptr<gltf_stream> {
+  auto stream = std::make_shared<gltf_stream>(path);
+
+  m_tasks.submit([this, path, weak_stream = std::weak_ptr<gltf_stream>(stream)]() {
+    if (weak_stream.expired()) {
+      return;
+    }
+    MAREWEB_PROFILE_ZONE("gltf_parse");
+    cgltf_options options{};
+    cgltf_data *parsed = nullptr;
+    cgltf_result result = cgltf_parse_file(&options, path.c_str(), &parsed);
+    // Shared by the primitive tasks below, the accessors point into its buffers
+    std::shared_ptr<cgltf_data> data(parsed, cgltf_free);
+    if (result == cgltf_result_success) {
+      result = cgltf_load_buffers(&options, data.get(), path.c_str());
+    }
+    if (result == cgltf_result_success) {
+      result = cgltf_validate(data.get());
+    }
+
+    decoded_item item;
+    item.stream = weak_stream;
+    if (result != cgltf_result_success) {
+      item.error = describe(result);
+      push(std::move(item));
+      return;
+    }
+    try {
+      item.structure = decode_structure(*data, path);
+    } catch (const std::exception &e) {
+      item.error = e.what();
+      push(std::move(item));
+      return;
+    }
+    push(std::move(item));
+
+    // One task per primitive, so a large file decodes across all workers and uploads start with the first ones done
+    for (cgltf_size mesh = 0; mesh < data->meshes_count; ++mesh) {
+      for (cgltf_size primitive = 0; primitive < data->meshes[mesh].primitives_count; ++primitive) {
+        m_tasks.submit([this, data, weak_stream, mesh = static_cast<uint32_t>(mesh),
+                        primitive = static_cast<uint32_t>(primitive)]() {
+          decoded_item decoded;
+          decoded.stream = weak_stream;
+          if (!weak_stream.expired()) {
+            MAREWEB_PROFILE_ZONE("gltf_decode_primitive");
+            try {
+              decoded.primitive = decode_primitive(*data, mesh, primitive, m_uploads);
+            } catch (const std::exception &e) {
+              std::cerr << "Skipping glTF primitive " << mesh << "/" << primitive << ": " << e.what() << std::endl;
+            }
+          }
+          push(std::move(decoded));
+        });
+      }
+    }
+  });
+
+  return stream;
+}
+
+auto gltf_loader::poll(size_t max_uploads) -> size_t {
+  MAREWEB_PROFILE_ZONE("gltf_loader_poll");
+  if (m_tasks.get_worker_count() == 0) {
+    // No worker threads (Emscripten), decode on the main thread at the same rate we upload
+    m_tasks.run_pending(max_uploads);
+  }
+
+  size_t uploaded = 0;
+  while (uploaded < max_uploads) {
+    decoded_item item;
+    {
+      std::lock_guard lock(m_mutex);
+      if (m_decoded.empty()) {
+        break;
+      }
+      item = std::move(m_decoded.front());
+      m_decoded.pop_front();
+    }
+
+    auto stream = item.stream.lock();
+    if (!stream || stream->has_failed()) {
+      continue;
+    }
+    if (!item.error.empty()) {
+      stream->fail(std::move(item.error));
+      continue;
+    }
+    if (item.structure) {
+      deliver_structure(*stream, *item.structure);
+      continue;
+    }
+    if (item.primitive) {
+      try {
+        deliver_primitive(*stream, *item.primitive);
+        ++uploaded;
+        continue;
+      } catch (const std::exception &e) {
+        std::cerr << "Skipping glTF primitive in " << stream->get_path() << ": " << e.what() << std::endl;
+      }
+    }
+    // Skipped primitives still count, so the stream can finish loading
+    ++stream->m_delivered;
+  }
+  return uploaded;
+}
+
+void gltf_loader::push(decoded_item item) {
+  std::lock_guard lock(m_mutex);
+  m_decoded.push_back(std::move(item));
+}
+
+auto gltf_loader::decode_structure(const cgltf_data &data, const std::string &path) -> decoded_structure {
+  decoded_structure structure;
+
+  structure.nodes.resize(data.nodes_count);
+  for (cgltf_size i = 0; i < data.nodes_count; ++i) {
+    const cgltf_node &source = data.nodes[i];
+    gltf_node &node = structure.nodes[i];
+    if (source.name != nullptr) {
+      node.name = source.name;
+    }
+    // Column-major, like squint's storage
+    std::array<float, 16> local{};
+    cgltf_node_transform_local(&source, local.data());
+    std::memcpy(node.local_transform.data(), local.data(), sizeof(local));
+    if (source.mesh != nullptr) {
+      node.mesh = static_cast<int32_t>(cgltf_mesh_index(&data, source.mesh));
+    }
+    for (cgltf_size child = 0; child < source.children_count; ++child) {
+      node.children.push_back(static_cast<uint32_t>(cgltf_node_index(&data, source.children[child])));
+    }
+  }
+
+  const cgltf_scene *scene = data.scene != nullptr ? data.scene : (data.scenes_count > 0 ? data.scenes : nullptr);
+  if (scene != nullptr) {
+    for (cgltf_size i = 0; i < scene->nodes_count; ++i) {
+      structure.root_nodes.push_back(static_cast<uint32_t>(cgltf_node_index(&data, scene->nodes[i])));
+    }
+  } else {
+    // No scene, show every top level node
+    for (cgltf_size i = 0; i < data.nodes_count; ++i) {
+      if (data.nodes[i].parent == nullptr) {
+        structure.root_nodes.push_back(static_cast<uint32_t>(i));
+      }
+    }
+  }
+
+  for (cgltf_size i = 0; i < data.materials_count; ++i) {
+    const cgltf_material &source = data.materials[i];
+    gltf_material material;
+    if (source.has_pbr_metallic_roughness) {
+      const float *factor = source.pbr_metallic_roughness.base_color_factor;
+      material.base_color = squint::vec4{factor[0], factor[1], factor[2], factor[3]};
+      if (const cgltf_texture *texture = source.pbr_metallic_roughness.base_color_texture.texture) {
+        material.base_color_texture = static_cast<int32_t>(cgltf_texture_index(&data, texture));
+      }
+    }
+    material.double_sided = source.double_sided != 0;
+    if (source.alpha_mode == cgltf_alpha_mode_mask) {
+      material.alpha = alpha_mode::masked;
+      material.alpha_cutoff = source.alpha_cutoff;
+    } else if (source.alpha_mode == cgltf_alpha_mode_blend) {
+      material.alpha = alpha_mode::blended;
+    }
+    structure.materials.push_back(material);
+  }
+
+  for (cgltf_size i = 0; i < data.textures_count; ++i) {
+    const cgltf_texture &source = data.textures[i];
+    decoded_texture texture;
+    if (source.image != nullptr) {
+      texture.image = static_cast<int32_t>(cgltf_image_index(&data, source.image));
+    }
+    if (source.sampler != nullptr) {
+      switch (static_cast<int>(source.sampler->wrap_s)) {
+      case 33071: // CLAMP_TO_EDGE
+        texture.address_mode = wgpu::AddressMode::ClampToEdge;
+        break;
+      case 33648: // MIRRORED_REPEAT
+        texture.address_mode = wgpu::AddressMode::MirrorRepeat;
+        break;
+      default:
+        texture.address_mode = wgpu::AddressMode::Repeat;
+        break;
+      }
+    }
+    structure.textures.push_back(texture);
+  }
+
+  const std::filesystem::path directory = std::filesystem::path(path).parent_path();
+  for (cgltf_size i = 0; i < data.images_count; ++i) {
+    const cgltf_image &source = data.images[i];
+    embedded_image image;
+    if (source.buffer_view != nullptr) {
+      const uint8_t *bytes = cgltf_buffer_view_data(source.buffer_view);
+      if (bytes != nullptr) {
+        image.bytes.assign(bytes, bytes + source.buffer_view->size);
+      }
+    } else if (source.uri != nullptr && std::strncmp(source.uri, "data:", 5) == 0) {
+      const char *base64 = std::strstr(source.uri, ";base64,");
+      if (base64 != nullptr) {
+        base64 += 8;
+        const size_t length = std::strlen(base64);
+        const auto padding = static_cast<size_t>(std::count(base64, base64 + length, '='));
+        const size_t size = ((length / 4) * 3) - padding;
+        cgltf_options options{};
+        void *decoded = nullptr;
+        if (cgltf_load_buffer_base64(&options, size, base64, &decoded) == cgltf_result_success) {
+          image.bytes.assign(static_cast<const uint8_t *>(decoded), static_cast<const uint8_t *>(decoded) + size);
+          std::free(decoded);
+        }
+      }
+    } else if (source.uri != nullptr) {
+      std::string uri = source.uri;
+      uri.resize(cgltf_decode_uri(uri.data()));
+      image.uri = (directory / uri).string();
+    }
+    structure.images.push_back(std::move(image));
+  }
+
+  for (cgltf_size i = 0; i < data.meshes_count; ++i) {
+    structure.primitive_count += data.meshes[i].primitives_count;
+  }
+  return structure;
+}
+
+auto gltf_loader::decode_primitive(const cgltf_data &data, uint32_t mesh, uint32_t primitive, upload_manager &uploads)
+    -> decoded_primitive {
+  const cgltf_primitive &source = data.meshes[mesh].primitives[primitive];
+  decoded_primitive decoded;
+  decoded.mesh = mesh;
+  decoded.primitive = primitive;
+
+  const cgltf_accessor *positions = find_attribute(source, cgltf_attribute_type_position);
+  if (positions == nullptr || positions->count == 0) {
+    throw std::runtime_error("primitive has no POSITION attribute");
+  }
+  const cgltf_accessor *normals = find_attribute(source, cgltf_attribute_type_normal);
+  const cgltf_accessor *texcoords = find_attribute(source, cgltf_attribute_type_texcoord);
+  const cgltf_accessor *colors = find_attribute(source, cgltf_attribute_type_color);
+
+  wgpu::PrimitiveState &state = decoded.primitive_state;
+  switch (source.type) {
+  case cgltf_primitive_type_points:
+    state.topology = wgpu::PrimitiveTopology::PointList;
+    break;
+  case cgltf_primitive_type_lines:
+    state.topology = wgpu::PrimitiveTopology::LineList;
+    break;
+  case cgltf_primitive_type_line_strip:
+    state.topology = wgpu::PrimitiveTopology::LineStrip;
+    break;
+  case cgltf_primitive_type_triangles:
+    state.topology = wgpu::PrimitiveTopology::TriangleList;
+    break;
+  case cgltf_primitive_type_triangle_strip:
+    state.topology = wgpu::PrimitiveTopology::TriangleStrip;
+    break;
+  default:
+    // Line loops and triangle fans have no WebGPU topology
+    throw std::runtime_error("unsupported primitive mode");
+  }
+  const bool is_strip = state.topology == wgpu::PrimitiveTopology::LineStrip ||
+                        state.topology == wgpu::PrimitiveTopology::TriangleStrip;
+  state.stripIndexFormat =
+      is_strip && source.indices != nullptr ? wgpu::IndexFormat::Uint32 : wgpu::IndexFormat::Undefined;
+  state.frontFace = wgpu::FrontFace::CCW;
+  state.cullMode = wgpu::CullMode::Back;
+  if (source.material != nullptr) {
+    decoded.material = static_cast<int32_t>(cgltf_material_index(&data, source.material));
+    if (source.material->double_sided) {
+      state.cullMode = wgpu::CullMode::None;
+    }
+  }
+
+  // Normals are always present since every stock material lights with them, and generated when the file has none
+  vertex_layout layout = vertex_layouts::with_normals(vertex_layouts::create_layout());
+  if (texcoords != nullptr) {
+    layout = vertex_layouts::with_texcoords(layout);
+  }
+  if (colors != nullptr) {
+    layout = vertex_layouts::with_colors(layout);
+  }
+
+  // Every attribute of the layout is written below, so the staging needs no clearing
+  const auto vertex_count = static_cast<uint32_t>(positions->count);
+  const uint64_t stride = layout.get_stride();
+  decoded.vertices = uploads.reserve(vertex_count * stride);
+  decoded.vertex_count = vertex_count;
+  uint8_t *vertices = decoded.vertices.data();
+
+  for (const auto &attribute : layout.get_attributes()) {
+    const cgltf_accessor *accessor = nullptr;
+    switch (attribute.location) {
+    case attribute_locations::POSITION:
+      accessor = positions;
+      break;
+    case attribute_locations::NORMAL:
+      accessor = normals;
+      break;
+    case attribute_locations::TEXCOORD:
+      accessor = texcoords;
+      break;
+    case attribute_locations::COLOR:
+      accessor = colors;
+      break;
+    }
+    if (accessor != nullptr && accessor->count != vertex_count) {
+      throw std::runtime_error("attribute counts differ");
+    }
+    if (accessor != nullptr) {
+      copy_attribute(*accessor, static_cast<uint32_t>(attribute.size / sizeof(float)), vertices, stride,
+                     attribute.offset);
+    }
+  }
+
+  if (source.indices != nullptr && source.indices->count > 0) {
+    const cgltf_accessor &indices = *source.indices;
+    decoded.index_count = static_cast<uint32_t>(indices.count);
+    decoded.indices = uploads.reserve(indices.count * sizeof(uint32_t));
+    uint8_t *destination = decoded.indices.data();
+    const uint8_t *packed = indices.buffer_view != nullptr ? cgltf_buffer_view_data(indices.buffer_view) : nullptr;
+    if (packed != nullptr && !indices.is_sparse && indices.component_type == cgltf_component_type_r_32u &&
+        indices.stride == sizeof(uint32_t)) {
+      std::memcpy(destination, packed + indices.offset, indices.count * sizeof(uint32_t));
+    } else {
+      for (cgltf_size i = 0; i < indices.count; ++i) {
+        const auto index = static_cast<uint32_t>(cgltf_accessor_read_index(&indices, i));
+        std::memcpy(destination + (i * sizeof(uint32_t)), &index, sizeof(index));
+      }
+    }
+  }
+
+  if (normals == nullptr) {
+    generate_normals(*positions, source.indices, vertices, layout, state.topology);
+  }
+
+  decoded.bounds = accessor_bounds(*positions);
+  decoded.layout = std::move(layout);
+  return decoded;
+}
+
+void gltf_loader::deliver_structure(gltf_stream &stream, decoded_structure &structure) {
+  stream.m_nodes = std::move(structure.nodes);
+  stream.m_root_nodes = std::move(structure.root_nodes);
+  stream.m_materials = std::move(structure.materials);
+  stream.m_primitive_count = structure.primitive_count;
+
+  // Only base color textures are used by the stock materials, the rest are not worth decoding
+  stream.m_textures.resize(structure.textures.size());
+  for (const gltf_material &material : stream.m_materials) {
+    const int32_t index = material.base_color_texture;
+    if (index < 0 || stream.m_textures[index] != nullptr || structure.textures[index].image < 0) {
+      continue;
+    }
+    const decoded_texture &source = structure.textures[index];
+    const embedded_image &image = structure.images[source.image];
+    texture_options options;
+    options.address_mode = source.address_mode;
+    if (!image.uri.empty()) {
+      stream.m_textures[index] = m_textures.load(image.uri, options);
+    } else if (!image.bytes.empty()) {
+      stream.m_textures[index] = m_textures.load_encoded(
+          image.bytes, stream.get_path() + "#image" + std::to_string(source.image), options);
+    }
+  }
+
+  stream.m_has_structure = true;
+  if (stream.m_on_structure) {
+    stream.m_on_structure(stream);
+  }
+}
+
+void gltf_loader::deliver_primitive(gltf_stream &stream, decoded_primitive &primitive) {
+  MAREWEB_PROFILE_ZONE("gltf_upload_primitive");
+  gltf_primitive uploaded;
+  uploaded.mesh = primitive.mesh;
+  uploaded.primitive = primitive.primitive;
+  uploaded.material = primitive.material;
+  uploaded.geometry = std::make_shared<mareweb::mesh>(m_device, primitive.primitive_state,
+                                                      std::move(primitive.vertices), primitive.vertex_count,
+                                                      primitive.layout, std::move(primitive.indices),
+                                                      primitive.index_count, primitive.bounds);
+
+  ++stream.m_delivered;
+  if (stream.m_on_primitive) {
+    stream.m_on_primitive(uploaded);
+  }
+}
+
+} // namespace mareweb
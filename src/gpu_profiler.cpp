@@ -0,0 +1,203 @@
+#include "mareweb/gpu_profiler.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace mareweb {
+
+namespace {
+constexpr uint64_t TIMESTAMP_SIZE = sizeof(uint64_t);
+constexpr uint32_t QUERY_COUNT = gpu_profiler::MAX_SCOPES_PER_FRAME * 2;
+constexpr double NANOSECONDS_PER_MILLISECOND = 1.0e6;
+} // namespace
+
+gpu_profiler::gpu_profiler(wgpu::Device &device) : m_device(device), m_state(std::make_shared<shared_state>()) {
+  if (!is_supported(device)) {
+    throw std::runtime_error("GPU profiling requires the timestamp-query feature");
+  }
+
+  wgpu::QuerySetDescriptor query_set_desc{};
+  query_set_desc.type = wgpu::QueryType::Timestamp;
+  query_set_desc.count = QUERY_COUNT;
+  m_query_set = device.CreateQuerySet(&query_set_desc);
+
+  wgpu::BufferDescriptor resolve_desc{};
+  resolve_desc.size = QUERY_COUNT * TIMESTAMP_SIZE;
+  resolve_desc.usage = wgpu::BufferUsage::QueryResolve | wgpu::BufferUsage::CopySrc;
+  m_resolve_buffer = device.CreateBuffer(&resolve_desc);
+  m_resources.push_back(
+      resource_registry::get_instance().register_buffer(resolve_desc.size, resolve_desc.usage, "timestamp resolve"));
+
+  for (auto &slot : m_state->slots) {
+    wgpu::BufferDescriptor readback_desc{};
+    readback_desc.size = QUERY_COUNT * TIMESTAMP_SIZE;
+    readback_desc.usage = wgpu::BufferUsage::MapRead | wgpu::BufferUsage::CopyDst;
+    slot.buffer = device.CreateBuffer(&readback_desc);
+    m_resources.push_back(resource_registry::get_instance().register_buffer(readback_desc.size, readback_desc.usage,
+                                                                             "timestamp readback"));
+  }
+}
+
+auto gpu_profiler::is_supported(const wgpu::Device &device) -> bool {
+  return device.HasFeature(wgpu::FeatureName::TimestampQuery);
+}
+
+void gpu_profiler::begin_frame() {
+  m_frame_scopes.clear();
+  m_frame_slot.reset();
+
+  // Skip profiling this frame if every readback buffer is still waiting on the GPU
+  for (size_t i = 0; i < READBACK_FRAMES; ++i) {
+    size_t slot = (m_next_slot + i) % READBACK_FRAMES;
+    if (m_state->slots[slot].state == slot_state::free) {
+      m_frame_slot = slot;
+      m_next_slot = (slot + 1) % READBACK_FRAMES;
+      return;
+    }
+  }
+}
+
+auto gpu_profiler::allocate_scope(const std::string &scope) -> std::optional<uint32_t> {
+  if (!m_frame_slot || m_frame_scopes.size() >= MAX_SCOPES_PER_FRAME) {
+    return std::nullopt;
+  }
+  auto first_query = static_cast<uint32_t>(m_frame_scopes.size() * 2);
+  m_frame_scopes.push_back(scope);
+  return first_query;
+}
+
+auto gpu_profiler::render_pass_timestamps(const std::string &scope) -> std::optional<wgpu::RenderPassTimestampWrites> {
+  auto first_query = allocate_scope(scope);
+  if (!first_query) {
+    return std::nullopt;
+  }
+  wgpu::RenderPassTimestampWrites writes{};
+  writes.querySet = m_query_set;
+  writes.beginningOfPassWriteIndex = *first_query;
+  writes.endOfPassWriteIndex = *first_query + 1;
+  return writes;
+}
+
+auto gpu_profiler::compute_pass_timestamps(const std::string &scope)
+    -> std::optional<wgpu::ComputePassTimestampWrites> {
+  auto first_query = allocate_scope(scope);
+  if (!first_query) {
+    return std::nullopt;
+  }
+  wgpu::ComputePassTimestampWrites writes{};
+  writes.querySet = m_query_set;
+  writes.beginningOfPassWriteIndex = *first_query;
+  writes.endOfPassWriteIndex = *first_query + 1;
+  return writes;
+}
+
+void gpu_profiler::resolve(wgpu::CommandEncoder &encoder) {
+  if (!m_frame_slot || m_frame_scopes.empty()) {
+    return;
+  }
+  auto &slot = m_state->slots[*m_frame_slot];
+  auto query_count = static_cast<uint32_t>(m_frame_scopes.size() * 2);
+  encoder.ResolveQuerySet(m_query_set, 0, query_count, m_resolve_buffer, 0);
+  encoder.CopyBufferToBuffer(m_resolve_buffer, 0, slot.buffer, 0, query_count * TIMESTAMP_SIZE);
+  slot.scopes = std::move(m_frame_scopes);
+  slot.state = slot_state::pending_map;
+  m_frame_scopes.clear();
+}
+
+void gpu_profiler::after_submit() {
+  if (!m_frame_slot) {
+    return;
+  }
+  auto &slot = m_state->slots[*m_frame_slot];
+  m_frame_slot.reset();
+  if (slot.state != slot_state::pending_map) {
+    return;
+  }
+  slot.state = slot_state::mapping;
+
+  // Ownership of the request passes to the callback
+  auto *request = new map_request{m_state, static_cast<size_t>(&slot - m_state->slots.data())};
+  uint64_t size = slot.scopes.size() * 2 * TIMESTAMP_SIZE;
+#ifdef __EMSCRIPTEN__
+  slot.buffer.MapAsync(
+      wgpu::MapMode::Read, 0, size,
+      [](WGPUBufferMapAsyncStatus status, void *userdata) {
+        std::unique_ptr<map_request> req(static_cast<map_request *>(userdata));
+        on_mapped(*req, status == WGPUBufferMapAsyncStatus_Success);
+      },
+      request);
+#else
+  slot.buffer.MapAsync(
+      wgpu::MapMode::Read, 0, size, wgpu::CallbackMode::AllowProcessEvents,
+      [](wgpu::MapAsyncStatus status, wgpu::StringView /*message*/, map_request *userdata) {
+        std::unique_ptr<map_request> req(userdata);
+        on_mapped(*req, status == wgpu::MapAsyncStatus::Success);
+      },
+      request);
+#endif
+}
+
+void gpu_profiler::on_mapped(map_request &request, bool success) {
+  auto &state = *request.state;
+  auto &slot = state.slots[request.slot];
+  if (!success) {
+    slot.state = slot_state::free;
+    return;
+  }
+
+  uint64_t size = slot.scopes.size() * 2 * TIMESTAMP_SIZE;
+  std::vector<uint64_t> timestamps(slot.scopes.size() * 2);
+  std::memcpy(timestamps.data(), slot.buffer.GetConstMappedRange(0, size), size);
+  slot.buffer.Unmap();
+
+  uint64_t frame_begin = UINT64_MAX;
+  uint64_t frame_end = 0;
+  for (size_t i = 0; i < slot.scopes.size(); ++i) {
+    uint64_t begin = timestamps[2 * i];
+    uint64_t end = timestamps[(2 * i) + 1];
+    // Timestamps can be reset or reordered by the driver, e.g. across power state changes
+    if (end < begin || begin == 0) {
+      continue;
+    }
+    double milliseconds = static_cast<double>(end - begin) / NANOSECONDS_PER_MILLISECOND;
+    record_sample(state.stats[slot.scopes[i]], state.history[slot.scopes[i]], milliseconds);
+    frame_begin = std::min(frame_begin, begin);
+    frame_end = std::max(frame_end, end);
+  }
+  if (frame_end > frame_begin) {
+    record_sample(state.frame_stats, state.frame_history,
+                  static_cast<double>(frame_end - frame_begin) / NANOSECONDS_PER_MILLISECOND);
+  }
+
+  slot.scopes.clear();
+  slot.state = slot_state::free;
+}
+
+void gpu_profiler::record_sample(gpu_scope_stats &stats, scope_history &history, double milliseconds) {
+  history.samples[history.next] = milliseconds;
+  history.next = (history.next + 1) % HISTORY_LENGTH;
+  history.count = std::min(history.count + 1, HISTORY_LENGTH);
+
+  double sum = 0.0;
+  double min_ms = milliseconds;
+  double max_ms = milliseconds;
+  for (size_t i = 0; i < history.count; ++i) {
+    sum += history.samples[i];
+    min_ms = std::min(min_ms, history.samples[i]);
+    max_ms = std::max(max_ms, history.samples[i]);
+  }
+
+  stats.last_ms = milliseconds;
+  stats.average_ms = sum / static_cast<double>(history.count);
+  stats.min_ms = min_ms;
+  stats.max_ms = max_ms;
+  stats.sample_count++;
+}
+
+auto gpu_profiler::get_scope_stats() const -> const std::map<std::string, gpu_scope_stats> & {
+  return m_state->stats;
+}
+
+auto gpu_profiler::get_frame_stats() const -> const gpu_scope_stats & { return m_state->frame_stats; }
+
+} // namespace mareweb
@@ -0,0 +1,239 @@
+#include "mareweb/ktx2_loader.hpp"
+#include "mareweb/resource_registry.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef MAREWEB_HAS_KTX2
+#include <ktx.h>
+#endif
+
+namespace mareweb {
+
+namespace {
+
+constexpr std::array<uint8_t, 12> KTX2_IDENTIFIER = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+#ifdef MAREWEB_HAS_KTX2
+
+// VkFormat values used by KTX2 files, see the Vulkan specification
+enum vk_format : uint32_t {
+  VK_R8G8B8A8_UNORM = 37,
+  VK_R8G8B8A8_SRGB = 43,
+  VK_BC1_RGBA_UNORM = 133,
+  VK_BC1_RGBA_SRGB = 134,
+  VK_BC3_UNORM = 137,
+  VK_BC3_SRGB = 138,
+  VK_BC4_UNORM = 139,
+  VK_BC5_UNORM = 141,
+  VK_BC7_UNORM = 145,
+  VK_BC7_SRGB = 146,
+  VK_ETC2_R8G8B8_UNORM = 147,
+  VK_ETC2_R8G8B8_SRGB = 148,
+  VK_ETC2_R8G8B8A8_UNORM = 151,
+  VK_ETC2_R8G8B8A8_SRGB = 152,
+  VK_EAC_R11_UNORM = 153,
+  VK_EAC_R11G11_UNORM = 155,
+  VK_ASTC_4x4_UNORM = 157,
+  VK_ASTC_4x4_SRGB = 158,
+};
+
+// Textures are sampled as raw unorm values everywhere else (RGBA8 images are uploaded as RGBA8Unorm), so sRGB-tagged
+// files map to the unorm variant of the same encoding to shade identically.
+auto to_texture_format(uint32_t vk) -> wgpu::TextureFormat {
+  switch (vk) {
+  case VK_R8G8B8A8_UNORM:
+  case VK_R8G8B8A8_SRGB:
+    return wgpu::TextureFormat::RGBA8Unorm;
+  case VK_BC1_RGBA_UNORM:
+  case VK_BC1_RGBA_SRGB:
+    return wgpu::TextureFormat::BC1RGBAUnorm;
+  case VK_BC3_UNORM:
+  case VK_BC3_SRGB:
+    return wgpu::TextureFormat::BC3RGBAUnorm;
+  case VK_BC4_UNORM:
+    return wgpu::TextureFormat::BC4RUnorm;
+  case VK_BC5_UNORM:
+    return wgpu::TextureFormat::BC5RGUnorm;
+  case VK_BC7_UNORM:
+  case VK_BC7_SRGB:
+    return wgpu::TextureFormat::BC7RGBAUnorm;
+  case VK_ETC2_R8G8B8_UNORM:
+  case VK_ETC2_R8G8B8_SRGB:
+    return wgpu::TextureFormat::ETC2RGB8Unorm;
+  case VK_ETC2_R8G8B8A8_UNORM:
+  case VK_ETC2_R8G8B8A8_SRGB:
+    return wgpu::TextureFormat::ETC2RGBA8Unorm;
+  case VK_EAC_R11_UNORM:
+    return wgpu::TextureFormat::EACR11Unorm;
+  case VK_EAC_R11G11_UNORM:
+    return wgpu::TextureFormat::EACRG11Unorm;
+  case VK_ASTC_4x4_UNORM:
+  case VK_ASTC_4x4_SRGB:
+    return wgpu::TextureFormat::ASTC4x4Unorm;
+  default:
+    throw std::runtime_error("Unsupported KTX2 format: VkFormat " + std::to_string(vk));
+  }
+}
+
+auto is_format_supported(wgpu::TextureFormat format, const texture_compression_support &compression) -> bool {
+  switch (format) {
+  case wgpu::TextureFormat::BC1RGBAUnorm:
+  case wgpu::TextureFormat::BC3RGBAUnorm:
+  case wgpu::TextureFormat::BC4RUnorm:
+  case wgpu::TextureFormat::BC5RGUnorm:
+  case wgpu::TextureFormat::BC7RGBAUnorm:
+    return compression.bc;
+  case wgpu::TextureFormat::ETC2RGB8Unorm:
+  case wgpu::TextureFormat::ETC2RGBA8Unorm:
+  case wgpu::TextureFormat::EACR11Unorm:
+  case wgpu::TextureFormat::EACRG11Unorm:
+    return compression.etc2;
+  case wgpu::TextureFormat::ASTC4x4Unorm:
+    return compression.astc;
+  default:
+    return true;
+  }
+}
+
+auto select_transcode_target(uint32_t width, uint32_t height, const texture_compression_support &compression)
+    -> ktx_transcode_fmt_e {
+  // Block-compressed textures need a base level made of whole 4x4 blocks
+  if (width % 4 != 0 || height % 4 != 0) {
+    return KTX_TTF_RGBA32;
+  }
+  // BC7 and ASTC 4x4 keep UASTC quality, ETC2 is the usual mobile fallback
+  if (compression.bc) {
+    return KTX_TTF_BC7_RGBA;
+  }
+  if (compression.astc) {
+    return KTX_TTF_ASTC_4x4_RGBA;
+  }
+  if (compression.etc2) {
+    return KTX_TTF_ETC2_RGBA;
+  }
+  return KTX_TTF_RGBA32;
+}
+
+struct ktx_texture_deleter {
+  void operator()(ktxTexture2 *texture) const { ktxTexture_Destroy(ktxTexture(texture)); }
+};
+
+// Transcodes if needed and copies out the mip levels, label names the texture in errors
+auto to_image(std::unique_ptr<ktxTexture2, ktx_texture_deleter> ktx_texture, const std::string &label,
+              const texture_compression_support &compression) -> image_data {
+  if (ktx_texture->numDimensions != 2 || ktx_texture->isArray || ktx_texture->isCubemap) {
+    throw std::runtime_error("Only 2D KTX2 textures are supported: " + label);
+  }
+
+  if (ktxTexture2_NeedsTranscoding(ktx_texture.get())) {
+    auto target = select_transcode_target(ktx_texture->baseWidth, ktx_texture->baseHeight, compression);
+    ktx_error_code_e result = ktxTexture2_TranscodeBasis(ktx_texture.get(), target, 0);
+    if (result != KTX_SUCCESS) {
+      throw std::runtime_error("Failed to transcode KTX2 texture " + label + ": " + ktxErrorString(result));
+    }
+  }
+
+  image_data image;
+  image.width = ktx_texture->baseWidth;
+  image.height = ktx_texture->baseHeight;
+  image.format = to_texture_format(ktx_texture->vkFormat);
+  if (!is_format_supported(image.format, compression)) {
+    throw std::runtime_error("KTX2 texture " + label + " is block-compressed in a format the device does not support");
+  }
+  auto block = resource_registry::get_texel_block(image.format);
+  if (image.width % block.width != 0 || image.height % block.height != 0) {
+    throw std::runtime_error("KTX2 texture " + label + " is block-compressed but its size is not a whole number of " +
+                             std::to_string(block.width) + "x" + std::to_string(block.height) + " blocks");
+  }
+
+  const uint8_t *data = ktxTexture_GetData(ktxTexture(ktx_texture.get()));
+  uint32_t level_count = ktx_texture->numLevels;
+  for (uint32_t level = 0; level < level_count; ++level) {
+    ktx_size_t offset = 0;
+    ktx_error_code_e result = ktxTexture_GetImageOffset(ktxTexture(ktx_texture.get()), level, 0, 0, &offset);
+    if (result != KTX_SUCCESS) {
+      throw std::runtime_error("Corrupt KTX2 mip level in " + label);
+    }
+    ktx_size_t size = ktxTexture_GetImageSize(ktxTexture(ktx_texture.get()), level);
+    std::vector<uint8_t> pixels(data + offset, data + offset + size);
+    if (level == 0) {
+      image.pixels = std::move(pixels);
+    } else {
+      image.mips.push_back({std::max(1U, image.width >> level), std::max(1U, image.height >> level),
+                            std::move(pixels)});
+    }
+  }
+  image.prebuilt_mips = level_count > 1;
+  return image;
+}
+
+#endif
+
+} // namespace
+
+auto ktx2_loader::is_ktx2_file(const char *file_path) -> bool {
+  std::ifstream file(file_path, std::ios::binary);
+  std::array<uint8_t, KTX2_IDENTIFIER.size()> identifier{};
+  if (!file.read(reinterpret_cast<char *>(identifier.data()), identifier.size())) {
+    return false;
+  }
+  return identifier == KTX2_IDENTIFIER;
+}
+
+auto ktx2_loader::is_ktx2_data(const uint8_t *data, size_t size) -> bool {
+  return size >= KTX2_IDENTIFIER.size() && std::equal(KTX2_IDENTIFIER.begin(), KTX2_IDENTIFIER.end(), data);
+}
+
+auto ktx2_loader::is_available() -> bool {
+#ifdef MAREWEB_HAS_KTX2
+  return true;
+#else
+  return false;
+#endif
+}
+
+#ifdef MAREWEB_HAS_KTX2
+
+auto ktx2_loader::load(const char *file_path, const texture_compression_support &compression) -> image_data {
+  ktxTexture2 *raw_texture = nullptr;
+  ktx_error_code_e result =
+      ktxTexture2_CreateFromNamedFile(file_path, KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &raw_texture);
+  if (result != KTX_SUCCESS) {
+    throw std::runtime_error("Failed to load KTX2 texture " + std::string(file_path) + ": " +
+                             ktxErrorString(result));
+  }
+  return to_image(std::unique_ptr<ktxTexture2, ktx_texture_deleter>(raw_texture), file_path, compression);
+}
+
+auto ktx2_loader::load(const uint8_t *data, size_t size, const std::string &label,
+                       const texture_compression_support &compression) -> image_data {
+  ktxTexture2 *raw_texture = nullptr;
+  ktx_error_code_e result =
+      ktxTexture2_CreateFromMemory(data, size, KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &raw_texture);
+  if (result != KTX_SUCCESS) {
+    throw std::runtime_error("Failed to load KTX2 texture " + label + ": " + ktxErrorString(result));
+  }
+  return to_image(std::unique_ptr<ktxTexture2, ktx_texture_deleter>(raw_texture), label, compression);
+}
+
+#else
+
+auto ktx2_loader::load(const char *file_path, const texture_compression_support & /*compression*/) -> image_data {
+  throw std::runtime_error("Cannot load " + std::string(file_path) +
+                           ": mareweb was built without KTX2 support (MAREWEB_ENABLE_KTX2)");
+}
+
+auto ktx2_loader::load(const uint8_t * /*data*/, size_t /*size*/, const std::string &label,
+                       const texture_compression_support & /*compression*/) -> image_data {
+  throw std::runtime_error("Cannot load " + label + ": mareweb was built without KTX2 support (MAREWEB_ENABLE_KTX2)");
+}
+
+#endif
+
+} // namespace mareweb
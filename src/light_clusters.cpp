@@ -0,0 +1,221 @@
+#include "mareweb/light_clusters.hpp"
+#include "mareweb/frame_stats.hpp"
+#include <algorithm>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
+namespace mareweb {
+
+namespace {
+
+// One invocation per cluster. Tiles are numbered from the top of the screen, like fragment coordinates.
+const char *const ASSIGN_SHADER = R"(
+struct PointLight {
+    position: vec4<f32>,
+    color: vec4<f32>,
+};
+struct Clusters {
+    view: mat4x4<f32>,
+    inverse_projection: mat4x4<f32>,
+    grid: vec4<u32>,
+    viewport: vec4<f32>,
+};
+@group(0) @binding(0) var<uniform> clusters: Clusters;
+@group(0) @binding(1) var<storage, read> point_lights: array<PointLight>;
+@group(0) @binding(2) var<storage, read_write> cluster_light_counts: array<u32>;
+@group(0) @binding(3) var<storage, read_write> cluster_light_indices: array<u32>;
+
+const MAX_LIGHTS_PER_CLUSTER: u32 = 128u;
+
+// View-space point at the given view depth on the line through an NDC position, which works for both projections
+fn view_point(ndc: vec2<f32>, depth: f32) -> vec3<f32> {
+    let near = clusters.inverse_projection * vec4<f32>(ndc, 0.0, 1.0);
+    let far = clusters.inverse_projection * vec4<f32>(ndc, 1.0, 1.0);
+    let a = near.xyz / near.w;
+    let b = far.xyz / far.w;
+    return mix(a, b, (depth + a.z) / (a.z - b.z));
+}
+
+fn slice_depth(slice: u32) -> f32 {
+    let near = clusters.viewport.z;
+    let far = clusters.viewport.w;
+    return near * pow(far / near, f32(slice) / f32(clusters.grid.z));
+}
+
+@compute @workgroup_size(64)
+fn main(@builtin(global_invocation_id) id: vec3<u32>) {
+    let grid = clusters.grid.xyz;
+    let index = id.x;
+    if (index >= grid.x * grid.y * grid.z) {
+        return;
+    }
+    let cell = vec3<u32>(index % grid.x, (index / grid.x) % grid.y, index / (grid.x * grid.y));
+    let ndc_min = vec2<f32>(f32(cell.x) / f32(grid.x) * 2.0 - 1.0, 1.0 - f32(cell.y + 1u) / f32(grid.y) * 2.0);
+    let ndc_max = vec2<f32>(f32(cell.x + 1u) / f32(grid.x) * 2.0 - 1.0, 1.0 - f32(cell.y) / f32(grid.y) * 2.0);
+    let near = slice_depth(cell.z);
+    let far = slice_depth(cell.z + 1u);
+
+    var box_min = vec3<f32>(3.4e38);
+    var box_max = vec3<f32>(-3.4e38);
+    for (var corner = 0u; corner < 8u; corner++) {
+        let ndc = select(ndc_min, ndc_max, vec2<bool>((corner & 1u) != 0u, (corner & 2u) != 0u));
+        let point = view_point(ndc, select(near, far, (corner & 4u) != 0u));
+        box_min = min(box_min, point);
+        box_max = max(box_max, point);
+    }
+
+    var count = 0u;
+    for (var i = 0u; i < clusters.grid.w && count < MAX_LIGHTS_PER_CLUSTER; i++) {
+        let light = point_lights[i];
+        let center = (clusters.view * vec4<f32>(light.position.xyz, 1.0)).xyz;
+        let offset = center - clamp(center, box_min, box_max);
+        if (dot(offset, offset) <= light.position.w * light.position.w) {
+            cluster_light_indices[index * MAX_LIGHTS_PER_CLUSTER + count] = i;
+            count++;
+        }
+    }
+    cluster_light_counts[index] = count;
+}
+)";
+
+constexpr uint32_t WORKGROUP_SIZE = 64;
+constexpr float MIN_NEAR_DEPTH = 1e-3F;
+
+auto buffer_layout_entry(uint32_t binding, wgpu::ShaderStage visibility, wgpu::BufferBindingType type)
+    -> wgpu::BindGroupLayoutEntry {
+  wgpu::BindGroupLayoutEntry entry{};
+  entry.binding = binding;
+  entry.visibility = visibility;
+  entry.buffer.type = type;
+  return entry;
+}
+
+auto buffer_entry(uint32_t binding, const buffer &source) -> wgpu::BindGroupEntry {
+  wgpu::BindGroupEntry entry{};
+  entry.binding = binding;
+  entry.buffer = source.get_buffer();
+  entry.size = source.get_size();
+  return entry;
+}
+
+// View depth of the point that NDC depth z unprojects to on the view axis
+auto unproject_depth(const squint::mat4 &inverse_projection, float z) -> float {
+  const float *m = inverse_projection.data();
+  const float view_z = (m[8 + 2] * z) + m[12 + 2];
+  const float view_w = (m[8 + 3] * z) + m[12 + 3];
+  return -view_z / view_w;
+}
+
+} // namespace
+
+light_clusters::light_clusters(wgpu::Device &device) : m_device(device) {
+  m_uniforms = std::make_unique<uniform_buffer>(m_device, sizeof(cluster_uniforms),
+                                                wgpu::ShaderStage::Fragment | wgpu::ShaderStage::Compute);
+  m_uniforms->set_label("cluster_uniforms");
+  m_light_buffer = std::make_unique<storage_buffer>(m_device, nullptr, MAX_LIGHTS * sizeof(point_light));
+  m_light_buffer->set_label("point_lights");
+  m_count_buffer = std::make_unique<storage_buffer>(m_device, nullptr, CLUSTER_COUNT * sizeof(uint32_t));
+  m_count_buffer->set_label("cluster_light_counts");
+  m_index_buffer = std::make_unique<storage_buffer>(m_device, nullptr,
+                                                    CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER * sizeof(uint32_t));
+  m_index_buffer->set_label("cluster_light_indices");
+
+  m_shader = std::make_unique<shader>(m_device, ASSIGN_SHADER, wgpu::ShaderStage::Compute);
+  std::array<wgpu::BindGroupLayoutEntry, 4> layout_entries{
+      buffer_layout_entry(0, wgpu::ShaderStage::Compute, wgpu::BufferBindingType::Uniform),
+      buffer_layout_entry(1, wgpu::ShaderStage::Compute, wgpu::BufferBindingType::ReadOnlyStorage),
+      buffer_layout_entry(2, wgpu::ShaderStage::Compute, wgpu::BufferBindingType::Storage),
+      buffer_layout_entry(3, wgpu::ShaderStage::Compute, wgpu::BufferBindingType::Storage)};
+  wgpu::BindGroupLayoutDescriptor layout_desc{};
+  layout_desc.entryCount = layout_entries.size();
+  layout_desc.entries = layout_entries.data();
+  wgpu::BindGroupLayout layout = m_device.CreateBindGroupLayout(&layout_desc);
+
+  wgpu::PipelineLayoutDescriptor pipeline_layout_desc{};
+  pipeline_layout_desc.bindGroupLayoutCount = 1;
+  pipeline_layout_desc.bindGroupLayouts = &layout;
+
+  wgpu::ComputePipelineDescriptor pipeline_desc{};
+  pipeline_desc.label = "light cluster assignment";
+  pipeline_desc.layout = m_device.CreatePipelineLayout(&pipeline_layout_desc);
+  pipeline_desc.compute.module = m_shader->get_shader_module();
+  pipeline_desc.compute.entryPoint = "main";
+  m_pipeline = m_device.CreateComputePipeline(&pipeline_desc);
+  if (!m_pipeline) {
+    throw std::runtime_error("Failed to create light cluster pipeline");
+  }
+  frame_counters::add_pipeline_created();
+
+  std::array<wgpu::BindGroupEntry, 4> entries{buffer_entry(0, *m_uniforms), buffer_entry(1, *m_light_buffer),
+                                              buffer_entry(2, *m_count_buffer), buffer_entry(3, *m_index_buffer)};
+  wgpu::BindGroupDescriptor bind_group_desc{};
+  bind_group_desc.layout = layout;
+  bind_group_desc.entryCount = entries.size();
+  bind_group_desc.entries = entries.data();
+  m_bind_group = m_device.CreateBindGroup(&bind_group_desc);
+}
+
+auto light_clusters::get_layout_entries() -> std::vector<wgpu::BindGroupLayoutEntry> {
+  wgpu::BindGroupLayoutEntry uniforms =
+      buffer_layout_entry(1, wgpu::ShaderStage::Fragment, wgpu::BufferBindingType::Uniform);
+  uniforms.buffer.minBindingSize = sizeof(cluster_uniforms);
+  return {uniforms,
+          buffer_layout_entry(2, wgpu::ShaderStage::Fragment, wgpu::BufferBindingType::ReadOnlyStorage),
+          buffer_layout_entry(3, wgpu::ShaderStage::Fragment, wgpu::BufferBindingType::ReadOnlyStorage),
+          buffer_layout_entry(4, wgpu::ShaderStage::Fragment, wgpu::BufferBindingType::ReadOnlyStorage)};
+}
+
+auto light_clusters::get_bind_group_entries() const -> std::vector<wgpu::BindGroupEntry> {
+  return {buffer_entry(1, *m_uniforms), buffer_entry(2, *m_light_buffer), buffer_entry(3, *m_count_buffer),
+          buffer_entry(4, *m_index_buffer)};
+}
+
+void light_clusters::set_lights(std::vector<point_light> lights) {
+  if (lights.size() > MAX_LIGHTS) {
+    throw std::runtime_error("Too many point lights, the limit is " + std::to_string(MAX_LIGHTS));
+  }
+  m_lights = std::move(lights);
+  m_lights_dirty = true;
+}
+
+void light_clusters::assign(wgpu::CommandEncoder &encoder, const squint::mat4 &view, const squint::mat4 &projection,
+                            uint32_t width, uint32_t height, gpu_profiler *profiler) {
+  cluster_uniforms uniforms;
+  uniforms.view = view;
+  uniforms.inverse_projection = squint::inv(projection);
+  const float near = std::max(unproject_depth(uniforms.inverse_projection, 0.0F), MIN_NEAR_DEPTH);
+  const float far = std::max(unproject_depth(uniforms.inverse_projection, 1.0F), near * 2.0F);
+  const auto light_count = static_cast<uint32_t>(m_lights.size());
+  uniforms.grid = {GRID_X, GRID_Y, GRID_Z, light_count};
+  uniforms.viewport = {static_cast<float>(width), static_cast<float>(height), near, far};
+  // Fragment shaders read the uniforms even without lights, to find their (empty) cluster
+  m_uniforms->update(&uniforms, sizeof(uniforms));
+  if (m_lights_dirty && !m_lights.empty()) {
+    m_light_buffer->update(m_lights.data(), m_lights.size() * sizeof(point_light));
+  }
+  m_lights_dirty = false;
+
+  // An empty grid stays empty until lights are added
+  if (light_count == 0 && m_assigned_count == 0) {
+    return;
+  }
+  m_assigned_count = light_count;
+
+  wgpu::ComputePassDescriptor pass_desc{};
+  pass_desc.label = "light clusters";
+  std::optional<wgpu::ComputePassTimestampWrites> timestamp_writes;
+  if (profiler != nullptr) {
+    timestamp_writes = profiler->compute_pass_timestamps("light_clusters");
+  }
+  if (timestamp_writes) {
+    pass_desc.timestampWrites = &*timestamp_writes;
+  }
+  wgpu::ComputePassEncoder pass = encoder.BeginComputePass(&pass_desc);
+  pass.SetPipeline(m_pipeline);
+  pass.SetBindGroup(0, m_bind_group);
+  pass.DispatchWorkgroups((CLUSTER_COUNT + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE);
+  pass.End();
+}
+
+} // namespace mareweb
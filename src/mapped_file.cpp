@@ -0,0 +1,112 @@
+#include "mareweb/mapped_file.hpp"
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace mareweb {
+
+#ifdef _WIN32
+
+mapped_file::mapped_file(const std::string &path) {
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    throw std::runtime_error("Failed to open " + path);
+  }
+  LARGE_INTEGER size{};
+  if (!GetFileSizeEx(file, &size)) {
+    CloseHandle(file);
+    throw std::runtime_error("Failed to stat " + path);
+  }
+  m_file = file;
+  m_size = static_cast<size_t>(size.QuadPart);
+  if (m_size == 0) {
+    return;
+  }
+  m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (m_mapping == nullptr) {
+    close();
+    throw std::runtime_error("Failed to map " + path);
+  }
+  m_data = static_cast<const uint8_t *>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+  if (m_data == nullptr) {
+    close();
+    throw std::runtime_error("Failed to map " + path);
+  }
+}
+
+void mapped_file::close() {
+  if (m_data != nullptr) {
+    UnmapViewOfFile(m_data);
+  }
+  if (m_mapping != nullptr) {
+    CloseHandle(m_mapping);
+  }
+  if (m_file != nullptr) {
+    CloseHandle(m_file);
+  }
+  m_data = nullptr;
+  m_size = 0;
+  m_mapping = nullptr;
+  m_file = nullptr;
+}
+
+#else
+
+mapped_file::mapped_file(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Failed to open " + path);
+  }
+  struct stat info {};
+  if (::fstat(fd, &info) != 0) {
+    ::close(fd);
+    throw std::runtime_error("Failed to stat " + path);
+  }
+  m_size = static_cast<size_t>(info.st_size);
+  if (m_size > 0) {
+    void *mapping = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      ::close(fd);
+      throw std::runtime_error("Failed to map " + path);
+    }
+    m_data = static_cast<const uint8_t *>(mapping);
+  }
+  // The mapping keeps its own reference to the file
+  ::close(fd);
+}
+
+void mapped_file::close() {
+  if (m_data != nullptr) {
+    ::munmap(const_cast<uint8_t *>(m_data), m_size);
+  }
+  m_data = nullptr;
+  m_size = 0;
+}
+
+#endif
+
+mapped_file::~mapped_file() { close(); }
+
+auto mapped_file::operator=(mapped_file &&other) noexcept -> mapped_file & {
+  if (this != &other) {
+    close();
+    m_data = std::exchange(other.m_data, nullptr);
+    m_size = std::exchange(other.m_size, 0);
+#ifdef _WIN32
+    m_file = std::exchange(other.m_file, nullptr);
+    m_mapping = std::exchange(other.m_mapping, nullptr);
+#endif
+  }
+  return *this;
+}
+
+} // namespace mareweb
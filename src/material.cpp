@@ -1,38 +1,65 @@
 #include "mareweb/material.hpp"
+#include "mareweb/bind_group_cache.hpp"
+#include "mareweb/frame_stats.hpp"
 #include <stdexcept>
 
 namespace mareweb {
 
 material::material(wgpu::Device &device, const std::string &vertex_shader_source,
                    const std::string &fragment_shader_source, wgpu::TextureFormat surface_format, uint32_t sample_count,
-                   const std::vector<binding_resource> &bindings, const vertex_requirements &requirements)
+                   const std::vector<binding_resource> &bindings, const vertex_requirements &requirements,
+                   alpha_mode mode)
     : m_device(device), m_vertex_shader_source(vertex_shader_source), m_fragment_shader_source(fragment_shader_source),
       m_surface_format(surface_format), m_sample_count(sample_count), m_bindings(bindings),
-      m_requirements(requirements) { // Initialize vertex state
+      m_requirements(requirements), m_alpha_mode(mode) {
   create_shaders();
   create_buffers();
+  m_bind_group_layout = bind_group_cache::get(m_device).get_layout(create_bind_group_layout_entries());
 }
 
-void material::bind(wgpu::RenderPassEncoder &pass_encoder, const wgpu::PrimitiveState &primitive_state,
-                    const vertex_state &mesh_vertex_state) {
+void material::bind(wgpu::RenderPassEncoder &pass_encoder, pass_bindings &bindings,
+                    const wgpu::PrimitiveState &primitive_state, const vertex_state &mesh_vertex_state,
+                    depth_mode depth) {
   if (!m_requirements.is_satisfied_by(mesh_vertex_state)) {
     throw std::runtime_error("Mesh does not satisfy material vertex requirements");
   }
-  // Use the mesh's vertex state instead of our own
-  auto &pipeline = get_or_create_pipeline(primitive_state, mesh_vertex_state);
-  pass_encoder.SetPipeline(pipeline.get_pipeline());
-  pass_encoder.SetBindGroup(0, pipeline.get_bind_group());
+  // The mesh decides the per-vertex attributes, the material whether instance data arrives as a vertex buffer
+  vertex_state state = mesh_vertex_state;
+  state.has_instance_data = m_requirements.needs_instance_data;
+  auto &pipeline = get_or_create_pipeline(primitive_state, state, depth);
+  if (m_bind_group_dirty) {
+    // Resolved on first use after a change, so several updates before a draw cost one lookup
+    m_bind_group = bind_group_cache::get(m_device).get_bind_group(m_bind_group_layout, create_bind_group_entries());
+    m_bind_group_dirty = false;
+  }
+  if (bindings.pipeline != pipeline.get_pipeline().Get()) {
+    pass_encoder.SetPipeline(pipeline.get_pipeline());
+    bindings.pipeline = pipeline.get_pipeline().Get();
+    frame_counters::add_pipeline_bind();
+  }
+  // Groups stay bound across pipeline changes, as every pipeline shares the same group layouts
+  if (bindings.material != m_bind_group.Get()) {
+    pass_encoder.SetBindGroup(bind_group_index::MATERIAL, m_bind_group);
+    bindings.material = m_bind_group.Get();
+    frame_counters::add_bind_group_bind();
+  }
 }
 
-void material::update_uniform(uint32_t binding, const void *data) {
-  auto buffer_it = m_uniform_buffers.find(binding);
-  auto size_it = m_uniform_sizes.find(binding);
-
-  if (buffer_it == m_uniform_buffers.end() || size_it == m_uniform_sizes.end()) {
-    throw std::runtime_error("Uniform buffer not found for binding: " + std::to_string(binding));
+auto material::get_uniforms() -> uniform_block & {
+  if (!m_uniforms) {
+    throw std::runtime_error("Material has no uniform block");
   }
+  return *m_uniforms;
+}
 
-  buffer_it->second->update(data, size_it->second);
+void material::set_alpha_cutoff(float cutoff) {
+  if (m_alpha_mode != alpha_mode::masked) {
+    throw std::runtime_error("Alpha cutoff only applies to masked materials");
+  }
+  if (cutoff != m_alpha_cutoff) {
+    m_alpha_cutoff = cutoff;
+    m_pipelines.clear();
+  }
 }
 
 void material::update_texture(uint32_t binding, wgpu::TextureView texture_view) {
@@ -41,7 +68,10 @@ void material::update_texture(uint32_t binding, wgpu::TextureView texture_view)
     if (std::holds_alternative<texture_binding>(bind_resource)) {
       auto &tex_binding = std::get<texture_binding>(bind_resource);
       if (tex_binding.binding == binding) {
-        tex_binding.texture_view = texture_view;
+        if (tex_binding.texture_view.Get() != texture_view.Get()) {
+          tex_binding.texture_view = texture_view;
+          invalidate_bind_group();
+        }
         return;
       }
     }
@@ -55,7 +85,10 @@ void material::update_sampler(uint32_t binding, wgpu::Sampler sampler) {
     if (std::holds_alternative<sampler_binding>(bind_resource)) {
       auto &samp_binding = std::get<sampler_binding>(bind_resource);
       if (samp_binding.binding == binding) {
-        samp_binding.sampler = sampler;
+        if (samp_binding.sampler.Get() != sampler.Get()) {
+          samp_binding.sampler = sampler;
+          invalidate_bind_group();
+        }
         return;
       }
     }
@@ -67,8 +100,11 @@ void material::update_instance_buffer(wgpu::Buffer buffer, size_t size) {
   for (auto &binding : m_bindings) {
     if (std::holds_alternative<storage_binding>(binding)) {
       auto &instance_binding = std::get<storage_binding>(binding);
-      instance_binding.buffer = buffer;
-      instance_binding.size = size;
+      if (instance_binding.buffer.Get() != buffer.Get() || instance_binding.size != size) {
+        instance_binding.buffer = buffer;
+        instance_binding.size = size;
+        invalidate_bind_group();
+      }
     }
   }
 }
@@ -80,10 +116,12 @@ void material::create_shaders() {
 
 void material::create_buffers() {
   for (const auto &binding : m_bindings) {
-    if (std::holds_alternative<uniform_binding>(binding)) {
-      const auto &uniform = std::get<uniform_binding>(binding);
-      m_uniform_buffers[uniform.binding] = std::make_unique<uniform_buffer>(m_device, uniform.size, uniform.visibility);
-      m_uniform_sizes[uniform.binding] = uniform.size;
+    if (std::holds_alternative<uniform_block_binding>(binding)) {
+      if (m_uniforms) {
+        throw std::runtime_error("A material can only have one uniform block");
+      }
+      const auto &uniform = std::get<uniform_block_binding>(binding);
+      m_uniforms = std::make_unique<uniform_block>(m_device, uniform.layout, uniform.visibility);
     }
   }
 }
@@ -100,10 +138,10 @@ auto material::create_bind_group_layout_entries() const -> std::vector<wgpu::Bin
           entry.visibility = b.visibility;
 
           using T = std::decay_t<decltype(b)>;
-          if constexpr (std::is_same_v<T, uniform_binding>) {
+          if constexpr (std::is_same_v<T, uniform_block_binding>) {
             entry.buffer.type = wgpu::BufferBindingType::Uniform;
             entry.buffer.hasDynamicOffset = false;
-            entry.buffer.minBindingSize = b.size;
+            entry.buffer.minBindingSize = b.layout.get_size();
           } else if constexpr (std::is_same_v<T, storage_binding>) {
             entry.buffer.type = b.type;
             entry.buffer.hasDynamicOffset = false;
@@ -134,13 +172,10 @@ auto material::create_bind_group_entries() const -> std::vector<wgpu::BindGroupE
           entry.binding = b.binding;
 
           using T = std::decay_t<decltype(b)>;
-          if constexpr (std::is_same_v<T, uniform_binding>) {
-            auto it = m_uniform_buffers.find(b.binding);
-            if (it != m_uniform_buffers.end()) {
-              entry.buffer = it->second->get_buffer();
-              entry.offset = 0;
-              entry.size = b.size;
-            }
+          if constexpr (std::is_same_v<T, uniform_block_binding>) {
+            entry.buffer = m_uniforms->get_buffer();
+            entry.offset = 0;
+            entry.size = m_uniforms->get_size();
           } else if constexpr (std::is_same_v<T, storage_binding>) {
             if (b.buffer) {
               entry.buffer = b.buffer;
@@ -161,27 +196,21 @@ auto material::create_bind_group_entries() const -> std::vector<wgpu::BindGroupE
 }
 
 auto material::get_or_create_pipeline(const wgpu::PrimitiveState &primitive_state,
-                                      const vertex_state &mesh_vertex_state) -> pipeline & {
-  pipeline_key key{primitive_state.topology, primitive_state.stripIndexFormat, primitive_state.frontFace,
-                   primitive_state.cullMode};
+                                      const vertex_state &mesh_vertex_state, depth_mode depth) -> pipeline & {
+  pipeline_key key{primitive_state.topology,      primitive_state.stripIndexFormat,
+                   primitive_state.frontFace,     primitive_state.cullMode,
+                   mesh_vertex_state.has_normals, mesh_vertex_state.has_texcoords,
+                   mesh_vertex_state.has_colors,  mesh_vertex_state.has_instance_data,
+                   depth};
 
   auto it = m_pipelines.find(key);
   if (it == m_pipelines.end()) {
+    std::vector<wgpu::BindGroupLayout> layouts{frame_bindings::get_frame_layout(m_device), m_bind_group_layout,
+                                               frame_bindings::get_draw_layout(m_device)};
     // Pass vertex state to pipeline constructor
     auto new_pipeline = std::make_unique<pipeline>(m_device, *m_vertex_shader, *m_fragment_shader, m_surface_format,
-                                                   m_sample_count, create_bind_group_layout_entries(), primitive_state,
-                                                   mesh_vertex_state); // Pass vertex state
-
-    // Rest of the pipeline creation code...
-    auto bind_group_entries = create_bind_group_entries();
-
-    wgpu::BindGroupDescriptor bind_group_desc{};
-    bind_group_desc.layout = new_pipeline->get_bind_group_layout();
-    bind_group_desc.entryCount = static_cast<uint32_t>(bind_group_entries.size());
-    bind_group_desc.entries = bind_group_entries.data();
-
-    new_pipeline->set_bind_group(m_device.CreateBindGroup(&bind_group_desc));
-
+                                                   m_sample_count, std::move(layouts), primitive_state,
+                                                   mesh_vertex_state, m_alpha_mode, m_alpha_cutoff, depth);
     it = m_pipelines.emplace(key, std::move(new_pipeline)).first;
   }
 
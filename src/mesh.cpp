@@ -1,13 +1,12 @@
 #include "mareweb/mesh.hpp"
+#include <algorithm>
 #include <cstring>
 #include <sstream>
 #include <stdexcept>
 
 namespace mareweb {
 
-void mesh::create_vertex_buffer(wgpu::Device &device, const std::vector<vertex> &vertices,
-                                const vertex_layout &layout) {
-
+auto mesh::pack_vertices(const std::vector<vertex> &vertices, const vertex_layout &layout) -> std::vector<uint8_t> {
   const size_t vertex_count = vertices.size();
   const size_t stride = layout.get_stride();
   std::vector<uint8_t> buffer_data(vertex_count * stride, 0);
@@ -44,15 +43,40 @@ void mesh::create_vertex_buffer(wgpu::Device &device, const std::vector<vertex>
       }
     }
   }
+  return buffer_data;
+}
 
-  m_vertex_buffer = std::make_unique<vertex_buffer>(device, buffer_data.data(), buffer_data.size(), layout);
+auto mesh_bounds::compute(const void *vertex_data, uint32_t vertex_count, const vertex_layout &layout) -> mesh_bounds {
+  mesh_bounds bounds{};
+  uint64_t position_offset = 0;
+  for (const auto &attr : layout.get_attributes()) {
+    if (attr.location == attribute_locations::POSITION) {
+      position_offset = attr.offset;
+    }
+  }
+  const auto *bytes = static_cast<const uint8_t *>(vertex_data);
+  for (uint32_t i = 0; i < vertex_count; ++i) {
+    float position[3];
+    std::memcpy(position, bytes + (i * layout.get_stride()) + position_offset, sizeof(position));
+    for (int axis = 0; axis < 3; ++axis) {
+      bounds.min[axis] = i == 0 ? position[axis] : std::min(bounds.min[axis], position[axis]);
+      bounds.max[axis] = i == 0 ? position[axis] : std::max(bounds.max[axis], position[axis]);
+    }
+  }
+  return bounds;
 }
 
 mesh::mesh(wgpu::Device &device, const wgpu::PrimitiveState &primitive_state, const std::vector<vertex> &vertices,
            const vertex_layout &layout, const std::vector<uint32_t> &indices)
-    : m_primitive_state(primitive_state), m_vertex_layout(layout) {
+    : mesh(device, primitive_state, pack_vertices(vertices, layout).data(), static_cast<uint32_t>(vertices.size()),
+           layout, indices.empty() ? nullptr : indices.data(), static_cast<uint32_t>(indices.size())) {}
+
+mesh::mesh(wgpu::Device &device, const wgpu::PrimitiveState &primitive_state, const void *vertex_data,
+           uint32_t vertex_count, const vertex_layout &layout, const uint32_t *indices, uint32_t index_count,
+           const mesh_bounds *bounds)
+    : m_vertex_layout(layout), m_primitive_state(primitive_state) {
 
-  if (vertices.empty()) {
+  if (vertex_data == nullptr || vertex_count == 0) {
     throw std::runtime_error("Vertex data is empty");
   }
 
@@ -61,27 +85,61 @@ mesh::mesh(wgpu::Device &device, const wgpu::PrimitiveState &primitive_state, co
     throw std::runtime_error("Vertex layout has no attributes");
   }
 
-  // Create vertex buffer with the final stride
-  create_vertex_buffer(device, vertices, m_vertex_layout);
+  m_bounds = bounds != nullptr ? *bounds : mesh_bounds::compute(vertex_data, vertex_count, m_vertex_layout);
+
+  // Already interleaved with the layout's stride, so it goes straight into the shared arena
+  m_vertices = geometry_arena::get(device).allocate_vertices(vertex_data, vertex_count,
+                                                            static_cast<uint32_t>(m_vertex_layout.get_stride()));
 
-  if (!indices.empty()) {
-    m_index_buffer = std::make_unique<index_buffer>(device, indices);
+  if (indices != nullptr && index_count > 0) {
+    m_indices = geometry_arena::get(device).allocate_indices(indices, index_count);
   }
 }
 
-auto mesh::get_vertex_count() const -> uint32_t {
-  auto stride = m_vertex_layout.get_stride();
-  if (stride == 0) {
-    throw std::runtime_error("Invalid vertex layout stride");
+mesh::mesh(wgpu::Device &device, const wgpu::PrimitiveState &primitive_state, upload_span vertices,
+           uint32_t vertex_count, const vertex_layout &layout, upload_span indices, uint32_t index_count,
+           const mesh_bounds &bounds)
+    : m_vertex_layout(layout), m_primitive_state(primitive_state), m_bounds(bounds) {
+  if (vertex_count == 0) {
+    throw std::runtime_error("Vertex data is empty");
+  }
+  if (m_vertex_layout.get_attributes().empty()) {
+    throw std::runtime_error("Vertex layout has no attributes");
+  }
+
+  m_vertices = geometry_arena::get(device).allocate_vertices(std::move(vertices), vertex_count,
+                                                            static_cast<uint32_t>(m_vertex_layout.get_stride()));
+  if (index_count > 0) {
+    m_indices = geometry_arena::get(device).allocate_indices(std::move(indices), index_count);
   }
-  return static_cast<uint32_t>(m_vertex_buffer->get_size() / stride);
 }
 
-auto mesh::get_index_count() const -> uint32_t {
-  return m_index_buffer ? static_cast<uint32_t>(m_index_buffer->get_size() / sizeof(uint32_t)) : 0;
+auto mesh::get_vertex_count() const -> uint32_t { return m_vertices.get_count(); }
+
+auto mesh::get_index_count() const -> uint32_t { return m_indices.is_valid() ? m_indices.get_count() : 0; }
+
+void mesh::draw(wgpu::RenderPassEncoder &pass_encoder, geometry_bindings &bindings, uint32_t instance_count) const {
+  wgpu::Buffer vertices = m_vertices.get_buffer();
+  if (bindings.vertex_buffer != vertices.Get()) {
+    pass_encoder.SetVertexBuffer(vertex_buffer_slots::MESH, vertices);
+    bindings.vertex_buffer = vertices.Get();
+  }
+
+  if (m_indices.is_valid()) {
+    wgpu::Buffer indices = m_indices.get_buffer();
+    if (bindings.index_buffer != indices.Get()) {
+      pass_encoder.SetIndexBuffer(indices, wgpu::IndexFormat::Uint32);
+      bindings.index_buffer = indices.Get();
+    }
+    pass_encoder.DrawIndexed(m_indices.get_count(), instance_count, m_indices.get_offset(),
+                             static_cast<int32_t>(m_vertices.get_offset()));
+  } else {
+    pass_encoder.Draw(m_vertices.get_count(), instance_count, m_vertices.get_offset());
+  }
 }
 
-void mesh::bind_material(material &material, wgpu::RenderPassEncoder &pass_encoder) const {
+void mesh::bind_material(material &material, wgpu::RenderPassEncoder &pass_encoder, pass_bindings &bindings,
+                         depth_mode depth) const {
   auto mesh_state = get_vertex_state();
   auto &requirements = material.get_requirements();
 
@@ -95,7 +153,7 @@ void mesh::bind_material(material &material, wgpu::RenderPassEncoder &pass_encod
         << (mesh_state.has_texcoords ? "texcoords " : "") << (mesh_state.has_colors ? "colors " : "");
     throw std::runtime_error(err.str());
   }
-  material.bind(pass_encoder, get_primitive_state(), get_vertex_state());
+  material.bind(pass_encoder, bindings, get_primitive_state(), get_vertex_state(), depth);
 }
 
 } // namespace mareweb
\ No newline at end of file
@@ -0,0 +1,268 @@
+#include "mareweb/mesh_file.hpp"
+#include <array>
+#include <bit>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+namespace mareweb {
+
+static_assert(std::endian::native == std::endian::little, "mesh_file reads and writes little-endian data in place");
+
+namespace {
+
+struct file_header {
+  std::array<char, 4> magic;
+  uint32_t version;
+  uint32_t topology;
+  uint32_t strip_index_format;
+  uint32_t front_face;
+  uint32_t cull_mode;
+  uint32_t attribute_count;
+  uint32_t stride;
+  uint32_t vertex_count;
+  uint32_t index_count;
+  uint64_t vertex_offset;
+  uint64_t index_offset;
+  std::array<float, 3> bounds_min;
+  std::array<float, 3> bounds_max;
+};
+
+struct file_attribute {
+  uint32_t location;
+  uint32_t format;
+  uint32_t offset;
+  uint32_t reserved;
+};
+
+constexpr std::array<char, 4> MAGIC = {'M', 'W', 'M', '1'};
+constexpr uint32_t MAX_ATTRIBUTES = 16;
+
+// Index in each table is the code stored in the file
+constexpr std::array TOPOLOGIES = {wgpu::PrimitiveTopology::PointList, wgpu::PrimitiveTopology::LineList,
+                                   wgpu::PrimitiveTopology::LineStrip, wgpu::PrimitiveTopology::TriangleList,
+                                   wgpu::PrimitiveTopology::TriangleStrip};
+constexpr std::array INDEX_FORMATS = {wgpu::IndexFormat::Undefined, wgpu::IndexFormat::Uint16,
+                                      wgpu::IndexFormat::Uint32};
+constexpr std::array FRONT_FACES = {wgpu::FrontFace::CCW, wgpu::FrontFace::CW};
+constexpr std::array CULL_MODES = {wgpu::CullMode::None, wgpu::CullMode::Front, wgpu::CullMode::Back};
+constexpr std::array VERTEX_FORMATS = {wgpu::VertexFormat::Float32x2, wgpu::VertexFormat::Float32x3,
+                                       wgpu::VertexFormat::Float32x4};
+
+// The only order and formats pipeline::create_vertex_buffer_layout and the depth prepass draw with. A file holds
+// POSITION and then any of the others, in this order.
+struct canonical_attribute {
+  uint32_t location;
+  wgpu::VertexFormat format;
+};
+constexpr std::array CANONICAL_ATTRIBUTES = {
+    canonical_attribute{attribute_locations::POSITION, wgpu::VertexFormat::Float32x3},
+    canonical_attribute{attribute_locations::NORMAL, wgpu::VertexFormat::Float32x3},
+    canonical_attribute{attribute_locations::TEXCOORD, wgpu::VertexFormat::Float32x2},
+    canonical_attribute{attribute_locations::COLOR, wgpu::VertexFormat::Float32x4},
+};
+
+auto is_canonical(const std::vector<vertex_attribute> &attributes) -> bool {
+  if (attributes.empty() || attributes.front().location != attribute_locations::POSITION) {
+    return false;
+  }
+  size_t next = 0;
+  for (const auto &attribute : attributes) {
+    while (next < CANONICAL_ATTRIBUTES.size() && CANONICAL_ATTRIBUTES[next].location != attribute.location) {
+      ++next;
+    }
+    if (next == CANONICAL_ATTRIBUTES.size() || CANONICAL_ATTRIBUTES[next].format != attribute.format) {
+      return false;
+    }
+    ++next;
+  }
+  return true;
+}
+
+template <typename Enum, size_t N>
+auto encode(const std::array<Enum, N> &table, Enum value, const char *what) -> uint32_t {
+  for (size_t i = 0; i < N; ++i) {
+    if (table[i] == value) {
+      return static_cast<uint32_t>(i);
+    }
+  }
+  throw std::runtime_error(std::string("Unsupported ") + what + " for mesh file");
+}
+
+template <typename Enum, size_t N>
+auto decode(const std::array<Enum, N> &table, uint32_t code, const char *what) -> Enum {
+  if (code >= N) {
+    throw std::runtime_error(std::string("Invalid ") + what + " in mesh file");
+  }
+  return table[code];
+}
+
+auto semantic_name(uint32_t location) -> const char * {
+  switch (location) {
+  case attribute_locations::POSITION:
+    return "POSITION";
+  case attribute_locations::NORMAL:
+    return "NORMAL";
+  case attribute_locations::TEXCOORD:
+    return "TEXCOORD";
+  case attribute_locations::COLOR:
+    return "COLOR";
+  default:
+    return "CUSTOM";
+  }
+}
+
+auto align_up(uint64_t value) -> uint64_t {
+  return (value + mesh_file::BLOB_ALIGNMENT - 1) & ~(mesh_file::BLOB_ALIGNMENT - 1);
+}
+
+} // namespace
+
+mesh_file::mesh_file(const std::string &path) : m_file(path) {
+  const uint8_t *data = m_file.data();
+  const size_t size = m_file.size();
+  const auto fail = [&path](const char *reason) {
+    return std::runtime_error("Invalid mesh file " + path + ": " + reason);
+  };
+
+  file_header header{};
+  if (size < sizeof(header)) {
+    throw fail("truncated header");
+  }
+  std::memcpy(&header, data, sizeof(header));
+  if (header.magic != MAGIC) {
+    throw fail("bad magic");
+  }
+  if (header.version != VERSION) {
+    throw fail("unsupported version");
+  }
+  if (header.attribute_count == 0 || header.attribute_count > MAX_ATTRIBUTES) {
+    throw fail("bad attribute count");
+  }
+  if (sizeof(header) + (header.attribute_count * sizeof(file_attribute)) > size) {
+    throw fail("truncated attribute table");
+  }
+
+  m_topology = header.topology;
+  m_strip_index_format = header.strip_index_format;
+  m_front_face = header.front_face;
+  m_cull_mode = header.cull_mode;
+  // Decode now so a bad primitive state is reported at load rather than at mesh creation
+  if (get_primitive_state().stripIndexFormat == wgpu::IndexFormat::Uint16) {
+    throw fail("16-bit strip index format, indices are stored as uint32");
+  }
+
+  // Rebuild the layout the same way the vertex_layouts helpers do, then check it matches what was written
+  for (uint32_t i = 0; i < header.attribute_count; ++i) {
+    file_attribute attr{};
+    std::memcpy(&attr, data + sizeof(header) + (i * sizeof(file_attribute)), sizeof(attr));
+    m_layout.add_attribute(
+        {attr.location, decode(VERTEX_FORMATS, attr.format, "vertex format"), 0, semantic_name(attr.location)});
+    if (m_layout.get_attributes().back().offset != attr.offset) {
+      throw fail("attribute offsets do not match a packed layout");
+    }
+  }
+  if (!is_canonical(m_layout.get_attributes())) {
+    throw fail("attributes are not in the canonical order and formats");
+  }
+  if (m_layout.get_stride() != header.stride) {
+    throw fail("stride does not match attributes");
+  }
+
+  const uint64_t vertex_bytes = uint64_t{header.vertex_count} * header.stride;
+  const uint64_t index_bytes = uint64_t{header.index_count} * sizeof(uint32_t);
+  // Written as differences, so corrupt offsets cannot wrap around
+  if (header.vertex_count == 0 || header.vertex_offset % BLOB_ALIGNMENT != 0 || header.vertex_offset > size ||
+      vertex_bytes > size - header.vertex_offset) {
+    throw fail("bad vertex blob");
+  }
+  if (header.index_count > 0 && (header.index_offset % BLOB_ALIGNMENT != 0 || header.index_offset > size ||
+                                 index_bytes > size - header.index_offset)) {
+    throw fail("bad index blob");
+  }
+
+  m_vertex_data = data + header.vertex_offset;
+  m_vertex_count = header.vertex_count;
+  if (header.index_count > 0) {
+    m_indices = reinterpret_cast<const uint32_t *>(data + header.index_offset);
+    m_index_count = header.index_count;
+  }
+  m_bounds = {header.bounds_min, header.bounds_max};
+}
+
+auto mesh_file::get_primitive_state() const -> wgpu::PrimitiveState {
+  wgpu::PrimitiveState state;
+  state.topology = decode(TOPOLOGIES, m_topology, "topology");
+  state.stripIndexFormat = decode(INDEX_FORMATS, m_strip_index_format, "strip index format");
+  state.frontFace = decode(FRONT_FACES, m_front_face, "front face");
+  state.cullMode = decode(CULL_MODES, m_cull_mode, "cull mode");
+  return state;
+}
+
+void mesh_file::write(const std::string &path, const wgpu::PrimitiveState &primitive_state, const void *vertex_data,
+                      uint32_t vertex_count, const vertex_layout &layout, const uint32_t *indices,
+                      uint32_t index_count) {
+  if (vertex_data == nullptr || vertex_count == 0) {
+    throw std::runtime_error("Vertex data is empty");
+  }
+  const auto &attributes = layout.get_attributes();
+  if (attributes.size() > MAX_ATTRIBUTES || !is_canonical(attributes)) {
+    throw std::runtime_error("Unsupported vertex layout for mesh file");
+  }
+  if (primitive_state.stripIndexFormat == wgpu::IndexFormat::Uint16) {
+    throw std::runtime_error("Mesh files store uint32 indices, a 16-bit strip index format cannot be written");
+  }
+
+  file_header header{};
+  header.magic = MAGIC;
+  header.version = VERSION;
+  header.topology = encode(TOPOLOGIES, primitive_state.topology, "topology");
+  header.strip_index_format = encode(INDEX_FORMATS, primitive_state.stripIndexFormat, "strip index format");
+  header.front_face = encode(FRONT_FACES, primitive_state.frontFace, "front face");
+  header.cull_mode = encode(CULL_MODES, primitive_state.cullMode, "cull mode");
+  header.attribute_count = static_cast<uint32_t>(attributes.size());
+  header.stride = static_cast<uint32_t>(layout.get_stride());
+  header.vertex_count = vertex_count;
+  header.index_count = indices != nullptr ? index_count : 0;
+
+  const uint64_t vertex_bytes = uint64_t{vertex_count} * header.stride;
+  header.vertex_offset = align_up(sizeof(header) + (attributes.size() * sizeof(file_attribute)));
+  header.index_offset = header.index_count > 0 ? align_up(header.vertex_offset + vertex_bytes) : 0;
+
+  const mesh_bounds bounds = mesh_bounds::compute(vertex_data, vertex_count, layout);
+  header.bounds_min = bounds.min;
+  header.bounds_max = bounds.max;
+
+  std::vector<uint8_t> contents(header.index_count > 0 ? header.index_offset + (header.index_count * sizeof(uint32_t))
+                                                       : header.vertex_offset + vertex_bytes,
+                                0);
+  std::memcpy(contents.data(), &header, sizeof(header));
+  for (size_t i = 0; i < attributes.size(); ++i) {
+    file_attribute attr{attributes[i].location, encode(VERTEX_FORMATS, attributes[i].format, "vertex format"),
+                        static_cast<uint32_t>(attributes[i].offset), 0};
+    std::memcpy(contents.data() + sizeof(header) + (i * sizeof(file_attribute)), &attr, sizeof(attr));
+  }
+  std::memcpy(contents.data() + header.vertex_offset, vertex_data, vertex_bytes);
+  if (header.index_count > 0) {
+    std::memcpy(contents.data() + header.index_offset, indices, header.index_count * sizeof(uint32_t));
+  }
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file) {
+    throw std::runtime_error("Failed to open mesh file for writing: " + path);
+  }
+  file.write(reinterpret_cast<const char *>(contents.data()), static_cast<std::streamsize>(contents.size()));
+  if (!file) {
+    throw std::runtime_error("Failed to write mesh file: " + path);
+  }
+}
+
+void mesh_file::write(const std::string &path, const wgpu::PrimitiveState &primitive_state,
+                      const std::vector<vertex> &vertices, const vertex_layout &layout,
+                      const std::vector<uint32_t> &indices) {
+  const std::vector<uint8_t> packed = mesh::pack_vertices(vertices, layout);
+  write(path, primitive_state, packed.data(), static_cast<uint32_t>(vertices.size()), layout,
+        indices.empty() ? nullptr : indices.data(), static_cast<uint32_t>(indices.size()));
+}
+
+} // namespace mareweb
@@ -0,0 +1,333 @@
+#include "mareweb/mipmap_generator.hpp"
+#include "mareweb/frame_stats.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numbers>
+#include <stdexcept>
+#include <string>
+
+namespace mareweb {
+
+namespace {
+
+const char *const MIPMAP_SHADER = R"(
+    struct VertexOutput {
+        @builtin(position) position: vec4<f32>,
+        @location(0) uv: vec2<f32>,
+    };
+
+    @vertex
+    fn vs_main(@builtin(vertex_index) index: u32) -> VertexOutput {
+        // Fullscreen triangle
+        let uv = vec2<f32>(f32((index << 1u) & 2u), f32(index & 2u));
+        var out: VertexOutput;
+        out.position = vec4<f32>(uv * vec2<f32>(2.0, -2.0) + vec2<f32>(-1.0, 1.0), 0.0, 1.0);
+        out.uv = uv;
+        return out;
+    }
+
+    @group(0) @binding(0) var source_texture: texture_2d<f32>;
+    @group(0) @binding(1) var source_sampler: sampler;
+
+    @fragment
+    fn fs_main(in: VertexOutput) -> @location(0) vec4<f32> {
+        // Sampling at the center of a destination texel averages the 2x2 source block
+        return textureSample(source_texture, source_sampler, in.uv);
+    }
+)";
+
+constexpr uint32_t CHANNELS = 4;
+constexpr double KAISER_BETA = 4.0;
+constexpr double KAISER_RADIUS = 3.0; // in destination texels
+
+auto srgb_to_linear(float c) -> float {
+  return c <= 0.04045F ? c / 12.92F : std::pow((c + 0.055F) / 1.055F, 2.4F);
+}
+
+auto linear_to_srgb(float c) -> float {
+  return c <= 0.0031308F ? c * 12.92F : (1.055F * std::pow(c, 1.0F / 2.4F)) - 0.055F;
+}
+
+// Zeroth order modified Bessel function of the first kind
+auto bessel_i0(double x) -> double {
+  double sum = 1.0;
+  double term = 1.0;
+  for (int k = 1; k < 32; ++k) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if (term < sum * 1e-12) {
+      break;
+    }
+  }
+  return sum;
+}
+
+auto kaiser_sinc(double t) -> double {
+  if (std::abs(t) >= KAISER_RADIUS) {
+    return 0.0;
+  }
+  double sinc = t == 0.0 ? 1.0 : std::sin(std::numbers::pi * t) / (std::numbers::pi * t);
+  double ratio = t / KAISER_RADIUS;
+  return sinc * bessel_i0(KAISER_BETA * std::sqrt(1.0 - (ratio * ratio))) / bessel_i0(KAISER_BETA);
+}
+
+struct filter_tap {
+  uint32_t first;
+  std::vector<float> weights;
+};
+
+// Precomputes normalized weights for resampling src_size texels down to dst_size texels
+auto compute_taps(uint32_t src_size, uint32_t dst_size, mipmap_filter filter) -> std::vector<filter_tap> {
+  double scale = static_cast<double>(src_size) / static_cast<double>(dst_size);
+  double support = filter == mipmap_filter::cpu_kaiser ? KAISER_RADIUS * scale : 0.5 * scale;
+  std::vector<filter_tap> taps(dst_size);
+  for (uint32_t i = 0; i < dst_size; ++i) {
+    double center = (i + 0.5) * scale;
+    auto first = static_cast<int64_t>(std::floor(center - support));
+    auto last = static_cast<int64_t>(std::ceil(center + support));
+    first = std::max<int64_t>(first, 0);
+    last = std::min<int64_t>(last, static_cast<int64_t>(src_size) - 1);
+
+    auto &tap = taps[i];
+    tap.first = static_cast<uint32_t>(first);
+    double total = 0.0;
+    for (int64_t j = first; j <= last; ++j) {
+      double t = (static_cast<double>(j) + 0.5 - center) / scale;
+      double weight = filter == mipmap_filter::cpu_kaiser ? kaiser_sinc(t) : (std::abs(t) <= 0.5 ? 1.0 : 0.0);
+      tap.weights.push_back(static_cast<float>(weight));
+      total += weight;
+    }
+    if (total != 0.0) {
+      for (auto &weight : tap.weights) {
+        weight = static_cast<float>(weight / total);
+      }
+    }
+  }
+  return taps;
+}
+
+// Separable resample of a linear float RGBA image
+auto downsample(const std::vector<float> &src, uint32_t src_width, uint32_t src_height, uint32_t dst_width,
+                uint32_t dst_height, mipmap_filter filter) -> std::vector<float> {
+  auto taps_x = compute_taps(src_width, dst_width, filter);
+  auto taps_y = compute_taps(src_height, dst_height, filter);
+
+  std::vector<float> horizontal(static_cast<size_t>(dst_width) * src_height * CHANNELS, 0.0F);
+  for (uint32_t y = 0; y < src_height; ++y) {
+    for (uint32_t x = 0; x < dst_width; ++x) {
+      const auto &tap = taps_x[x];
+      float *out = &horizontal[((static_cast<size_t>(y) * dst_width) + x) * CHANNELS];
+      for (size_t k = 0; k < tap.weights.size(); ++k) {
+        const float *in = &src[((static_cast<size_t>(y) * src_width) + tap.first + k) * CHANNELS];
+        for (uint32_t c = 0; c < CHANNELS; ++c) {
+          out[c] += in[c] * tap.weights[k];
+        }
+      }
+    }
+  }
+
+  std::vector<float> result(static_cast<size_t>(dst_width) * dst_height * CHANNELS, 0.0F);
+  for (uint32_t y = 0; y < dst_height; ++y) {
+    const auto &tap = taps_y[y];
+    for (uint32_t x = 0; x < dst_width; ++x) {
+      float *out = &result[((static_cast<size_t>(y) * dst_width) + x) * CHANNELS];
+      for (size_t k = 0; k < tap.weights.size(); ++k) {
+        const float *in = &horizontal[(((tap.first + k) * dst_width) + x) * CHANNELS];
+        for (uint32_t c = 0; c < CHANNELS; ++c) {
+          out[c] += in[c] * tap.weights[k];
+        }
+      }
+    }
+  }
+  return result;
+}
+
+} // namespace
+
+mipmap_generator::mipmap_generator(wgpu::Device &device) : m_device(device) {
+  m_shader = std::make_unique<shader>(device, MIPMAP_SHADER, wgpu::ShaderStage::Vertex | wgpu::ShaderStage::Fragment);
+
+  std::array<wgpu::BindGroupLayoutEntry, 2> entries{};
+  entries[0].binding = 0;
+  entries[0].visibility = wgpu::ShaderStage::Fragment;
+  entries[0].texture.sampleType = wgpu::TextureSampleType::Float;
+  entries[0].texture.viewDimension = wgpu::TextureViewDimension::e2D;
+  entries[1].binding = 1;
+  entries[1].visibility = wgpu::ShaderStage::Fragment;
+  entries[1].sampler.type = wgpu::SamplerBindingType::Filtering;
+
+  wgpu::BindGroupLayoutDescriptor bind_group_layout_desc{};
+  bind_group_layout_desc.entryCount = entries.size();
+  bind_group_layout_desc.entries = entries.data();
+  m_bind_group_layout = device.CreateBindGroupLayout(&bind_group_layout_desc);
+
+  wgpu::PipelineLayoutDescriptor pipeline_layout_desc{};
+  pipeline_layout_desc.bindGroupLayoutCount = 1;
+  pipeline_layout_desc.bindGroupLayouts = &m_bind_group_layout;
+  m_pipeline_layout = device.CreatePipelineLayout(&pipeline_layout_desc);
+
+  wgpu::SamplerDescriptor sampler_desc{};
+  sampler_desc.addressModeU = wgpu::AddressMode::ClampToEdge;
+  sampler_desc.addressModeV = wgpu::AddressMode::ClampToEdge;
+  sampler_desc.magFilter = wgpu::FilterMode::Linear;
+  sampler_desc.minFilter = wgpu::FilterMode::Linear;
+  m_sampler = device.CreateSampler(&sampler_desc);
+}
+
+auto mipmap_generator::get(wgpu::Device &device) -> mipmap_generator & {
+  static std::map<WGPUDevice, std::unique_ptr<mipmap_generator>> generators;
+  auto &generator = generators[device.Get()];
+  if (!generator) {
+    generator = std::make_unique<mipmap_generator>(device);
+  }
+  return *generator;
+}
+
+auto mipmap_generator::get_mip_level_count(uint32_t width, uint32_t height) -> uint32_t {
+  uint32_t size = std::max(width, height);
+  uint32_t levels = 1;
+  while (size > 1) {
+    size >>= 1U;
+    ++levels;
+  }
+  return levels;
+}
+
+auto mipmap_generator::get_pipeline(wgpu::TextureFormat format) -> wgpu::RenderPipeline {
+  auto it = m_pipelines.find(format);
+  if (it != m_pipelines.end()) {
+    return it->second;
+  }
+
+  wgpu::ColorTargetState color_target{};
+  color_target.format = format;
+  color_target.writeMask = wgpu::ColorWriteMask::All;
+
+  wgpu::FragmentState fragment_state{};
+  fragment_state.module = m_shader->get_shader_module();
+  fragment_state.entryPoint = "fs_main";
+  fragment_state.targetCount = 1;
+  fragment_state.targets = &color_target;
+
+  wgpu::RenderPipelineDescriptor pipeline_desc{};
+  pipeline_desc.layout = m_pipeline_layout;
+  pipeline_desc.vertex.module = m_shader->get_shader_module();
+  pipeline_desc.vertex.entryPoint = "vs_main";
+  pipeline_desc.primitive.topology = wgpu::PrimitiveTopology::TriangleList;
+  pipeline_desc.fragment = &fragment_state;
+  pipeline_desc.multisample.count = 1;
+
+  auto pipeline = m_device.CreateRenderPipeline(&pipeline_desc);
+  if (!pipeline) {
+    throw std::runtime_error("Failed to create mipmap pipeline");
+  }
+  frame_counters::add_pipeline_created();
+  m_pipelines.emplace(format, pipeline);
+  return pipeline;
+}
+
+void mipmap_generator::generate(const wgpu::Texture &texture, wgpu::TextureFormat view_format,
+                                uint32_t mip_level_count) {
+  if (mip_level_count <= 1) {
+    return;
+  }
+  auto pipeline = get_pipeline(view_format);
+  auto encoder = m_device.CreateCommandEncoder();
+
+  for (uint32_t level = 1; level < mip_level_count; ++level) {
+    wgpu::TextureViewDescriptor source_desc{};
+    source_desc.format = view_format;
+    source_desc.dimension = wgpu::TextureViewDimension::e2D;
+    source_desc.baseMipLevel = level - 1;
+    source_desc.mipLevelCount = 1;
+    source_desc.arrayLayerCount = 1;
+    auto source_view = texture.CreateView(&source_desc);
+
+    wgpu::TextureViewDescriptor target_desc = source_desc;
+    target_desc.baseMipLevel = level;
+    auto target_view = texture.CreateView(&target_desc);
+
+    std::array<wgpu::BindGroupEntry, 2> entries{};
+    entries[0].binding = 0;
+    entries[0].textureView = source_view;
+    entries[1].binding = 1;
+    entries[1].sampler = m_sampler;
+
+    wgpu::BindGroupDescriptor bind_group_desc{};
+    bind_group_desc.layout = m_bind_group_layout;
+    bind_group_desc.entryCount = entries.size();
+    bind_group_desc.entries = entries.data();
+    auto bind_group = m_device.CreateBindGroup(&bind_group_desc);
+
+    wgpu::RenderPassColorAttachment color_attachment{};
+    color_attachment.view = target_view;
+    color_attachment.loadOp = wgpu::LoadOp::Clear;
+    color_attachment.storeOp = wgpu::StoreOp::Store;
+    color_attachment.clearValue = {0.0, 0.0, 0.0, 0.0};
+
+    wgpu::RenderPassDescriptor pass_desc{};
+    pass_desc.colorAttachmentCount = 1;
+    pass_desc.colorAttachments = &color_attachment;
+
+    auto pass = encoder.BeginRenderPass(&pass_desc);
+    pass.SetPipeline(pipeline);
+    pass.SetBindGroup(0, bind_group);
+    pass.Draw(3);
+    pass.End();
+  }
+
+  auto commands = encoder.Finish();
+  m_device.GetQueue().Submit(1, &commands);
+}
+
+auto mipmap_generator::generate_cpu(const uint8_t *pixels, uint32_t width, uint32_t height, size_t row_pitch, bool srgb,
+                                    mipmap_filter filter) -> std::vector<mip_level> {
+  if (filter != mipmap_filter::cpu_box && filter != mipmap_filter::cpu_kaiser) {
+    throw std::runtime_error("generate_cpu requires a CPU mipmap filter");
+  }
+
+  std::array<float, 256> decode{};
+  for (size_t i = 0; i < decode.size(); ++i) {
+    float value = static_cast<float>(i) / 255.0F;
+    decode[i] = srgb ? srgb_to_linear(value) : value;
+  }
+
+  std::vector<float> current(static_cast<size_t>(width) * height * CHANNELS);
+  for (uint32_t y = 0; y < height; ++y) {
+    const uint8_t *row = pixels + (y * row_pitch);
+    for (uint32_t x = 0; x < width * CHANNELS; ++x) {
+      bool is_alpha = x % CHANNELS == 3;
+      current[(static_cast<size_t>(y) * width * CHANNELS) + x] =
+          is_alpha ? static_cast<float>(row[x]) / 255.0F : decode[row[x]];
+    }
+  }
+
+  // Each level is resampled from the previous one while still in linear float, so only the output is quantized
+  std::vector<mip_level> levels;
+  uint32_t current_width = width;
+  uint32_t current_height = height;
+  uint32_t level_count = get_mip_level_count(width, height);
+  for (uint32_t level = 1; level < level_count; ++level) {
+    uint32_t level_width = std::max(1U, width >> level);
+    uint32_t level_height = std::max(1U, height >> level);
+    current = downsample(current, current_width, current_height, level_width, level_height, filter);
+    current_width = level_width;
+    current_height = level_height;
+    const auto &linear = current;
+
+    mip_level out{level_width, level_height, std::vector<uint8_t>(linear.size())};
+    for (size_t i = 0; i < linear.size(); ++i) {
+      float value = std::clamp(linear[i], 0.0F, 1.0F);
+      bool is_alpha = i % CHANNELS == 3;
+      if (srgb && !is_alpha) {
+        value = linear_to_srgb(value);
+      }
+      out.pixels[i] = static_cast<uint8_t>(std::lround(value * 255.0F));
+    }
+    levels.push_back(std::move(out));
+  }
+  return levels;
+}
+
+} // namespace mareweb
@@ -0,0 +1,403 @@
+#include "mareweb/occlusion_culler.hpp"
+#include "mareweb/frame_stats.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+namespace mareweb {
+
+namespace {
+
+const char *const DEPTH_SOURCE = R"(
+@group(0) @binding(0) var source: texture_depth_2d;
+
+fn load_depth(coord: vec2<i32>) -> f32 {
+    return textureLoad(source, coord, 0);
+}
+)";
+
+// The farthest of the samples, so a pixel only partially covered by an occluder does not occlude
+const char *const MULTISAMPLED_DEPTH_SOURCE = R"(
+@group(0) @binding(0) var source: texture_depth_multisampled_2d;
+
+fn load_depth(coord: vec2<i32>) -> f32 {
+    var farthest = 0.0;
+    for (var i = 0u; i < textureNumSamples(source); i++) {
+        farthest = max(farthest, textureLoad(source, coord, i32(i)));
+    }
+    return farthest;
+}
+)";
+
+const char *const LEVEL_SOURCE = R"(
+@group(0) @binding(0) var source: texture_2d<f32>;
+
+fn load_depth(coord: vec2<i32>) -> f32 {
+    return textureLoad(source, coord, 0).x;
+}
+)";
+
+const char *const REDUCE_SHADER = R"(
+@group(0) @binding(1) var destination: texture_storage_2d<r32float, write>;
+
+@compute @workgroup_size(8, 8)
+fn main(@builtin(global_invocation_id) id: vec3<u32>) {
+    let size = textureDimensions(destination);
+    if (id.x >= size.x || id.y >= size.y) {
+        return;
+    }
+    // Destination sizes round up, the clamp lets the last row and column of an odd source cover its leftover texel
+    let last = vec2<i32>(textureDimensions(source)) - 1;
+    let base = vec2<i32>(id.xy) * 2;
+    let top = max(load_depth(min(base, last)), load_depth(min(base + vec2<i32>(1, 0), last)));
+    let bottom = max(load_depth(min(base + vec2<i32>(0, 1), last)), load_depth(min(base + vec2<i32>(1, 1), last)));
+    textureStore(destination, vec2<i32>(id.xy), vec4<f32>(max(top, bottom), 0.0, 0.0, 0.0));
+}
+)";
+
+constexpr uint32_t WORKGROUP_SIZE = 8;
+constexpr uint32_t BYTES_PER_ROW_ALIGNMENT = 256;
+constexpr uint64_t TEXEL_SIZE = sizeof(float);
+constexpr float MIN_CLIP_W = 1e-5F;
+
+auto create_layout(wgpu::Device &device, wgpu::TextureSampleType sample_type, bool multisampled)
+    -> wgpu::BindGroupLayout {
+  std::array<wgpu::BindGroupLayoutEntry, 2> entries{};
+  entries[0].binding = 0;
+  entries[0].visibility = wgpu::ShaderStage::Compute;
+  entries[0].texture.sampleType = sample_type;
+  entries[0].texture.viewDimension = wgpu::TextureViewDimension::e2D;
+  entries[0].texture.multisampled = multisampled;
+  entries[1].binding = 1;
+  entries[1].visibility = wgpu::ShaderStage::Compute;
+  entries[1].storageTexture.access = wgpu::StorageTextureAccess::WriteOnly;
+  entries[1].storageTexture.format = wgpu::TextureFormat::R32Float;
+  entries[1].storageTexture.viewDimension = wgpu::TextureViewDimension::e2D;
+
+  wgpu::BindGroupLayoutDescriptor layout_desc{};
+  layout_desc.entryCount = entries.size();
+  layout_desc.entries = entries.data();
+  return device.CreateBindGroupLayout(&layout_desc);
+}
+
+} // namespace
+
+occlusion_culler::occlusion_culler(wgpu::Device &device)
+    : m_device(device), m_state(std::make_shared<shared_state>()) {
+  m_depth_shader =
+      std::make_unique<shader>(device, std::string(DEPTH_SOURCE) + REDUCE_SHADER, wgpu::ShaderStage::Compute);
+  m_multisampled_depth_shader = std::make_unique<shader>(
+      device, std::string(MULTISAMPLED_DEPTH_SOURCE) + REDUCE_SHADER, wgpu::ShaderStage::Compute);
+  m_reduce_shader =
+      std::make_unique<shader>(device, std::string(LEVEL_SOURCE) + REDUCE_SHADER, wgpu::ShaderStage::Compute);
+
+  m_depth_layout = create_layout(device, wgpu::TextureSampleType::Depth, false);
+  m_multisampled_depth_layout = create_layout(device, wgpu::TextureSampleType::Depth, true);
+  m_reduce_layout = create_layout(device, wgpu::TextureSampleType::UnfilterableFloat, false);
+
+  m_depth_pipeline = create_pipeline(*m_depth_shader, m_depth_layout);
+  m_multisampled_depth_pipeline = create_pipeline(*m_multisampled_depth_shader, m_multisampled_depth_layout);
+  m_reduce_pipeline = create_pipeline(*m_reduce_shader, m_reduce_layout);
+}
+
+auto occlusion_culler::create_pipeline(const shader &compute_shader, const wgpu::BindGroupLayout &layout)
+    -> wgpu::ComputePipeline {
+  wgpu::PipelineLayoutDescriptor pipeline_layout_desc{};
+  pipeline_layout_desc.bindGroupLayoutCount = 1;
+  pipeline_layout_desc.bindGroupLayouts = &layout;
+
+  wgpu::ComputePipelineDescriptor pipeline_desc{};
+  pipeline_desc.label = "hi-z downsample";
+  pipeline_desc.layout = m_device.CreatePipelineLayout(&pipeline_layout_desc);
+  pipeline_desc.compute.module = compute_shader.get_shader_module();
+  pipeline_desc.compute.entryPoint = "main";
+
+  auto pipeline = m_device.CreateComputePipeline(&pipeline_desc);
+  if (!pipeline) {
+    throw std::runtime_error("Failed to create Hi-Z pipeline");
+  }
+  frame_counters::add_pipeline_created();
+  return pipeline;
+}
+
+void occlusion_culler::create_pyramid(const wgpu::Texture &depth_texture) {
+  m_source = depth_texture;
+  m_levels.clear();
+
+  const bool multisampled = depth_texture.GetSampleCount() > 1;
+  wgpu::TextureView source_view = depth_texture.CreateView();
+  uint32_t width = depth_texture.GetWidth();
+  uint32_t height = depth_texture.GetHeight();
+  do {
+    width = (width + 1) / 2;
+    height = (height + 1) / 2;
+
+    wgpu::TextureDescriptor texture_desc{};
+    texture_desc.label = "hi-z level";
+    texture_desc.dimension = wgpu::TextureDimension::e2D;
+    texture_desc.format = wgpu::TextureFormat::R32Float;
+    texture_desc.mipLevelCount = 1;
+    texture_desc.sampleCount = 1;
+    texture_desc.size = {width, height, 1};
+    texture_desc.usage =
+        wgpu::TextureUsage::StorageBinding | wgpu::TextureUsage::TextureBinding | wgpu::TextureUsage::CopySrc;
+
+    pyramid_level level{};
+    level.texture = m_device.CreateTexture(&texture_desc);
+    if (!level.texture) {
+      throw std::runtime_error("Failed to create Hi-Z texture");
+    }
+    level.resource =
+        resource_registry::get_instance().register_texture(texture_desc, resource_category::texture, "hi-z level");
+    level.view = level.texture.CreateView();
+    level.width = width;
+    level.height = height;
+
+    std::array<wgpu::BindGroupEntry, 2> entries{};
+    entries[0].binding = 0;
+    entries[0].textureView = m_levels.empty() ? source_view : m_levels.back().view;
+    entries[1].binding = 1;
+    entries[1].textureView = level.view;
+
+    wgpu::BindGroupDescriptor bind_group_desc{};
+    if (!m_levels.empty()) {
+      bind_group_desc.layout = m_reduce_layout;
+    } else {
+      bind_group_desc.layout = multisampled ? m_multisampled_depth_layout : m_depth_layout;
+    }
+    bind_group_desc.entryCount = entries.size();
+    bind_group_desc.entries = entries.data();
+    level.bind_group = m_device.CreateBindGroup(&bind_group_desc);
+    m_levels.push_back(std::move(level));
+  } while (width > MAX_READBACK_WIDTH);
+}
+
+void occlusion_culler::build(wgpu::CommandEncoder &encoder, const wgpu::Texture &depth_texture,
+                             const squint::mat4 &view_projection, gpu_profiler *profiler) {
+  // A frame whose readback has no free slot would go unused, so it skips the pyramid as well
+  for (size_t i = 0; i < READBACK_FRAMES; ++i) {
+    size_t slot = (m_next_slot + i) % READBACK_FRAMES;
+    if (m_state->slots[slot].state == slot_state::free) {
+      m_frame_slot = slot;
+      m_next_slot = (slot + 1) % READBACK_FRAMES;
+      break;
+    }
+  }
+  if (!m_frame_slot) {
+    return;
+  }
+  if (m_source.Get() != depth_texture.Get()) {
+    create_pyramid(depth_texture);
+  }
+
+  wgpu::ComputePassDescriptor pass_desc{};
+  pass_desc.label = "hi-z";
+  std::optional<wgpu::ComputePassTimestampWrites> timestamp_writes;
+  if (profiler != nullptr) {
+    timestamp_writes = profiler->compute_pass_timestamps("hi_z");
+  }
+  if (timestamp_writes) {
+    pass_desc.timestampWrites = &*timestamp_writes;
+  }
+
+  wgpu::ComputePassEncoder pass = encoder.BeginComputePass(&pass_desc);
+  for (size_t i = 0; i < m_levels.size(); ++i) {
+    const auto &level = m_levels[i];
+    if (i == 0) {
+      pass.SetPipeline(m_source.GetSampleCount() > 1 ? m_multisampled_depth_pipeline : m_depth_pipeline);
+    } else if (i == 1) {
+      pass.SetPipeline(m_reduce_pipeline);
+    }
+    pass.SetBindGroup(0, level.bind_group);
+    pass.DispatchWorkgroups((level.width + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE,
+                            (level.height + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE);
+  }
+  pass.End();
+
+  const auto &coarse = m_levels.back();
+  auto &slot = m_state->slots[*m_frame_slot];
+  const auto row_size = static_cast<uint32_t>(coarse.width * TEXEL_SIZE);
+  const uint32_t bytes_per_row =
+      (row_size + BYTES_PER_ROW_ALIGNMENT - 1) / BYTES_PER_ROW_ALIGNMENT * BYTES_PER_ROW_ALIGNMENT;
+  const uint64_t size = static_cast<uint64_t>(bytes_per_row) * coarse.height;
+  if (!slot.buffer || slot.buffer.GetSize() < size) {
+    wgpu::BufferDescriptor readback_desc{};
+    readback_desc.label = "hi-z readback";
+    readback_desc.size = size;
+    readback_desc.usage = wgpu::BufferUsage::MapRead | wgpu::BufferUsage::CopyDst;
+    slot.resource.reset();
+    slot.buffer = m_device.CreateBuffer(&readback_desc);
+    slot.resource =
+        resource_registry::get_instance().register_buffer(readback_desc.size, readback_desc.usage, "hi-z readback");
+  }
+
+  wgpu::ImageCopyTexture source{};
+  source.texture = coarse.texture;
+  wgpu::ImageCopyBuffer destination{};
+  destination.buffer = slot.buffer;
+  destination.layout.bytesPerRow = bytes_per_row;
+  destination.layout.rowsPerImage = coarse.height;
+  wgpu::Extent3D copy_size{coarse.width, coarse.height, 1};
+  encoder.CopyTextureToBuffer(&source, &destination, &copy_size);
+
+  slot.width = coarse.width;
+  slot.height = coarse.height;
+  slot.bytes_per_row = bytes_per_row;
+  slot.view_projection = view_projection;
+  slot.state = slot_state::pending_map;
+}
+
+void occlusion_culler::after_submit() {
+  if (!m_frame_slot) {
+    return;
+  }
+  auto &slot = m_state->slots[*m_frame_slot];
+  m_frame_slot.reset();
+  if (slot.state != slot_state::pending_map) {
+    return;
+  }
+  slot.state = slot_state::mapping;
+
+  // Ownership of the request passes to the callback
+  auto *request = new map_request{m_state, static_cast<size_t>(&slot - m_state->slots.data())};
+  uint64_t size = static_cast<uint64_t>(slot.bytes_per_row) * slot.height;
+#ifdef __EMSCRIPTEN__
+  slot.buffer.MapAsync(
+      wgpu::MapMode::Read, 0, size,
+      [](WGPUBufferMapAsyncStatus status, void *userdata) {
+        std::unique_ptr<map_request> req(static_cast<map_request *>(userdata));
+        on_mapped(*req, status == WGPUBufferMapAsyncStatus_Success);
+      },
+      request);
+#else
+  slot.buffer.MapAsync(
+      wgpu::MapMode::Read, 0, size, wgpu::CallbackMode::AllowProcessEvents,
+      [](wgpu::MapAsyncStatus status, wgpu::StringView /*message*/, map_request *userdata) {
+        std::unique_ptr<map_request> req(userdata);
+        on_mapped(*req, status == wgpu::MapAsyncStatus::Success);
+      },
+      request);
+#endif
+}
+
+void occlusion_culler::on_mapped(map_request &request, bool success) {
+  auto &state = *request.state;
+  auto &slot = state.slots[request.slot];
+  if (!success) {
+    slot.state = slot_state::free;
+    return;
+  }
+
+  uint64_t size = static_cast<uint64_t>(slot.bytes_per_row) * slot.height;
+  const auto *mapped = static_cast<const uint8_t *>(slot.buffer.GetConstMappedRange(0, size));
+  auto &depth = state.depth;
+  depth.texels.resize(static_cast<size_t>(slot.width) * slot.height);
+  for (uint32_t y = 0; y < slot.height; ++y) {
+    std::memcpy(&depth.texels[static_cast<size_t>(y) * slot.width],
+                mapped + (static_cast<size_t>(y) * slot.bytes_per_row), slot.width * TEXEL_SIZE);
+  }
+  slot.buffer.Unmap();
+  depth.width = slot.width;
+  depth.height = slot.height;
+  depth.view_projection = slot.view_projection;
+  depth.valid = true;
+  slot.state = slot_state::free;
+}
+
+auto occlusion_culler::test(const mesh_bounds &bounds, const squint::mat4 &model,
+                            const squint::mat4 &view_projection) const -> cull_result {
+  // World-space corners of the box; the model matrix is column major
+  std::array<std::array<float, 3>, 8> corners{};
+  const float *m = model.data();
+  for (size_t i = 0; i < corners.size(); ++i) {
+    const float x = (i & 1U) != 0 ? bounds.max[0] : bounds.min[0];
+    const float y = (i & 2U) != 0 ? bounds.max[1] : bounds.min[1];
+    const float z = (i & 4U) != 0 ? bounds.max[2] : bounds.min[2];
+    for (size_t r = 0; r < 3; ++r) {
+      corners[i][r] = (m[r] * x) + (m[4 + r] * y) + (m[8 + r] * z) + m[12 + r];
+    }
+  }
+
+  // Outside the frustum when every corner is beyond the same clip plane, with WebGPU's 0..w depth range
+  const float *vp = view_projection.data();
+  uint32_t outside_all = 0x3FU;
+  for (const auto &corner : corners) {
+    std::array<float, 4> clip{};
+    for (size_t r = 0; r < 4; ++r) {
+      clip[r] = (vp[r] * corner[0]) + (vp[4 + r] * corner[1]) + (vp[8 + r] * corner[2]) + vp[12 + r];
+    }
+    uint32_t outside = 0;
+    outside |= clip[0] < -clip[3] ? 0x01U : 0U;
+    outside |= clip[0] > clip[3] ? 0x02U : 0U;
+    outside |= clip[1] < -clip[3] ? 0x04U : 0U;
+    outside |= clip[1] > clip[3] ? 0x08U : 0U;
+    outside |= clip[2] < 0.0F ? 0x10U : 0U;
+    outside |= clip[2] > clip[3] ? 0x20U : 0U;
+    outside_all &= outside;
+  }
+  if (outside_all != 0) {
+    return cull_result::outside_frustum;
+  }
+  return is_occluded(corners) ? cull_result::occluded : cull_result::visible;
+}
+
+auto occlusion_culler::is_occluded(const std::array<std::array<float, 3>, 8> &corners) const -> bool {
+  const auto &depth = m_state->depth;
+  if (!depth.valid) {
+    return false;
+  }
+
+  // Screen rectangle and nearest depth of the box as seen when the depth was rendered
+  const float *vp = depth.view_projection.data();
+  float min_x = std::numeric_limits<float>::max();
+  float max_x = std::numeric_limits<float>::lowest();
+  float min_y = std::numeric_limits<float>::max();
+  float max_y = std::numeric_limits<float>::lowest();
+  float nearest = 1.0F;
+  for (const auto &corner : corners) {
+    std::array<float, 4> clip{};
+    for (size_t r = 0; r < 4; ++r) {
+      clip[r] = (vp[r] * corner[0]) + (vp[4 + r] * corner[1]) + (vp[8 + r] * corner[2]) + vp[12 + r];
+    }
+    // A corner behind the camera projects nowhere useful, so the box is kept
+    if (clip[3] < MIN_CLIP_W) {
+      return false;
+    }
+    const float x = clip[0] / clip[3];
+    const float y = clip[1] / clip[3];
+    min_x = std::min(min_x, x);
+    max_x = std::max(max_x, x);
+    min_y = std::min(min_y, y);
+    max_y = std::max(max_y, y);
+    nearest = std::min(nearest, clip[2] / clip[3]);
+  }
+  if (nearest <= 0.0F) {
+    return false;
+  }
+  // Part of the box was off the old screen, where there is no depth to test against. It may be on screen now.
+  if (min_x < -1.0F || max_x > 1.0F || min_y < -1.0F || max_y > 1.0F) {
+    return false;
+  }
+
+  // Texel rows run top to bottom while NDC y points up
+  const auto width = static_cast<float>(depth.width);
+  const auto height = static_cast<float>(depth.height);
+  const auto first_x = static_cast<uint32_t>(std::clamp(((min_x * 0.5F) + 0.5F) * width, 0.0F, width - 1.0F));
+  const auto last_x = static_cast<uint32_t>(std::clamp(((max_x * 0.5F) + 0.5F) * width, 0.0F, width - 1.0F));
+  const auto first_y = static_cast<uint32_t>(std::clamp((0.5F - (max_y * 0.5F)) * height, 0.0F, height - 1.0F));
+  const auto last_y = static_cast<uint32_t>(std::clamp((0.5F - (min_y * 0.5F)) * height, 0.0F, height - 1.0F));
+  for (uint32_t y = first_y; y <= last_y; ++y) {
+    const float *row = &depth.texels[static_cast<size_t>(y) * depth.width];
+    for (uint32_t x = first_x; x <= last_x; ++x) {
+      if (nearest <= row[x]) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+} // namespace mareweb
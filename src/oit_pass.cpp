@@ -0,0 +1,233 @@
+#include "mareweb/oit_pass.hpp"
+#include "mareweb/frame_stats.hpp"
+#include <array>
+#include <optional>
+#include <stdexcept>
+
+namespace mareweb {
+
+namespace {
+
+const char *const COMPOSITE_SHADER = R"(
+    @vertex
+    fn vs_main(@builtin(vertex_index) index: u32) -> @builtin(position) vec4<f32> {
+        // Fullscreen triangle
+        let uv = vec2<f32>(f32((index << 1u) & 2u), f32(index & 2u));
+        return vec4<f32>(uv * 2.0 - 1.0, 0.0, 1.0);
+    }
+
+    @group(0) @binding(0) var accum_texture: texture_2d<f32>;
+    @group(0) @binding(1) var reveal_texture: texture_2d<f32>;
+
+    @fragment
+    fn fs_main(@builtin(position) position: vec4<f32>) -> @location(0) vec4<f32> {
+        let coord = vec2<i32>(position.xy);
+        let reveal = textureLoad(reveal_texture, coord, 0).r;
+        // Nothing transparent covered this pixel
+        if (reveal >= 1.0) {
+            discard;
+        }
+        // The clamp keeps half float sums that overflowed to infinity from turning the average into NaN
+        let accum = clamp(textureLoad(accum_texture, coord, 0), vec4<f32>(0.0), vec4<f32>(65504.0));
+        return vec4<f32>(accum.rgb / max(accum.a, 1e-5), 1.0 - reveal);
+    }
+)";
+
+} // namespace
+
+oit_pass::oit_pass(wgpu::Device &device, uint32_t sample_count) : m_device(device), m_sample_count(sample_count) {
+  m_shader =
+      std::make_unique<shader>(device, COMPOSITE_SHADER, wgpu::ShaderStage::Vertex | wgpu::ShaderStage::Fragment);
+
+  std::array<wgpu::BindGroupLayoutEntry, 2> entries{};
+  for (uint32_t i = 0; i < entries.size(); ++i) {
+    entries[i].binding = i;
+    entries[i].visibility = wgpu::ShaderStage::Fragment;
+    entries[i].texture.sampleType = wgpu::TextureSampleType::UnfilterableFloat;
+    entries[i].texture.viewDimension = wgpu::TextureViewDimension::e2D;
+  }
+
+  wgpu::BindGroupLayoutDescriptor bind_group_layout_desc{};
+  bind_group_layout_desc.entryCount = entries.size();
+  bind_group_layout_desc.entries = entries.data();
+  m_bind_group_layout = device.CreateBindGroupLayout(&bind_group_layout_desc);
+
+  wgpu::PipelineLayoutDescriptor pipeline_layout_desc{};
+  pipeline_layout_desc.bindGroupLayoutCount = 1;
+  pipeline_layout_desc.bindGroupLayouts = &m_bind_group_layout;
+  m_pipeline_layout = device.CreatePipelineLayout(&pipeline_layout_desc);
+}
+
+auto oit_pass::create_target(wgpu::TextureFormat format, uint32_t sample_count, const char *label) -> oit_target {
+  wgpu::TextureDescriptor texture_desc{};
+  texture_desc.label = label;
+  texture_desc.dimension = wgpu::TextureDimension::e2D;
+  texture_desc.format = format;
+  texture_desc.mipLevelCount = 1;
+  texture_desc.sampleCount = sample_count;
+  texture_desc.size = {m_width, m_height, 1};
+  // The single-sampled targets are read by the composite
+  texture_desc.usage = sample_count == 1 ? wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::TextureBinding
+                                         : wgpu::TextureUsage::RenderAttachment;
+
+  oit_target target;
+  target.texture = m_device.CreateTexture(&texture_desc);
+  if (!target.texture) {
+    throw std::runtime_error("Failed to create OIT target");
+  }
+  target.resource =
+      resource_registry::get_instance().register_texture(texture_desc, resource_category::render_target, label);
+  target.view = target.texture.CreateView();
+  return target;
+}
+
+void oit_pass::create_targets(uint32_t width, uint32_t height) {
+  m_width = width;
+  m_height = height;
+  // Released first, so the registry never counts the old and the new targets at once
+  m_accum = {};
+  m_reveal = {};
+  m_msaa_accum = {};
+  m_msaa_reveal = {};
+  m_accum = create_target(OIT_ACCUM_FORMAT, 1, "OIT accumulation");
+  m_reveal = create_target(OIT_REVEAL_FORMAT, 1, "OIT revealage");
+  if (m_sample_count > 1) {
+    m_msaa_accum = create_target(OIT_ACCUM_FORMAT, m_sample_count, "OIT MSAA accumulation");
+    m_msaa_reveal = create_target(OIT_REVEAL_FORMAT, m_sample_count, "OIT MSAA revealage");
+  }
+
+  std::array<wgpu::BindGroupEntry, 2> entries{};
+  entries[0].binding = 0;
+  entries[0].textureView = m_accum.view;
+  entries[1].binding = 1;
+  entries[1].textureView = m_reveal.view;
+
+  wgpu::BindGroupDescriptor bind_group_desc{};
+  bind_group_desc.layout = m_bind_group_layout;
+  bind_group_desc.entryCount = entries.size();
+  bind_group_desc.entries = entries.data();
+  m_bind_group = m_device.CreateBindGroup(&bind_group_desc);
+}
+
+auto oit_pass::begin(wgpu::CommandEncoder &encoder, const wgpu::TextureView &depth_view, uint32_t width,
+                     uint32_t height, gpu_profiler *profiler) -> wgpu::RenderPassEncoder {
+  if (width != m_width || height != m_height) {
+    create_targets(width, height);
+  }
+
+  // Nothing accumulated, fully revealed
+  std::array<wgpu::RenderPassColorAttachment, 2> color_attachments{};
+  color_attachments[0].clearValue = {0.0, 0.0, 0.0, 0.0};
+  color_attachments[1].clearValue = {1.0, 0.0, 0.0, 0.0};
+  const std::array<const oit_target *, 2> resolved{&m_accum, &m_reveal};
+  const std::array<const oit_target *, 2> multisampled{&m_msaa_accum, &m_msaa_reveal};
+  for (size_t i = 0; i < color_attachments.size(); ++i) {
+    auto &attachment = color_attachments[i];
+    attachment.loadOp = wgpu::LoadOp::Clear;
+    if (m_sample_count > 1) {
+      attachment.view = multisampled[i]->view;
+      attachment.resolveTarget = resolved[i]->view;
+      attachment.storeOp = wgpu::StoreOp::Discard;
+    } else {
+      attachment.view = resolved[i]->view;
+      attachment.storeOp = wgpu::StoreOp::Store;
+    }
+  }
+
+  // Transparent surfaces test against the opaque depth but never write it
+  wgpu::RenderPassDepthStencilAttachment depth_attachment{};
+  depth_attachment.view = depth_view;
+  depth_attachment.depthLoadOp = wgpu::LoadOp::Undefined;
+  depth_attachment.depthStoreOp = wgpu::StoreOp::Undefined;
+  depth_attachment.stencilLoadOp = wgpu::LoadOp::Undefined;
+  depth_attachment.stencilStoreOp = wgpu::StoreOp::Undefined;
+  depth_attachment.depthReadOnly = true;
+
+  wgpu::RenderPassDescriptor pass_desc{};
+  pass_desc.label = "OIT accumulation";
+  pass_desc.colorAttachmentCount = color_attachments.size();
+  pass_desc.colorAttachments = color_attachments.data();
+  pass_desc.depthStencilAttachment = &depth_attachment;
+  std::optional<wgpu::RenderPassTimestampWrites> timestamp_writes;
+  if (profiler != nullptr) {
+    timestamp_writes = profiler->render_pass_timestamps("oit_accumulation");
+  }
+  if (timestamp_writes) {
+    pass_desc.timestampWrites = &*timestamp_writes;
+  }
+  return encoder.BeginRenderPass(&pass_desc);
+}
+
+void oit_pass::composite(wgpu::CommandEncoder &encoder, const wgpu::TextureView &target,
+                         wgpu::TextureFormat target_format, gpu_profiler *profiler) {
+  wgpu::RenderPassColorAttachment color_attachment{};
+  color_attachment.view = target;
+  color_attachment.loadOp = wgpu::LoadOp::Load;
+  color_attachment.storeOp = wgpu::StoreOp::Store;
+
+  wgpu::RenderPassDescriptor pass_desc{};
+  pass_desc.label = "OIT composite";
+  pass_desc.colorAttachmentCount = 1;
+  pass_desc.colorAttachments = &color_attachment;
+  std::optional<wgpu::RenderPassTimestampWrites> timestamp_writes;
+  if (profiler != nullptr) {
+    timestamp_writes = profiler->render_pass_timestamps("oit_composite");
+  }
+  if (timestamp_writes) {
+    pass_desc.timestampWrites = &*timestamp_writes;
+  }
+
+  auto pass = encoder.BeginRenderPass(&pass_desc);
+  pass.SetPipeline(get_pipeline(target_format));
+  pass.SetBindGroup(0, m_bind_group);
+  pass.Draw(3);
+  pass.End();
+  frame_counters::add_pipeline_bind();
+  frame_counters::add_bind_group_bind();
+}
+
+auto oit_pass::get_pipeline(wgpu::TextureFormat format) -> wgpu::RenderPipeline {
+  auto it = m_pipelines.find(format);
+  if (it != m_pipelines.end()) {
+    return it->second;
+  }
+
+  // Over operator with the average color, 1 - revealage being the total coverage of the transparent layers
+  wgpu::BlendState blend{};
+  blend.color.srcFactor = wgpu::BlendFactor::SrcAlpha;
+  blend.color.dstFactor = wgpu::BlendFactor::OneMinusSrcAlpha;
+  blend.color.operation = wgpu::BlendOperation::Add;
+  blend.alpha.srcFactor = wgpu::BlendFactor::One;
+  blend.alpha.dstFactor = wgpu::BlendFactor::OneMinusSrcAlpha;
+  blend.alpha.operation = wgpu::BlendOperation::Add;
+
+  wgpu::ColorTargetState color_target{};
+  color_target.format = format;
+  color_target.blend = &blend;
+  color_target.writeMask = wgpu::ColorWriteMask::All;
+
+  wgpu::FragmentState fragment_state{};
+  fragment_state.module = m_shader->get_shader_module();
+  fragment_state.entryPoint = "fs_main";
+  fragment_state.targetCount = 1;
+  fragment_state.targets = &color_target;
+
+  wgpu::RenderPipelineDescriptor pipeline_desc{};
+  pipeline_desc.label = "OIT composite";
+  pipeline_desc.layout = m_pipeline_layout;
+  pipeline_desc.vertex.module = m_shader->get_shader_module();
+  pipeline_desc.vertex.entryPoint = "vs_main";
+  pipeline_desc.primitive.topology = wgpu::PrimitiveTopology::TriangleList;
+  pipeline_desc.fragment = &fragment_state;
+  pipeline_desc.multisample.count = 1;
+
+  auto pipeline = m_device.CreateRenderPipeline(&pipeline_desc);
+  if (!pipeline) {
+    throw std::runtime_error("Failed to create OIT composite pipeline");
+  }
+  frame_counters::add_pipeline_created();
+  m_pipelines.emplace(format, pipeline);
+  return pipeline;
+}
+
+} // namespace mareweb
@@ -1,29 +1,71 @@
 #include "mareweb/pipeline.hpp"
+#include "mareweb/frame_stats.hpp"
+#include <array>
 #include <stdexcept>
+#include <utility>
 
 namespace mareweb {
 
 constexpr uint32_t kAllSamplesMask = 0xFFFFFFFF;
 
+auto alpha_test_wgsl(alpha_mode mode) -> std::string {
+  if (mode == alpha_mode::masked) {
+    return R"(
+override alpha_cutoff: f32 = 0.5;
+fn alpha_test(alpha: f32) {
+    if (alpha < alpha_cutoff) {
+        discard;
+    }
+}
+)";
+  }
+  return R"(
+fn alpha_test(alpha: f32) {}
+)";
+}
+
+auto fragment_output_wgsl(alpha_mode mode) -> std::string {
+  if (mode == alpha_mode::weighted_blended) {
+    // Weight function of McGuire and Bavoil for a 0..1 depth range, favoring near and opaque fragments
+    return R"(
+struct FragmentOutput {
+    @location(0) accum: vec4<f32>,
+    @location(1) reveal: f32,
+};
+fn fragment_output(color: vec4<f32>, position: vec4<f32>) -> FragmentOutput {
+    let depth_weight = pow(1.0 - position.z * 0.9, 3.0);
+    let weight = clamp(pow(min(1.0, color.a * 10.0) + 0.01, 3.0) * 1e8 * depth_weight, 1e-2, 3e3);
+    var out: FragmentOutput;
+    out.accum = vec4<f32>(color.rgb * color.a, color.a) * weight;
+    out.reveal = color.a;
+    return out;
+}
+)";
+  }
+  return R"(
+struct FragmentOutput {
+    @location(0) color: vec4<f32>,
+};
+fn fragment_output(color: vec4<f32>, position: vec4<f32>) -> FragmentOutput {
+    return FragmentOutput(color);
+}
+)";
+}
+
 pipeline::pipeline(wgpu::Device &device, const shader &vertex_shader, const shader &fragment_shader,
                    wgpu::TextureFormat surface_format, uint32_t sample_count,
-                   const std::vector<wgpu::BindGroupLayoutEntry> &bind_group_layout_entries,
-                   const wgpu::PrimitiveState &primitive_state, const vertex_state &vert_state) {
-
-  // Create bind group layout
-  wgpu::BindGroupLayoutDescriptor bind_group_layout_desc{};
-  bind_group_layout_desc.entryCount = static_cast<uint32_t>(bind_group_layout_entries.size());
-  bind_group_layout_desc.entries = bind_group_layout_entries.data();
-  m_bind_group_layout = device.CreateBindGroupLayout(&bind_group_layout_desc);
+                   std::vector<wgpu::BindGroupLayout> bind_group_layouts, const wgpu::PrimitiveState &primitive_state,
+                   const vertex_state &vert_state, alpha_mode mode, float alpha_cutoff, depth_mode depth)
+    : m_bind_group_layouts(std::move(bind_group_layouts)) {
 
   // Create pipeline layout
   wgpu::PipelineLayoutDescriptor pipeline_layout_desc{};
-  pipeline_layout_desc.bindGroupLayoutCount = 1;
-  pipeline_layout_desc.bindGroupLayouts = &m_bind_group_layout;
+  pipeline_layout_desc.bindGroupLayoutCount = m_bind_group_layouts.size();
+  pipeline_layout_desc.bindGroupLayouts = m_bind_group_layouts.data();
   wgpu::PipelineLayout pipeline_layout = device.CreatePipelineLayout(&pipeline_layout_desc);
 
   // Create vertex buffer layout
-  auto [attributes, vertex_buffer_layout] = create_vertex_buffer_layout(vert_state);
+  auto vertex_buffers = create_vertex_buffer_layout(vert_state);
 
   // Setup blend state
   wgpu::BlendState blend{};
@@ -34,24 +76,59 @@ pipeline::pipeline(wgpu::Device &device, const shader &vertex_shader, const shad
   blend.alpha.dstFactor = wgpu::BlendFactor::OneMinusSrcAlpha;
   blend.alpha.operation = wgpu::BlendOperation::Add;
 
-  // Create color target state
+  // Create color target state, blending only where it is needed as it rules out some hardware fast paths
   wgpu::ColorTargetState color_target{};
   color_target.format = surface_format;
-  color_target.blend = &blend;
+  color_target.blend = mode == alpha_mode::blended ? &blend : nullptr;
   color_target.writeMask = wgpu::ColorWriteMask::All;
 
+  // Weighted blended transparency sums weighted colors and multiplies revealage, both independent of draw order
+  wgpu::BlendState accum_blend{};
+  accum_blend.color.srcFactor = wgpu::BlendFactor::One;
+  accum_blend.color.dstFactor = wgpu::BlendFactor::One;
+  accum_blend.color.operation = wgpu::BlendOperation::Add;
+  accum_blend.alpha = accum_blend.color;
+  wgpu::BlendState reveal_blend{};
+  reveal_blend.color.srcFactor = wgpu::BlendFactor::Zero;
+  reveal_blend.color.dstFactor = wgpu::BlendFactor::OneMinusSrc;
+  reveal_blend.color.operation = wgpu::BlendOperation::Add;
+  reveal_blend.alpha = reveal_blend.color;
+  std::array<wgpu::ColorTargetState, 2> oit_targets{};
+  oit_targets[0].format = OIT_ACCUM_FORMAT;
+  oit_targets[0].blend = &accum_blend;
+  oit_targets[0].writeMask = wgpu::ColorWriteMask::All;
+  oit_targets[1].format = OIT_REVEAL_FORMAT;
+  oit_targets[1].blend = &reveal_blend;
+  oit_targets[1].writeMask = wgpu::ColorWriteMask::Red;
+
   // Create fragment state
   wgpu::FragmentState fragment_state{};
   fragment_state.module = fragment_shader.get_shader_module();
   fragment_state.entryPoint = "main";
-  fragment_state.targetCount = 1;
-  fragment_state.targets = &color_target;
+  if (mode == alpha_mode::weighted_blended) {
+    fragment_state.targetCount = oit_targets.size();
+    fragment_state.targets = oit_targets.data();
+  } else {
+    fragment_state.targetCount = 1;
+    fragment_state.targets = &color_target;
+  }
+
+  // Declared by alpha_test_wgsl(alpha_mode::masked) only, setting it on another shader fails validation
+  wgpu::ConstantEntry cutoff_constant{};
+  cutoff_constant.key = "alpha_cutoff";
+  cutoff_constant.value = alpha_cutoff;
+  if (mode == alpha_mode::masked) {
+    fragment_state.constantCount = 1;
+    fragment_state.constants = &cutoff_constant;
+  }
 
-  // Create depth stencil state
+  // Create depth stencil state. Blended surfaces are sorted rather than depth resolved, so they leave depth alone, and
+  // after a depth pre-pass only the nearest surface matches the stored depth.
   wgpu::DepthStencilState depth_stencil{};
   depth_stencil.format = wgpu::TextureFormat::Depth24Plus;
-  depth_stencil.depthWriteEnabled = true;
-  depth_stencil.depthCompare = wgpu::CompareFunction::Less;
+  const bool translucent = mode == alpha_mode::blended || mode == alpha_mode::weighted_blended;
+  depth_stencil.depthWriteEnabled = !translucent && depth == depth_mode::test_and_write;
+  depth_stencil.depthCompare = depth == depth_mode::equal ? wgpu::CompareFunction::Equal : wgpu::CompareFunction::Less;
   // Make sure stencil is properly initialized even if not used
   depth_stencil.stencilFront = {};
   depth_stencil.stencilBack = {};
@@ -64,8 +141,8 @@ pipeline::pipeline(wgpu::Device &device, const shader &vertex_shader, const shad
 
   pipeline_desc.vertex.module = vertex_shader.get_shader_module();
   pipeline_desc.vertex.entryPoint = "main";
-  pipeline_desc.vertex.bufferCount = 1;
-  pipeline_desc.vertex.buffers = &vertex_buffer_layout;
+  pipeline_desc.vertex.bufferCount = vertex_buffers.buffers.size();
+  pipeline_desc.vertex.buffers = vertex_buffers.buffers.data();
 
   pipeline_desc.primitive = primitive_state;
   pipeline_desc.fragment = &fragment_state;
@@ -80,10 +157,10 @@ pipeline::pipeline(wgpu::Device &device, const shader &vertex_shader, const shad
   if (!m_pipeline) {
     throw std::runtime_error("Failed to create render pipeline");
   }
+  frame_counters::add_pipeline_created();
 }
 
-auto pipeline::create_vertex_buffer_layout(const vertex_state &vert_state)
-    -> std::pair<std::vector<wgpu::VertexAttribute>, wgpu::VertexBufferLayout> {
+auto pipeline::create_vertex_buffer_layout(const vertex_state &vert_state) -> vertex_buffer_layouts {
 
   // Create the basic layout with position
   auto layout = vertex_layouts::create_layout();
@@ -99,17 +176,26 @@ auto pipeline::create_vertex_buffer_layout(const vertex_state &vert_state)
     layout = vertex_layouts::with_colors(std::move(layout));
   }
 
-  // Get the WebGPU attributes
-  auto attributes = layout.get_wgpu_attributes();
+  std::vector<std::pair<vertex_layout, wgpu::VertexStepMode>> slots{{layout, wgpu::VertexStepMode::Vertex}};
+  if (vert_state.has_instance_data) {
+    slots.emplace_back(vertex_layouts::instance_record_layout(), wgpu::VertexStepMode::Instance);
+  }
 
-  // Create the vertex buffer layout
-  wgpu::VertexBufferLayout buffer_layout{};
-  buffer_layout.arrayStride = layout.get_stride();
-  buffer_layout.stepMode = wgpu::VertexStepMode::Vertex;
-  buffer_layout.attributeCount = static_cast<uint32_t>(attributes.size());
-  buffer_layout.attributes = attributes.data();
+  // Fill every attribute array first, so the pointers taken below stay valid
+  vertex_buffer_layouts result;
+  for (const auto &slot : slots) {
+    result.attributes.push_back(slot.first.get_wgpu_attributes());
+  }
+  for (size_t i = 0; i < slots.size(); ++i) {
+    wgpu::VertexBufferLayout buffer_layout{};
+    buffer_layout.arrayStride = slots[i].first.get_stride();
+    buffer_layout.stepMode = slots[i].second;
+    buffer_layout.attributeCount = static_cast<uint32_t>(result.attributes[i].size());
+    buffer_layout.attributes = result.attributes[i].data();
+    result.buffers.push_back(buffer_layout);
+  }
 
-  return {std::move(attributes), buffer_layout};
+  return result;
 }
 
-} // namespace mareweb
\ No newline at end of file
+} // namespace mareweb
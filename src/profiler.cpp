@@ -0,0 +1,167 @@
+#include "mareweb/profiler.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+
+namespace mareweb {
+
+namespace {
+constexpr double NANOSECONDS_PER_MILLISECOND = 1.0e6;
+constexpr double NANOSECONDS_PER_MICROSECOND = 1.0e3;
+
+void write_json_string(std::ostream &out, const char *str) {
+  out << '"';
+  for (const char *c = str; *c != '\0'; ++c) {
+    if (*c == '"' || *c == '\\') {
+      out << '\\';
+    }
+    out << *c;
+  }
+  out << '"';
+}
+} // namespace
+
+auto profiler::get_instance() -> profiler & {
+  static profiler instance;
+  return instance;
+}
+
+auto profiler::now_ns() -> uint64_t {
+  static const auto epoch = std::chrono::steady_clock::now();
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count());
+}
+
+auto profiler::get_thread_buffer() -> thread_buffer & {
+  thread_local std::shared_ptr<thread_buffer> buffer;
+  if (!buffer) {
+    buffer = std::make_shared<thread_buffer>();
+    buffer->events.resize(EVENTS_PER_THREAD);
+    std::lock_guard lock(m_mutex);
+    buffer->thread_id = m_next_thread_id++;
+    m_buffers.push_back(buffer);
+  }
+  return *buffer;
+}
+
+auto profiler::enter_zone() -> uint32_t { return get_thread_buffer().depth++; }
+
+void profiler::leave_zone() {
+  auto &buffer = get_thread_buffer();
+  if (buffer.depth > 0) {
+    buffer.depth--;
+  }
+}
+
+void profiler::record(const profile_event &event) {
+  auto &buffer = get_thread_buffer();
+  // Only contended while another thread exports or aggregates
+  std::lock_guard lock(buffer.mutex);
+  buffer.events[buffer.next] = event;
+  buffer.next = (buffer.next + 1) % EVENTS_PER_THREAD;
+  buffer.count = std::min(buffer.count + 1, EVENTS_PER_THREAD);
+}
+
+void profiler::end_frame(uint64_t start_ns, uint64_t end_ns) {
+  std::function<void(const hitch_info &)> handler;
+  hitch_info info{};
+  {
+    std::lock_guard lock(m_mutex);
+    info = {m_frame_index++, start_ns, end_ns, static_cast<double>(end_ns - start_ns) / NANOSECONDS_PER_MILLISECOND};
+    if (!m_hitch_handler || info.duration_ms < m_hitch_threshold_ms) {
+      return;
+    }
+    handler = m_hitch_handler;
+  }
+  handler(info);
+}
+
+void profiler::set_hitch_handler(double threshold_ms, std::function<void(const hitch_info &)> handler) {
+  std::lock_guard lock(m_mutex);
+  m_hitch_threshold_ms = threshold_ms;
+  m_hitch_handler = std::move(handler);
+}
+
+template <typename F> void profiler::for_each_event(F &&fn) const {
+  std::vector<std::shared_ptr<thread_buffer>> buffers;
+  {
+    std::lock_guard lock(m_mutex);
+    buffers = m_buffers;
+  }
+  for (const auto &buffer : buffers) {
+    std::lock_guard lock(buffer->mutex);
+    size_t first = (buffer->next + EVENTS_PER_THREAD - buffer->count) % EVENTS_PER_THREAD;
+    for (size_t i = 0; i < buffer->count; ++i) {
+      fn(buffer->events[(first + i) % EVENTS_PER_THREAD], buffer->thread_id);
+    }
+  }
+}
+
+void profiler::export_chrome_trace(std::ostream &out, uint64_t start_ns, uint64_t end_ns) const {
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  for_each_event([&](const profile_event &event, uint32_t thread_id) {
+    if (event.end_ns < start_ns || event.start_ns > end_ns) {
+      return;
+    }
+    if (!first) {
+      out << ',';
+    }
+    first = false;
+    out << "\n{\"name\":";
+    write_json_string(out, event.name);
+    out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread_id
+        << ",\"ts\":" << static_cast<double>(event.start_ns) / NANOSECONDS_PER_MICROSECOND
+        << ",\"dur\":" << static_cast<double>(event.end_ns - event.start_ns) / NANOSECONDS_PER_MICROSECOND
+        << ",\"args\":{\"depth\":" << event.depth << "}}";
+  });
+  out << "\n]}\n";
+}
+
+void profiler::export_chrome_trace(const std::string &path, uint64_t start_ns, uint64_t end_ns) const {
+  std::ofstream out(path);
+  if (!out) {
+    throw std::runtime_error("Failed to open trace file: " + path);
+  }
+  export_chrome_trace(out, start_ns, end_ns);
+}
+
+auto profiler::get_zone_stats() const -> std::vector<zone_stats> {
+  std::map<std::string, zone_stats> by_name;
+  for_each_event([&](const profile_event &event, uint32_t /*thread_id*/) {
+    double milliseconds = static_cast<double>(event.end_ns - event.start_ns) / NANOSECONDS_PER_MILLISECOND;
+    auto &stats = by_name[event.name];
+    if (stats.count == 0) {
+      stats.name = event.name;
+      stats.min_ms = milliseconds;
+      stats.max_ms = milliseconds;
+    }
+    stats.count++;
+    stats.total_ms += milliseconds;
+    stats.min_ms = std::min(stats.min_ms, milliseconds);
+    stats.max_ms = std::max(stats.max_ms, milliseconds);
+  });
+
+  std::vector<zone_stats> result;
+  result.reserve(by_name.size());
+  for (auto &[name, stats] : by_name) {
+    stats.average_ms = stats.total_ms / static_cast<double>(stats.count);
+    result.push_back(std::move(stats));
+  }
+  std::sort(result.begin(), result.end(),
+            [](const zone_stats &a, const zone_stats &b) { return a.total_ms > b.total_ms; });
+  return result;
+}
+
+void profiler::clear() {
+  std::lock_guard lock(m_mutex);
+  for (const auto &buffer : m_buffers) {
+    std::lock_guard buffer_lock(buffer->mutex);
+    buffer->next = 0;
+    buffer->count = 0;
+  }
+}
+
+} // namespace mareweb
@@ -1,9 +1,14 @@
 #include "mareweb/renderer.hpp"
+#include "mareweb/bind_group_cache.hpp"
 #include "mareweb/material.hpp"
+#include "mareweb/uniform_block.hpp"
+#include "mareweb/upload_manager.hpp"
 #include <SDL2/SDL_video.h>
 #include <iostream>
+#include <optional>
 #include <sstream>
 #include <stdexcept>
+#include <tuple>
 #include <utility>
 
 namespace mareweb {
@@ -16,7 +21,14 @@ renderer::renderer(wgpu::Device &device, wgpu::Surface surface, SDL_Window *wind
   // m_surface_format = *capabilities.formats;
   m_surface_format = wgpu::TextureFormat::BGRA8Unorm;
 
-  configure_surface();
+  if (m_properties.headless) {
+    create_headless_texture();
+  } else {
+    configure_surface();
+  }
+  // Dynamic resolution starts at full size, the scaler is created by the first frame
+  m_render_width = m_properties.width;
+  m_render_height = m_properties.height;
   create_depth_texture();
 
   if (m_properties.sample_count > 1) {
@@ -28,6 +40,13 @@ renderer::renderer(wgpu::Device &device, wgpu::Surface surface, SDL_Window *wind
     }
   }
 
+  if (gpu_profiler::is_supported(m_device)) {
+    m_gpu_profiler = std::make_unique<gpu_profiler>(m_device);
+  }
+  m_texture_loader = std::make_unique<texture_loader>(m_device);
+  m_light_clusters = std::make_unique<light_clusters>(m_device);
+  m_frame_bindings = std::make_unique<frame_bindings>(m_device, *m_light_clusters);
+
   attach_system<renderer_render_system>();
   attach_system<renderer_physics_system>();
   attach_system<renderer_controls_system>();
@@ -42,16 +61,19 @@ renderer::~renderer() {
 void renderer::resize(uint32_t new_width, uint32_t new_height) {
   m_properties.width = new_width;
   m_properties.height = new_height;
-  configure_surface();
-  create_depth_texture();
-  if (m_properties.sample_count > 1) {
-    create_msaa_texture(); // Recreate MSAA texture with new size
+  if (m_properties.headless) {
+    create_headless_texture();
+  } else {
+    configure_surface();
   }
+  create_render_targets();
 }
 
 void renderer::present() {
 #ifndef __EMSCRIPTEN__
-  m_surface.Present();
+  if (!m_properties.headless) {
+    m_surface.Present();
+  }
 #endif
 }
 
@@ -97,36 +119,136 @@ void renderer::set_fullscreen(bool fullscreen) {
 void renderer::set_present_mode(wgpu::PresentMode present_mode) {
   if (present_mode != m_properties.present_mode) {
     m_properties.present_mode = present_mode;
-    configure_surface(); // Reconfigure surface to apply present mode change
+    if (!m_properties.headless) {
+      configure_surface(); // Reconfigure surface to apply present mode change
+    }
+  }
+}
+
+auto renderer::load_texture(const std::string &path, const texture_options &options)
+    -> std::shared_ptr<texture_handle> {
+  // Packed entries are keyed by pack and name; the pack only changes when it is rebuilt, which needs a restart
+  if (m_asset_pack && m_asset_pack->contains(path)) {
+    return m_resource_cache->acquire<texture_handle>(
+        [&]() { return m_texture_loader->load_packed(m_asset_pack, path, options); }, m_asset_pack->get_path(), path,
+        options.mipmaps, options.srgb, options.address_mode);
+  }
+  return m_resource_cache->acquire<texture_handle>([&]() { return m_texture_loader->load(path, options); },
+                                                   resource_cache::file_key(path), options.mipmaps, options.srgb,
+                                                   options.address_mode);
+}
+
+void renderer::mount_asset_pack(const std::string &path) {
+  m_asset_pack = std::make_shared<const asset_pack>(path);
+}
+
+void renderer::set_resolution_scale(const resolution_scale_settings &settings) {
+  resolution_scaler::validate(settings);
+  m_properties.resolution_scale = settings;
+  if (m_resolution_scaler) {
+    m_resolution_scaler->set_settings(settings);
   }
 }
 
+auto renderer::get_resolution_scale() const -> float {
+  return m_properties.dynamic_resolution && m_resolution_scaler ? m_resolution_scaler->get_scale() : 1.0F;
+}
+
+void renderer::set_light(const vec3 &direction, const vec3 &color, float ambient) {
+  m_frame_uniforms.light_direction = vec4{direction[0], direction[1], direction[2], 0.0F};
+  m_frame_uniforms.light_color = vec4{color[0], color[1], color[2], ambient};
+}
+
+auto renderer::get_gltf_loader() -> gltf_loader & {
+  if (!m_gltf_loader) {
+    m_gltf_loader = std::make_unique<gltf_loader>(m_device, *m_texture_loader);
+  }
+  return *m_gltf_loader;
+}
+
+void renderer::defragment_geometry() {
+  // Geometry still staged has to reach its pages before they move
+  upload_manager::get(m_device).flush();
+  wgpu::CommandEncoder encoder = m_device.CreateCommandEncoder();
+  geometry_arena::get(m_device).defragment(encoder);
+  wgpu::CommandBuffer commands = encoder.Finish();
+  m_device.GetQueue().Submit(1, &commands);
+}
+
 void renderer::begin_frame() {
-  wgpu::SurfaceTexture surface_texture{};
-  m_surface.GetCurrentTexture(&surface_texture);
-  if (!surface_texture.texture) {
-    throw std::runtime_error("Failed to get current surface texture");
+  MAREWEB_PROFILE_ZONE("begin_frame");
+  frame_counters::scope counting(*m_frame_counters);
+  // Finished decodes are uploaded before the frame's encoder exists so their writes land ahead of this frame's draws
+  m_texture_loader->poll();
+  if (m_gltf_loader) {
+    m_gltf_loader->poll();
   }
-  m_current_texture_view = surface_texture.texture.CreateView();
-  if (!m_current_texture_view) {
-    throw std::runtime_error("Failed to create view for surface texture");
+  if (m_properties.headless) {
+    m_current_texture_view = m_headless_texture_view;
+  } else {
+    wgpu::SurfaceTexture surface_texture{};
+    m_surface.GetCurrentTexture(&surface_texture);
+    if (!surface_texture.texture) {
+      throw std::runtime_error("Failed to get current surface texture");
+    }
+    m_current_texture_view = surface_texture.texture.CreateView();
+    if (!m_current_texture_view) {
+      throw std::runtime_error("Failed to create view for surface texture");
+    }
   }
 
+  if (m_properties.dynamic_resolution && !m_resolution_scaler) {
+    m_resolution_scaler =
+        std::make_unique<resolution_scaler>(m_device, m_surface_format, m_properties.resolution_scale);
+    if (!m_gpu_profiler) {
+      std::cout << "Dynamic resolution needs the timestamp-query feature to measure GPU frame time. Keeping the scale "
+                   "at resolution_scale.max_scale."
+                << std::endl;
+    }
+  }
+  if (get_scaled_size() != std::pair{m_render_width, m_render_height}) {
+    create_render_targets();
+  }
+  // At full size the scene renders straight into the surface
+  m_frame_upscale = m_render_width != m_properties.width || m_render_height != m_properties.height;
+  m_scene_texture_view = m_frame_upscale ? m_resolution_scaler->get_target(m_render_width, m_render_height)
+                                         : m_current_texture_view;
+
   m_command_encoder = m_device.CreateCommandEncoder();
   if (!m_command_encoder) {
     throw std::runtime_error("Failed to create command encoder");
   }
+  if (m_gpu_profiler) {
+    m_gpu_profiler->begin_frame();
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  m_frame_uniforms.time = std::chrono::duration<float>(now - m_start_time).count();
+  m_frame_uniforms.delta_time = std::chrono::duration<float>(now - m_last_frame_end).count();
+  update_frame_uniforms(m_frame_uniforms);
+  m_light_clusters->assign(m_command_encoder, m_frame_uniforms.view, m_frame_uniforms.projection, m_render_width,
+                           m_render_height, m_gpu_profiler.get());
+
+  // With a depth pre-pass the color pass has to wait for the frame's draws, end_frame begins both
+  m_frame_depth_prepass = m_properties.depth_prepass;
+  if (!m_frame_depth_prepass) {
+    begin_main_pass(wgpu::LoadOp::Clear);
+  }
+  // Counting stays on this renderer until end_frame. A throw above ends the scope and restores the previous counters.
+  m_previous_counters = counting.release();
+}
 
+void renderer::begin_main_pass(wgpu::LoadOp depth_load) {
   wgpu::RenderPassColorAttachment color_attachment{};
   if (m_properties.sample_count > 1) {
     if (!m_msaa_texture_view) {
       throw std::runtime_error("MSAA texture view is null");
     }
     color_attachment.view = m_msaa_texture_view;
-    color_attachment.resolveTarget = m_current_texture_view;
+    color_attachment.resolveTarget = m_scene_texture_view;
     color_attachment.storeOp = wgpu::StoreOp::Discard;
   } else {
-    color_attachment.view = m_current_texture_view;
+    color_attachment.view = m_scene_texture_view;
     color_attachment.resolveTarget = nullptr;
     color_attachment.storeOp = wgpu::StoreOp::Store;
   }
@@ -137,7 +259,7 @@ void renderer::begin_frame() {
   wgpu::RenderPassDepthStencilAttachment depth_attachment{};
   depth_attachment.view = m_depth_texture_view;
   depth_attachment.depthClearValue = 1.0f;
-  depth_attachment.depthLoadOp = wgpu::LoadOp::Clear;
+  depth_attachment.depthLoadOp = depth_load;
   depth_attachment.depthStoreOp = wgpu::StoreOp::Store;
   depth_attachment.stencilLoadOp = wgpu::LoadOp::Undefined;
   depth_attachment.stencilStoreOp = wgpu::StoreOp::Undefined;
@@ -148,24 +270,146 @@ void renderer::begin_frame() {
   render_pass_descriptor.colorAttachments = &color_attachment;
   render_pass_descriptor.depthStencilAttachment = &depth_attachment;
 
+  std::optional<wgpu::RenderPassTimestampWrites> timestamp_writes;
+  if (m_gpu_profiler) {
+    timestamp_writes = m_gpu_profiler->render_pass_timestamps("main_pass");
+  }
+  if (timestamp_writes) {
+    render_pass_descriptor.timestampWrites = &*timestamp_writes;
+  }
+
   m_render_pass = m_command_encoder.BeginRenderPass(&render_pass_descriptor);
+  m_geometry_bindings.reset();
   if (!m_render_pass) {
     std::stringstream ss;
     ss << "Failed to begin render pass. "
        << "Sample count: " << m_properties.sample_count
        << ", MSAA view valid: " << (m_msaa_texture_view ? "true" : "false")
-       << ", Surface view valid: " << (m_current_texture_view ? "true" : "false");
+       << ", Scene view valid: " << (m_scene_texture_view ? "true" : "false");
     throw std::runtime_error(ss.str());
   }
+
+  if (depth_load == wgpu::LoadOp::Load) {
+    // The pre-pass already wrote the frame uniforms
+    m_frame_bindings->begin_pass(m_render_pass);
+  } else {
+    m_frame_bindings->begin_pass(m_render_pass, m_frame_uniforms);
+  }
+}
+
+void renderer::record_depth_prepass() {
+  if (!m_depth_prepass) {
+    m_depth_prepass = std::make_unique<depth_prepass>(m_device, m_properties.sample_count);
+  }
+
+  wgpu::RenderPassDepthStencilAttachment depth_attachment{};
+  depth_attachment.view = m_depth_texture_view;
+  depth_attachment.depthClearValue = 1.0f;
+  depth_attachment.depthLoadOp = wgpu::LoadOp::Clear;
+  depth_attachment.depthStoreOp = wgpu::StoreOp::Store;
+  depth_attachment.stencilLoadOp = wgpu::LoadOp::Undefined;
+  depth_attachment.stencilStoreOp = wgpu::StoreOp::Undefined;
+  depth_attachment.depthReadOnly = false;
+
+  wgpu::RenderPassDescriptor pass_descriptor{};
+  pass_descriptor.label = "depth pre-pass";
+  pass_descriptor.colorAttachmentCount = 0;
+  pass_descriptor.depthStencilAttachment = &depth_attachment;
+  std::optional<wgpu::RenderPassTimestampWrites> timestamp_writes;
+  if (m_gpu_profiler) {
+    timestamp_writes = m_gpu_profiler->render_pass_timestamps("depth_prepass");
+  }
+  if (timestamp_writes) {
+    pass_descriptor.timestampWrites = &*timestamp_writes;
+  }
+
+  wgpu::RenderPassEncoder pass = m_command_encoder.BeginRenderPass(&pass_descriptor);
+  m_geometry_bindings.reset();
+  m_frame_bindings->begin_pass(pass, m_frame_uniforms);
+  m_draw_queue.record_depth_prepass(pass, *m_frame_bindings, m_geometry_bindings, *m_depth_prepass);
+  pass.End();
+}
+
+void renderer::record_weighted_blended() {
+  if (!m_oit_pass) {
+    m_oit_pass = std::make_unique<oit_pass>(m_device, m_properties.sample_count);
+  }
+  wgpu::RenderPassEncoder pass = m_oit_pass->begin(m_command_encoder, m_depth_texture_view, m_render_width,
+                                                   m_render_height, m_gpu_profiler.get());
+  m_geometry_bindings.reset();
+  m_frame_bindings->begin_pass(pass);
+  m_draw_queue.record_weighted_blended(pass, *m_frame_bindings, m_geometry_bindings);
+  pass.End();
+  // Over the resolved color, which the color pass has stored
+  m_oit_pass->composite(m_command_encoder, m_scene_texture_view, m_surface_format, m_gpu_profiler.get());
 }
 
 void renderer::end_frame() {
+  MAREWEB_PROFILE_ZONE("end_frame");
+  // Hands begin_frame's counters to a scope, so they come off the thread however end_frame exits
+  frame_counters::install(m_previous_counters);
+  frame_counters::scope counting(*m_frame_counters);
+  if (m_properties.occlusion_culling) {
+    if (!m_occlusion_culler) {
+      m_occlusion_culler = std::make_unique<occlusion_culler>(m_device);
+    }
+    m_draw_queue.cull(*m_occlusion_culler, m_frame_uniforms.view_projection);
+  }
+  m_draw_queue.sort(m_frame_uniforms.camera_position);
+  if (m_frame_depth_prepass) {
+    record_depth_prepass();
+    begin_main_pass(wgpu::LoadOp::Load);
+  }
+  m_draw_queue.record(m_render_pass, *m_frame_bindings, m_geometry_bindings);
   m_render_pass.End();
-  wgpu::CommandBuffer commands = m_command_encoder.Finish();
-  m_device.GetQueue().Submit(1, &commands);
-#ifndef __EMSCRIPTEN__
-  m_surface.Present();
-#endif
+  m_render_pass = nullptr;
+  if (m_draw_queue.has_weighted_blended()) {
+    record_weighted_blended();
+  }
+  if (m_frame_upscale) {
+    m_resolution_scaler->upscale(m_command_encoder, m_current_texture_view, m_gpu_profiler.get());
+  }
+  m_draw_queue.clear();
+  if (m_properties.occlusion_culling) {
+    // The finished depth becomes the Hi-Z that later frames cull against
+    m_occlusion_culler->build(m_command_encoder, m_depth_texture, m_frame_uniforms.view_projection,
+                              m_gpu_profiler.get());
+  }
+  // Queued ahead of the submit, so the draws recorded this frame read their uniforms
+  m_frame_bindings->flush();
+  uniform_block::flush_all(m_device);
+  if (m_gpu_profiler) {
+    m_gpu_profiler->resolve(m_command_encoder);
+  }
+  // Staged uploads go in their own submit ahead of the frame, including meshes created while it was recorded
+  upload_manager::get(m_device).flush();
+  {
+    MAREWEB_PROFILE_ZONE("submit");
+    wgpu::CommandBuffer commands = m_command_encoder.Finish();
+    m_device.GetQueue().Submit(1, &commands);
+  }
+  bind_group_cache::get(m_device).end_frame(this);
+  if (m_gpu_profiler) {
+    m_gpu_profiler->after_submit();
+  }
+  if (m_properties.dynamic_resolution && m_resolution_scaler && m_gpu_profiler) {
+    // A new scale resizes the targets in the next begin_frame
+    m_resolution_scaler->update(*m_gpu_profiler);
+  }
+  if (m_occlusion_culler) {
+    m_occlusion_culler->after_submit();
+  }
+  {
+    MAREWEB_PROFILE_ZONE("present");
+    present();
+  }
+
+  auto now = std::chrono::steady_clock::now();
+  frame_stats stats = m_frame_counters->take();
+  stats.frame_index = m_frame_index++;
+  stats.frame_time_ms = std::chrono::duration<double, std::milli>(now - m_last_frame_end).count();
+  m_last_frame_end = now;
+  m_frame_stats.push(stats);
 }
 
 void renderer::configure_surface() {
@@ -183,24 +427,52 @@ void renderer::configure_surface() {
   m_surface.Configure(&config);
 }
 
+void renderer::create_headless_texture() {
+  wgpu::TextureDescriptor texture_desc{};
+  texture_desc.size.width = m_properties.width;
+  texture_desc.size.height = m_properties.height;
+  texture_desc.size.depthOrArrayLayers = 1;
+  texture_desc.sampleCount = 1;
+  texture_desc.format = m_surface_format;
+  texture_desc.mipLevelCount = 1;
+  texture_desc.usage = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::CopySrc;
+
+  texture_desc.label = "headless target";
+
+  // Released first, so the registry never counts the old and the new target at once
+  m_headless_resource.reset();
+  m_headless_texture = m_device.CreateTexture(&texture_desc);
+  if (!m_headless_texture) {
+    throw std::runtime_error("Failed to create headless render target");
+  }
+  m_headless_resource = resource_registry::get_instance().register_texture(texture_desc, resource_category::render_target,
+                                                                           "headless target");
+  m_headless_texture_view = m_headless_texture.CreateView();
+}
+
 void renderer::create_msaa_texture() {
   if (m_properties.sample_count <= 1) {
     return;
   }
 
   wgpu::TextureDescriptor texture_desc{};
-  texture_desc.size.width = m_properties.width;
-  texture_desc.size.height = m_properties.height;
+  texture_desc.size.width = m_render_width;
+  texture_desc.size.height = m_render_height;
   texture_desc.size.depthOrArrayLayers = 1;
   texture_desc.sampleCount = m_properties.sample_count;
   texture_desc.format = m_surface_format;
   texture_desc.mipLevelCount = 1;
   texture_desc.usage = wgpu::TextureUsage::RenderAttachment;
 
+  texture_desc.label = "MSAA target";
+
+  m_msaa_resource.reset();
   m_msaa_texture = m_device.CreateTexture(&texture_desc);
   if (!m_msaa_texture) {
     throw std::runtime_error("Failed to create MSAA texture");
   }
+  m_msaa_resource =
+      resource_registry::get_instance().register_texture(texture_desc, resource_category::render_target, "MSAA target");
   m_msaa_texture_view = m_msaa_texture.CreateView();
   if (!m_msaa_texture_view) {
     throw std::runtime_error("Failed to create MSAA texture view");
@@ -213,13 +485,34 @@ void renderer::create_depth_texture() {
   depth_tex_desc.format = wgpu::TextureFormat::Depth24Plus;
   depth_tex_desc.mipLevelCount = 1;
   depth_tex_desc.sampleCount = m_properties.sample_count;
-  depth_tex_desc.size = {m_properties.width, m_properties.height, 1};
-  depth_tex_desc.usage = wgpu::TextureUsage::RenderAttachment;
+  depth_tex_desc.size = {m_render_width, m_render_height, 1};
+  // Sampled by the occlusion culler's Hi-Z build
+  depth_tex_desc.usage = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::TextureBinding;
   depth_tex_desc.viewFormats = nullptr;
   depth_tex_desc.viewFormatCount = 0;
 
+  depth_tex_desc.label = "depth target";
+
+  m_depth_resource.reset();
   m_depth_texture = m_device.CreateTexture(&depth_tex_desc);
+  m_depth_resource = resource_registry::get_instance().register_texture(depth_tex_desc, resource_category::depth_target,
+                                                                        "depth target");
   m_depth_texture_view = m_depth_texture.CreateView();
 }
 
+auto renderer::get_scaled_size() const -> std::pair<uint32_t, uint32_t> {
+  if (m_properties.dynamic_resolution && m_resolution_scaler) {
+    return m_resolution_scaler->scaled_size(m_properties.width, m_properties.height);
+  }
+  return {m_properties.width, m_properties.height};
+}
+
+void renderer::create_render_targets() {
+  std::tie(m_render_width, m_render_height) = get_scaled_size();
+  create_depth_texture();
+  if (m_properties.sample_count > 1) {
+    create_msaa_texture();
+  }
+}
+
 } // namespace mareweb
\ No newline at end of file
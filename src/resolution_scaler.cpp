@@ -0,0 +1,250 @@
+#include "mareweb/resolution_scaler.hpp"
+#include "mareweb/frame_stats.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <optional>
+#include <stdexcept>
+
+namespace mareweb {
+
+namespace {
+
+const char *const UPSCALE_SHADER = R"(
+    struct VertexOutput {
+        @builtin(position) position: vec4<f32>,
+        @location(0) uv: vec2<f32>,
+    };
+
+    @vertex
+    fn vs_main(@builtin(vertex_index) index: u32) -> VertexOutput {
+        // Fullscreen triangle
+        let uv = vec2<f32>(f32((index << 1u) & 2u), f32(index & 2u));
+        var out: VertexOutput;
+        out.position = vec4<f32>(uv * vec2<f32>(2.0, -2.0) + vec2<f32>(-1.0, 1.0), 0.0, 1.0);
+        out.uv = uv;
+        return out;
+    }
+
+    @group(0) @binding(0) var source_texture: texture_2d<f32>;
+    @group(0) @binding(1) var source_sampler: sampler;
+
+    @fragment
+    fn fs_bilinear(in: VertexOutput) -> @location(0) vec4<f32> {
+        return textureSample(source_texture, source_sampler, in.uv);
+    }
+
+    // Contrast-adaptive sharpening of the bilinear result. The cross of neighbors one source texel away sharpens
+    // less where the local contrast is already high, so edges get crisper without ringing.
+    @fragment
+    fn fs_edge_aware(in: VertexOutput) -> @location(0) vec4<f32> {
+        let texel = 1.0 / vec2<f32>(textureDimensions(source_texture));
+        let center = textureSample(source_texture, source_sampler, in.uv);
+        let north = textureSample(source_texture, source_sampler, in.uv - vec2<f32>(0.0, texel.y)).rgb;
+        let south = textureSample(source_texture, source_sampler, in.uv + vec2<f32>(0.0, texel.y)).rgb;
+        let west = textureSample(source_texture, source_sampler, in.uv - vec2<f32>(texel.x, 0.0)).rgb;
+        let east = textureSample(source_texture, source_sampler, in.uv + vec2<f32>(texel.x, 0.0)).rgb;
+
+        let low = min(center.rgb, min(min(north, south), min(west, east)));
+        let high = max(center.rgb, max(max(north, south), max(west, east)));
+        let amount = sqrt(clamp(min(low, 1.0 - high) / max(high, vec3<f32>(1e-5)), vec3<f32>(0.0), vec3<f32>(1.0)));
+        let weight = amount * -0.125;
+        let sharpened = (center.rgb + (north + south + west + east) * weight) / (1.0 + 4.0 * weight);
+        return vec4<f32>(clamp(sharpened, vec3<f32>(0.0), vec3<f32>(1.0)), center.a);
+    }
+)";
+
+auto scale_dimension(uint32_t size, float scale) -> uint32_t {
+  return std::max(static_cast<uint32_t>(std::lround(static_cast<float>(size) * scale)), 1U);
+}
+
+} // namespace
+
+resolution_scaler::resolution_scaler(wgpu::Device &device, wgpu::TextureFormat format,
+                                     const resolution_scale_settings &settings)
+    : m_device(device), m_format(format), m_settings(settings), m_scale(settings.max_scale) {
+  validate(settings);
+  m_shader = std::make_unique<shader>(device, UPSCALE_SHADER, wgpu::ShaderStage::Vertex | wgpu::ShaderStage::Fragment);
+
+  std::array<wgpu::BindGroupLayoutEntry, 2> entries{};
+  entries[0].binding = 0;
+  entries[0].visibility = wgpu::ShaderStage::Fragment;
+  entries[0].texture.sampleType = wgpu::TextureSampleType::Float;
+  entries[0].texture.viewDimension = wgpu::TextureViewDimension::e2D;
+  entries[1].binding = 1;
+  entries[1].visibility = wgpu::ShaderStage::Fragment;
+  entries[1].sampler.type = wgpu::SamplerBindingType::Filtering;
+
+  wgpu::BindGroupLayoutDescriptor bind_group_layout_desc{};
+  bind_group_layout_desc.entryCount = entries.size();
+  bind_group_layout_desc.entries = entries.data();
+  m_bind_group_layout = device.CreateBindGroupLayout(&bind_group_layout_desc);
+
+  wgpu::PipelineLayoutDescriptor pipeline_layout_desc{};
+  pipeline_layout_desc.bindGroupLayoutCount = 1;
+  pipeline_layout_desc.bindGroupLayouts = &m_bind_group_layout;
+  m_pipeline_layout = device.CreatePipelineLayout(&pipeline_layout_desc);
+
+  wgpu::SamplerDescriptor sampler_desc{};
+  sampler_desc.addressModeU = wgpu::AddressMode::ClampToEdge;
+  sampler_desc.addressModeV = wgpu::AddressMode::ClampToEdge;
+  sampler_desc.magFilter = wgpu::FilterMode::Linear;
+  sampler_desc.minFilter = wgpu::FilterMode::Linear;
+  m_sampler = device.CreateSampler(&sampler_desc);
+}
+
+void resolution_scaler::validate(const resolution_scale_settings &settings) {
+  if (!(settings.min_scale > 0.0F) || settings.min_scale > settings.max_scale) {
+    throw std::runtime_error("Resolution scale bounds must satisfy 0 < min_scale <= max_scale");
+  }
+}
+
+void resolution_scaler::set_settings(const resolution_scale_settings &settings) {
+  validate(settings);
+  m_settings = settings;
+  m_scale = std::clamp(m_scale, settings.min_scale, settings.max_scale);
+}
+
+auto resolution_scaler::scaled_size(uint32_t width, uint32_t height) const -> std::pair<uint32_t, uint32_t> {
+  return {scale_dimension(width, m_scale), scale_dimension(height, m_scale)};
+}
+
+auto resolution_scaler::update(const gpu_profiler &profiler) -> bool {
+  const gpu_scope_stats &frame = profiler.get_frame_stats();
+  if (frame.sample_count == m_last_sample_count) {
+    return false;
+  }
+  m_last_sample_count = frame.sample_count;
+  // Readbacks still in flight measured frames at the old scale
+  if (m_settle_frames > 0) {
+    --m_settle_frames;
+    return false;
+  }
+
+  // Shading cost follows the pixel count, the square of the scale
+  const double target = m_settings.target_gpu_ms;
+  const double measured = std::max(frame.last_ms, 1e-3);
+  float wanted = m_scale;
+  if (measured > target) {
+    wanted = m_scale * static_cast<float>(std::sqrt(target / measured));
+  } else if (measured < target * HEADROOM) {
+    wanted = std::min(m_scale * static_cast<float>(std::sqrt(target * HEADROOM / measured)), m_scale + MAX_INCREASE);
+  }
+  // Rounding down keeps the new scale under the estimate in both directions
+  wanted = std::clamp(std::floor(wanted / SCALE_STEP) * SCALE_STEP, m_settings.min_scale, m_settings.max_scale);
+  if (wanted == m_scale) {
+    return false;
+  }
+  m_scale = wanted;
+  m_settle_frames = SETTLE_FRAMES;
+  return true;
+}
+
+void resolution_scaler::create_target(uint32_t width, uint32_t height) {
+  m_width = width;
+  m_height = height;
+
+  wgpu::TextureDescriptor texture_desc{};
+  texture_desc.label = "scaled scene target";
+  texture_desc.dimension = wgpu::TextureDimension::e2D;
+  texture_desc.format = m_format;
+  texture_desc.mipLevelCount = 1;
+  texture_desc.sampleCount = 1;
+  texture_desc.size = {width, height, 1};
+  texture_desc.usage = wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::TextureBinding;
+
+  // Released first, so the registry never counts the old and the new target at once
+  m_resource.reset();
+  m_texture = m_device.CreateTexture(&texture_desc);
+  if (!m_texture) {
+    throw std::runtime_error("Failed to create scaled scene target");
+  }
+  m_resource = resource_registry::get_instance().register_texture(texture_desc, resource_category::render_target,
+                                                                  "scaled scene target");
+  m_view = m_texture.CreateView();
+
+  std::array<wgpu::BindGroupEntry, 2> entries{};
+  entries[0].binding = 0;
+  entries[0].textureView = m_view;
+  entries[1].binding = 1;
+  entries[1].sampler = m_sampler;
+
+  wgpu::BindGroupDescriptor bind_group_desc{};
+  bind_group_desc.layout = m_bind_group_layout;
+  bind_group_desc.entryCount = entries.size();
+  bind_group_desc.entries = entries.data();
+  m_bind_group = m_device.CreateBindGroup(&bind_group_desc);
+}
+
+auto resolution_scaler::get_target(uint32_t width, uint32_t height) -> wgpu::TextureView {
+  if (width != m_width || height != m_height) {
+    create_target(width, height);
+  }
+  return m_view;
+}
+
+void resolution_scaler::upscale(wgpu::CommandEncoder &encoder, const wgpu::TextureView &target,
+                                gpu_profiler *profiler) {
+  // Every pixel is written, clearing only spares loading the old contents
+  wgpu::RenderPassColorAttachment color_attachment{};
+  color_attachment.view = target;
+  color_attachment.loadOp = wgpu::LoadOp::Clear;
+  color_attachment.storeOp = wgpu::StoreOp::Store;
+  color_attachment.clearValue = {0.0, 0.0, 0.0, 1.0};
+
+  wgpu::RenderPassDescriptor pass_desc{};
+  pass_desc.label = "upscale";
+  pass_desc.colorAttachmentCount = 1;
+  pass_desc.colorAttachments = &color_attachment;
+  std::optional<wgpu::RenderPassTimestampWrites> timestamp_writes;
+  if (profiler != nullptr) {
+    timestamp_writes = profiler->render_pass_timestamps("upscale");
+  }
+  if (timestamp_writes) {
+    pass_desc.timestampWrites = &*timestamp_writes;
+  }
+
+  auto pass = encoder.BeginRenderPass(&pass_desc);
+  pass.SetPipeline(get_pipeline(m_settings.filter));
+  pass.SetBindGroup(0, m_bind_group);
+  pass.Draw(3);
+  pass.End();
+  frame_counters::add_pipeline_bind();
+  frame_counters::add_bind_group_bind();
+}
+
+auto resolution_scaler::get_pipeline(upscale_filter filter) -> wgpu::RenderPipeline {
+  auto it = m_pipelines.find(filter);
+  if (it != m_pipelines.end()) {
+    return it->second;
+  }
+
+  wgpu::ColorTargetState color_target{};
+  color_target.format = m_format;
+  color_target.writeMask = wgpu::ColorWriteMask::All;
+
+  wgpu::FragmentState fragment_state{};
+  fragment_state.module = m_shader->get_shader_module();
+  fragment_state.entryPoint = filter == upscale_filter::edge_aware ? "fs_edge_aware" : "fs_bilinear";
+  fragment_state.targetCount = 1;
+  fragment_state.targets = &color_target;
+
+  wgpu::RenderPipelineDescriptor pipeline_desc{};
+  pipeline_desc.label = "upscale";
+  pipeline_desc.layout = m_pipeline_layout;
+  pipeline_desc.vertex.module = m_shader->get_shader_module();
+  pipeline_desc.vertex.entryPoint = "vs_main";
+  pipeline_desc.primitive.topology = wgpu::PrimitiveTopology::TriangleList;
+  pipeline_desc.fragment = &fragment_state;
+  pipeline_desc.multisample.count = 1;
+
+  auto pipeline = m_device.CreateRenderPipeline(&pipeline_desc);
+  if (!pipeline) {
+    throw std::runtime_error("Failed to create upscale pipeline");
+  }
+  frame_counters::add_pipeline_created();
+  m_pipelines.emplace(filter, pipeline);
+  return pipeline;
+}
+
+} // namespace mareweb
@@ -0,0 +1,69 @@
+#include "mareweb/resource_cache.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+
+namespace mareweb {
+
+auto resource_cache::file_key(const std::string &path) -> std::string {
+  std::string key = path;
+  std::error_code error;
+  auto write_time = std::filesystem::last_write_time(path, error);
+  if (!error) {
+    key += '@';
+    key += std::to_string(write_time.time_since_epoch().count());
+  }
+  return key;
+}
+
+void resource_cache::prune() {
+  std::lock_guard lock(m_mutex);
+  prune_locked();
+}
+
+void resource_cache::clear() {
+  std::lock_guard lock(m_mutex);
+  m_entries.clear();
+  m_prune_threshold = MIN_PRUNE_THRESHOLD;
+}
+
+auto resource_cache::get_entry_count() const -> size_t {
+  std::lock_guard lock(m_mutex);
+  return m_entries.size();
+}
+
+auto resource_cache::get_hit_count() const -> uint64_t {
+  std::lock_guard lock(m_mutex);
+  return m_hits;
+}
+
+auto resource_cache::get_miss_count() const -> uint64_t {
+  std::lock_guard lock(m_mutex);
+  return m_misses;
+}
+
+auto resource_cache::find(const std::string &key) -> std::shared_ptr<void> {
+  auto it = m_entries.find(key);
+  if (it == m_entries.end()) {
+    return nullptr;
+  }
+  auto existing = it->second.lock();
+  if (!existing) {
+    m_entries.erase(it);
+  }
+  return existing;
+}
+
+void resource_cache::prune_if_needed() {
+  // Expired entries are only found lazily, so sweep whenever the map doubles to keep the cost amortized
+  if (m_entries.size() >= m_prune_threshold) {
+    prune_locked();
+    m_prune_threshold = std::max(MIN_PRUNE_THRESHOLD, m_entries.size() * 2);
+  }
+}
+
+void resource_cache::prune_locked() {
+  std::erase_if(m_entries, [](const auto &entry) { return entry.second.expired(); });
+}
+
+} // namespace mareweb
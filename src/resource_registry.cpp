@@ -0,0 +1,302 @@
+#include "mareweb/resource_registry.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+namespace mareweb {
+
+namespace {
+
+auto category_for_usage(wgpu::BufferUsage usage) -> resource_category {
+  if (usage & wgpu::BufferUsage::Vertex) {
+    return resource_category::vertex_buffer;
+  }
+  if (usage & wgpu::BufferUsage::Index) {
+    return resource_category::index_buffer;
+  }
+  if (usage & wgpu::BufferUsage::Uniform) {
+    return resource_category::uniform_buffer;
+  }
+  if (usage & wgpu::BufferUsage::Storage) {
+    return resource_category::storage_buffer;
+  }
+  if (usage & (wgpu::BufferUsage::MapWrite | wgpu::BufferUsage::MapRead)) {
+    return resource_category::staging_buffer;
+  }
+  return resource_category::other_buffer;
+}
+
+} // namespace
+
+void resource_handle::reset() {
+  if (m_id != 0) {
+    resource_registry::get_instance().release(m_id);
+    m_id = 0;
+  }
+}
+
+auto resource_registry::get_instance() -> resource_registry & {
+  // Never destroyed, resources owned by other singletons (e.g. the application's renderers) release during exit
+  static auto *instance = new resource_registry();
+  return *instance;
+}
+
+auto resource_registry::register_buffer(uint64_t size, wgpu::BufferUsage usage, const std::string &label)
+    -> resource_handle {
+  return add({0, category_for_usage(usage), size, static_cast<uint64_t>(usage), label});
+}
+
+auto resource_registry::register_texture(const wgpu::TextureDescriptor &desc, resource_category category,
+                                         const std::string &label) -> resource_handle {
+  return add({0, category, estimate_texture_size(desc), static_cast<uint64_t>(desc.usage), label});
+}
+
+auto resource_registry::add(resource_record record) -> resource_handle {
+  resource_id id = 0;
+  {
+    std::lock_guard lock(m_mutex);
+    id = m_next_id++;
+    record.id = id;
+    m_total_bytes += record.size;
+    m_peak_bytes = std::max(m_peak_bytes, m_total_bytes);
+    m_category_bytes[static_cast<size_t>(record.category)] += record.size;
+    m_records.emplace(id, std::move(record));
+  }
+  enforce_budget();
+  return resource_handle(id);
+}
+
+void resource_registry::release(resource_id id) {
+  std::lock_guard lock(m_mutex);
+  auto it = m_records.find(id);
+  if (it == m_records.end()) {
+    return;
+  }
+  m_total_bytes -= it->second.size;
+  m_category_bytes[static_cast<size_t>(it->second.category)] -= it->second.size;
+  m_records.erase(it);
+}
+
+void resource_registry::set_label(resource_id id, const std::string &label) {
+  std::lock_guard lock(m_mutex);
+  auto it = m_records.find(id);
+  if (it != m_records.end()) {
+    it->second.label = label;
+  }
+}
+
+void resource_registry::enforce_budget() {
+  std::vector<std::pair<handler_id, budget_handler>> handlers;
+  {
+    std::lock_guard lock(m_mutex);
+    // Handlers may create replacement resources (e.g. a lower LOD), which must not recurse into enforcement
+    if (m_enforcing || m_budget_bytes == 0 || m_total_bytes <= m_budget_bytes) {
+      return;
+    }
+    m_enforcing = true;
+    handlers = m_budget_handlers;
+  }
+
+  // Handlers run unlocked since they release resources through this registry
+  for (auto &[id, handler] : handlers) {
+    uint64_t over = 0;
+    {
+      std::lock_guard lock(m_mutex);
+      if (m_total_bytes <= m_budget_bytes) {
+        break;
+      }
+      over = m_total_bytes - m_budget_bytes;
+    }
+    handler(over);
+  }
+
+  std::lock_guard lock(m_mutex);
+  m_enforcing = false;
+  if (m_total_bytes > m_budget_bytes) {
+    std::cerr << "GPU memory budget exceeded: " << m_total_bytes << " of " << m_budget_bytes << " bytes in use"
+              << std::endl;
+  }
+}
+
+auto resource_registry::get_total_bytes() const -> uint64_t {
+  std::lock_guard lock(m_mutex);
+  return m_total_bytes;
+}
+
+auto resource_registry::get_peak_bytes() const -> uint64_t {
+  std::lock_guard lock(m_mutex);
+  return m_peak_bytes;
+}
+
+auto resource_registry::get_category_bytes(resource_category category) const -> uint64_t {
+  std::lock_guard lock(m_mutex);
+  return m_category_bytes[static_cast<size_t>(category)];
+}
+
+auto resource_registry::get_records() const -> std::vector<resource_record> {
+  std::lock_guard lock(m_mutex);
+  std::vector<resource_record> records;
+  records.reserve(m_records.size());
+  for (const auto &[id, record] : m_records) {
+    records.push_back(record);
+  }
+  return records;
+}
+
+void resource_registry::report(std::ostream &out, size_t largest_count) const {
+  constexpr double BYTES_PER_MIB = 1024.0 * 1024.0;
+  auto records = get_records();
+  std::lock_guard lock(m_mutex);
+
+  out << std::fixed << std::setprecision(2);
+  out << "GPU memory: " << static_cast<double>(m_total_bytes) / BYTES_PER_MIB << " MiB in " << m_records.size()
+      << " resources (peak " << static_cast<double>(m_peak_bytes) / BYTES_PER_MIB << " MiB";
+  if (m_budget_bytes > 0) {
+    out << ", budget " << static_cast<double>(m_budget_bytes) / BYTES_PER_MIB << " MiB";
+  }
+  out << ")\n";
+  for (size_t i = 0; i < m_category_bytes.size(); ++i) {
+    if (m_category_bytes[i] > 0) {
+      out << "  " << std::setw(16) << std::left << category_name(static_cast<resource_category>(i)) << std::right
+          << static_cast<double>(m_category_bytes[i]) / BYTES_PER_MIB << " MiB\n";
+    }
+  }
+
+  std::sort(records.begin(), records.end(), [](const auto &a, const auto &b) { return a.size > b.size; });
+  records.resize(std::min(records.size(), largest_count));
+  for (const auto &record : records) {
+    out << "  " << static_cast<double>(record.size) / BYTES_PER_MIB << " MiB  " << category_name(record.category)
+        << "  " << (record.label.empty() ? "<unlabeled>" : record.label) << '\n';
+  }
+}
+
+void resource_registry::set_budget(uint64_t bytes) {
+  {
+    std::lock_guard lock(m_mutex);
+    m_budget_bytes = bytes;
+  }
+  enforce_budget();
+}
+
+auto resource_registry::get_budget() const -> uint64_t {
+  std::lock_guard lock(m_mutex);
+  return m_budget_bytes;
+}
+
+auto resource_registry::add_budget_handler(budget_handler handler) -> handler_id {
+  std::lock_guard lock(m_mutex);
+  handler_id id = m_next_handler_id++;
+  m_budget_handlers.emplace_back(id, std::move(handler));
+  return id;
+}
+
+void resource_registry::remove_budget_handler(handler_id id) {
+  std::lock_guard lock(m_mutex);
+  std::erase_if(m_budget_handlers, [id](const auto &entry) { return entry.first == id; });
+}
+
+auto resource_registry::estimate_texture_size(const wgpu::TextureDescriptor &desc) -> uint64_t {
+  auto block = get_texel_block(desc.format);
+  bool is_3d = desc.dimension == wgpu::TextureDimension::e3D;
+  uint64_t total = 0;
+  for (uint32_t level = 0; level < desc.mipLevelCount; ++level) {
+    uint64_t width = std::max(1U, desc.size.width >> level);
+    uint64_t height = std::max(1U, desc.size.height >> level);
+    uint64_t depth = is_3d ? std::max(1U, desc.size.depthOrArrayLayers >> level) : desc.size.depthOrArrayLayers;
+    uint64_t blocks_x = (width + block.width - 1) / block.width;
+    uint64_t blocks_y = (height + block.height - 1) / block.height;
+    total += blocks_x * blocks_y * depth * block.bytes;
+  }
+  return total * std::max(1U, desc.sampleCount);
+}
+
+auto resource_registry::get_texel_block(wgpu::TextureFormat format) -> texel_block {
+  switch (format) {
+  case wgpu::TextureFormat::R8Unorm:
+  case wgpu::TextureFormat::R8Snorm:
+  case wgpu::TextureFormat::R8Uint:
+  case wgpu::TextureFormat::R8Sint:
+  case wgpu::TextureFormat::Stencil8:
+    return {1, 1, 1};
+  case wgpu::TextureFormat::RG8Unorm:
+  case wgpu::TextureFormat::R16Float:
+  case wgpu::TextureFormat::R16Uint:
+  case wgpu::TextureFormat::Depth16Unorm:
+    return {1, 1, 2};
+  case wgpu::TextureFormat::RGBA16Float:
+  case wgpu::TextureFormat::RGBA16Uint:
+  case wgpu::TextureFormat::RG32Float:
+  case wgpu::TextureFormat::Depth32FloatStencil8:
+    return {1, 1, 8};
+  case wgpu::TextureFormat::RGBA32Float:
+  case wgpu::TextureFormat::RGBA32Uint:
+    return {1, 1, 16};
+  case wgpu::TextureFormat::BC1RGBAUnorm:
+  case wgpu::TextureFormat::BC1RGBAUnormSrgb:
+  case wgpu::TextureFormat::BC4RUnorm:
+  case wgpu::TextureFormat::BC4RSnorm:
+  case wgpu::TextureFormat::ETC2RGB8Unorm:
+  case wgpu::TextureFormat::ETC2RGB8UnormSrgb:
+  case wgpu::TextureFormat::ETC2RGB8A1Unorm:
+  case wgpu::TextureFormat::ETC2RGB8A1UnormSrgb:
+  case wgpu::TextureFormat::EACR11Unorm:
+  case wgpu::TextureFormat::EACR11Snorm:
+    return {4, 4, 8};
+  case wgpu::TextureFormat::BC2RGBAUnorm:
+  case wgpu::TextureFormat::BC2RGBAUnormSrgb:
+  case wgpu::TextureFormat::BC3RGBAUnorm:
+  case wgpu::TextureFormat::BC3RGBAUnormSrgb:
+  case wgpu::TextureFormat::BC5RGUnorm:
+  case wgpu::TextureFormat::BC5RGSnorm:
+  case wgpu::TextureFormat::BC6HRGBUfloat:
+  case wgpu::TextureFormat::BC6HRGBFloat:
+  case wgpu::TextureFormat::BC7RGBAUnorm:
+  case wgpu::TextureFormat::BC7RGBAUnormSrgb:
+  case wgpu::TextureFormat::ETC2RGBA8Unorm:
+  case wgpu::TextureFormat::ETC2RGBA8UnormSrgb:
+  case wgpu::TextureFormat::EACRG11Unorm:
+  case wgpu::TextureFormat::EACRG11Snorm:
+  case wgpu::TextureFormat::ASTC4x4Unorm:
+  case wgpu::TextureFormat::ASTC4x4UnormSrgb:
+    return {4, 4, 16};
+  case wgpu::TextureFormat::ASTC5x5Unorm:
+  case wgpu::TextureFormat::ASTC5x5UnormSrgb:
+    return {5, 5, 16};
+  case wgpu::TextureFormat::ASTC6x6Unorm:
+  case wgpu::TextureFormat::ASTC6x6UnormSrgb:
+    return {6, 6, 16};
+  case wgpu::TextureFormat::ASTC8x8Unorm:
+  case wgpu::TextureFormat::ASTC8x8UnormSrgb:
+    return {8, 8, 16};
+  default:
+    // RGBA8, BGRA8, R32Float, RG16Float, RGB10A2, Depth24Plus, Depth32Float, ...
+    return {1, 1, 4};
+  }
+}
+
+auto resource_registry::category_name(resource_category category) -> const char * {
+  switch (category) {
+  case resource_category::vertex_buffer:
+    return "vertex_buffer";
+  case resource_category::index_buffer:
+    return "index_buffer";
+  case resource_category::uniform_buffer:
+    return "uniform_buffer";
+  case resource_category::storage_buffer:
+    return "storage_buffer";
+  case resource_category::staging_buffer:
+    return "staging_buffer";
+  case resource_category::other_buffer:
+    return "other_buffer";
+  case resource_category::texture:
+    return "texture";
+  case resource_category::render_target:
+    return "render_target";
+  case resource_category::depth_target:
+    return "depth_target";
+  default:
+    return "unknown";
+  }
+}
+
+} // namespace mareweb
@@ -7,4 +7,13 @@ scene::scene(wgpu::Device &device, wgpu::Surface surface, SDL_Window *window, co
              projection_type type)
     : renderer(device, surface, window, properties), camera(type) {}
 
+void scene::update_frame_uniforms(frame_uniforms &uniforms) {
+  uniforms.view = get_view_matrix();
+  uniforms.projection = get_projection_matrix();
+  uniforms.view_projection = uniforms.projection * uniforms.view;
+  // Shaders work in unitless world space, the translation column rather than get_position()
+  const float *translation = get_translation_matrix().data();
+  uniforms.camera_position = vec4{translation[12], translation[13], translation[14], 1.0F};
+}
+
 } // namespace mareweb
\ No newline at end of file
@@ -1,11 +1,22 @@
 #include "mareweb/texture.hpp"
+#include "mareweb/frame_stats.hpp"
+#include "mareweb/ktx2_loader.hpp"
 #include <SDL_image.h>
+#include <cstring>
 #include <stdexcept>
 #include <utility>
 
 namespace mareweb {
 
-texture::texture(wgpu::Device &device, const char *file_path) : m_device(device), m_owns_surface(true) {
+texture::texture(wgpu::Device &device, const char *file_path, const texture_options &options)
+    : m_device(device), m_owns_surface(true), m_options(options), m_label(file_path) {
+  if (ktx2_loader::is_ktx2_file(file_path)) {
+    m_owns_surface = false;
+    create_texture_from_image(ktx2_loader::load(file_path, texture_compression_support::query(device)));
+    create_sampler(m_options.address_mode);
+    return;
+  }
+
   // Load image using SDL_image
   m_surface = IMG_Load(file_path);
   if (!m_surface) {
@@ -17,11 +28,11 @@ texture::texture(wgpu::Device &device, const char *file_path) : m_device(device)
   m_format = wgpu::TextureFormat::RGBA8Unorm;
 
   create_texture_from_surface();
-  create_sampler();
+  create_sampler(m_options.address_mode);
 }
 
-texture::texture(wgpu::Device &device, SDL_Surface *surface)
-    : m_device(device), m_surface(surface), m_owns_surface(false) {
+texture::texture(wgpu::Device &device, SDL_Surface *surface, const texture_options &options)
+    : m_device(device), m_surface(surface), m_owns_surface(false), m_options(options) {
   if (!surface) {
     throw std::runtime_error("Invalid surface provided to texture constructor");
   }
@@ -31,7 +42,14 @@ texture::texture(wgpu::Device &device, SDL_Surface *surface)
   m_format = wgpu::TextureFormat::RGBA8Unorm;
 
   create_texture_from_surface();
-  create_sampler();
+  create_sampler(m_options.address_mode);
+}
+
+texture::texture(wgpu::Device &device, const image_data &image, const texture_options &options,
+                 const std::string &label)
+    : m_device(device), m_owns_surface(false), m_options(options), m_label(label) {
+  create_texture_from_image(image);
+  create_sampler(m_options.address_mode);
 }
 
 texture::~texture() { cleanup(); }
@@ -40,7 +58,9 @@ texture::texture(texture &&other) noexcept
     : m_device(other.m_device), m_texture(std::exchange(other.m_texture, nullptr)),
       m_texture_view(std::exchange(other.m_texture_view, nullptr)), m_sampler(std::exchange(other.m_sampler, nullptr)),
       m_surface(std::exchange(other.m_surface, nullptr)), m_owns_surface(std::exchange(other.m_owns_surface, false)),
-      m_width(std::exchange(other.m_width, 0)), m_height(std::exchange(other.m_height, 0)), m_format(other.m_format) {}
+      m_width(std::exchange(other.m_width, 0)), m_height(std::exchange(other.m_height, 0)), m_format(other.m_format),
+      m_options(other.m_options), m_mip_level_count(std::exchange(other.m_mip_level_count, 1)),
+      m_label(std::move(other.m_label)), m_resource(std::move(other.m_resource)) {}
 
 texture &texture::operator=(texture &&other) noexcept {
   if (this != &other) {
@@ -55,80 +75,252 @@ texture &texture::operator=(texture &&other) noexcept {
     m_width = std::exchange(other.m_width, 0);
     m_height = std::exchange(other.m_height, 0);
     m_format = other.m_format;
+    m_options = other.m_options;
+    m_mip_level_count = std::exchange(other.m_mip_level_count, 1);
+    m_label = std::move(other.m_label);
+    m_resource = std::move(other.m_resource);
   }
   return *this;
 }
 
+auto texture_compression_support::query(const wgpu::Device &device) -> texture_compression_support {
+  texture_compression_support support;
+  support.bc = device.HasFeature(wgpu::FeatureName::TextureCompressionBC);
+  support.etc2 = device.HasFeature(wgpu::FeatureName::TextureCompressionETC2);
+  support.astc = device.HasFeature(wgpu::FeatureName::TextureCompressionASTC);
+  return support;
+}
+
+auto texture::decode_image(const char *file_path, const texture_options &options,
+                           const texture_compression_support &compression) -> image_data {
+  if (ktx2_loader::is_ktx2_file(file_path)) {
+    return ktx2_loader::load(file_path, compression);
+  }
+
+  SDL_Surface *surface = IMG_Load(file_path);
+  if (!surface) {
+    throw std::runtime_error("Failed to load texture: " + std::string(IMG_GetError()));
+  }
+  return decode_surface(surface, options);
+}
+
+auto texture::decode_image(const uint8_t *encoded, size_t size, const texture_options &options,
+                           const texture_compression_support &compression, const std::string &label) -> image_data {
+  if (ktx2_loader::is_ktx2_data(encoded, size)) {
+    return ktx2_loader::load(encoded, size, label, compression);
+  }
+
+  SDL_Surface *surface = IMG_Load_RW(SDL_RWFromConstMem(encoded, static_cast<int>(size)), 1);
+  if (!surface) {
+    throw std::runtime_error("Failed to decode texture: " + std::string(IMG_GetError()));
+  }
+  return decode_surface(surface, options);
+}
+
+// Takes ownership of surface
+auto texture::decode_surface(SDL_Surface *surface, const texture_options &options) -> image_data {
+  SDL_Surface *rgba_surface = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0);
+  SDL_FreeSurface(surface);
+  if (!rgba_surface) {
+    throw std::runtime_error("Failed to convert texture to RGBA format");
+  }
+
+  image_data image;
+  image.width = static_cast<uint32_t>(rgba_surface->w);
+  image.height = static_cast<uint32_t>(rgba_surface->h);
+  size_t row_bytes = static_cast<size_t>(image.width) * 4;
+  image.pixels.resize(row_bytes * image.height);
+  for (uint32_t y = 0; y < image.height; ++y) {
+    std::memcpy(image.pixels.data() + (y * row_bytes),
+                static_cast<const uint8_t *>(rgba_surface->pixels) + (static_cast<size_t>(y) * rgba_surface->pitch),
+                row_bytes);
+  }
+  SDL_FreeSurface(rgba_surface);
+
+  if (options.mipmaps == mipmap_filter::cpu_box || options.mipmaps == mipmap_filter::cpu_kaiser) {
+    image.mips = mipmap_generator::generate_cpu(image.pixels.data(), image.width, image.height, row_bytes, options.srgb,
+                                                options.mipmaps);
+  }
+  return image;
+}
+
 void texture::create_texture_from_surface() {
-  // Create texture descriptor
+#ifdef __EMSCRIPTEN__
+  // Direct approach for Emscripten
+  SDL_Surface *rgba_surface = m_surface;
+#else
+  // Native approach with conversion
+  SDL_Surface *rgba_surface = SDL_ConvertSurfaceFormat(m_surface, SDL_PIXELFORMAT_RGBA32, 0);
+  if (!rgba_surface) {
+    throw std::runtime_error("Failed to convert texture to RGBA format");
+  }
+#endif
+
+  create_texture(static_cast<const uint8_t *>(rgba_surface->pixels), static_cast<size_t>(rgba_surface->pitch), nullptr);
+
+#ifndef __EMSCRIPTEN__
+  SDL_FreeSurface(rgba_surface);
+#endif
+}
+
+void texture::create_texture_from_image(const image_data &image) {
+  auto block = resource_registry::get_texel_block(image.format);
+  size_t expected_size = static_cast<size_t>((image.width + block.width - 1) / block.width) *
+                         ((image.height + block.height - 1) / block.height) * block.bytes;
+  if (image.pixels.size() != expected_size) {
+    throw std::runtime_error("Image data size does not match its dimensions");
+  }
+
+  m_width = static_cast<int>(image.width);
+  m_height = static_cast<int>(image.height);
+  m_format = image.format;
+
+  if (image.format != wgpu::TextureFormat::RGBA8Unorm || image.prebuilt_mips) {
+    create_texture_from_levels(image);
+  } else {
+    create_texture(image.pixels.data(), static_cast<size_t>(image.width) * 4,
+                   image.mips.empty() ? nullptr : &image.mips);
+  }
+}
+
+void texture::create_texture_from_levels(const image_data &image) {
+  // Block-compressed data cannot be rendered to or filtered on the CPU, so only the file's own mips are used
+  m_mip_level_count = m_options.mipmaps == mipmap_filter::none ? 1 : static_cast<uint32_t>(image.mips.size()) + 1;
+
   wgpu::TextureDescriptor texture_desc = {};
-  texture_desc.size.width = m_width;
-  texture_desc.size.height = m_height;
-  texture_desc.size.depthOrArrayLayers = 1;
-  texture_desc.mipLevelCount = 1;
+  texture_desc.size = {static_cast<uint32_t>(m_width), static_cast<uint32_t>(m_height), 1};
+  texture_desc.mipLevelCount = m_mip_level_count;
   texture_desc.sampleCount = 1;
   texture_desc.dimension = wgpu::TextureDimension::e2D;
   texture_desc.format = m_format;
   texture_desc.usage = wgpu::TextureUsage::TextureBinding | wgpu::TextureUsage::CopyDst;
+  texture_desc.label = m_label.c_str();
 
   m_texture = m_device.CreateTexture(&texture_desc);
+  m_resource = resource_registry::get_instance().register_texture(texture_desc, resource_category::texture, m_label);
 
-#ifdef __EMSCRIPTEN__
-  // Direct approach for Emscripten
-  wgpu::ImageCopyTexture destination = {};
-  destination.texture = m_texture;
+  auto block = resource_registry::get_texel_block(m_format);
+  for (uint32_t level = 0; level < m_mip_level_count; ++level) {
+    uint32_t width = level == 0 ? image.width : image.mips[level - 1].width;
+    uint32_t height = level == 0 ? image.height : image.mips[level - 1].height;
+    const auto &pixels = level == 0 ? image.pixels : image.mips[level - 1].pixels;
 
-  wgpu::TextureDataLayout data_layout = {};
-  data_layout.offset = 0;
-  data_layout.bytesPerRow = m_surface->pitch;
-  data_layout.rowsPerImage = m_surface->h;
+    wgpu::ImageCopyTexture destination = {};
+    destination.texture = m_texture;
+    destination.mipLevel = level;
 
-  wgpu::Extent3D write_size = {};
-  write_size.width = m_surface->w;
-  write_size.height = m_surface->h;
-  write_size.depthOrArrayLayers = 1;
+    wgpu::TextureDataLayout data_layout = {};
+    data_layout.bytesPerRow = ((width + block.width - 1) / block.width) * block.bytes;
+    data_layout.rowsPerImage = (height + block.height - 1) / block.height;
 
-  m_device.GetQueue().WriteTexture(&destination, m_surface->pixels, m_surface->pitch * m_surface->h, &data_layout,
-                                   &write_size);
-#else
-  // Native approach with conversion
-  SDL_Surface *rgba_surface = SDL_ConvertSurfaceFormat(m_surface, SDL_PIXELFORMAT_RGBA32, 0);
-  if (!rgba_surface) {
-    throw std::runtime_error("Failed to convert texture to RGBA format");
+    // Copies of compressed formats cover whole blocks, the physical size of the level
+    wgpu::Extent3D write_size = {(width + block.width - 1) / block.width * block.width,
+                                 (height + block.height - 1) / block.height * block.height, 1};
+    m_device.GetQueue().WriteTexture(&destination, pixels.data(), pixels.size(), &data_layout, &write_size);
+    frame_counters::add_texture_upload(pixels.size());
+  }
+
+  wgpu::TextureViewDescriptor view_desc = {};
+  view_desc.format = m_format;
+  view_desc.dimension = wgpu::TextureViewDimension::e2D;
+  view_desc.baseMipLevel = 0;
+  view_desc.mipLevelCount = m_mip_level_count;
+  view_desc.baseArrayLayer = 0;
+  view_desc.arrayLayerCount = 1;
+  view_desc.aspect = wgpu::TextureAspect::All;
+  m_texture_view = m_texture.CreateView(&view_desc);
+}
+
+void texture::create_texture(const uint8_t *pixels, size_t row_pitch, const std::vector<mip_level> *cpu_mips) {
+  m_mip_level_count = m_options.mipmaps == mipmap_filter::none
+                          ? 1
+                          : mipmap_generator::get_mip_level_count(static_cast<uint32_t>(m_width),
+                                                                  static_cast<uint32_t>(m_height));
+  bool gpu_mipmaps = m_mip_level_count > 1 && m_options.mipmaps == mipmap_filter::gpu;
+  // The data stays RGBA8Unorm so shaders see the same values as before; the sRGB view is only used to filter mips
+  wgpu::TextureFormat mip_view_format = m_options.srgb ? wgpu::TextureFormat::RGBA8UnormSrgb : m_format;
+
+  // Create texture descriptor
+  wgpu::TextureDescriptor texture_desc = {};
+  texture_desc.size.width = m_width;
+  texture_desc.size.height = m_height;
+  texture_desc.size.depthOrArrayLayers = 1;
+  texture_desc.mipLevelCount = m_mip_level_count;
+  texture_desc.sampleCount = 1;
+  texture_desc.dimension = wgpu::TextureDimension::e2D;
+  texture_desc.format = m_format;
+  texture_desc.usage = wgpu::TextureUsage::TextureBinding | wgpu::TextureUsage::CopyDst;
+  texture_desc.label = m_label.c_str();
+  if (gpu_mipmaps) {
+    texture_desc.usage |= wgpu::TextureUsage::RenderAttachment;
+    if (mip_view_format != m_format) {
+      texture_desc.viewFormatCount = 1;
+      texture_desc.viewFormats = &mip_view_format;
+    }
   }
 
+  m_texture = m_device.CreateTexture(&texture_desc);
+  m_resource = resource_registry::get_instance().register_texture(texture_desc, resource_category::texture, m_label);
+
   // Write texture data
   wgpu::ImageCopyTexture destination = {};
   destination.texture = m_texture;
 
   wgpu::TextureDataLayout data_layout = {};
   data_layout.offset = 0;
-  data_layout.bytesPerRow = rgba_surface->pitch;
-  data_layout.rowsPerImage = rgba_surface->h;
+  data_layout.bytesPerRow = static_cast<uint32_t>(row_pitch);
+  data_layout.rowsPerImage = m_height;
 
   wgpu::Extent3D write_size = {};
-  write_size.width = rgba_surface->w;
-  write_size.height = rgba_surface->h;
+  write_size.width = m_width;
+  write_size.height = m_height;
   write_size.depthOrArrayLayers = 1;
 
-  m_device.GetQueue().WriteTexture(&destination, rgba_surface->pixels, rgba_surface->pitch * rgba_surface->h,
-                                   &data_layout, &write_size);
+  m_device.GetQueue().WriteTexture(&destination, pixels, row_pitch * m_height, &data_layout, &write_size);
+  frame_counters::add_texture_upload(static_cast<uint64_t>(row_pitch) * m_height);
 
-  SDL_FreeSurface(rgba_surface);
-#endif
+  if (gpu_mipmaps) {
+    mipmap_generator::get(m_device).generate(m_texture, mip_view_format, m_mip_level_count);
+  } else if (m_mip_level_count > 1) {
+    if (cpu_mips != nullptr && cpu_mips->size() + 1 == m_mip_level_count) {
+      upload_mips(*cpu_mips);
+    } else {
+      upload_mips(mipmap_generator::generate_cpu(pixels, m_width, m_height, row_pitch, m_options.srgb,
+                                                 m_options.mipmaps));
+    }
+  }
 
   // Create texture view
   wgpu::TextureViewDescriptor view_desc = {};
   view_desc.format = texture_desc.format;
   view_desc.dimension = wgpu::TextureViewDimension::e2D;
   view_desc.baseMipLevel = 0;
-  view_desc.mipLevelCount = 1;
+  view_desc.mipLevelCount = m_mip_level_count;
   view_desc.baseArrayLayer = 0;
   view_desc.arrayLayerCount = 1;
   view_desc.aspect = wgpu::TextureAspect::All;
   m_texture_view = m_texture.CreateView(&view_desc);
 }
 
+void texture::upload_mips(const std::vector<mip_level> &levels) {
+  for (uint32_t i = 0; i < levels.size(); ++i) {
+    const auto &level = levels[i];
+
+    wgpu::ImageCopyTexture destination = {};
+    destination.texture = m_texture;
+    destination.mipLevel = i + 1;
+
+    wgpu::TextureDataLayout data_layout = {};
+    data_layout.bytesPerRow = level.width * 4;
+    data_layout.rowsPerImage = level.height;
+
+    wgpu::Extent3D write_size = {level.width, level.height, 1};
+    m_device.GetQueue().WriteTexture(&destination, level.pixels.data(), level.pixels.size(), &data_layout,
+                                     &write_size);
+    frame_counters::add_texture_upload(level.pixels.size());
+  }
+}
+
 void texture::create_sampler(wgpu::AddressMode address_mode) {
   wgpu::SamplerDescriptor sampler_desc = {};
   sampler_desc.addressModeU = address_mode;
@@ -138,7 +330,7 @@ void texture::create_sampler(wgpu::AddressMode address_mode) {
   sampler_desc.minFilter = wgpu::FilterMode::Linear;
   sampler_desc.mipmapFilter = wgpu::MipmapFilterMode::Linear;
   sampler_desc.lodMinClamp = 0.0f;
-  sampler_desc.lodMaxClamp = 1.0f;
+  sampler_desc.lodMaxClamp = static_cast<float>(m_mip_level_count);
   sampler_desc.compare = wgpu::CompareFunction::Undefined;
   sampler_desc.maxAnisotropy = 1;
 
@@ -150,6 +342,7 @@ void texture::cleanup() {
     m_texture.Destroy();
     m_texture = nullptr;
   }
+  m_resource.reset();
 
   if (m_surface && m_owns_surface) {
     SDL_FreeSurface(m_surface);
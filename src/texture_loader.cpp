@@ -0,0 +1,146 @@
+#include "mareweb/texture_loader.hpp"
+#include "mareweb/asset_pack.hpp"
+#include "mareweb/profiler.hpp"
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <iterator>
+#include <span>
+
+namespace mareweb {
+
+texture_handle::texture_handle(std::shared_ptr<texture> placeholder, std::string path)
+    : m_placeholder(std::move(placeholder)), m_path(std::move(path)) {}
+
+texture_handle::texture_handle(std::unique_ptr<texture> loaded, std::string path)
+    : m_texture(std::move(loaded)), m_path(std::move(path)) {}
+
+auto texture_handle::on_ready(ready_callback callback) -> uint64_t {
+  uint64_t id = m_next_callback_id++;
+  if (is_ready()) {
+    callback(*m_texture);
+    return id;
+  }
+  m_callbacks.emplace_back(id, std::move(callback));
+  return id;
+}
+
+void texture_handle::remove_callback(uint64_t id) {
+  std::erase_if(m_callbacks, [id](const auto &entry) { return entry.first == id; });
+}
+
+void texture_handle::complete(std::unique_ptr<texture> loaded) {
+  m_texture = std::move(loaded);
+  // Callbacks may remove themselves or register new ones, so run a detached copy
+  auto callbacks = std::exchange(m_callbacks, {});
+  for (auto &[id, callback] : callbacks) {
+    callback(*m_texture);
+  }
+}
+
+void texture_handle::fail(std::string error) {
+  std::cerr << "Failed to load texture " << m_path << ": " << error << std::endl;
+  m_error = std::move(error);
+  m_callbacks.clear();
+}
+
+texture_loader::texture_loader(wgpu::Device &device, std::shared_ptr<thread_pool> pool)
+    : m_device(device), m_compression(texture_compression_support::query(device)), m_tasks(std::move(pool)) {
+  // Opaque white, so lit materials still shade sensibly while their texture streams in
+  image_data white;
+  white.width = 1;
+  white.height = 1;
+  white.pixels = {255, 255, 255, 255};
+  texture_options placeholder_options;
+  placeholder_options.mipmaps = mipmap_filter::none;
+  m_placeholder = std::make_shared<texture>(m_device, white, placeholder_options, "texture_placeholder");
+}
+
+auto texture_loader::load(const std::string &path, const texture_options &options) -> std::shared_ptr<texture_handle> {
+  return enqueue(path, options, [path, options, compression = m_compression]() {
+    return texture::decode_image(path.c_str(), options, compression);
+  });
+}
+
+auto texture_loader::load_encoded(std::vector<uint8_t> encoded, const std::string &label,
+                                  const texture_options &options) -> std::shared_ptr<texture_handle> {
+  return enqueue(label, options, [encoded = std::move(encoded), label, options, compression = m_compression]() {
+    return texture::decode_image(encoded.data(), encoded.size(), options, compression, label);
+  });
+}
+
+auto texture_loader::load_packed(std::shared_ptr<const asset_pack> pack, const std::string &name,
+                                 const texture_options &options) -> std::shared_ptr<texture_handle> {
+  return enqueue(name, options, [pack = std::move(pack), name, options, compression = m_compression]() {
+    // Uncompressed entries decode straight out of the mapped pack. KTX2 entries are told apart by their identifier.
+    std::span<const uint8_t> bytes = pack->view(name);
+    if (!bytes.empty()) {
+      return texture::decode_image(bytes.data(), bytes.size(), options, compression, name);
+    }
+    std::vector<uint8_t> encoded = pack->read(name);
+    return texture::decode_image(encoded.data(), encoded.size(), options, compression, name);
+  });
+}
+
+auto texture_loader::enqueue(const std::string &label, const texture_options &options,
+                             std::function<image_data()> decode) -> std::shared_ptr<texture_handle> {
+  auto handle = std::make_shared<texture_handle>(m_placeholder, label);
+  ++m_pending;
+
+  m_tasks.submit([this, options, decode = std::move(decode), weak_handle = std::weak_ptr<texture_handle>(handle)]() {
+    decoded_image result;
+    result.handle = weak_handle;
+    result.options = options;
+    // Nobody is waiting for it anymore, skip the decode
+    if (!weak_handle.expired()) {
+      MAREWEB_PROFILE_ZONE("texture_decode");
+      try {
+        result.image = decode();
+      } catch (const std::exception &e) {
+        result.error = e.what();
+      }
+    }
+    std::lock_guard lock(m_mutex);
+    m_decoded.push_back(std::move(result));
+  });
+
+  return handle;
+}
+
+auto texture_loader::poll(size_t max_uploads) -> size_t {
+  MAREWEB_PROFILE_ZONE("texture_loader_poll");
+  if (m_tasks.get_worker_count() == 0) {
+    // No worker threads (Emscripten), decode on the main thread at the same rate we upload
+    m_tasks.run_pending(max_uploads);
+  }
+
+  std::deque<decoded_image> ready;
+  {
+    std::lock_guard lock(m_mutex);
+    size_t count = std::min(max_uploads, m_decoded.size());
+    std::move(m_decoded.begin(), m_decoded.begin() + static_cast<std::ptrdiff_t>(count), std::back_inserter(ready));
+    m_decoded.erase(m_decoded.begin(), m_decoded.begin() + static_cast<std::ptrdiff_t>(count));
+  }
+
+  size_t uploaded = 0;
+  for (auto &result : ready) {
+    --m_pending;
+    auto handle = result.handle.lock();
+    if (!handle) {
+      continue;
+    }
+    if (!result.image) {
+      handle->fail(result.error);
+      continue;
+    }
+    try {
+      handle->complete(std::make_unique<texture>(m_device, *result.image, result.options, handle->get_path()));
+      ++uploaded;
+    } catch (const std::exception &e) {
+      handle->fail(e.what());
+    }
+  }
+  return uploaded;
+}
+
+} // namespace mareweb
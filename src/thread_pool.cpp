@@ -0,0 +1,116 @@
+#include "mareweb/thread_pool.hpp"
+#include <algorithm>
+
+namespace mareweb {
+
+thread_pool::thread_pool(size_t worker_count) {
+  m_workers.reserve(worker_count);
+  for (size_t i = 0; i < worker_count; ++i) {
+    m_workers.emplace_back([this]() { worker_loop(); });
+  }
+}
+
+thread_pool::~thread_pool() {
+  {
+    std::lock_guard lock(m_mutex);
+    m_stopping = true;
+    // Queued work is dropped, in-flight tasks finish before the join below returns
+    m_tasks.clear();
+  }
+  m_condition.notify_all();
+  for (auto &worker : m_workers) {
+    worker.join();
+  }
+}
+
+auto thread_pool::default_worker_count() -> size_t {
+#ifdef __EMSCRIPTEN__
+  return 0;
+#else
+  // Leave one core for the main thread
+  size_t hardware = std::thread::hardware_concurrency();
+  return std::max<size_t>(1, hardware > 1 ? hardware - 1 : 1);
+#endif
+}
+
+auto thread_pool::shared() -> std::shared_ptr<thread_pool> {
+  static std::mutex shared_mutex;
+  static std::weak_ptr<thread_pool> shared_pool;
+  std::lock_guard lock(shared_mutex);
+  auto pool = shared_pool.lock();
+  if (!pool) {
+    pool = std::make_shared<thread_pool>();
+    shared_pool = pool;
+  }
+  return pool;
+}
+
+void thread_pool::submit(std::function<void()> task) {
+  {
+    std::lock_guard lock(m_mutex);
+    m_tasks.push_back(std::move(task));
+  }
+  m_condition.notify_one();
+}
+
+auto thread_pool::run_pending(size_t max_tasks) -> size_t {
+  size_t ran = 0;
+  while (ran < max_tasks) {
+    std::function<void()> task;
+    {
+      std::lock_guard lock(m_mutex);
+      if (m_tasks.empty()) {
+        break;
+      }
+      task = std::move(m_tasks.front());
+      m_tasks.pop_front();
+    }
+    task();
+    ++ran;
+  }
+  return ran;
+}
+
+void thread_pool::worker_loop() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock lock(m_mutex);
+      m_condition.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+      if (m_stopping) {
+        return;
+      }
+      task = std::move(m_tasks.front());
+      m_tasks.pop_front();
+    }
+    task();
+  }
+}
+
+task_group::task_group(std::shared_ptr<thread_pool> pool) : m_pool(std::move(pool)) {}
+
+task_group::~task_group() {
+  std::unique_lock lock(m_state->mutex);
+  m_state->cancelled = true;
+  m_state->idle.wait(lock, [this]() { return m_state->running == 0; });
+}
+
+void task_group::submit(std::function<void()> task) {
+  m_pool->submit([group = m_state, task = std::move(task)]() {
+    {
+      std::lock_guard lock(group->mutex);
+      if (group->cancelled) {
+        return;
+      }
+      ++group->running;
+    }
+    task();
+    {
+      std::lock_guard lock(group->mutex);
+      --group->running;
+    }
+    group->idle.notify_all();
+  });
+}
+
+} // namespace mareweb
@@ -0,0 +1,177 @@
+#include "mareweb/uniform_block.hpp"
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+
+namespace mareweb {
+
+namespace {
+
+constexpr uint32_t STRUCT_ALIGNMENT = 16;
+constexpr size_t PACKED_MAT3_SIZE = 9 * sizeof(float);
+
+auto align_up(uint32_t value, uint32_t alignment) -> uint32_t {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+auto wgsl_type(uniform_type type) -> const char * {
+  switch (type) {
+  case uniform_type::f32:
+    return "f32";
+  case uniform_type::i32:
+    return "i32";
+  case uniform_type::u32:
+    return "u32";
+  case uniform_type::vec2:
+    return "vec2<f32>";
+  case uniform_type::vec3:
+    return "vec3<f32>";
+  case uniform_type::vec4:
+    return "vec4<f32>";
+  case uniform_type::mat3:
+    return "mat3x3<f32>";
+  case uniform_type::mat4:
+    return "mat4x4<f32>";
+  }
+  return "f32";
+}
+
+// Blocks with writes since their last flush, per device
+auto dirty_blocks(WGPUDevice device) -> std::vector<uniform_block *> & {
+  // Leaked on purpose, blocks owned by static materials may unregister during exit
+  static auto *lists = new std::map<WGPUDevice, std::vector<uniform_block *>>();
+  return (*lists)[device];
+}
+
+} // namespace
+
+auto uniform_block_layout::add(std::string name, uniform_type type) -> uniform_block_layout & {
+  const uint32_t offset = align_up(m_end, get_alignment(type));
+  m_fields.push_back({std::move(name), type, offset});
+  m_end = offset + get_size(type);
+  return *this;
+}
+
+auto uniform_block_layout::find(std::string_view name) const -> uint32_t {
+  for (size_t i = 0; i < m_fields.size(); ++i) {
+    if (m_fields[i].name == name) {
+      return static_cast<uint32_t>(i);
+    }
+  }
+  throw std::runtime_error("Uniform block has no field " + std::string(name));
+}
+
+auto uniform_block_layout::get_size() const -> uint32_t { return std::max(align_up(m_end, STRUCT_ALIGNMENT), 16U); }
+
+auto uniform_block_layout::to_wgsl(std::string_view struct_name) const -> std::string {
+  std::string wgsl = "struct " + std::string(struct_name) + " {\n";
+  for (const auto &field : m_fields) {
+    wgsl += "    " + field.name + ": " + wgsl_type(field.type) + ",\n";
+  }
+  wgsl += "};\n";
+  return wgsl;
+}
+
+auto uniform_block_layout::get_alignment(uniform_type type) -> uint32_t {
+  switch (type) {
+  case uniform_type::f32:
+  case uniform_type::i32:
+  case uniform_type::u32:
+    return 4;
+  case uniform_type::vec2:
+    return 8;
+  case uniform_type::vec3:
+  case uniform_type::vec4:
+  case uniform_type::mat3:
+  case uniform_type::mat4:
+    return 16;
+  }
+  return 16;
+}
+
+auto uniform_block_layout::get_size(uniform_type type) -> uint32_t {
+  switch (type) {
+  case uniform_type::f32:
+  case uniform_type::i32:
+  case uniform_type::u32:
+    return 4;
+  case uniform_type::vec2:
+    return 8;
+  case uniform_type::vec3:
+    return 12;
+  case uniform_type::vec4:
+    return 16;
+  case uniform_type::mat3:
+    return 48;
+  case uniform_type::mat4:
+    return 64;
+  }
+  return 0;
+}
+
+uniform_block::uniform_block(wgpu::Device &device, uniform_block_layout layout, wgpu::ShaderStage visibility)
+    : m_device(device), m_layout(std::move(layout)) {
+  m_shadow.resize(m_layout.get_size(), 0);
+  m_buffer = std::make_unique<uniform_buffer>(m_device, m_shadow.size(), visibility);
+}
+
+uniform_block::~uniform_block() {
+  if (m_queued) {
+    auto &dirty = dirty_blocks(m_device.Get());
+    std::erase(dirty, this);
+  }
+}
+
+void uniform_block::set(uint32_t field, const void *data, size_t size) {
+  if (field >= m_layout.get_fields().size()) {
+    throw std::runtime_error("Uniform field index out of range: " + std::to_string(field));
+  }
+  const uniform_field &desc = m_layout.get_fields()[field];
+  const uint32_t field_size = uniform_block_layout::get_size(desc.type);
+  uint8_t *destination = m_shadow.data() + desc.offset;
+
+  if (desc.type == uniform_type::mat3 && size == PACKED_MAT3_SIZE) {
+    // Spread the three columns to the vec4 stride WGSL expects
+    const auto *columns = static_cast<const uint8_t *>(data);
+    for (size_t column = 0; column < 3; ++column) {
+      std::memcpy(destination + (column * 16), columns + (column * 12), 12);
+    }
+  } else if (size == field_size) {
+    // Skip writes that change nothing, materials often set the same values every frame
+    if (std::memcmp(destination, data, size) == 0) {
+      return;
+    }
+    std::memcpy(destination, data, size);
+  } else {
+    throw std::runtime_error("Uniform field " + desc.name + " expects " + std::to_string(field_size) + " bytes, got " +
+                             std::to_string(size));
+  }
+
+  m_dirty_begin = std::min(m_dirty_begin, desc.offset);
+  m_dirty_end = std::max(m_dirty_end, desc.offset + field_size);
+  if (!m_queued) {
+    dirty_blocks(m_device.Get()).push_back(this);
+    m_queued = true;
+  }
+}
+
+void uniform_block::flush() {
+  if (m_dirty_begin < m_dirty_end) {
+    // WriteBuffer needs 4-byte multiples, which every field offset and size already is
+    m_buffer->update(m_shadow.data() + m_dirty_begin, m_dirty_end - m_dirty_begin, m_dirty_begin);
+  }
+  m_dirty_begin = UINT32_MAX;
+  m_dirty_end = 0;
+}
+
+void uniform_block::flush_all(wgpu::Device &device) {
+  auto &dirty = dirty_blocks(device.Get());
+  for (uniform_block *block : dirty) {
+    block->flush();
+    block->m_queued = false;
+  }
+  dirty.clear();
+}
+
+} // namespace mareweb
@@ -0,0 +1,363 @@
+#include "mareweb/upload_manager.hpp"
+#include "mareweb/frame_stats.hpp"
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace mareweb {
+
+void upload_span::commit() {
+  if (m_manager != nullptr) {
+    m_manager->commit(*this, nullptr, 0);
+    m_manager = nullptr;
+    m_data = nullptr;
+  }
+}
+
+void upload_span::commit_to(wgpu::Buffer destination, uint64_t offset) {
+  if (m_manager == nullptr) {
+    throw std::runtime_error("Upload span was already committed");
+  }
+  if (offset % 4 != 0) {
+    throw std::runtime_error("Staged uploads need 4-byte aligned offsets and sizes");
+  }
+  m_manager->commit(*this, &destination, offset);
+  m_manager = nullptr;
+  m_data = nullptr;
+}
+
+upload_manager::upload_manager(wgpu::Device &device, uint64_t chunk_size)
+    : m_device(device), m_chunk_size(chunk_size), m_main_thread(std::this_thread::get_id()) {}
+
+auto upload_manager::get(wgpu::Device &device) -> upload_manager & {
+  // Leaked on purpose: map callbacks may still reference the manager during shutdown
+  static auto *managers = new std::map<WGPUDevice, std::unique_ptr<upload_manager>>();
+  static std::mutex managers_mutex;
+  std::lock_guard lock(managers_mutex);
+  auto &manager = (*managers)[device.Get()];
+  if (!manager) {
+    manager = std::make_unique<upload_manager>(device);
+  }
+  return *manager;
+}
+
+auto upload_manager::reserve(wgpu::Buffer destination, uint64_t offset, uint64_t size) -> upload_span {
+  if (offset % 4 != 0 || size % 4 != 0) {
+    throw std::runtime_error("Staged uploads need 4-byte aligned offsets and sizes");
+  }
+  return reserve_span(std::move(destination), offset, size);
+}
+
+auto upload_manager::reserve(uint64_t size) -> upload_span {
+  if (size % 4 != 0) {
+    throw std::runtime_error("Staged uploads need 4-byte aligned offsets and sizes");
+  }
+  return reserve_span(nullptr, 0, size);
+}
+
+auto upload_manager::reserve_span(wgpu::Buffer destination, uint64_t offset, uint64_t size) -> upload_span {
+  upload_span span;
+  span.m_manager = this;
+  span.m_size = size;
+
+  std::lock_guard lock(m_mutex);
+  span.m_id = m_next_id++;
+  pending_copy &copy = m_copies[span.m_id];
+  copy.sequence = span.m_id;
+  copy.destination_offset = offset;
+  copy.size = size;
+  if (destination) {
+    add_pending(destination);
+  }
+  copy.destination = std::move(destination);
+
+  uint32_t index = find_chunk(size);
+  if (index == NO_CHUNK) {
+    copy.fallback.resize(size);
+    span.m_data = copy.fallback.data();
+  } else {
+    auto &target = *m_chunks[index];
+    copy.chunk = index;
+    copy.source_offset = target.used;
+    span.m_data = target.mapped + target.used;
+    target.used += size;
+    ++target.writers;
+  }
+  return span;
+}
+
+void upload_manager::write(wgpu::Buffer destination, uint64_t offset, const void *data, uint64_t size) {
+  auto span = reserve(std::move(destination), offset, size);
+  std::memcpy(span.data(), data, size);
+}
+
+auto upload_manager::has_pending(const wgpu::Buffer &destination) const -> bool {
+  std::lock_guard lock(m_mutex);
+  return m_pending.contains(destination.Get());
+}
+
+void upload_manager::commit(upload_span &span, wgpu::Buffer *destination, uint64_t offset) {
+  std::lock_guard lock(m_mutex);
+  auto it = m_copies.find(span.m_id);
+  if (it == m_copies.end()) {
+    return;
+  }
+  auto &copy = it->second;
+  if (copy.chunk != NO_CHUNK) {
+    --m_chunks[copy.chunk]->writers;
+  }
+
+  if (destination != nullptr) {
+    if (copy.destination) {
+      remove_pending(copy.destination);
+    }
+    add_pending(*destination);
+    copy.destination = *destination;
+    copy.destination_offset = offset;
+    copy.committed = true;
+    // Ordered by when it got its destination, not by when its staging was reserved
+    copy.sequence = m_next_id++;
+    return;
+  }
+  if (!copy.destination) {
+    // Never given a destination, the staging is dropped
+    m_copies.erase(it);
+    return;
+  }
+  copy.committed = true;
+}
+
+void upload_manager::add_pending(const wgpu::Buffer &destination) { ++m_pending[destination.Get()]; }
+
+void upload_manager::remove_pending(const wgpu::Buffer &destination) {
+  auto it = m_pending.find(destination.Get());
+  if (it != m_pending.end() && --it->second == 0) {
+    m_pending.erase(it);
+  }
+}
+
+auto upload_manager::find_chunk(uint64_t size) -> uint32_t {
+  const bool main_thread = std::this_thread::get_id() == m_main_thread;
+  uint32_t &active = main_thread ? m_active : m_worker_active;
+  const uint32_t other = main_thread ? m_worker_active : m_active;
+  if (active != NO_CHUNK) {
+    auto &current = *m_chunks[active];
+    if (current.state == chunk_state::mapped && current.used + size <= current.size) {
+      return active;
+    }
+  }
+  if (size <= m_chunk_size) {
+    for (uint32_t i = 0; i < m_chunks.size(); ++i) {
+      auto &candidate = *m_chunks[i];
+      if (i != other && !candidate.oversized && candidate.state == chunk_state::mapped && candidate.used == 0) {
+        active = i;
+        return i;
+      }
+    }
+  }
+  // Creating buffers is only safe on the thread that owns the device
+  if (!main_thread) {
+    m_worker_fell_back = true;
+    return NO_CHUNK;
+  }
+  uint32_t index = create_chunk(size);
+  if (!m_chunks[index]->oversized) {
+    active = index;
+  }
+  return index;
+}
+
+auto upload_manager::create_chunk(uint64_t size) -> uint32_t {
+  auto new_chunk = std::make_unique<chunk>();
+  new_chunk->oversized = size > m_chunk_size;
+  new_chunk->size = std::max(size, m_chunk_size);
+
+  wgpu::BufferDescriptor desc{};
+  desc.size = new_chunk->size;
+  desc.usage = wgpu::BufferUsage::MapWrite | wgpu::BufferUsage::CopySrc;
+  desc.mappedAtCreation = true;
+  desc.label = "upload_manager/staging";
+  new_chunk->buffer = m_device.CreateBuffer(&desc);
+  new_chunk->mapped = static_cast<uint8_t *>(new_chunk->buffer.GetMappedRange(0, new_chunk->size));
+  new_chunk->resource = resource_registry::get_instance().register_buffer(desc.size, desc.usage, "upload_staging");
+
+  // Reuse the slot of a released oversized chunk so indices held by pending copies stay valid
+  for (uint32_t i = 0; i < m_chunks.size(); ++i) {
+    if (m_chunks[i]->state == chunk_state::retired) {
+      m_chunks[i] = std::move(new_chunk);
+      return i;
+    }
+  }
+  m_chunks.push_back(std::move(new_chunk));
+  return static_cast<uint32_t>(m_chunks.size() - 1);
+}
+
+void upload_manager::flush() {
+  std::vector<std::pair<uint32_t, wgpu::Buffer>> to_map;
+  uint64_t uploaded = 0;
+  {
+    std::lock_guard lock(m_mutex);
+    m_last_flush.staged_bytes = 0;
+    m_last_flush.fallback_bytes = 0;
+
+    // A chunk is copied from once every span in it is committed. A copy that has to wait holds back the later copies
+    // to its destination, and with them their chunks, so this repeats until nothing changes.
+    std::vector<bool> ready(m_chunks.size(), false);
+    for (uint32_t i = 0; i < m_chunks.size(); ++i) {
+      const auto &candidate = *m_chunks[i];
+      ready[i] = candidate.state == chunk_state::mapped && candidate.used > 0 && candidate.writers == 0;
+    }
+    // Copies waiting for a destination never go out and hold nothing back
+    std::vector<std::pair<uint64_t, pending_copy *>> ordered;
+    ordered.reserve(m_copies.size());
+    for (auto &[id, copy] : m_copies) {
+      if (copy.destination) {
+        ordered.emplace_back(id, &copy);
+      }
+    }
+    std::ranges::sort(ordered, {}, [](const auto &entry) { return entry.second->sequence; });
+
+    std::vector<bool> emit(ordered.size(), false);
+    for (bool changed = true; changed;) {
+      changed = false;
+      std::unordered_set<WGPUBuffer> blocked;
+      for (size_t i = 0; i < ordered.size(); ++i) {
+        const auto &copy = *ordered[i].second;
+        WGPUBuffer destination = copy.destination.Get();
+        emit[i] = (copy.chunk == NO_CHUNK ? copy.committed : ready[copy.chunk]) && !blocked.contains(destination);
+        if (emit[i]) {
+          continue;
+        }
+        blocked.insert(destination);
+        if (copy.chunk != NO_CHUNK && ready[copy.chunk]) {
+          ready[copy.chunk] = false;
+          changed = true;
+        }
+      }
+    }
+
+    for (uint32_t i = 0; i < m_chunks.size(); ++i) {
+      if (ready[i]) {
+        m_chunks[i]->buffer.Unmap();
+        m_chunks[i]->mapped = nullptr;
+        if (m_active == i) {
+          m_active = NO_CHUNK;
+        }
+        if (m_worker_active == i) {
+          m_worker_active = NO_CHUNK;
+        }
+      }
+    }
+
+    // Copies and fallback writes go out in queue order: a write submits the copies recorded before it first
+    auto queue = m_device.GetQueue();
+    wgpu::CommandEncoder encoder;
+    auto submit_copies = [&] {
+      if (encoder) {
+        auto commands = encoder.Finish();
+        queue.Submit(1, &commands);
+        encoder = nullptr;
+      }
+    };
+    for (size_t i = 0; i < ordered.size(); ++i) {
+      if (!emit[i]) {
+        continue;
+      }
+      auto &copy = *ordered[i].second;
+      if (copy.chunk == NO_CHUNK) {
+        submit_copies();
+        queue.WriteBuffer(copy.destination, copy.destination_offset, copy.fallback.data(), copy.size);
+        m_last_flush.fallback_bytes += copy.size;
+      } else {
+        if (!encoder) {
+          encoder = m_device.CreateCommandEncoder();
+        }
+        encoder.CopyBufferToBuffer(m_chunks[copy.chunk]->buffer, copy.source_offset, copy.destination,
+                                   copy.destination_offset, copy.size);
+        m_last_flush.staged_bytes += copy.size;
+      }
+      remove_pending(copy.destination);
+      m_copies.erase(ordered[i].first);
+    }
+    submit_copies();
+
+    for (uint32_t i = 0; i < m_chunks.size(); ++i) {
+      if (!ready[i]) {
+        continue;
+      }
+      auto &submitted = *m_chunks[i];
+      if (submitted.oversized) {
+        // One-off uploads larger than a chunk are not worth keeping mapped
+        submitted.buffer = nullptr;
+        submitted.resource.reset();
+        submitted.state = chunk_state::retired;
+        continue;
+      }
+      submitted.state = chunk_state::mapping;
+      to_map.emplace_back(i, submitted.buffer);
+    }
+
+    uploaded = m_last_flush.staged_bytes + m_last_flush.fallback_bytes;
+
+    // Workers cannot create chunks, so give them a mapped one to find next time
+    if (m_worker_fell_back) {
+      m_worker_fell_back = false;
+      create_chunk(m_chunk_size);
+    }
+  }
+
+  // Mapped outside the lock in case the callback fires immediately
+  for (auto &[index, staging] : to_map) {
+    auto *request = new map_request{this, index};
+#ifdef __EMSCRIPTEN__
+    staging.MapAsync(
+        wgpu::MapMode::Write, 0, staging.GetSize(),
+        [](WGPUBufferMapAsyncStatus status, void *userdata) {
+          std::unique_ptr<map_request> req(static_cast<map_request *>(userdata));
+          on_mapped(*req, status == WGPUBufferMapAsyncStatus_Success);
+        },
+        request);
+#else
+    staging.MapAsync(
+        wgpu::MapMode::Write, 0, staging.GetSize(), wgpu::CallbackMode::AllowProcessEvents,
+        [](wgpu::MapAsyncStatus status, wgpu::StringView /*message*/, map_request *userdata) {
+          std::unique_ptr<map_request> req(userdata);
+          on_mapped(*req, status == wgpu::MapAsyncStatus::Success);
+        },
+        request);
+#endif
+  }
+  frame_counters::add_buffer_upload(uploaded);
+}
+
+void upload_manager::on_mapped(map_request &request, bool success) {
+  auto &manager = *request.manager;
+  std::lock_guard lock(manager.m_mutex);
+  auto &mapped = *manager.m_chunks[request.chunk];
+  if (!success) {
+    // Device lost or buffer destroyed, drop the chunk rather than retrying
+    mapped.buffer = nullptr;
+    mapped.resource.reset();
+    mapped.state = chunk_state::retired;
+    return;
+  }
+  mapped.mapped = static_cast<uint8_t *>(mapped.buffer.GetMappedRange(0, mapped.size));
+  mapped.used = 0;
+  mapped.state = chunk_state::mapped;
+}
+
+auto upload_manager::get_stats() const -> upload_stats {
+  std::lock_guard lock(m_mutex);
+  upload_stats stats = m_last_flush;
+  for (const auto &existing : m_chunks) {
+    if (existing->state != chunk_state::retired) {
+      ++stats.chunk_count;
+      stats.chunk_bytes += existing->size;
+    }
+  }
+  return stats;
+}
+
+} // namespace mareweb
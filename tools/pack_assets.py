@@ -0,0 +1,122 @@
+"""Packs a directory into a single mareweb asset pack (.mwp).
+
+Layout, little-endian:
+    header      32 bytes: magic "MWP1", version, entry count, names size, TOC offset, names offset
+    TOC         32 bytes per entry, sorted by name: data offset, stored size, size, name offset, name length,
+                compression (0 none, 1 LZ4 frame, 2 zstd), reserved
+    names       UTF-8 entry names, not terminated
+    data        one blob per entry, each 64-byte aligned
+
+Entry names are the file paths relative to the directory's parent ("assets/wall.jpg"), so they match the paths the
+examples already load.
+
+Usage: python tools/pack_assets.py assets build/assets.mwp [--compression none|lz4|zstd]
+"""
+
+import argparse
+import os
+import struct
+import sys
+
+MAGIC = b"MWP1"
+VERSION = 1
+ALIGNMENT = 64
+HEADER = struct.Struct("<4sIIIQQ")
+ENTRY = struct.Struct("<QQQIHBB")
+
+COMPRESSION_NONE = 0
+COMPRESSION_LZ4 = 1
+COMPRESSION_ZSTD = 2
+
+# Already compressed, another pass only costs decode time
+STORED_EXTENSIONS = {".png", ".jpg", ".jpeg", ".ktx2", ".basis", ".glb", ".mwp"}
+
+
+def get_compressor(name):
+    if name == "none":
+        return COMPRESSION_NONE, None
+    if name == "lz4":
+        import lz4.frame
+        return COMPRESSION_LZ4, lambda data: lz4.frame.compress(data, content_checksum=False)
+    if name == "zstd":
+        import zstandard
+        return COMPRESSION_ZSTD, zstandard.ZstdCompressor(level=19, write_content_size=True).compress
+    raise ValueError(f"unknown compression {name}")
+
+
+def collect_files(directory):
+    base = os.path.dirname(os.path.abspath(directory))
+    files = []
+    for root, dirs, names in os.walk(directory):
+        dirs.sort()
+        for name in sorted(names):
+            path = os.path.join(root, name)
+            files.append((os.path.relpath(os.path.abspath(path), base).replace(os.sep, "/"), path))
+    return sorted(files)
+
+
+def align(value):
+    return (value + ALIGNMENT - 1) // ALIGNMENT * ALIGNMENT
+
+
+def pack(directory, output, compression, min_ratio):
+    codec, compress = get_compressor(compression)
+    files = collect_files(directory)
+
+    names = b""
+    blobs = []
+    for name, path in files:
+        with open(path, "rb") as f:
+            data = f.read()
+        stored, entry_codec = data, COMPRESSION_NONE
+        extension = os.path.splitext(name)[1].lower()
+        if compress is not None and data and extension not in STORED_EXTENSIONS:
+            compressed = compress(data)
+            # Only worth a decode when it saves a real amount of I/O
+            if len(compressed) <= len(data) * min_ratio:
+                stored, entry_codec = compressed, codec
+        encoded_name = name.encode("utf-8")
+        blobs.append((len(names), len(encoded_name), stored, len(data), entry_codec))
+        names += encoded_name
+
+    toc_offset = HEADER.size
+    names_offset = toc_offset + ENTRY.size * len(blobs)
+    offset = align(names_offset + len(names))
+
+    entries = b""
+    for name_offset, name_length, stored, size, entry_codec in blobs:
+        entries += ENTRY.pack(offset, len(stored), size, name_offset, name_length, entry_codec, 0)
+        offset = align(offset + len(stored))
+
+    os.makedirs(os.path.dirname(os.path.abspath(output)), exist_ok=True)
+    with open(output, "wb") as f:
+        f.write(HEADER.pack(MAGIC, VERSION, len(blobs), len(names), toc_offset, names_offset))
+        f.write(entries)
+        f.write(names)
+        for _, _, stored, _, _ in blobs:
+            f.write(b"\0" * (align(f.tell()) - f.tell()))
+            f.write(stored)
+
+    total = sum(size for _, _, _, size, _ in blobs)
+    print(f"Packed {len(blobs)} files ({total} bytes) into {output} ({os.path.getsize(output)} bytes)")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Pack a directory into a mareweb asset pack")
+    parser.add_argument("directory")
+    parser.add_argument("output")
+    parser.add_argument("--compression", choices=["none", "lz4", "zstd"], default="none")
+    parser.add_argument("--min-ratio", type=float, default=0.9,
+                        help="store an entry compressed only if it shrinks to at most this fraction")
+    args = parser.parse_args()
+    try:
+        pack(args.directory, args.output, args.compression, args.min_ratio)
+    except ImportError as e:
+        print(f"Compression module missing ({e}), install lz4 or zstandard or use --compression none",
+              file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())